@@ -21,7 +21,6 @@ function getImportUrl(path) {
     return rootUrl.toString();
 }
 
-const utils = await import(getImportUrl('/js/utils.js'));
 const fmt = await import(getImportUrl('/js/fmt.js'));
 const math = await import(getImportUrl('/js/math.js'));
 
@@ -36,6 +35,15 @@ class MetricValueSet {
         return new MetricValueSet(values);
     }
 
+    static createFromMetricsAndValues(metrics, valueList) {
+        let values = {};
+        for (let i = 0; i < metrics.length; i++) {
+            values[metrics[i]] = valueList[i];
+        }
+
+        return new MetricValueSet(values);
+    }
+
     static lerpByTime(a, b, time) {
         if (a.values['wt'] == b.values['wt']) {
             return a.copy();
@@ -141,257 +149,11 @@ class MetricValueSet {
     }
 }
 
-class CallListEntry {
-
-    constructor(list, idx) {
-        if (idx < 0 || idx >= list.getSize()) {
-            throw new Error('Out of bound index: ' + idx);
-        }
-
-        this.list = list;
-        this.idx = idx;
-        this.elemOffset = idx * this.list.elemSize;
-    }
-
-    getIdx() {
-        return this.idx;
-    }
-
-    getFunctionIdx() {
-        return this.list.array.getElementFieldValue(this.idx, 'functionIdx');
-    }
-
-    getFunctionName() {
-        return this.list.functionNames[this.getFunctionIdx()];
-    }
-
-    getMetrics() {
-        return this.list.metrics;
-    }
-
-    getMetricValue(type, metric) {
-        return this.list.array.getElementFieldValue(this.idx, type + '_' + metric);
-    }
-
-    getMetricValues(type) {
-        let values = {};
-        for (let metric of this.list.metrics) {
-            values[metric] = this.getMetricValue(type, metric);
-        }
-
-        return new MetricValueSet(values);
-    }
-
-    getStartMetricValues() {
-        return this.getMetricValues('start');
-    }
-
-    getEndMetricValues() {
-        return this.getMetricValues('end');
-    }
-
-    getIncMetricValues() {
-        return this.getEndMetricValues().copy().sub(this.getStartMetricValues());
-    }
-
-    getExcMetricValues() {
-        return this.getMetricValues('exc');
-    }
-
-    getStart(metric) {
-        return this.getMetricValue('start', metric);
-    }
-
-    getEnd(metric) {
-        return this.getMetricValue('end', metric);
-    }
-
-    getInc(metric) {
-        return this.getEnd(metric) - this.getStart(metric);
-    }
-
-    getExc(metric) {
-        return this.getMetricValue('exc', metric);
-    }
-
-    getTimeRange() {
-        return new math.Range(this.getStart('wt'), this.getEnd('wt'));
-    }
-
-    getParent() {
-        const parentIdx = this.list.array.getElementFieldValue(this.idx, 'parentIdx');
-        if (parentIdx < 0) {
-            return null;
-        }
-
-        return this.list.getCall(parentIdx);
-    }
-
-    getAncestors() {
-        const ancestors = [];
-
-        let parent = this.getParent();
-        while (parent != null) {
-            ancestors.push(parent);
-            parent = parent.getParent();
-        }
-
-        return ancestors;
-    }
-
-    getStack() {
-        const stack = this.getAncestors().reverse();
-        stack.push(this);
-
-        return stack;
-    }
-
-    getDepth() {
-        let parentIdx = this.list.array.getElementFieldValue(this.idx, 'parentIdx');
-        let depth = 0;
-        while (parentIdx >= 0) {
-            parentIdx = this.list.array.getElementFieldValue(parentIdx, 'parentIdx');
-            depth++;
-        }
-
-        return depth;
-    }
-
-    getCycleDepth() {
-        const functionIdx = this.getFunctionIdx();
-        let parentIdx = this.list.array.getElementFieldValue(this.idx, 'parentIdx');
-
-        let cycleDepth = 0;
-        while (parentIdx >= 0) {
-            const parentFunctionIdx = this.list.array.getElementFieldValue(parentIdx, 'functionIdx');
-            if (functionIdx == parentFunctionIdx) {
-                cycleDepth++;
-            }
-
-            parentIdx = this.list.array.getElementFieldValue(parentIdx, 'parentIdx');
-        }
-
-        return cycleDepth;
-    }
-}
-
-class TruncatedCallListEntry extends CallListEntry {
-
-    constructor(call, lowerBound, upperBound) {
-        super(call.list, call.idx);
-
-        this.customMetricValues = {};
-
-        let truncated = false;
-
-        if (lowerBound && lowerBound.getValue('wt') > this.getStart('wt')) {
-            truncated = true;
-            this.customMetricValues['start'] = lowerBound;
-        }
-
-        if (upperBound && upperBound.getValue('wt') < this.getEnd('wt')) {
-            truncated = true;
-            this.customMetricValues['end'] = upperBound;
-        }
-
-        if (truncated) {
-            this.customMetricValues['exc'] = MetricValueSet.createFromMetricsAndValue(
-                this.getMetrics(),
-                0
-            );
-        }
-    }
-
-    getMetricValue(type, metric) {
-        if (type in this.customMetricValues) {
-            return this.customMetricValues[type].getValue(metric);
-        }
-
-        return super.getMetricValue(type, metric);
-    }
-}
-
-class CallList {
-
-    constructor(functionCount, metrics) {
-        this.metrics = metrics;
-        this.functionNames = Array(functionCount).fill("n/a");
-
-        this.metricOffsets = {};
-        for (let i = 0; i < this.metrics.length; i++) {
-            this.metricOffsets[this.metrics[i]] = i;
-        }
-
-        const structure = {
-            functionIdx: 'int32',
-            parentIdx: 'int32',
-        };
-
-        // FIXME use float32 to save space ?
-        // FIXME or add/compute some stats somewhere to find the best type (e.g. compiled
-        //       file count metric could be stored as uint16)
-        for (let metric of this.metrics) {
-            structure['start_' + metric] = 'float64';
-            structure['end_'   + metric] = 'float64';
-            structure['exc_'   + metric] = 'float64';
-        }
-
-        this.array = new utils.ChunkedRecordArray(structure, 1024 * 1024);
-    }
-
-    getSize() {
-        return this.array.size;
-    }
-
-    getMetrics() {
-        return this.metrics;
-    }
-
-    setRawCallData(idx, functionNameIdx, parentIdx, start, end, exc) {
-        const elt = {
-            functionIdx: functionNameIdx,
-            parentIdx: parentIdx,
-        };
-
-        for (let i = 0; i < this.metrics.length; i++) {
-            const metric = this.metrics[i];
-
-            elt['start_' + metric] = start[i];
-            elt['end_'   + metric] = end[i];
-            elt['exc_'   + metric] = exc[i];
-        }
-
-        this.array.setElement(idx, elt);
-
-        return this;
-    }
-
-    getCall(idx) {
-        return new CallListEntry(this, idx);
-    }
-
-    setFunctionName(idx, functionName) {
-        this.functionNames[idx] = functionName;
-
-        return this;
-    }
-}
-
 class CumCostStats {
 
-    constructor(metrics) {
-        this.min = MetricValueSet.createFromMetricsAndValue(metrics, 0);
-        this.max = MetricValueSet.createFromMetricsAndValue(metrics, 0);
-    }
-
-    merge(other) {
-        this.min.addNeg(other.min);
-        this.max.addPos(other.max);
-    }
-
-    mergeMetricValues(metricValues) {
-        this.min.addNeg(metricValues);
-        this.max.addPos(metricValues);
+    constructor(min, max) {
+        this.min = min;
+        this.max = max;
     }
 
     getMin(metric) {
@@ -424,122 +186,27 @@ class CumCostStats {
     }
 }
 
-// fixme rename MetricValueSet -> Sample & MetricValuesList -> SampleList ?
-//       keep in mind that Sample might be to concrete since MetricValueSet can also represent a cost
-class MetricValuesList {
-
-    constructor(metrics) {
-        this.metrics = metrics;
-
-        const structure = {};
-        for (let metric of this.metrics) {
-            structure[metric] = 'float64';
-        }
-
-        this.array = new utils.ChunkedRecordArray(structure, 1024 * 1024);
-    }
-
-    setRawMetricValuesData(idx, rawMetricValuesData) {
-        const elt = {};
-
-        for (let i = 0; i < this.metrics.length; i++) {
-            const metric = this.metrics[i];
-
-            elt[metric] = rawMetricValuesData[i];
-        }
-
-        this.array.setElement(idx, elt);
-    }
-
-    getCumCostStats(range) {
-        if (range.length() == 0) {
-            return new CumCostStats(this.metrics);
-        }
-
-        let firstIdx = this._findNearestIdx(range.begin);
-        if (firstIdx < this.array.getSize() - 1 && this.array.getElement(firstIdx)['wt'] < range.begin) {
-            firstIdx++;
-        }
-
-        let lastIdx = this._findNearestIdx(range.end);
-        if (lastIdx > 0 && this.array.getElement(lastIdx)['wt'] > range.end) {
-            lastIdx--;
-        }
-
-        const first = this.getMetricValues(range.begin);
-        const last = this.getMetricValues(range.end);
-
-        let previous = first;
-        const cumCost = new CumCostStats(previous.getMetrics());
-        for (let i = firstIdx; i <= lastIdx; i++) {
-            const current = new MetricValueSet(this.array.getElement(i));
-            cumCost.mergeMetricValues(current.copy().sub(previous));
-            previous = current;
-        }
-
-        cumCost.mergeMetricValues(last.copy().sub(previous));
-
-        return cumCost;
-    }
-
-    getMetricValues(time) {
-        const nearestIdx = this._findNearestIdx(time);
-        const nearestRawMetricValues = this.array.getElement(nearestIdx);
-
-        if (nearestRawMetricValues['wt'] == time) {
-            return new MetricValueSet(nearestRawMetricValues);
-        }
-
-        let lowerRawMetricValues = null;
-        let upperRawMetricValues = null;
+/*
+ Whole report value & call cost bounds, used to scale the plots and the call colors.
+*/
+class Stats {
 
-        if (nearestRawMetricValues['wt'] < time) {
-            lowerRawMetricValues = nearestRawMetricValues;
-            upperRawMetricValues = this.array.getElement(nearestIdx + 1);
-        } else {
-            lowerRawMetricValues = this.array.getElement(nearestIdx - 1);
-            upperRawMetricValues = nearestRawMetricValues;
-        }
+    static createFromJSON(json) {
+        const metrics = json.metrics;
 
-        return MetricValueSet.lerpByTime(
-            new MetricValueSet(lowerRawMetricValues),
-            new MetricValueSet(upperRawMetricValues),
-            time
+        return new Stats(
+            MetricValueSet.createFromMetricsAndValues(metrics, json.value_range.min),
+            MetricValueSet.createFromMetricsAndValues(metrics, json.value_range.max),
+            MetricValueSet.createFromMetricsAndValues(metrics, json.call_range.min),
+            MetricValueSet.createFromMetricsAndValues(metrics, json.call_range.max)
         );
     }
 
-    _findNearestIdx(time, range) {
-        range = range || new math.Range(0, this.array.getSize());
-
-        if (range.length() == 1) {
-            return range.begin;
-        }
-
-        const center = Math.floor(range.center());
-        const centerTime = this.array.getElementFieldValue(center, 'wt');
-
-        if (time < centerTime) {
-            return this._findNearestIdx(time, new math.Range(range.begin, center));
-        }
-
-        if (time > centerTime) {
-            return this._findNearestIdx(time, new math.Range(center, range.end));
-        }
-
-        return center;
-    }
-}
-
-/*
- FIXME remove and do a dead code removal pass
-*/
-class Stats {
-
-    constructor(metrics) {
-        this.min = MetricValueSet.createFromMetricsAndValue(metrics, Number.MAX_VALUE);
-        this.max = MetricValueSet.createFromMetricsAndValue(metrics, -Number.MAX_VALUE);
-        this.callMin = MetricValueSet.createFromMetricsAndValue(metrics, Number.MAX_VALUE);
-        this.callMax = MetricValueSet.createFromMetricsAndValue(metrics, -Number.MAX_VALUE);
+    constructor(min, max, callMin, callMax) {
+        this.min = min;
+        this.max = max;
+        this.callMin = callMin;
+        this.callMax = callMax;
     }
 
     getMin(metric) {
@@ -571,112 +238,27 @@ class Stats {
             this.getCallMax(metric)
         );
     }
-
-    merge(other) {
-        this.min.min(other.min);
-        this.max.max(other.max);
-        this.callMin.min(other.callMin);
-        this.callMax.max(other.callMax);
-
-        return this;
-    }
-
-    mergeMetricValue(metric, value) {
-        this.min.setValue(metric, Math.min(
-            this.min.getValue(metric),
-            value
-        ));
-
-        this.max.setValue(metric, Math.max(
-            this.max.getValue(metric),
-            value
-        ));
-    }
-
-    mergeCallMetricValue(metric, value) {
-        this.callMin.setValue(metric, Math.min(
-            this.callMin.getValue(metric),
-            value
-        ));
-
-        this.callMax.setValue(metric, Math.max(
-            this.callMax.getValue(metric),
-            value
-        ));
-    }
 }
 
 class FunctionsStats {
 
-    constructor(calls) {
-        this.functionsStats = new Map();
-
-        calls = calls || [];
-        for (let call of calls) {
-            let stats = this.functionsStats.get(call.getFunctionIdx());
-            if (!stats) {
-                stats = {
-                    functionName: call.getFunctionName(),
-                    maxCycleDepth: 0,
-                    called: 0,
-                    inc: MetricValueSet.createFromMetricsAndValue(call.getMetrics(), 0),
-                    exc: MetricValueSet.createFromMetricsAndValue(call.getMetrics(), 0),
-                };
-
-                this.functionsStats.set(call.getFunctionIdx(), stats);
-            }
-
-            stats.called++;
-            let cycleDepth = call.getCycleDepth();
-            stats.maxCycleDepth = Math.max(stats.maxCycleDepth, cycleDepth);
-            if (cycleDepth > 0) {
-                continue;
-            }
-
-            stats.inc.add(call.getIncMetricValues());
-            stats.exc.add(call.getExcMetricValues());
-        }
+    constructor(functionsStats) {
+        this.functionsStats = functionsStats;
     }
 
     getValues() {
-        return Array.from(this.functionsStats.values());
-    }
-
-    merge(other) {
-        for (let key of other.functionsStats.keys()) {
-            let a = this.functionsStats.get(key);
-            let b = other.functionsStats.get(key);
-
-            if (!a) {
-                this.functionsStats.set(key, {
-                    functionName: b.functionName,
-                    maxCycleDepth: b.maxCycleDepth,
-                    called: b.called,
-                    inc: b.inc.copy(),
-                    exc: b.exc.copy(),
-                });
-
-                continue;
-            }
-
-            a.called += b.called;
-            a.maxCycleDepth = Math.max(a.maxCycleDepth, b.maxCycleDepth);
-
-            a.inc.add(b.inc);
-            a.exc.add(b.exc);
-        }
+        return this.functionsStats;
     }
 }
 
 class CallTreeStatsNode {
 
-    constructor(functionName, metrics) {
+    constructor(functionName, called, inc) {
         this.functionName = functionName;
         this.parent = null;
-        this.children = {};
-        this.minTime = Number.MAX_VALUE;
-        this.called = 0;
-        this.inc = MetricValueSet.createFromMetricsAndValue(metrics, 0);
+        this.children = [];
+        this.called = called;
+        this.inc = inc;
     }
 
     getFunctionName() {
@@ -696,11 +278,8 @@ class CallTreeStatsNode {
     }
 
     getChildren() {
-        return Object
-            .keys(this.children)
-            .map(k => this.children[k])
-            .sort((a, b) => a.minTime - b.minTime)
-        ;
+        // already sorted by first call time, see json_print_call_tree_node()
+        return this.children;
     }
 
     getDepth() {
@@ -714,22 +293,13 @@ class CallTreeStatsNode {
         return depth;
     }
 
-    getMinInc() {
-        const minInc = this.inc.copy();
-        for (let i in this.children) {
-            minInc.min(this.children[i].getMinInc());
-        }
-
-        return minInc;
-    }
-
     getMaxCumInc() {
         const maxCumInc = this.inc.copy().set(0);
-        for (const i in this.children) {
-            maxCumInc.add(this.children[i].getMaxCumInc());
+        for (const child of this.children) {
+            maxCumInc.add(child.getMaxCumInc());
         }
 
-        if (this.getChildren().length == 0) {
+        if (this.children.length == 0) {
             maxCumInc.set(-Number.MAX_VALUE);
         }
 
@@ -738,50 +308,7 @@ class CallTreeStatsNode {
 
     addChild(node) {
         node.parent = this;
-        this.children[node.functionName] = node;
-
-        return this;
-    }
-
-    addCallStats(call) {
-        this.minTime = Math.min(this.minTime, call.getStart('wt'));
-        this.called++;
-        this.inc.add(call.getIncMetricValues());
-
-        return this;
-    }
-
-    merge(other) {
-        this.called += other.called;
-        this.inc.add(other.inc);
-        this.minTime = Math.min(this.minTime, other.minTime);
-
-        for (let i in other.children) {
-            if (!(i in this.children)) {
-                this.addChild(new CallTreeStatsNode(
-                    other.children[i].getFunctionName(),
-                    other.children[i].getInc().getMetrics()
-                ));
-            }
-
-            this.children[i].merge(other.children[i]);
-        }
-
-        return this;
-    }
-
-    prune(minDuration) {
-        for (let i in this.children) {
-            const child = this.children[i];
-
-            if (child.called > 0 && child.inc.getValue('wt') < minDuration) {
-                delete this.children[i];
-
-                continue;
-            }
-
-            child.prune(minDuration);
-        }
+        this.children.push(node);
 
         return this;
     }
@@ -789,53 +316,56 @@ class CallTreeStatsNode {
 
 class CallTreeStats {
 
-    constructor(metrics, calls) {
-        this.root = new CallTreeStatsNode(null, metrics);
-        this.root.called = 1;
-
-        calls = calls || [];
-        for (let call of calls) {
-            const stack = call.getStack();
-
-            let node = this.root;
-            for (let i = 0; i < stack.length; i++) {
-                const functionName = stack[i].getFunctionName();
-                let child = node.children[functionName];
-                if (!child) {
-                    child = new CallTreeStatsNode(functionName, metrics);
-                    node.addChild(child);
-                }
-
-                node = child;
-            }
-
-            node.addCallStats(call);
-            if (node.getDepth() == 1) {
-                node.getParent().getInc().add(
-                    call.getIncMetricValues()
-                );
-            }
-        }
+    constructor(root) {
+        this.root = root;
     }
 
     getRoot() {
         return this.root;
     }
+}
 
-    merge(other) {
-        this.root.merge(other.root);
+/*
+ Aggregated stats of a time range, as computed server side by spx_report_analyzer.c (see the
+ /data/reports/time-range-stats/ route).
+*/
+class TimeRangeStats {
 
-        return this;
-    }
+    static createFromJSON(timeRange, json) {
+        const metrics = json.metrics;
+
+        const functionsStats = json.functions.map(f => ({
+            functionName: f.name,
+            maxCycleDepth: f.max_cycle_depth,
+            called: f.called,
+            inc: MetricValueSet.createFromMetricsAndValues(metrics, f.inc),
+            exc: MetricValueSet.createFromMetricsAndValues(metrics, f.exc),
+        }));
+
+        const createNode = (functionName, json) => {
+            const node = new CallTreeStatsNode(
+                functionName,
+                json.called,
+                MetricValueSet.createFromMetricsAndValues(metrics, json.inc)
+            );
 
-    prune(minDuration) {
-        this.root.prune(minDuration);
+            for (const child of json.children) {
+                node.addChild(createNode(child.name, child));
+            }
 
-        return this;
-    }
-}
+            return node;
+        };
 
-class TimeRangeStats {
+        return new TimeRangeStats(
+            timeRange,
+            new FunctionsStats(functionsStats),
+            new CallTreeStats(createNode(null, json.call_tree)),
+            new CumCostStats(
+                MetricValueSet.createFromMetricsAndValues(metrics, json.cum_cost.min),
+                MetricValueSet.createFromMetricsAndValues(metrics, json.cum_cost.max)
+            )
+        );
+    }
 
     constructor(timeRange, functionsStats, callTreeStats, cumCostStats) {
         this.timeRange = timeRange;
@@ -844,12 +374,6 @@ class TimeRangeStats {
         this.cumCostStats = cumCostStats;
     }
 
-    merge(other) {
-        this.functionsStats.merge(other.functionsStats);
-        this.callTreeStats.merge(other.callTreeStats);
-        this.cumCostStats.merge(other.cumCostStats);
-    }
-
     getTimeRange() {
         return this.timeRange;
     }
@@ -867,278 +391,374 @@ class TimeRangeStats {
     }
 }
 
-class CallRangeTree {
+class Call {
 
-    constructor(range, callList, metricValuesList) {
-        this.range = range;
-        this.callList = callList;
-        this.metricValuesList = metricValuesList;
-        this.callRefs = [];
-        this.children = [];
-        this.functionsStats = null;
-        this.callTreeStats = null;
-        this.cumCostStats = null;
+    constructor(functionName, depth, start, end, exc, truncated) {
+        this.functionName = functionName;
+        this.depth = depth;
+        this.start = start;
+        this.end = end;
+        this.exc = exc;
+        this.truncated = truncated;
     }
 
-    getNodeCount() {
-        let nodeCount = 0;
-        for (const child of this.children) {
-            nodeCount += child.getNodeCount();
-        }
-
-        return 1 + nodeCount;
+    getFunctionName() {
+        return this.functionName;
     }
 
-    getMaxDepth() {
-        let maxDepth = 0;
-        for (const child of this.children) {
-            maxDepth = Math.max(maxDepth, child.getMaxDepth());
-        }
+    getDepth() {
+        return this.depth;
+    }
 
-        return maxDepth + 1;
+    getStart(metric) {
+        return this.start.getValue(metric);
     }
 
-    getTimeRangeStats(range, lowerBound, upperBound) {
-        range = range || this.range;
+    getEnd(metric) {
+        return this.end.getValue(metric);
+    }
 
-        if (!this.range.overlaps(range)) {
-            return new TimeRangeStats(
-                range,
-                new FunctionsStats(),
-                new CallTreeStats(this.callList.getMetrics()),
-                new CumCostStats(this.callList.getMetrics())
-            );
-        }
+    getInc(metric) {
+        return this.getEnd(metric) - this.getStart(metric);
+    }
 
-        if (this.range.isContainedBy(range)) {
-            return new TimeRangeStats(
-                range,
-                this.functionsStats,
-                this.callTreeStats,
-                this.cumCostStats
-            );
+    getExc(metric) {
+        // unknown for timeline pyramid calls and for truncated calls
+        if (this.exc == null || this.truncated) {
+            return null;
         }
 
-        if (lowerBound == null && this.range.begin < range.begin) {
-            lowerBound = this.metricValuesList.getMetricValues(range.begin);
-        }
+        return this.exc.getValue(metric);
+    }
 
-        if (upperBound == null && this.range.end > range.end) {
-            upperBound = this.metricValuesList.getMetricValues(range.end);
-        }
+    isTruncated() {
+        return this.truncated;
+    }
 
-        const calls = [];
-        for (const callRef of this.callRefs) {
-            const callTimeRange = this.callList.getCall(callRef).getTimeRange();
-            if (!callTimeRange.overlaps(range)) {
-                continue;
-            }
+    getTimeRange() {
+        return new math.Range(this.getStart('wt'), this.getEnd('wt'));
+    }
 
-            calls.push(new TruncatedCallListEntry(
-                this.callList.getCall(callRef),
-                lowerBound,
-                upperBound
-            ));
-        }
+    isSameAs(other) {
+        return this.depth == other.depth
+            && this.functionName == other.functionName
+            && this.getStart('wt') == other.getStart('wt')
+        ;
+    }
+}
 
-        const timeRangeStats = new TimeRangeStats(
-            range,
-            new FunctionsStats(calls),
-            new CallTreeStats(this.callList.getMetrics(), calls),
-            new CumCostStats(this.callList.getMetrics())
-        );
+/*
+ The calls of a time range lasting at least a given duration, along with the metric values
+ sampled over this range.
+*/
+class TimelineData {
 
-        const remainingRange = this.range.copy().intersect(range);
-        for (const child of this.children) {
-            timeRangeStats.merge(child.getTimeRangeStats(range, lowerBound, upperBound));
-            remainingRange.sub(child.range);
-        }
+    constructor(timeRange, minDuration, calls, samples) {
+        this.timeRange = timeRange;
+        this.minDuration = minDuration;
+        this.calls = calls;
+        this.samples = samples.sort((a, b) => a.getValue('wt') - b.getValue('wt'));
+    }
 
-        timeRangeStats.getCumCostStats().merge(
-            this.metricValuesList.getCumCostStats(remainingRange)
-        );
+    getTimeRange() {
+        return this.timeRange;
+    }
 
-        return timeRangeStats;
+    getCalls() {
+        return this.calls;
     }
 
-    getCallRefs(range, minDuration, callRefs) {
-        if (this.range.length() < minDuration) {
-            return [];
+    getMetricValues(time) {
+        if (this.samples.length == 0) {
+            return null;
         }
 
-        if (!this.range.overlaps(range)) {
-            return [];
+        let lower = 0;
+        let upper = this.samples.length - 1;
+
+        if (time <= this.samples[lower].getValue('wt')) {
+            return this.samples[lower].copy();
         }
 
-        if (callRefs === undefined) {
-            callRefs = [];
+        if (time >= this.samples[upper].getValue('wt')) {
+            return this.samples[upper].copy();
         }
 
-        for (const callRef of this.callRefs) {
-            const callTimeRange = this.callList.getCall(callRef).getTimeRange();
-            if (callTimeRange.length() < minDuration) {
-                // since calls are sorted
-                break;
+        while (upper - lower > 1) {
+            const center = Math.floor((lower + upper) / 2);
+            if (this.samples[center].getValue('wt') <= time) {
+                lower = center;
+            } else {
+                upper = center;
             }
+        }
+
+        return MetricValueSet.lerpByTime(this.samples[lower], this.samples[upper], time);
+    }
+}
+
+/*
+ Level of detail timeline pyramid, see spx_report_timeline.h for the file format.
+ Only the header and the tiles covering the requested time range are fetched.
+*/
+class TimelinePyramid {
+
+    static async load(url) {
+        let size = 64 * 1024;
+        while (true) {
+            const response = await fetch(url, {
+                credentials: 'same-origin',
+                headers: {Range: 'bytes=0-' + (size - 1)},
+            });
 
-            if (!callTimeRange.overlaps(range)) {
-                continue;
+            if (!response.ok) {
+                throw new Error('Timeline fetch failed: ' + response.status);
             }
 
-            callRefs.push(callRef);
-        }
+            const buffer = new Uint8Array(await response.arrayBuffer());
+            const end = buffer.indexOf(10);
+            if (end >= 0) {
+                const header = JSON.parse(new TextDecoder('utf-8').decode(buffer.subarray(0, end)));
+                if (header.version != 2) {
+                    throw new Error('Unsupported timeline version: ' + header.version);
+                }
 
-        for (const child of this.children) {
-            child.getCallRefs(range, minDuration, callRefs);
+                return new TimelinePyramid(url, header, end + 1);
+            }
+
+            if (buffer.length < size) {
+                throw new Error('Invalid timeline file');
+            }
+
+            size *= 2;
         }
+    }
 
-        return callRefs;
+    constructor(url, header, dataOffset) {
+        this.url = url;
+        this.header = header;
+        this.dataOffset = dataOffset;
     }
 
-    static buildAsync(range, callRefs, callList, metricValuesList, progress, done) {
-        const tree = new CallRangeTree(range, callList, metricValuesList);
+    getMinBucketWidth() {
+        return this.header.levels.length > 0 ? this.header.levels[0].bucket_width : Infinity;
+    }
 
-        const lRange = tree.range.subRange(0.5, 0);
-        const rRange = tree.range.subRange(0.5, 1);
+    getLevelIdx(minDuration) {
+        // coarsest level whose buckets are not larger than the requested resolution
+        for (let i = this.header.levels.length - 1; i > 0; i--) {
+            if (this.header.levels[i].bucket_width <= minDuration) {
+                return i;
+            }
+        }
 
-        let lCallRefs = [];
-        let rCallRefs = [];
+        return 0;
+    }
 
-        if (!callRefs) {
-            callRefs = Array(callList.getSize());
-            for (let i = 0; i < callRefs.length; i++) {
-                callRefs[i] = i;
-            }
+    async getTimelineData(range, minDuration, signal) {
+        const levelIdx = this.getLevelIdx(minDuration);
+        const level = this.header.levels[levelIdx];
+
+        const first = Math.max(0, Math.floor(range.begin / level.bucket_width));
+        const last = Math.min(level.bucket_count - 1, Math.floor(range.end / level.bucket_width));
+        if (first > last) {
+            return new TimelineData(range, minDuration, [], []);
         }
 
-        for (const callRef of callRefs) {
-            const callTimeRange = callList.getCall(callRef).getTimeRange();
+        const recordSize = this.header.record_size;
+        const begin = this.dataOffset + level.offset + first * recordSize;
+        const end = this.dataOffset + level.offset + (last + 1) * recordSize - 1;
 
-            if (!tree.range.contains(callTimeRange)) {
-                continue;
-            }
+        const response = await fetch(this.url, {
+            credentials: 'same-origin',
+            headers: {Range: 'bytes=' + begin + '-' + end},
+            signal: signal,
+        });
+
+        if (!response.ok) {
+            throw new Error('Timeline fetch failed: ' + response.status);
+        }
 
-            if (lRange.contains(callTimeRange)) {
-                lCallRefs.push(callRef);
+        const view = new DataView(await response.arrayBuffer());
+        const littleEndian = !!this.header.little_endian;
+        const metrics = this.header.metrics;
 
-                continue;
+        const readValues = offset => {
+            const values = {};
+            for (let i = 0; i < metrics.length; i++) {
+                values[metrics[i]] = view.getFloat64(offset + i * 8, littleEndian);
             }
 
-            if (rRange.contains(callTimeRange)) {
-                rCallRefs.push(callRef);
+            return new MetricValueSet(values);
+        };
 
-                continue;
-            }
+        const calls = [];
+        const samples = [];
+
+        // a call lasting several buckets is the longest one of each of them
+        const previousCalls = Array(this.header.max_depth).fill(null);
+
+        for (let i = 0; i <= last - first; i++) {
+            let offset = i * recordSize;
+
+            samples.push(readValues(offset));
+            offset += metrics.length * 8;
+
+            for (let depth = 0; depth < this.header.max_depth; depth++) {
+                const functionIdx = view.getUint32(offset + metrics.length * 16, littleEndian);
+                if (functionIdx > 0) {
+                    const call = new Call(
+                        this.header.functions[functionIdx - 1],
+                        depth,
+                        readValues(offset),
+                        readValues(offset + metrics.length * 8),
+                        null,
+                        false
+                    );
+
+                    if (previousCalls[depth] == null || !call.isSameAs(previousCalls[depth])) {
+                        calls.push(call);
+                        previousCalls[depth] = call;
+                    }
+                }
 
-            tree.callRefs.push(callRef);
+                offset += metrics.length * 16 + 4;
+            }
         }
 
-        const minCallsPerNode = 500;
+        return new TimelineData(
+            new math.Range(first * level.bucket_width, (last + 1) * level.bucket_width),
+            level.bucket_width,
+            calls,
+            samples
+        );
+    }
+}
 
-        if (lCallRefs.length < minCallsPerNode) {
-            tree.callRefs = tree.callRefs.concat(lCallRefs);
-            lCallRefs = [];
-        }
+/*
+ Keeps the timeline data of a view up to date, it is fetched asynchronously for a range wider
+ than the view so that it can be panned or zoomed a bit without waiting for new data.
+*/
+class TimelineDataLoader {
+
+    constructor(profileData, onLoad) {
+        this.profileData = profileData;
+        this.onLoad = onLoad;
+        this.data = null;
+        this.loadedRequest = null;
+        this.pendingRequest = null;
+        this.timeout = null;
+        this.controller = null;
+    }
+
+    get(range, minDuration) {
+        const request = {
+            range: range.copy().bound(0, this.profileData.getWallTime()),
+            minDuration: minDuration,
+        };
 
-        if (rCallRefs.length < minCallsPerNode) {
-            tree.callRefs = tree.callRefs.concat(rCallRefs);
-            rCallRefs = [];
+        if (!this._covers(this.loadedRequest, request) && !this._covers(this.pendingRequest, request)) {
+            this._load(request);
         }
 
-        tree.callRefs.sort((a, b) => {
-            a = callList.getCall(a).getTimeRange().length();
-            b = callList.getCall(b).getTimeRange().length();
-            
-            // N.B. "b - a" does not work on Chromium 62.0.3202.94 !!!
-
-            if (a == b) {
-                return 0;
-            }
+        return this.data;
+    }
 
-            return a > b ? -1 : 1;
-        });
+    _covers(coveringRequest, request) {
+        // detailed enough but not too much
+        return coveringRequest != null
+            && coveringRequest.range.contains(request.range)
+            && coveringRequest.minDuration <= request.minDuration
+            && coveringRequest.minDuration * 4 >= request.minDuration
+        ;
+    }
 
-        const treeCalls = [];
-        for (const callRef of tree.callRefs) {
-            treeCalls.push(callList.getCall(callRef));
+    _load(request) {
+        clearTimeout(this.timeout);
+        if (this.controller) {
+            this.controller.abort();
+            this.controller = null;
         }
 
-        tree.functionsStats = new FunctionsStats(treeCalls);
-        tree.callTreeStats = new CallTreeStats(callList.getMetrics(), treeCalls);
-        tree.cumCostStats = new CumCostStats(callList.getMetrics());
-
-        utils.processCallChain([
-            next => {
-                progress(tree.callRefs.length);
-                next();
-            },
-            next => {
-                if (lCallRefs.length == 0) {
-                    tree.cumCostStats.merge(metricValuesList.getCumCostStats(lRange));
-                    next();
-
-                    return;
-                }
+        const wideRange = request.range.copy();
+        wideRange.begin -= request.range.length();
+        wideRange.end += request.range.length();
+        wideRange.bound(0, this.profileData.getWallTime());
 
-                tree.children.push(CallRangeTree.buildAsync(
-                    lRange,
-                    lCallRefs,
-                    callList,
-                    metricValuesList,
-                    progress,
-                    child => {
-                        tree.functionsStats.merge(child.functionsStats);
-                        tree.callTreeStats.merge(child.callTreeStats);
-                        tree.cumCostStats.merge(child.cumCostStats);
-                        next();
-                    }
-                ));
-            },
-            next => {
-                if (rCallRefs.length == 0) {
-                    tree.cumCostStats.merge(metricValuesList.getCumCostStats(rRange));
-                    next();
+        const pendingRequest = {
+            range: wideRange,
+            minDuration: request.minDuration,
+        };
 
-                    return;
-                }
+        this.pendingRequest = pendingRequest;
 
-                tree.children.push(CallRangeTree.buildAsync(
-                    rRange,
-                    rCallRefs,
-                    callList,
-                    metricValuesList,
-                    progress,
-                    child => {
-                        tree.functionsStats.merge(child.functionsStats);
-                        tree.callTreeStats.merge(child.callTreeStats);
-                        tree.cumCostStats.merge(child.cumCostStats);
-                        next();
+        this.timeout = setTimeout(() => {
+            const controller = new AbortController();
+            this.controller = controller;
+
+            this
+                .profileData
+                .fetchTimelineData(pendingRequest.range, pendingRequest.minDuration, controller.signal)
+                .then(data => {
+                    if (this.controller !== controller) {
+                        return;
                     }
-                ));
-            },
-            () => {
-                // prune calls < 1/150th of node range as memory / accuracy trade-off
-                // FIXME /!\ this should be tunable, pruning on time basis only could broke accuracy on other metrics
-                // FIXME /!\ pruning appears to cause popping noise in flamegraph view
-                tree.callTreeStats.prune(range.length() / 150);
-                done(tree);
-            }
-        ], callRefs.length >= 5000, 0);
 
-        return tree;
+                    this.controller = null;
+                    this.pendingRequest = null;
+                    this.loadedRequest = pendingRequest;
+                    this.data = data;
+                    this.onLoad();
+                })
+                .catch(e => {
+                    // the pending request is kept so that it is not retried until the view
+                    // moves away
+                    if (e.name != 'AbortError') {
+                        console.error(e);
+                    }
+                })
+            ;
+        }, 50);
     }
 }
 
-class ProfileData {
+export class ProfileData {
+
+    static async load(metricsInfo, metadata, key) {
+        const profileData = new ProfileData(metricsInfo, metadata, key);
+
+        // the exact wall time is only known from the analysis, the metadata one (see
+        // index.html for its unit) is fine to prune the call tree
+        const json = await profileData._fetchAnalysis(
+            'time-range-stats',
+            null,
+            metadata.wall_time_ms * 1000 / 4000,
+            null
+        );
+
+        profileData.stats = Stats.createFromJSON(json);
+        profileData.reportTimeRangeStats = TimeRangeStats.createFromJSON(profileData.getTimeRange(), json);
+
+        try {
+            profileData.timelinePyramid = await TimelinePyramid.load(
+                '?SPX_UI_URI=/data/reports/timeline/' + key
+            );
+        } catch (e) {
+            // e.g. a report recorded by a former version, the calls route is then used alone
+        }
+
+        return profileData;
+    }
 
-    constructor(metricsInfo, metadata, stats, callList, metricValuesList, callRangeTree) {
-        console.log('tree', callRangeTree.getMaxDepth(), callRangeTree.getNodeCount(), callList.getSize());
+    constructor(metricsInfo, metadata, key) {
         this.metricsInfo = metricsInfo;
         this.metadata = metadata;
-        this.stats = stats;
-        this.callList = callList;
-        this.metricValuesList = metricValuesList;
-        this.callRangeTree = callRangeTree;
+        this.key = key;
+        this.stats = null;
+        this.reportTimeRangeStats = null;
+        this.timelinePyramid = null;
+        this.timeRangeStatsTimeout = null;
+        this.timeRangeStatsController = null;
     }
 
     getMetricKeys() {
@@ -1176,7 +796,7 @@ class ProfileData {
         return this.metadata;
     }
 
-    getStats() {
+    getStats() {
         return this.stats;
     }
 
@@ -1191,185 +811,107 @@ class ProfileData {
         );
     }
 
-    getTimeRangeStats(range) {
-        console.time('getTimeRangeStats');
-
-        const timeRangeStats = this
-            .callRangeTree
-            .getTimeRangeStats(range)
-        ;
-
-        console.timeEnd('getTimeRangeStats');
-
-        return timeRangeStats;
-    }
-
-    getCall(idx) {
-        return this.callList.getCall(idx);
+    getReportTimeRangeStats() {
+        return this.reportTimeRangeStats;
     }
 
-    getCalls(range, minDuration) {
-        console.time('getCalls');
-        const callRefs = this.callRangeTree.getCallRefs(
-            range,
-            minDuration
-        );
-
-        let calls = [];
-        for (let callRef of callRefs) {
-            calls.push(this.callList.getCall(callRef));
+    fetchTimeRangeStats(range) {
+        // Time range updates come in bursts (e.g. while dragging), requests are then delayed
+        // and the pending one is aborted so that only the last requested range is analyzed.
+        // The returned promise of a superseded request never settles.
+        clearTimeout(this.timeRangeStatsTimeout);
+        if (this.timeRangeStatsController) {
+            this.timeRangeStatsController.abort();
+            this.timeRangeStatsController = null;
         }
 
-        console.timeEnd('getCalls');
-
-        return calls;
-    }
-
-    getMetricValues(time) {
-        return this.metricValuesList.getMetricValues(time);
-    }
-}
-
-export class ProfileDataBuilder {
-
-    constructor(metricsInfo) {
-        this.metricsInfo = metricsInfo;
-    }
-
-    setMetadata(metadata) {
-        this.metadata = metadata;
-        this.metrics = metadata.enabled_metrics;
-        this.stats = new Stats(this.metrics);
-
-        this.totalCallCount = metadata.recorded_call_count;
-        this.currentCallCount = 0;
+        if (this.getTimeRange().isContainedBy(range)) {
+            return Promise.resolve(this.reportTimeRangeStats);
+        }
 
-        this.callList = new CallList(
-            metadata.called_function_count,
-            this.metrics
-        );
+        return new Promise((resolve, reject) => {
+            this.timeRangeStatsTimeout = setTimeout(() => {
+                const controller = new AbortController();
+                this.timeRangeStatsController = controller;
 
-        this.metricValuesList = new MetricValuesList(
-            this.metrics
-        );
+                this
+                    // call tree nodes narrower than a fraction of pixel are not rendered anyway
+                    ._fetchAnalysis('time-range-stats', range, range.length() / 4000, controller.signal)
+                    .then(json => {
+                        if (this.timeRangeStatsController === controller) {
+                            this.timeRangeStatsController = null;
+                        }
 
-        this.stack = [];
-        this.eventCount = 0;
-        this.callCount = 0;
-    }
-
-    getTotalCallCount() {
-        return this.totalCallCount;
+                        resolve(TimeRangeStats.createFromJSON(range, json));
+                    })
+                    .catch(e => {
+                        if (e.name != 'AbortError') {
+                            reject(e);
+                        }
+                    })
+                ;
+            }, 50);
+        });
     }
 
-    getCurrentCallCount() {
-        return this.currentCallCount;
+    createTimelineDataLoader(onLoad) {
+        return new TimelineDataLoader(this, onLoad);
     }
 
-    addEvent(event) {
-        if (event[1]) {
-            this.stack.push({
-                idx: this.callCount++,
-                startEvent: event,
-                startEventIdx: this.eventCount++,
-                fnIdx: event[0],
-                parent: this.stack.length > 0 ? this.stack[this.stack.length - 1] : null,
-                start: Array(this.metrics.length).fill(0),
-                end: Array(this.metrics.length).fill(0),
-                exc: Array(this.metrics.length).fill(0),
-                children: Array(this.metrics.length).fill(0),
-            });
-
-            return;
+    fetchTimelineData(range, minDuration, signal) {
+        // the pyramid only covers the coarse resolutions, see spx_report_timeline.h
+        if (this.timelinePyramid && minDuration >= this.timelinePyramid.getMinBucketWidth()) {
+            return this.timelinePyramid.getTimelineData(range, minDuration, signal);
         }
 
-        const frame = this.stack.pop();
+        return this
+            ._fetchAnalysis('calls', range, minDuration, signal)
+            .then(json => {
+                const metrics = json.metrics;
+                const count = metrics.length;
+                const createValues = values => MetricValueSet.createFromMetricsAndValues(metrics, values);
 
-        frame.endEventIdx = this.eventCount++;
+                // see json_print_calls() for the call record layout
+                const calls = json.calls.map(call => new Call(
+                    json.functions[call[0]],
+                    call[1],
+                    createValues(call.slice(3, 3 + count)),
+                    createValues(call.slice(3 + count, 3 + 2 * count)),
+                    createValues(call.slice(3 + 2 * count)),
+                    call[2] != 0
+                ));
 
-        for (let j = 0; j < this.metrics.length; j++) {
-            const m = this.metrics[j];
-            frame.start[j] = frame.startEvent[2 + j];
-            frame.end[j] = event[2 + j];
+                return new TimelineData(range, minDuration, calls, json.samples.map(createValues));
+            })
+        ;
+    }
 
-            this.stats.mergeMetricValue(m, frame.start[j]);
-            this.stats.mergeMetricValue(m, frame.end[j]);
-            this.stats.mergeCallMetricValue(m, frame.end[j] - frame.start[j]);
-        }
+    _fetchAnalysis(name, range, minDuration, signal) {
+        console.time('fetch ' + name);
 
-        this.metricValuesList.setRawMetricValuesData(frame.startEventIdx, frame.start);
-        this.metricValuesList.setRawMetricValuesData(frame.endEventIdx, frame.end);
+        const params = new URLSearchParams({
+            SPX_UI_URI: '/data/reports/' + name + '/' + this.key,
+            min_duration: minDuration,
+        });
 
-        for (let j = 0; j < this.metrics.length; j++) {
-            frame.exc[j] = frame.end[j] - frame.start[j];
-            if (j in frame.children) {
-                frame.exc[j] -= frame.children[j];
-            }
+        if (range != null) {
+            params.set('begin', range.begin);
+            params.set('end', range.end);
         }
 
-        if (this.stack.length > 0) {
-            let parent = this.stack[this.stack.length - 1];
-            for (let j = 0; j < this.metrics.length; j++) {
-                parent.children[j] += frame.end[j] - frame.start[j];
-            }
-
-            for (let k = this.stack.length - 1; k >= 0; k--) {
-                if (this.stack[k].fnIdx == frame.fnIdx) {
-                    for (let j = 0; j < this.metrics.length; j++) {
-                        this.stack[k].children[j] -= frame.exc[j];
-                    }
-
-                    break;
+        return fetch('?' + params.toString(), {credentials: 'same-origin', signal: signal})
+            .then(response => {
+                if (!response.ok) {
+                    throw new Error('Cannot load report ' + name);
                 }
-            }
-        }
 
-        this.currentCallCount++;
+                return response.json();
+            })
+            .then(json => {
+                console.timeEnd('fetch ' + name);
 
-        this.callList.setRawCallData(
-            frame.idx,
-            frame.fnIdx,
-            frame.parent != null ? frame.parent.idx : -1,
-            frame.start,
-            frame.end,
-            frame.exc
-        );
-    }
-
-    setFunctionName(idx, name) {
-        this.callList.setFunctionName(idx, name);
-    }
-
-    buildCallRangeTree(setProgress) {
-        return new Promise(resolve => {
-            let totalInserted = 0;
-            console.time('Call range tree building');
-            CallRangeTree.buildAsync(
-                new math.Range(0, this.stats.getMax('wt')),
-                null,
-                this.callList,
-                this.metricValuesList,
-                inserted => {
-                    totalInserted += inserted;
-                    setProgress(totalInserted, this.callList.getSize());
-                },
-                callRangeTree => {
-                    console.timeEnd('Call range tree building');
-                    this.callRangeTree = callRangeTree;
-                    resolve();
-                }
-            );
-        });
-    }
-
-    getProfileData() {
-        return new ProfileData(
-            this.metricsInfo,
-            this.metadata,
-            this.stats,
-            this.callList,
-            this.metricValuesList,
-            this.callRangeTree
-        );
+                return json;
+            })
+        ;
     }
 }
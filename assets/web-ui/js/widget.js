@@ -171,7 +171,11 @@ function renderSVGMultiLineText(viewPort, lines) {
     }
 }
 
-function renderSVGMetricValuesPlot(viewPort, profileData, metric, timeRange) {
+function renderSVGMetricValuesPlot(viewPort, profileData, timelineData, metric, timeRange) {
+    if (timelineData == null || timelineData.getMetricValues(timeRange.begin) == null) {
+        return;
+    }
+
     const timeComponentMetric = ['ct', 'it'].includes(metric);
     const valueRange = timeComponentMetric ? new math.Range(0, 1) : profileData.getStats().getRange(metric);
 
@@ -180,7 +184,7 @@ function renderSVGMetricValuesPlot(viewPort, profileData, metric, timeRange) {
     let points = [];
     console.time('renderSVGMetricValuesPlot')
     for (let i = 0; i < viewPort.width; i += step) {
-        const currentMetricValues = profileData.getMetricValues(
+        const currentMetricValues = timelineData.getMetricValues(
             timeRange.lerp(i / viewPort.width)
         );
 
@@ -407,7 +411,7 @@ class Widget {
         this.container = container;
         this.profileData = profileData;
         this.timeRange = profileData.getTimeRange();
-        this.timeRangeStats = profileData.getTimeRangeStats(this.timeRange);
+        this.timeRangeStats = profileData.getReportTimeRangeStats();
         this.currentMetric = profileData.getMetadata().enabled_metrics[0];
         this.repaintTimeout = null;
         this.resizingTimeouts = [];
@@ -442,13 +446,18 @@ class Widget {
 
         $(window).on('resize', () => this.handleResize());
 
-        $(window).on('spx-timerange-update', (e, timeRange, timeRangeStats) => {
+        $(window).on('spx-timerange-update', (e, timeRange) => {
             this.timeRange = timeRange;
-            this.timeRangeStats = timeRangeStats;
 
             this.onTimeRangeUpdate();
         });
 
+        $(window).on('spx-timerange-stats-update', (e, timeRangeStats) => {
+            this.timeRangeStats = timeRangeStats;
+
+            this.onTimeRangeStatsUpdate();
+        });
+
         $(window).on('spx-colorscheme-mode-update', (e, colorSchemeMode) => {
             this.colorSchemeMode = colorSchemeMode;
 
@@ -502,6 +511,9 @@ class Widget {
     onTimeRangeUpdate() {
     }
 
+    onTimeRangeStatsUpdate() {
+    }
+
     onColorSchemeModeUpdate() {
         this.repaint();
     }
@@ -516,9 +528,17 @@ class Widget {
 
     notifyTimeRangeUpdate(timeRange) {
         this.timeRange = timeRange;
-        this.timeRangeStats = this.profileData.getTimeRangeStats(this.timeRange);
 
-        $(window).trigger('spx-timerange-update', [this.timeRange, this.timeRangeStats]);
+        $(window).trigger('spx-timerange-update', [this.timeRange]);
+
+        // the stats are computed server side and follow asynchronously
+        this.profileData
+            .fetchTimeRangeStats(this.timeRange)
+            .then(timeRangeStats => {
+                $(window).trigger('spx-timerange-stats-update', [timeRangeStats]);
+            })
+            .catch(e => console.error(e))
+        ;
     }
 
     notifyColorSchemeModeUpdate(colorSchemeMode) {
@@ -964,6 +984,8 @@ export class OverView extends SVGWidget {
             this.viewPort.width
         );
 
+        this.timelineDataLoader = this.profileData.createTimelineDataLoader(() => this.repaint());
+
         let action = null;
         this.container.mouseleave(e => {
             action = null;
@@ -1038,11 +1060,13 @@ export class OverView extends SVGWidget {
             'fill-opacity': '0.3',
         }));
 
-        const calls = this.profileData.getCalls(
+        const timelineData = this.timelineDataLoader.get(
             this.profileData.getTimeRange(),
             this.profileData.getTimeRange().length() / this.viewPort.width
         );
 
+        const calls = timelineData != null ? timelineData.getCalls() : [];
+
         for (let i = 0; i < calls.length; i++) {
             const call = calls[i];
 
@@ -1081,6 +1105,7 @@ export class OverView extends SVGWidget {
             renderSVGMetricValuesPlot(
                 this.viewPort,
                 this.profileData,
+                timelineData,
                 this.currentMetric,
                 this.profileData.getTimeRange()
             );
@@ -1117,6 +1142,9 @@ export class TimeLine extends SVGWidget {
 
         this.offsetY = 0;
 
+        this.timelineDataLoader = this.profileData.createTimelineDataLoader(() => this.repaint());
+        this.renderedCalls = [];
+
         this.svgRectPool = new svg.NodePool('rect');
         this.svgTextPool = new svg.NodePool('text');
 
@@ -1137,12 +1165,12 @@ export class TimeLine extends SVGWidget {
         });
 
         this.infoViewPort = null;
-        this.selectedCallIdx = null;
+        this.selectedCall = null;
 
         const firstPos = {x: 0, y: 0};
         const lastPos = {x: 0, y: 0};
         let dragging = false;
-        let pointedElement = null, callIdx = null, holdCallInfo = false;
+        let pointedElement = null, pointedCall = null;
 
         this.container.mousedown(e => {
             dragging = true;
@@ -1165,13 +1193,13 @@ export class TimeLine extends SVGWidget {
             $(window).trigger(
                 'spx-highlighted-function-update',
                 [
-                    callIdx != null ?
-                        this.profileData.getCall(callIdx).getFunctionName()
+                    pointedCall != null ?
+                        pointedCall.getFunctionName()
                         : null
                 ]
             );
 
-            this.selectedCallIdx = callIdx;
+            this.selectedCall = pointedCall;
         });
 
         this.container.mouseleave(e => {
@@ -1222,11 +1250,11 @@ export class TimeLine extends SVGWidget {
         });
 
         $(this.viewPort.node).dblclick(e => {
-            if (callIdx == null) {
+            if (pointedCall == null) {
                 return;
             }
 
-            this.notifyTimeRangeUpdate(this.profileData.getCall(callIdx).getTimeRange());
+            this.notifyTimeRangeUpdate(pointedCall.getTimeRange());
         });
 
         $(this.viewPort.node).on('mousemove mouseout', e => {
@@ -1235,15 +1263,15 @@ export class TimeLine extends SVGWidget {
             }
 
             if (pointedElement != null) {
-                if (this.selectedCallIdx == null) {
+                if (this.selectedCall == null) {
                     pointedElement.setAttribute('stroke', 'none');
                 }
 
                 pointedElement = null;
-                callIdx = null;
+                pointedCall = null;
             }
 
-            if (this.selectedCallIdx == null) {
+            if (this.selectedCall == null) {
                 this.infoViewPort.clear();
             }
 
@@ -1256,21 +1284,22 @@ export class TimeLine extends SVGWidget {
                 pointedElement = pointedElement.previousSibling;
             }
 
-            callIdx = pointedElement.dataset.callIdx;
+            const callIdx = pointedElement.dataset.callIdx;
             if (callIdx === undefined) {
-                callIdx = null;
                 pointedElement = null;
 
                 return;
             }
 
-            if (this.selectedCallIdx != null) {
+            pointedCall = this.renderedCalls[callIdx];
+
+            if (this.selectedCall != null) {
                 return;
             }
 
             pointedElement.setAttribute('stroke', '#0ff');
 
-            this._renderCallInfo(callIdx);
+            this._renderCallInfo(pointedCall);
         });
     }
 
@@ -1285,7 +1314,7 @@ export class TimeLine extends SVGWidget {
     }
 
     onHighlightedFunctionUpdate() {
-        this.selectedCallIdx = null;
+        this.selectedCall = null;
         super.onHighlightedFunctionUpdate();
     }
 
@@ -1299,11 +1328,14 @@ export class TimeLine extends SVGWidget {
         }));
 
         const timeRange = this.viewTimeRange.getTimeRange();
-        const calls = this.profileData.getCalls(
+        const timelineData = this.timelineDataLoader.get(
             timeRange,
             timeRange.length() / this.viewPort.width
         );
 
+        const calls = timelineData != null ? timelineData.getCalls() : [];
+        this.renderedCalls = [];
+
         const viewRange = this.viewTimeRange.getScaledViewRange();
         const offsetX = -viewRange.begin;
         
@@ -1338,7 +1370,7 @@ export class TimeLine extends SVGWidget {
                 y: y,
                 width: w,
                 height: h,
-                stroke: call.getIdx() == this.selectedCallIdx ? '#0ff' : 'none',
+                stroke: this.selectedCall != null && call.isSameAs(this.selectedCall) ? '#0ff' : 'none',
                 'stroke-width': 2,
                 fill: this.functionColorResolver(
                     call.getFunctionName(),
@@ -1348,9 +1380,11 @@ export class TimeLine extends SVGWidget {
                         call.getInc(this.currentMetric)
                     )
                 ),
-                'data-call-idx': call.getIdx(),
+                'data-call-idx': this.renderedCalls.length,
             });
 
+            this.renderedCalls.push(call);
+
             this.viewPort.appendChildToFragment(rect);
 
             if (w > 20) {
@@ -1395,6 +1429,7 @@ export class TimeLine extends SVGWidget {
             renderSVGMetricValuesPlot(
                 overlayViewPort,
                 this.profileData,
+                timelineData,
                 this.currentMetric,
                 timeRange
             );
@@ -1415,13 +1450,12 @@ export class TimeLine extends SVGWidget {
             e.stopPropagation();
         });
 
-        if (this.selectedCallIdx != null) {
-            this._renderCallInfo(this.selectedCallIdx);
+        if (this.selectedCall != null) {
+            this._renderCallInfo(this.selectedCall);
         }
     }
 
-    _renderCallInfo(callIdx) {
-        const call = this.profileData.getCall(callIdx);
+    _renderCallInfo(call) {
         const currentMetricName = this.profileData.getMetricInfo(this.currentMetric).name;
         const formatter = this.profileData.getMetricFormatter(this.currentMetric);
 
@@ -1435,8 +1469,11 @@ export class TimeLine extends SVGWidget {
             [
                 'Function: ' + call.getFunctionName(),
                 'Depth: ' + call.getDepth(),
-                currentMetricName + ' inc.: ' + formatter(call.getInc(this.currentMetric)),
-                currentMetricName + ' exc.: ' + formatter(call.getExc(this.currentMetric)),
+                currentMetricName + ' inc.: ' + (call.isTruncated() ? '≥ ' : '')
+                    + formatter(call.getInc(this.currentMetric)),
+                currentMetricName + ' exc.: ' + (call.getExc(this.currentMetric) != null ?
+                    formatter(call.getExc(this.currentMetric))
+                    : 'n/a'),
             ]
         );
     }
@@ -1525,7 +1562,7 @@ export class FlameGraph extends SVGWidget {
         });
     }
 
-    onTimeRangeUpdate() {
+    onTimeRangeStatsUpdate() {
         this.repaint();
     }
 
@@ -1623,7 +1660,7 @@ export class FlameGraph extends SVGWidget {
 
         const cgRoot = this
             .timeRangeStats
-            .getCallTreeStats(this.timeRange)
+            .getCallTreeStats()
             .getRoot()
         ;
 
@@ -1656,7 +1693,7 @@ export class FlatProfile extends Widget {
         this.sortDir = -1;
     }
 
-    onTimeRangeUpdate() {
+    onTimeRangeStatsUpdate() {
         this.repaint();
     }
 
@@ -9,6 +9,12 @@ PHP_ARG_WITH(zlib-dir, for ZLIB,
 [  --with-zlib-dir[=DIR]   Set the path to ZLIB install prefix.], no)
 fi
 
+PHP_ARG_WITH(spx-zstd, for zstd report compression support,
+[  --with-spx-zstd[=DIR]   Enable zstd report compression, DIR being the zstd install prefix.], no, no)
+
+PHP_ARG_WITH(spx-lz4, for lz4 report compression support,
+[  --with-spx-lz4[=DIR]   Enable lz4 report compression, DIR being the lz4 install prefix.], no, no)
+
 PHP_ARG_WITH(spx-assets-dir, for assets path,
 [  --with-spx-assets-dir[=DIR]   Set the installation path of assets.], $prefix/share/misc/php-spx/assets)
 
@@ -73,19 +79,66 @@ if test "$PHP_SPX" = "yes"; then
         AC_MSG_ERROR([spx support requires ZLIB. Use --with-zlib-dir=<DIR> to specify the prefix where ZLIB headers and library are located])
     fi
 
+    if test "$PHP_SPX_ZSTD" != "no"; then
+        AC_MSG_CHECKING([for zstd location])
+        SPX_ZSTD_DIR=""
+        for i in $PHP_SPX_ZSTD /usr/local /usr /opt/local; do
+            if test -f "$i/include/zstd.h"; then
+                SPX_ZSTD_DIR="$i"
+                break
+            fi
+        done
+
+        if test -z "$SPX_ZSTD_DIR"; then
+            AC_MSG_ERROR([Can't find zstd headers, use --with-spx-zstd=<DIR> to specify the prefix where they are located])
+        fi
+
+        AC_MSG_RESULT([$SPX_ZSTD_DIR])
+        PHP_ADD_LIBRARY_WITH_PATH(zstd, $SPX_ZSTD_DIR/$PHP_LIBDIR, SPX_SHARED_LIBADD)
+        PHP_ADD_INCLUDE($SPX_ZSTD_DIR/include)
+        AC_DEFINE(HAVE_SPX_ZSTD, 1, [zstd report compression support])
+    fi
+
+    if test "$PHP_SPX_LZ4" != "no"; then
+        AC_MSG_CHECKING([for lz4 location])
+        SPX_LZ4_DIR=""
+        for i in $PHP_SPX_LZ4 /usr/local /usr /opt/local; do
+            if test -f "$i/include/lz4frame.h"; then
+                SPX_LZ4_DIR="$i"
+                break
+            fi
+        done
+
+        if test -z "$SPX_LZ4_DIR"; then
+            AC_MSG_ERROR([Can't find lz4 headers, use --with-spx-lz4=<DIR> to specify the prefix where they are located])
+        fi
+
+        AC_MSG_RESULT([$SPX_LZ4_DIR])
+        PHP_ADD_LIBRARY_WITH_PATH(lz4, $SPX_LZ4_DIR/$PHP_LIBDIR, SPX_SHARED_LIBADD)
+        PHP_ADD_INCLUDE($SPX_LZ4_DIR/include)
+        AC_DEFINE(HAVE_SPX_LZ4, 1, [lz4 report compression support])
+    fi
+
     PHP_NEW_EXTENSION(spx,
         src/php_spx.c               \
         src/spx_profiler.c          \
         src/spx_profiler_tracer.c   \
         src/spx_profiler_sampler.c  \
+        src/spx_function_filter.c   \
         src/spx_reporter_full.c     \
         src/spx_reporter_fp.c       \
         src/spx_reporter_trace.c    \
+        src/spx_reporter_pool.c     \
+        src/spx_pool.c              \
         src/spx_metric.c            \
         src/spx_resource_stats.c    \
         src/spx_hmap.c              \
         src/spx_str_builder.c       \
         src/spx_output_stream.c     \
+        src/spx_input_stream.c      \
+        src/spx_async_flusher.c     \
+        src/spx_report_analyzer.c   \
+        src/spx_report_timeline.c   \
         src/spx_php.c               \
         src/spx_stdio.c             \
         src/spx_config.c            \
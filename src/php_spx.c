@@ -17,6 +17,13 @@
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #if ! defined(ZTS) && ! defined(_WIN32)
 #   define USE_SIGNAL
@@ -40,6 +47,10 @@
 #include "spx_reporter_fp.h"
 #include "spx_reporter_full.h"
 #include "spx_reporter_trace.h"
+#include "spx_reporter_pool.h"
+#include "spx_pool.h"
+#include "spx_input_stream.h"
+#include "spx_report_analyzer.h"
 
 typedef struct {
     void (*init) (void);
@@ -54,6 +65,12 @@ static SPX_THREAD_TLS struct {
 
     execution_handler_t * execution_handler;
 
+    struct {
+        /* the process the state has been seeded in, so that forked workers get their own draws */
+        pid_t pid;
+        unsigned short state[3];
+    } request_sampling;
+
     struct {
 #ifdef USE_SIGNAL
         struct {
@@ -61,27 +78,48 @@ static SPX_THREAD_TLS struct {
             struct {
                 struct sigaction sigint;
                 struct sigaction sigterm;
+                struct sigaction snapshot;
             } prev_handler;
 
             volatile sig_atomic_t handler_called;
             volatile sig_atomic_t probing;
             volatile sig_atomic_t stop;
             int signo;
+
+            int snapshot_handler_set;
+            void * snapshot_interrupt_handle;
+            volatile sig_atomic_t snapshot;
         } sig_handling;
 #endif
 
         char full_report_key[512];
         spx_profiler_reporter_t * reporter;
+        spx_function_filter_t * filter;
         spx_profiler_t * profiler;
+        spx_profiler_t * async_sampler;
         spx_php_function_t stack[STACK_CAPACITY];
         size_t depth;
         size_t span_depth;
+
+        struct {
+            /* whether a threshold or a snapshot signal can trigger a switch to the next segment */
+            int enabled;
+            /* set while switching to the next segment, so that the hooks it triggers do not roll again */
+            int active;
+            size_t started_at;
+            /* the last persisted segment of the current rolling profile */
+            char previous_key[512];
+        } rolling;
     } profiling_handler;
 } context;
 
+/* shared by all threads & forked processes */
+static spx_pool_t * pool;
+
 ZEND_BEGIN_MODULE_GLOBALS(spx)
     zend_bool debug;
     const char * data_dir;
+    zend_bool pool_enabled;
     zend_bool http_enabled;
     const char * http_key;
     const char * http_ip_var;
@@ -89,11 +127,29 @@ ZEND_BEGIN_MODULE_GLOBALS(spx)
     const char * http_ip_whitelist;
     const char * http_ui_assets_dir;
     const char * http_profiling_enabled;
+    const char * http_profiling_report;
+    double http_profiling_sample_rate;
+    const char * http_profiling_sample_uri_rates;
     const char * http_profiling_auto_start;
     const char * http_profiling_builtins;
     const char * http_profiling_sampling_period;
+    const char * http_profiling_sampling_async;
     const char * http_profiling_depth;
     const char * http_profiling_metrics;
+    const char * http_profiling_compression;
+    const char * http_profiling_compression_level;
+    const char * http_profiling_compression_long;
+    const char * http_profiling_buffer_size;
+    const char * http_profiling_tail;
+    const char * http_profiling_tail_min_wall_time;
+    const char * http_profiling_tail_min_peak_memory;
+    const char * http_profiling_tail_errors;
+    const char * http_profiling_full_min_duration;
+    const char * http_profiling_demote_calls;
+    const char * http_profiling_demote_max_wall_time;
+    const char * http_profiling_demote_measure;
+    const char * http_profiling_filter_include;
+    const char * http_profiling_filter_exclude;
 ZEND_END_MODULE_GLOBALS(spx)
 
 ZEND_DECLARE_MODULE_GLOBALS(spx)
@@ -113,6 +169,10 @@ PHP_INI_BEGIN()
         "spx.data_dir", "/tmp/spx", PHP_INI_SYSTEM,
         OnUpdateString, data_dir, zend_spx_globals, spx_globals
     )
+    STD_PHP_INI_ENTRY(
+        "spx.pool_enabled", "0", PHP_INI_SYSTEM,
+        OnUpdateBool, pool_enabled, zend_spx_globals, spx_globals
+    )
     STD_PHP_INI_ENTRY(
         "spx.http_enabled", "0", PHP_INI_SYSTEM,
         OnUpdateBool, http_enabled, zend_spx_globals, spx_globals
@@ -141,6 +201,18 @@ PHP_INI_BEGIN()
         "spx.http_profiling_enabled", NULL, PHP_INI_SYSTEM,
         OnUpdateString, http_profiling_enabled, zend_spx_globals, spx_globals
     )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_sample_rate", "0", PHP_INI_SYSTEM,
+        OnUpdateReal, http_profiling_sample_rate, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_sample_uri_rates", "", PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_sample_uri_rates, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_report", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_report, zend_spx_globals, spx_globals
+    )
     STD_PHP_INI_ENTRY(
         "spx.http_profiling_auto_start", NULL, PHP_INI_SYSTEM,
         OnUpdateString, http_profiling_auto_start, zend_spx_globals, spx_globals
@@ -153,6 +225,10 @@ PHP_INI_BEGIN()
         "spx.http_profiling_sampling_period", NULL, PHP_INI_SYSTEM,
         OnUpdateString, http_profiling_sampling_period, zend_spx_globals, spx_globals
     )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_sampling_async", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_sampling_async, zend_spx_globals, spx_globals
+    )
     STD_PHP_INI_ENTRY(
         "spx.http_profiling_depth", NULL, PHP_INI_SYSTEM,
         OnUpdateString, http_profiling_depth, zend_spx_globals, spx_globals
@@ -161,6 +237,62 @@ PHP_INI_BEGIN()
         "spx.http_profiling_metrics", NULL, PHP_INI_SYSTEM,
         OnUpdateString, http_profiling_metrics, zend_spx_globals, spx_globals
     )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_compression", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_compression, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_compression_level", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_compression_level, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_compression_long", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_compression_long, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_buffer_size", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_buffer_size, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_tail", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_tail, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_tail_min_wall_time", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_tail_min_wall_time, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_tail_min_peak_memory", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_tail_min_peak_memory, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_tail_errors", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_tail_errors, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_full_min_duration", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_full_min_duration, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_demote_calls", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_demote_calls, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_demote_max_wall_time", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_demote_max_wall_time, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_demote_measure", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_demote_measure, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_filter_include", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_filter_include, zend_spx_globals, spx_globals
+    )
+    STD_PHP_INI_ENTRY(
+        "spx.http_profiling_filter_exclude", NULL, PHP_INI_SYSTEM,
+        OnUpdateString, http_profiling_filter_exclude, zend_spx_globals, spx_globals
+    )
 PHP_INI_END()
 
 static PHP_MINIT_FUNCTION(spx);
@@ -171,8 +303,11 @@ static PHP_MINFO_FUNCTION(spx);
 static PHP_FUNCTION(spx_profiler_start);
 static PHP_FUNCTION(spx_profiler_stop);
 static PHP_FUNCTION(spx_profiler_full_report_set_custom_metadata_str);
+static PHP_FUNCTION(spx_profiler_full_report_keep);
 
 static int check_access(void);
+static int sample_request(void);
+static double sample_request_uri_rate(const char * uri, const char * uri_rates, double rate);
 
 static void profiling_handler_init(void);
 static void profiling_handler_shutdown(void);
@@ -182,11 +317,17 @@ static void profiling_handler_ex_set_context(void);
 static void profiling_handler_ex_unset_context(void);
 static void profiling_handler_ex_hook_before(void);
 static void profiling_handler_ex_hook_after(void);
+static void profiling_handler_rolling_check(void);
+static void profiling_handler_roll(void);
+static void profiling_handler_interrupt_handler(void);
 #ifdef USE_SIGNAL
 static void profiling_handler_sig_terminate(void);
 static void profiling_handler_sig_handler(int signo);
 static void profiling_handler_sig_set_handler(void);
 static void profiling_handler_sig_unset_handler(void);
+static void profiling_handler_sig_snapshot_handler(int signo);
+static void profiling_handler_sig_set_snapshot_handler(void);
+static void profiling_handler_sig_unset_snapshot_handler(void);
 #endif
 
 static void http_ui_handler_init(void);
@@ -194,6 +335,25 @@ static void http_ui_handler_shutdown(void);
 static int  http_ui_handler_data(const char * data_dir, const char *relative_path);
 static void http_ui_handler_list_metadata_files_callback(const char * file_name, size_t count);
 static int  http_ui_handler_output_file(const char * file_name);
+static int  http_ui_handler_output_report_file(const char * file_name);
+static int  http_ui_handler_output_pool(int reset);
+static int  http_ui_handler_output_report_analysis(
+    const char * data_dir,
+    const char * key,
+    spx_report_analyzer_query_type_t type
+);
+static size_t http_ui_handler_output_report_analysis_write(void * arg, const void * ptr, size_t len);
+static void http_ui_handler_file_validators(
+    const struct stat * file_stat,
+    char * etag,
+    size_t etag_size,
+    char * last_modified,
+    size_t last_modified_size
+);
+static int  http_ui_handler_not_modified(const char * etag, const char * last_modified);
+static int  http_ui_handler_parse_range(const char * range, size_t size, size_t * first, size_t * last);
+static void http_ui_handler_output_fd_content(int fd, size_t offset, size_t length);
+static void http_ui_handler_write_all(const char * ptr, size_t length);
 
 static void read_stream_content(FILE * stream, size_t (*callback) (const void * ptr, size_t len));
 
@@ -221,10 +381,14 @@ ZEND_BEGIN_ARG_INFO_EX(arginfo_spx_profiler_full_report_set_custom_metadata_str,
 #endif
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(arginfo_spx_profiler_full_report_keep, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
 static zend_function_entry spx_functions[] = {
     PHP_FE(spx_profiler_start, arginfo_spx_profiler_start)
     PHP_FE(spx_profiler_stop, arginfo_spx_profiler_stop)
     PHP_FE(spx_profiler_full_report_set_custom_metadata_str, arginfo_spx_profiler_full_report_set_custom_metadata_str)
+    PHP_FE(spx_profiler_full_report_keep, arginfo_spx_profiler_full_report_keep)
     PHP_FE_END
 };
 
@@ -251,12 +415,19 @@ ZEND_GET_MODULE(spx)
 
 static PHP_MINIT_FUNCTION(spx)
 {
+    spx_php_global_hooks_register();
+
 #ifdef ZTS
     spx_php_global_hooks_set();
 #endif
 
     REGISTER_INI_ENTRIES();
 
+    if (SPX_G(pool_enabled)) {
+        /* created before any fork so that all the workers share it */
+        pool = spx_pool_create();
+    }
+
     return SUCCESS;
 }
 
@@ -268,14 +439,21 @@ static PHP_MSHUTDOWN_FUNCTION(spx)
 
     UNREGISTER_INI_ENTRIES();
 
+    if (pool) {
+        spx_pool_destroy(pool);
+        pool = NULL;
+    }
+
     return SUCCESS;
 }
 
 static PHP_RINIT_FUNCTION(spx)
 {
-#ifdef ZTS
+    /*
+        Global hooks are enabled back by the execution handler when needed, this also applies
+        to the function call observer which is registered whatever the thread model.
+    */
     spx_php_global_hooks_disable();
-#endif
 
     context.execution_handler = NULL;
     context.cli_sapi = spx_php_is_cli_sapi();
@@ -308,6 +486,10 @@ static PHP_RINIT_FUNCTION(spx)
                 SPX_CONFIG_SOURCE_INI,
                 -1
             );
+
+            if (!context.config.enabled && !context.config.ui_uri && sample_request()) {
+                context.config.enabled = 1;
+            }
         }
     }
 
@@ -355,8 +537,68 @@ static PHP_MINFO_FUNCTION(spx)
     php_info_print_table_row(2, PHP_SPX_EXTNAME " Support", "enabled");
     php_info_print_table_row(2, PHP_SPX_EXTNAME " Version", PHP_SPX_VERSION);
 
+    char codecs[64] = "";
+    int codec;
+    for (codec = 0; codec < SPX_OUTPUT_STREAM_CODEC_COUNT; codec++) {
+        if (!spx_output_stream_codec_available(codec)) {
+            continue;
+        }
+
+        snprintf(
+            codecs + strlen(codecs),
+            sizeof(codecs) - strlen(codecs),
+            "%s%s",
+            codecs[0] ? ", " : "",
+            spx_output_stream_codec_key(codec)
+        );
+    }
+
+    php_info_print_table_row(2, "Report compression codecs", codecs);
+    php_info_print_table_row(2, "Pool profile", pool ? "enabled" : "disabled");
+
     php_info_print_table_end();
 
+    spx_profiler_tracer_calibration_t calibrations[SPX_PROFILER_TRACER_CALIBRATION_CACHE_SIZE];
+    const size_t calibration_count = spx_profiler_tracer_get_calibrations(
+        calibrations,
+        sizeof(calibrations) / sizeof(*calibrations)
+    );
+
+    if (calibration_count > 0) {
+        php_info_print_table_start();
+        php_info_print_table_header(2, "Tracer calibration (metrics)", "Call start / end noise");
+
+        size_t i;
+        for (i = 0; i < calibration_count; i++) {
+            char metrics[256] = "";
+            SPX_METRIC_FOREACH(j, {
+                if (!calibrations[i].enabled_metrics[j]) {
+                    continue;
+                }
+
+                if (metrics[0]) {
+                    strncat(metrics, ",", sizeof(metrics) - strlen(metrics) - 1);
+                }
+
+                strncat(metrics, spx_metric_info[j].key, sizeof(metrics) - strlen(metrics) - 1);
+            });
+
+            char noise[128];
+            snprintf(
+                noise,
+                sizeof(noise),
+                "%.0f ns / %.0f ns (%zu s ago)",
+                calibrations[i].call_start_noise,
+                calibrations[i].call_end_noise,
+                calibrations[i].age_s
+            );
+
+            php_info_print_table_row(2, metrics, noise);
+        }
+
+        php_info_print_table_end();
+    }
+
     DISPLAY_INI_ENTRIES();
 }
 
@@ -492,6 +734,88 @@ static PHP_FUNCTION(spx_profiler_full_report_set_custom_metadata_str)
     );
 }
 
+static PHP_FUNCTION(spx_profiler_full_report_keep)
+{
+    if (context.config.report != SPX_CONFIG_REPORT_FULL) {
+        spx_php_log_notice(
+            "spx_profiler_full_report_keep(): `full` report required"
+        );
+
+        return;
+    }
+
+    if (!context.profiling_handler.reporter) {
+        return;
+    }
+
+    spx_reporter_full_keep(context.profiling_handler.reporter);
+}
+
+static int sample_request(void)
+{
+    TSRMLS_FETCH();
+
+    double rate = SPX_G(http_profiling_sample_rate);
+
+    const char * uri_rates = SPX_G(http_profiling_sample_uri_rates);
+    if (uri_rates && uri_rates[0]) {
+        const char * uri = spx_php_global_array_get("_SERVER", "REQUEST_URI");
+        if (uri) {
+            rate = sample_request_uri_rate(uri, uri_rates, rate);
+        }
+    }
+
+    if (rate <= 0) {
+        return 0;
+    }
+
+    const pid_t pid = getpid();
+    if (context.request_sampling.pid != pid) {
+        const uint64_t seed = (uint64_t) time(NULL) ^ ((uint64_t) pid << 16) ^ (uintptr_t) &context;
+
+        context.request_sampling.pid = pid;
+        context.request_sampling.state[0] = seed;
+        context.request_sampling.state[1] = seed >> 16;
+        context.request_sampling.state[2] = seed >> 32;
+    }
+
+    return erand48(context.request_sampling.state) < rate;
+}
+
+static double sample_request_uri_rate(const char * uri, const char * uri_rates, double rate)
+{
+    /* uri_rates is a comma separated list of "<URI prefix>=<rate>", the longest matching prefix wins */
+    size_t matched_len = 0;
+    const char * entry = uri_rates;
+
+    while (*entry) {
+        const char * end = strchr(entry, ',');
+        if (!end) {
+            end = entry + strlen(entry);
+        }
+
+        const char * separator = memchr(entry, '=', end - entry);
+        if (separator) {
+            const size_t prefix_len = separator - entry;
+            if (
+                prefix_len >= matched_len
+                && strncmp(uri, entry, prefix_len) == 0
+            ) {
+                matched_len = prefix_len;
+                rate = strtod(separator + 1, NULL);
+            }
+        }
+
+        if (!*end) {
+            break;
+        }
+
+        entry = end + 1;
+    }
+
+    return rate;
+}
+
 static int check_access(void)
 {
     TSRMLS_FETCH();
@@ -612,16 +936,32 @@ static void profiling_handler_init(void)
     context.profiling_handler.sig_handling.stop = 0;
     context.profiling_handler.sig_handling.handler_called = 0;
     context.profiling_handler.sig_handling.signo = -1;
+    context.profiling_handler.sig_handling.snapshot_handler_set = 0;
+    context.profiling_handler.sig_handling.snapshot_interrupt_handle = NULL;
+    context.profiling_handler.sig_handling.snapshot = 0;
 #endif
 
     profiling_handler_ex_set_context();
 
     context.profiling_handler.full_report_key[0] = 0;
     context.profiling_handler.reporter = NULL;
+    context.profiling_handler.filter = NULL;
     context.profiling_handler.profiler = NULL;
+    context.profiling_handler.async_sampler = NULL;
     context.profiling_handler.depth = 0;
     context.profiling_handler.span_depth = 0;
 
+    context.profiling_handler.rolling.enabled =
+        context.config.rolling_period > 0
+        || context.config.rolling_calls > 0
+        || context.config.rolling_size > 0
+        || context.config.snapshot_signal > 0
+    ;
+
+    context.profiling_handler.rolling.active = 0;
+    context.profiling_handler.rolling.started_at = 0;
+    context.profiling_handler.rolling.previous_key[0] = 0;
+
     if (context.config.auto_start) {
         profiling_handler_start();
     }
@@ -647,7 +987,13 @@ static void profiling_handler_start(void)
     switch (context.config.report) {
         default:
         case SPX_CONFIG_REPORT_FULL:
-            context.profiling_handler.reporter = spx_reporter_full_create(SPX_G(data_dir));
+            context.profiling_handler.reporter = spx_reporter_full_create(
+                SPX_G(data_dir),
+                &context.config.compression,
+                context.config.buffer_size,
+                &context.config.tail,
+                context.config.full_min_duration
+            );
             if (context.profiling_handler.reporter) {
                 snprintf(
                     context.profiling_handler.full_report_key,
@@ -674,9 +1020,22 @@ static void profiling_handler_start(void)
         case SPX_CONFIG_REPORT_TRACE:
             context.profiling_handler.reporter = spx_reporter_trace_create(
                 context.config.trace_file,
-                context.config.trace_safe
+                context.config.trace_safe,
+                &context.config.compression,
+                context.config.buffer_size
             );
 
+            break;
+
+        case SPX_CONFIG_REPORT_POOL:
+            if (!pool) {
+                spx_php_log_notice("`pool` report requires spx.pool_enabled to be set");
+
+                break;
+            }
+
+            context.profiling_handler.reporter = spx_reporter_pool_create(pool);
+
             break;
     }
 
@@ -684,9 +1043,22 @@ static void profiling_handler_start(void)
         goto error;
     }
 
+    if (context.config.filter_include || context.config.filter_exclude) {
+        context.profiling_handler.filter = spx_function_filter_create(
+            context.config.filter_include,
+            context.config.filter_exclude
+        );
+
+        if (!context.profiling_handler.filter) {
+            goto error;
+        }
+    }
+
     context.profiling_handler.profiler = spx_profiler_tracer_create(
         context.config.max_depth,
         context.config.enabled_metrics,
+        context.profiling_handler.filter,
+        &context.config.demotion,
         context.profiling_handler.reporter
     );
 
@@ -695,16 +1067,33 @@ static void profiling_handler_start(void)
     }
 
     if (context.config.sampling_period > 0) {
-        spx_profiler_t * sampling_profiler = spx_profiler_sampler_create(
-            context.profiling_handler.profiler,
-            context.config.sampling_period
-        );
+        spx_profiler_t * sampling_profiler;
+        if (context.config.sampling_async) {
+            sampling_profiler = spx_profiler_sampler_create_async(
+                context.profiling_handler.profiler,
+                context.config.sampling_period,
+                spx_php_execution_interrupt,
+                spx_php_execution_interrupt_handle()
+            );
+        } else {
+            sampling_profiler = spx_profiler_sampler_create(
+                context.profiling_handler.profiler,
+                context.config.sampling_period
+            );
+        }
 
         if (!sampling_profiler) {
             goto error;
         }
 
         context.profiling_handler.profiler = sampling_profiler;
+        if (context.config.sampling_async) {
+            context.profiling_handler.async_sampler = sampling_profiler;
+        }
+    }
+
+    if (context.profiling_handler.rolling.enabled) {
+        context.profiling_handler.rolling.started_at = spx_resource_stats_wall_time();
     }
 
     return;
@@ -721,12 +1110,31 @@ static void profiling_handler_stop(void)
         context.profiling_handler.profiler->finalize(context.profiling_handler.profiler);
         context.profiling_handler.profiler->destroy(context.profiling_handler.profiler);
         context.profiling_handler.profiler = NULL;
+        context.profiling_handler.async_sampler = NULL;
     }
 
     if (context.profiling_handler.reporter) {
+        if (
+            context.config.report == SPX_CONFIG_REPORT_FULL
+            && !spx_reporter_full_is_kept(context.profiling_handler.reporter)
+        ) {
+            /* discarded tail mode report */
+            context.profiling_handler.full_report_key[0] = 0;
+        }
+
         spx_profiler_reporter_destroy(context.profiling_handler.reporter);
         context.profiling_handler.reporter = NULL;
     }
+
+    if (context.profiling_handler.filter) {
+        spx_function_filter_destroy(context.profiling_handler.filter);
+        context.profiling_handler.filter = NULL;
+    }
+
+    if (!context.profiling_handler.rolling.active) {
+        /* the next start begins a new rolling profile */
+        context.profiling_handler.rolling.previous_key[0] = 0;
+    }
 }
 
 static void profiling_handler_ex_set_context(void)
@@ -737,18 +1145,31 @@ static void profiling_handler_ex_set_context(void)
 
     spx_php_execution_init();
 
-    spx_php_execution_hook(
-        profiling_handler_ex_hook_before,
-        profiling_handler_ex_hook_after,
-        0
-    );
-
-    if (context.config.builtins) {
+    if (context.config.sampling_async) {
+        /*
+         *  The call stack is only walked when a sample is requested, the call path
+         *  is thus left unhooked.
+         */
+        spx_php_execution_interrupt_hook(profiling_handler_interrupt_handler);
+    } else {
         spx_php_execution_hook(
             profiling_handler_ex_hook_before,
             profiling_handler_ex_hook_after,
-            1
+            0
         );
+
+        if (context.config.builtins) {
+            spx_php_execution_hook(
+                profiling_handler_ex_hook_before,
+                profiling_handler_ex_hook_after,
+                1
+            );
+        }
+
+        if (context.config.snapshot_signal) {
+            /* so that a snapshot is not delayed until the next function call end */
+            spx_php_execution_interrupt_hook(profiling_handler_interrupt_handler);
+        }
     }
 
     spx_resource_stats_init();
@@ -757,6 +1178,10 @@ static void profiling_handler_ex_set_context(void)
     if (context.cli_sapi && context.config.auto_start) {
         profiling_handler_sig_set_handler();
     }
+
+    if (context.cli_sapi && context.config.snapshot_signal) {
+        profiling_handler_sig_set_snapshot_handler();
+    }
 #endif
 }
 
@@ -766,6 +1191,8 @@ static void profiling_handler_ex_unset_context(void)
     if (context.cli_sapi && context.config.auto_start) {
         profiling_handler_sig_unset_handler();
     }
+
+    profiling_handler_sig_unset_snapshot_handler();
 #endif
 
     spx_resource_stats_shutdown();
@@ -831,6 +1258,49 @@ static void profiling_handler_ex_hook_after(void)
 
     context.profiling_handler.profiler->call_end(context.profiling_handler.profiler);
 
+    if (context.profiling_handler.rolling.enabled) {
+        profiling_handler_rolling_check();
+    }
+
+#ifdef USE_SIGNAL
+    context.profiling_handler.sig_handling.probing = 0;
+    if (context.profiling_handler.sig_handling.stop) {
+        profiling_handler_sig_terminate();
+    }
+#endif
+}
+
+static void profiling_handler_interrupt_handler(void)
+{
+    if (
+        !context.profiling_handler.async_sampler
+        && !context.profiling_handler.rolling.enabled
+    ) {
+        return;
+    }
+
+#ifdef USE_SIGNAL
+    context.profiling_handler.sig_handling.probing = 1;
+#endif
+
+    if (context.profiling_handler.async_sampler) {
+        const size_t depth = spx_php_execution_stack(
+            context.profiling_handler.stack,
+            STACK_CAPACITY,
+            context.config.builtins
+        );
+
+        spx_profiler_sampler_sample_stack(
+            context.profiling_handler.async_sampler,
+            context.profiling_handler.stack,
+            depth
+        );
+    }
+
+    if (context.profiling_handler.rolling.enabled) {
+        profiling_handler_rolling_check();
+    }
+
 #ifdef USE_SIGNAL
     context.profiling_handler.sig_handling.probing = 0;
     if (context.profiling_handler.sig_handling.stop) {
@@ -839,6 +1309,136 @@ static void profiling_handler_ex_hook_after(void)
 #endif
 }
 
+static void profiling_handler_rolling_check(void)
+{
+    if (context.profiling_handler.rolling.active) {
+        return;
+    }
+
+#ifdef USE_SIGNAL
+    /* a snapshot requested while not profiling is simply ignored */
+    const int snapshot = context.profiling_handler.sig_handling.snapshot;
+    context.profiling_handler.sig_handling.snapshot = 0;
+#endif
+
+    if (!context.profiling_handler.reporter) {
+        return;
+    }
+
+#ifdef USE_SIGNAL
+    if (snapshot) {
+        /* an explicitly requested snapshot is never discarded in tail mode */
+        spx_reporter_full_keep(context.profiling_handler.reporter);
+        profiling_handler_roll();
+
+        if (context.profiling_handler.rolling.previous_key[0]) {
+            spx_php_log_notice("snapshot saved as %s", context.profiling_handler.rolling.previous_key);
+        }
+
+        return;
+    }
+#endif
+
+    if (
+        context.config.rolling_calls > 0
+        && spx_reporter_full_get_call_count(context.profiling_handler.reporter)
+            >= context.config.rolling_calls
+    ) {
+        goto roll;
+    }
+
+    if (
+        context.config.rolling_size > 0
+        && spx_reporter_full_get_recorded_size(context.profiling_handler.reporter)
+            >= context.config.rolling_size * 1024 * 1024
+    ) {
+        goto roll;
+    }
+
+    if (
+        context.config.rolling_period > 0
+        && spx_resource_stats_wall_time() - context.profiling_handler.rolling.started_at
+            >= context.config.rolling_period * 1000 * 1000 * 1000
+    ) {
+        goto roll;
+    }
+
+    return;
+
+roll:
+    profiling_handler_roll();
+}
+
+static void profiling_handler_roll(void)
+{
+    /*
+        The current segment is finalized with its running calls ended at the current time,
+        then these calls are started again in the next segment so that its call tree
+        remains rooted as the actual call stack.
+    */
+
+    context.profiling_handler.rolling.active = 1;
+
+    char * custom_metadata_str = NULL;
+    const char * current_custom_metadata_str = spx_reporter_full_get_custom_metadata_str(
+        context.profiling_handler.reporter
+    );
+
+    if (current_custom_metadata_str) {
+        custom_metadata_str = strdup(current_custom_metadata_str);
+    }
+
+    profiling_handler_stop();
+
+    if (context.profiling_handler.full_report_key[0]) {
+        /* a segment discarded in tail mode is skipped by the link */
+        snprintf(
+            context.profiling_handler.rolling.previous_key,
+            sizeof(context.profiling_handler.rolling.previous_key),
+            "%s",
+            context.profiling_handler.full_report_key
+        );
+    }
+
+    profiling_handler_start();
+
+    if (!context.profiling_handler.profiler) {
+        goto end;
+    }
+
+    if (context.profiling_handler.rolling.previous_key[0]) {
+        spx_reporter_full_set_previous_key(
+            context.profiling_handler.reporter,
+            context.profiling_handler.rolling.previous_key
+        );
+    }
+
+    if (custom_metadata_str) {
+        spx_reporter_full_set_custom_metadata_str(
+            context.profiling_handler.reporter,
+            custom_metadata_str
+        );
+    }
+
+    if (context.profiling_handler.async_sampler) {
+        /* the whole stack will be sampled again at the next period */
+        goto end;
+    }
+
+    size_t i;
+    for (i = 0; i < context.profiling_handler.depth; i++) {
+        context.profiling_handler.profiler->call_start(
+            context.profiling_handler.profiler,
+            &context.profiling_handler.stack[i]
+        );
+    }
+
+end:
+    free(custom_metadata_str);
+
+    context.profiling_handler.rolling.active = 0;
+}
+
 #ifdef USE_SIGNAL
 static void profiling_handler_sig_terminate(void)
 {
@@ -892,6 +1492,60 @@ static void profiling_handler_sig_unset_handler(void)
 
     context.profiling_handler.sig_handling.handler_set = 0;
 }
+
+static void profiling_handler_sig_snapshot_handler(int signo)
+{
+    /*
+        The snapshot itself is taken at the next safe point, i.e. at the next function call
+        end or VM interrupt, the latter being requested right away when supported.
+    */
+    context.profiling_handler.sig_handling.snapshot = 1;
+
+    if (context.profiling_handler.sig_handling.snapshot_interrupt_handle) {
+        spx_php_execution_interrupt(context.profiling_handler.sig_handling.snapshot_interrupt_handle);
+    }
+}
+
+static void profiling_handler_sig_set_snapshot_handler(void)
+{
+    struct sigaction act;
+
+    act.sa_handler = profiling_handler_sig_snapshot_handler;
+    sigemptyset(&act.sa_mask);
+    /* the profiled process is not supposed to notice the snapshot, even while blocked in a syscall */
+    act.sa_flags = SA_RESTART;
+
+    context.profiling_handler.sig_handling.snapshot_interrupt_handle = spx_php_execution_interrupt_handle();
+
+    if (
+        sigaction(
+            context.config.snapshot_signal,
+            &act,
+            &context.profiling_handler.sig_handling.prev_handler.snapshot
+        ) != 0
+    ) {
+        spx_php_log_notice("cannot handle the snapshot signal, snapshots are disabled");
+
+        return;
+    }
+
+    context.profiling_handler.sig_handling.snapshot_handler_set = 1;
+}
+
+static void profiling_handler_sig_unset_snapshot_handler(void)
+{
+    if (!context.profiling_handler.sig_handling.snapshot_handler_set) {
+        return;
+    }
+
+    sigaction(
+        context.config.snapshot_signal,
+        &context.profiling_handler.sig_handling.prev_handler.snapshot,
+        NULL
+    );
+
+    context.profiling_handler.sig_handling.snapshot_handler_set = 0;
+}
 #endif /* defined(USE_SIGNAL) */
 
 static void http_ui_handler_init(void)
@@ -1059,9 +1713,56 @@ static int http_ui_handler_data(const char * data_dir, const char *relative_path
             return -1;
         }
 
+        return http_ui_handler_output_report_file(file_name);
+    }
+
+    const char * get_report_timeline_uri = "/data/reports/timeline/";
+    if (spx_utils_str_starts_with(relative_path, get_report_timeline_uri)) {
+        char file_name[PATH_MAX];
+        if (
+            spx_reporter_full_build_timeline_file_name(
+                data_dir,
+                relative_path + strlen(get_report_timeline_uri) - 1,
+                file_name,
+                sizeof(file_name)
+            ) == NULL
+        ) {
+            return -1;
+        }
+
+        /* served as is, the UI fetching only the tiles it needs through range requests */
         return http_ui_handler_output_file(file_name);
     }
 
+    if (0 == strcmp(relative_path, "/data/pool")) {
+        return http_ui_handler_output_pool(0);
+    }
+
+    if (0 == strcmp(relative_path, "/data/pool/reset")) {
+        return http_ui_handler_output_pool(1);
+    }
+
+    static const struct {
+        const char * uri;
+        spx_report_analyzer_query_type_t type;
+    } analysis_uris[] = {
+        {"/data/reports/flat-profile/",     SPX_REPORT_ANALYZER_QUERY_FLAT_PROFILE},
+        {"/data/reports/call-tree/",        SPX_REPORT_ANALYZER_QUERY_CALL_TREE},
+        {"/data/reports/time-range-stats/", SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS},
+        {"/data/reports/calls/",            SPX_REPORT_ANALYZER_QUERY_CALLS},
+    };
+
+    size_t i;
+    for (i = 0; i < sizeof(analysis_uris) / sizeof(analysis_uris[0]); i++) {
+        if (spx_utils_str_starts_with(relative_path, analysis_uris[i].uri)) {
+            return http_ui_handler_output_report_analysis(
+                data_dir,
+                relative_path + strlen(analysis_uris[i].uri) - 1,
+                analysis_uris[i].type
+            );
+        }
+    }
+
     return -1;
 }
 
@@ -1082,11 +1783,20 @@ static void http_ui_handler_list_metadata_files_callback(const char * file_name,
 
 static int http_ui_handler_output_file(const char * file_name)
 {
-    FILE * fp = fopen(file_name, "rb");
-    if (!fp) {
+    const int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
         return -1;
     }
 
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        close(fd);
+
+        return -1;
+    }
+
+    const size_t file_size = file_stat.st_size;
+
     char suffix[32];
     int suffix_offset = strlen(file_name) - (sizeof(suffix) - 1);
     snprintf(
@@ -1112,24 +1822,406 @@ static int http_ui_handler_output_file(const char * file_name)
         content_type = "application/json";
     }
 
-    spx_php_output_add_header_line("HTTP/1.1 200 OK");
+    char etag[64];
+    char last_modified[64];
+    http_ui_handler_file_validators(&file_stat, etag, sizeof(etag), last_modified, sizeof(last_modified));
+
+    if (http_ui_handler_not_modified(etag, last_modified)) {
+        close(fd);
+
+        return 0;
+    }
+
+    size_t first = 0;
+    size_t last = file_size - 1;
+    int range = 0;
+
+    const char * range_str = spx_php_global_array_get("_SERVER", "HTTP_RANGE");
+    const char * if_range_str = spx_php_global_array_get("_SERVER", "HTTP_IF_RANGE");
+    if (
+        range_str
+        && (
+            !if_range_str
+            || 0 == strcmp(if_range_str, etag)
+            || 0 == strcmp(if_range_str, last_modified)
+        )
+    ) {
+        range = http_ui_handler_parse_range(range_str, file_size, &first, &last);
+    }
+
+    if (range < 0) {
+        close(fd);
+
+        spx_php_output_add_header_line("HTTP/1.1 416 Range Not Satisfiable");
+        spx_php_output_add_header_linef("Content-Range: bytes */%zu", file_size);
+        spx_php_output_send_headers();
+
+        return 0;
+    }
+
+    if (range) {
+        spx_php_output_add_header_line("HTTP/1.1 206 Partial Content");
+        spx_php_output_add_header_linef("Content-Range: bytes %zu-%zu/%zu", first, last, file_size);
+    } else {
+        spx_php_output_add_header_line("HTTP/1.1 200 OK");
+    }
+
     spx_php_output_add_header_linef("Content-Type: %s", content_type);
     if (compressed) {
         spx_php_output_add_header_line("Content-Encoding: gzip");
     }
 
-    fseek(fp, 0L, SEEK_END);
-    spx_php_output_add_header_linef("Content-Length: %ld", ftell(fp));
-    rewind(fp);
+    spx_php_output_add_header_line("Accept-Ranges: bytes");
+    spx_php_output_add_header_linef("ETag: %s", etag);
+    spx_php_output_add_header_linef("Last-Modified: %s", last_modified);
+    /* cached copies are revalidated through the above validators */
+    spx_php_output_add_header_line("Cache-Control: no-cache");
+
+    const size_t length = file_size == 0 ? 0 : last - first + 1;
+    spx_php_output_add_header_linef("Content-Length: %zu", length);
 
     spx_php_output_send_headers();
 
-    read_stream_content(fp, spx_php_output_direct_write);
-    fclose(fp);
+    const char * request_method = spx_php_global_array_get("_SERVER", "REQUEST_METHOD");
+    if (!request_method || 0 != strcmp(request_method, "HEAD")) {
+        http_ui_handler_output_fd_content(fd, first, length);
+    }
+
+    close(fd);
 
     return 0;
 }
 
+static void http_ui_handler_file_validators(
+    const struct stat * file_stat,
+    char * etag,
+    size_t etag_size,
+    char * last_modified,
+    size_t last_modified_size
+) {
+    snprintf(
+        etag,
+        etag_size,
+        "\"%lx-%lx-%lx\"",
+        (unsigned long) file_stat->st_ino,
+        (unsigned long) file_stat->st_size,
+        (unsigned long) file_stat->st_mtime
+    );
+
+    struct tm tm;
+    strftime(
+        last_modified,
+        last_modified_size,
+        "%a, %d %b %Y %H:%M:%S GMT",
+        gmtime_r(&file_stat->st_mtime, &tm)
+    );
+}
+
+static int http_ui_handler_not_modified(const char * etag, const char * last_modified)
+{
+    const char * if_none_match = spx_php_global_array_get("_SERVER", "HTTP_IF_NONE_MATCH");
+    const char * if_modified_since = spx_php_global_array_get("_SERVER", "HTTP_IF_MODIFIED_SINCE");
+
+    int not_modified = 0;
+    if (if_none_match) {
+        /* If-None-Match takes precedence over If-Modified-Since */
+        not_modified = 0 == strcmp(if_none_match, "*") || strstr(if_none_match, etag) != NULL;
+    } else if (if_modified_since) {
+        /* browsers send back the exact Last-Modified value */
+        not_modified = 0 == strcmp(if_modified_since, last_modified);
+    }
+
+    if (!not_modified) {
+        return 0;
+    }
+
+    spx_php_output_add_header_line("HTTP/1.1 304 Not Modified");
+    spx_php_output_add_header_linef("ETag: %s", etag);
+    spx_php_output_add_header_linef("Last-Modified: %s", last_modified);
+    spx_php_output_add_header_line("Cache-Control: no-cache");
+    spx_php_output_send_headers();
+
+    return 1;
+}
+
+/*
+ *  Returns 1 and fills first & last for a satisfiable single byte range, -1 for an
+ *  unsatisfiable one, and 0 when the range must be ignored (i.e. the whole file is
+ *  served), which is notably the case of multiple ranges.
+ */
+static int http_ui_handler_parse_range(const char * range, size_t size, size_t * first, size_t * last)
+{
+    if (!spx_utils_str_starts_with(range, "bytes=")) {
+        return 0;
+    }
+
+    range += strlen("bytes=");
+    if (strchr(range, ',')) {
+        return 0;
+    }
+
+    char * end;
+
+    if (range[0] == '-') {
+        const unsigned long long suffix_length = strtoull(range + 1, &end, 10);
+        if (end == range + 1 || *end) {
+            return 0;
+        }
+
+        if (suffix_length == 0 || size == 0) {
+            return -1;
+        }
+
+        *first = suffix_length >= size ? 0 : size - suffix_length;
+        *last = size - 1;
+
+        return 1;
+    }
+
+    if (range[0] < '0' || range[0] > '9') {
+        return 0;
+    }
+
+    const unsigned long long range_first = strtoull(range, &end, 10);
+    if (*end != '-') {
+        return 0;
+    }
+
+    const char * last_str = end + 1;
+    unsigned long long range_last = size - 1;
+    if (*last_str) {
+        if (*last_str < '0' || *last_str > '9') {
+            return 0;
+        }
+
+        range_last = strtoull(last_str, &end, 10);
+        if (*end || range_last < range_first) {
+            return 0;
+        }
+    }
+
+    if (range_first >= size) {
+        return -1;
+    }
+
+    *first = range_first;
+    *last = range_last >= size ? size - 1 : range_last;
+
+    return 1;
+}
+
+static void http_ui_handler_output_fd_content(int fd, size_t offset, size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+
+    /*
+     *  The SAPI output layer does not give access to the client socket, so sendfile()
+     *  is not an option. The file is mapped instead and handed over in a single write,
+     *  sparing the copies through an intermediate buffer.
+     */
+    void * addr = mmap(NULL, offset + length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+        madvise(addr, offset + length, MADV_SEQUENTIAL);
+#endif
+
+        http_ui_handler_write_all((const char *) addr + offset, length);
+        munmap(addr, offset + length);
+
+        return;
+    }
+
+    char buf[64 * 1024];
+    while (length > 0) {
+        const ssize_t read = pread(fd, buf, length < sizeof(buf) ? length : sizeof(buf), offset);
+        if (read <= 0) {
+            break;
+        }
+
+        http_ui_handler_write_all(buf, read);
+
+        offset += read;
+        length -= read;
+    }
+}
+
+static void http_ui_handler_write_all(const char * ptr, size_t length)
+{
+    while (length > 0) {
+        const size_t written = spx_php_output_direct_write(ptr, length);
+        if (written == 0) {
+            break;
+        }
+
+        ptr += written;
+        length -= written;
+    }
+}
+
+static int http_ui_handler_output_report_file(const char * file_name)
+{
+    const spx_output_stream_codec_t codec = spx_output_stream_codec_get_by_file_name(file_name);
+    if (codec == SPX_OUTPUT_STREAM_CODEC_RAW || codec == SPX_OUTPUT_STREAM_CODEC_GZIP) {
+        /* served as is, gzip being natively decoded by the browser */
+        return http_ui_handler_output_file(file_name);
+    }
+
+    struct stat file_stat;
+    if (stat(file_name, &file_stat) != 0) {
+        return -1;
+    }
+
+    /* the decoded size is unknown upfront, so ranges are not supported here */
+    char etag[64];
+    char last_modified[64];
+    http_ui_handler_file_validators(&file_stat, etag, sizeof(etag), last_modified, sizeof(last_modified));
+
+    if (http_ui_handler_not_modified(etag, last_modified)) {
+        return 0;
+    }
+
+    spx_input_stream_t * input = spx_input_stream_open(file_name, codec);
+    if (!input) {
+        return -1;
+    }
+
+    spx_php_output_add_header_line("HTTP/1.1 200 OK");
+    spx_php_output_add_header_line("Content-Type: application/octet-stream");
+    spx_php_output_add_header_linef("ETag: %s", etag);
+    spx_php_output_add_header_linef("Last-Modified: %s", last_modified);
+    spx_php_output_add_header_line("Cache-Control: no-cache");
+    spx_php_output_send_headers();
+
+    char buf[64 * 1024];
+    while (1) {
+        const size_t read = spx_input_stream_read(input, buf, sizeof(buf));
+        http_ui_handler_write_all(buf, read);
+
+        if (read < sizeof(buf)) {
+            break;
+        }
+    }
+
+    spx_input_stream_close(input);
+
+    return 0;
+}
+
+static int http_ui_handler_output_report_analysis(
+    const char * data_dir,
+    const char * key,
+    spx_report_analyzer_query_type_t type
+) {
+    char file_name[PATH_MAX];
+    if (
+        spx_reporter_full_build_file_name(
+            data_dir,
+            key,
+            file_name,
+            sizeof(file_name)
+        ) == NULL
+    ) {
+        return -1;
+    }
+
+    char metadata_file_name[PATH_MAX];
+    if (
+        spx_reporter_full_build_metadata_file_name(
+            data_dir,
+            key,
+            metadata_file_name,
+            sizeof(metadata_file_name)
+        ) == NULL
+    ) {
+        return -1;
+    }
+
+    spx_report_analyzer_query_t query;
+    query.type = type;
+    query.begin = 0;
+    query.end = -1;
+    query.max_depth = 0;
+    query.min_duration = 0;
+
+    const char * begin_str = spx_php_global_array_get("_GET", "begin");
+    if (begin_str) {
+        query.begin = atof(begin_str);
+    }
+
+    const char * end_str = spx_php_global_array_get("_GET", "end");
+    if (end_str) {
+        query.end = atof(end_str);
+    }
+
+    const char * depth_str = spx_php_global_array_get("_GET", "depth");
+    if (depth_str) {
+        query.max_depth = atoi(depth_str);
+    }
+
+    const char * min_duration_str = spx_php_global_array_get("_GET", "min_duration");
+    if (min_duration_str) {
+        query.min_duration = atof(min_duration_str);
+    }
+
+    spx_report_analyzer_t * analyzer = spx_report_analyzer_create_from_report(
+        file_name,
+        metadata_file_name,
+        &query
+    );
+
+    if (!analyzer) {
+        return -1;
+    }
+
+    spx_php_output_add_header_line("HTTP/1.1 200 OK");
+    spx_php_output_add_header_line("Content-Type: application/json");
+    spx_php_output_send_headers();
+
+    spx_report_analyzer_output(analyzer, http_ui_handler_output_report_analysis_write, NULL);
+    spx_report_analyzer_destroy(analyzer);
+
+    return 0;
+}
+
+static int http_ui_handler_output_pool(int reset)
+{
+    if (!pool) {
+        return -1;
+    }
+
+    if (reset) {
+        const char * method = spx_php_global_array_get("_SERVER", "REQUEST_METHOD");
+        if (!method || 0 != strcmp(method, "POST")) {
+            return -1;
+        }
+
+        if (spx_pool_reset(pool) != 0) {
+            spx_php_output_add_header_line("HTTP/1.1 409 Conflict");
+            spx_php_output_send_headers();
+
+            return 0;
+        }
+    }
+
+    spx_php_output_add_header_line("HTTP/1.1 200 OK");
+    spx_php_output_add_header_line("Content-Type: application/json");
+    spx_php_output_add_header_line("Cache-Control: no-store");
+    spx_php_output_send_headers();
+
+    spx_pool_output(pool, http_ui_handler_output_report_analysis_write, NULL);
+
+    return 0;
+}
+
+static size_t http_ui_handler_output_report_analysis_write(void * arg, const void * ptr, size_t len)
+{
+    http_ui_handler_write_all(ptr, len);
+
+    return len;
+}
+
 static void read_stream_content(FILE * stream, size_t (*callback) (const void * ptr, size_t len))
 {
     char buf[8 * 1024];
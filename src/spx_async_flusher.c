@@ -0,0 +1,161 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+
+#include <pthread.h>
+
+#include "spx_async_flusher.h"
+
+struct spx_async_flusher_t {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    spx_async_flusher_handler_t handler;
+    void * handler_arg;
+
+    const void * buffer;
+    size_t size;
+    int pending;
+    int stop;
+};
+
+static void * flusher_thread_handler(void * arg);
+
+spx_async_flusher_t * spx_async_flusher_create(spx_async_flusher_handler_t handler, void * handler_arg)
+{
+    spx_async_flusher_t * flusher = malloc(sizeof(*flusher));
+    if (!flusher) {
+        return NULL;
+    }
+
+    flusher->handler = handler;
+    flusher->handler_arg = handler_arg;
+
+    flusher->buffer = NULL;
+    flusher->size = 0;
+    flusher->pending = 0;
+    flusher->stop = 0;
+
+    if (pthread_mutex_init(&flusher->mutex, NULL) != 0) {
+        goto error_mutex;
+    }
+
+    if (pthread_cond_init(&flusher->cond, NULL) != 0) {
+        goto error_cond;
+    }
+
+    if (pthread_create(&flusher->thread, NULL, flusher_thread_handler, flusher) != 0) {
+        goto error_thread;
+    }
+
+    return flusher;
+
+error_thread:
+    pthread_cond_destroy(&flusher->cond);
+
+error_cond:
+    pthread_mutex_destroy(&flusher->mutex);
+
+error_mutex:
+    free(flusher);
+
+    return NULL;
+}
+
+void spx_async_flusher_destroy(spx_async_flusher_t * flusher)
+{
+    pthread_mutex_lock(&flusher->mutex);
+    flusher->stop = 1;
+    pthread_cond_broadcast(&flusher->cond);
+    pthread_mutex_unlock(&flusher->mutex);
+
+    /* the thread flushes any pending buffer before exiting */
+    pthread_join(flusher->thread, NULL);
+
+    pthread_cond_destroy(&flusher->cond);
+    pthread_mutex_destroy(&flusher->mutex);
+
+    free(flusher);
+}
+
+int spx_async_flusher_submit(spx_async_flusher_t * flusher, const void * buffer, size_t size)
+{
+    int waited = 0;
+
+    pthread_mutex_lock(&flusher->mutex);
+
+    while (flusher->pending) {
+        waited = 1;
+        pthread_cond_wait(&flusher->cond, &flusher->mutex);
+    }
+
+    flusher->buffer = buffer;
+    flusher->size = size;
+    flusher->pending = 1;
+
+    pthread_cond_broadcast(&flusher->cond);
+    pthread_mutex_unlock(&flusher->mutex);
+
+    return waited;
+}
+
+void spx_async_flusher_wait(spx_async_flusher_t * flusher)
+{
+    pthread_mutex_lock(&flusher->mutex);
+
+    while (flusher->pending) {
+        pthread_cond_wait(&flusher->cond, &flusher->mutex);
+    }
+
+    pthread_mutex_unlock(&flusher->mutex);
+}
+
+static void * flusher_thread_handler(void * arg)
+{
+    spx_async_flusher_t * flusher = arg;
+
+    pthread_mutex_lock(&flusher->mutex);
+
+    while (1) {
+        while (!flusher->pending && !flusher->stop) {
+            pthread_cond_wait(&flusher->cond, &flusher->mutex);
+        }
+
+        if (!flusher->pending) {
+            break;
+        }
+
+        const void * buffer = flusher->buffer;
+        const size_t size = flusher->size;
+
+        pthread_mutex_unlock(&flusher->mutex);
+
+        flusher->handler(flusher->handler_arg, buffer, size);
+
+        pthread_mutex_lock(&flusher->mutex);
+
+        flusher->pending = 0;
+        pthread_cond_broadcast(&flusher->cond);
+    }
+
+    pthread_mutex_unlock(&flusher->mutex);
+
+    return NULL;
+}
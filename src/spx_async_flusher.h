@@ -0,0 +1,41 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_ASYNC_FLUSHER_H_DEFINED
+#define SPX_ASYNC_FLUSHER_H_DEFINED
+
+#include <stddef.h>
+
+/*
+ *  Background thread flushing one buffer at a time through the given handler.
+ *  The caller typically double buffers its data: it submits the full buffer and
+ *  keeps filling the other one, which is safe to reuse once the next submission
+ *  (or wait) returns.
+ */
+typedef struct spx_async_flusher_t spx_async_flusher_t;
+
+typedef void (*spx_async_flusher_handler_t) (void * arg, const void * buffer, size_t size);
+
+spx_async_flusher_t * spx_async_flusher_create(spx_async_flusher_handler_t handler, void * handler_arg);
+void spx_async_flusher_destroy(spx_async_flusher_t * flusher);
+
+/* returns 1 if it had to wait for the previously submitted buffer to be flushed, 0 otherwise */
+int spx_async_flusher_submit(spx_async_flusher_t * flusher, const void * buffer, size_t size);
+void spx_async_flusher_wait(spx_async_flusher_t * flusher);
+
+#endif /* SPX_ASYNC_FLUSHER_H_DEFINED */
@@ -21,6 +21,7 @@
 #include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include "spx_config.h"
 #include "spx_php.h"
@@ -35,12 +36,37 @@ typedef struct {
     const char * auto_start_str;
 
     const char * sampling_period_str;
+    const char * sampling_async_str;
     const char * builtins_str;
     const char * depth_str;
     const char * metrics_str;
 
     const char * report_str;
 
+    const char * compression_str;
+    const char * compression_level_str;
+    const char * compression_long_str;
+    const char * buffer_size_str;
+
+    const char * tail_str;
+    const char * tail_min_wall_time_str;
+    const char * tail_min_peak_memory_str;
+    const char * tail_errors_str;
+
+    const char * full_min_duration_str;
+
+    const char * rolling_period_str;
+    const char * rolling_calls_str;
+    const char * rolling_size_str;
+    const char * snapshot_signal_str;
+
+    const char * demote_calls_str;
+    const char * demote_max_wall_time_str;
+    const char * demote_measure_str;
+
+    const char * filter_include;
+    const char * filter_exclude;
+
     const char * fp_focus_str;
     const char * fp_inc_str;
     const char * fp_rel_str;
@@ -128,6 +154,7 @@ static void init_config(spx_config_t * config, int cli)
     config->auto_start = 1;
 
     config->sampling_period = 0;
+    config->sampling_async = 0;
     config->builtins = 0;
     config->max_depth = 0;
 
@@ -140,6 +167,31 @@ static void init_config(spx_config_t * config, int cli)
 
     config->report = cli ? SPX_CONFIG_REPORT_FLAT_PROFILE : SPX_CONFIG_REPORT_FULL;
 
+    config->compression.codec = SPX_OUTPUT_STREAM_CODEC_GZIP;
+    config->compression.level = 0;
+    config->compression.long_mode = 0;
+    config->buffer_size = 2 * 1024 * 1024;
+
+    config->tail.enabled = 0;
+    config->tail.min_wall_time_ms = 0;
+    config->tail.min_peak_memory = 0;
+    config->tail.errors = 1;
+
+    config->full_min_duration = 0;
+
+    config->rolling_period = 0;
+    config->rolling_calls = 0;
+    config->rolling_size = 0;
+
+    config->snapshot_signal = 0;
+
+    config->demotion.calls = 0;
+    config->demotion.max_wall_time = 1000;
+    config->demotion.measure = 1;
+
+    config->filter_include = NULL;
+    config->filter_exclude = NULL;
+
     config->fp_focus = SPX_METRIC_WALL_TIME;
     config->fp_inc = 0;
     config->fp_rel = 0;
@@ -157,39 +209,94 @@ static void fix_config(spx_config_t * config, int cli)
         config->ui_uri = NULL;
     }
 
-    if (!cli) {
+    if (!cli && config->report != SPX_CONFIG_REPORT_POOL) {
         config->report = SPX_CONFIG_REPORT_FULL;
     }
 
+    if (config->report != SPX_CONFIG_REPORT_FULL) {
+        config->tail.enabled = 0;
+        config->full_min_duration = 0;
+        config->rolling_period = 0;
+        config->rolling_calls = 0;
+        config->rolling_size = 0;
+        config->snapshot_signal = 0;
+    }
+
+    if (!cli) {
+        config->snapshot_signal = 0;
+    }
+
     if (config->report == SPX_CONFIG_REPORT_FULL) {
         config->enabled_metrics[SPX_METRIC_WALL_TIME] = 1;
         config->enabled_metrics[SPX_METRIC_ZE_MEMORY_USAGE] = 1;
     }
 
+    if (config->tail.enabled && config->tail.min_wall_time_ms > 0) {
+        /* the tail wall time condition is evaluated from the wall time metric */
+        config->enabled_metrics[SPX_METRIC_WALL_TIME] = 1;
+    }
+
     if (config->report == SPX_CONFIG_REPORT_FLAT_PROFILE) {
         config->enabled_metrics[config->fp_focus] = 1;
     }
+
+    if (config->sampling_period == 0 || !spx_php_execution_interrupt_handle()) {
+        config->sampling_async = 0;
+    }
+
+    if (config->sampling_period > 0) {
+        /* sampled stacks do not reflect the actual call count */
+        config->demotion.calls = 0;
+    }
+
+    if (!spx_output_stream_codec_available(config->compression.codec)) {
+        config->compression.codec = SPX_OUTPUT_STREAM_CODEC_GZIP;
+    }
+
+    /* so that a buffer always holds a decent amount of events */
+    if (config->buffer_size < 64 * 1024) {
+        config->buffer_size = 64 * 1024;
+    }
 }
 
 static void source_data_get(source_data_t * source_data, source_handler_t handler)
 {
-    source_data->enabled_str          = handler("SPX_ENABLED");
-    source_data->key_str              = handler("SPX_KEY");
-    source_data->ui_uri_str           = handler("SPX_UI_URI");
-    source_data->auto_start_str       = handler("SPX_AUTO_START");
-    source_data->sampling_period_str  = handler("SPX_SAMPLING_PERIOD");
-    source_data->builtins_str         = handler("SPX_BUILTINS");
-    source_data->depth_str            = handler("SPX_DEPTH");
-    source_data->metrics_str          = handler("SPX_METRICS");
-    source_data->report_str           = handler("SPX_REPORT");
-    source_data->fp_focus_str         = handler("SPX_FP_FOCUS");
-    source_data->fp_inc_str           = handler("SPX_FP_INC");
-    source_data->fp_rel_str           = handler("SPX_FP_REL");
-    source_data->fp_limit_str         = handler("SPX_FP_LIMIT");
-    source_data->fp_live_str          = handler("SPX_FP_LIVE");
-    source_data->fp_color_str         = handler("SPX_FP_COLOR");
-    source_data->trace_file           = handler("SPX_TRACE_FILE");
-    source_data->trace_safe_str       = handler("SPX_TRACE_SAFE");
+    source_data->enabled_str              = handler("SPX_ENABLED");
+    source_data->key_str                  = handler("SPX_KEY");
+    source_data->ui_uri_str               = handler("SPX_UI_URI");
+    source_data->auto_start_str           = handler("SPX_AUTO_START");
+    source_data->sampling_period_str      = handler("SPX_SAMPLING_PERIOD");
+    source_data->sampling_async_str       = handler("SPX_SAMPLING_ASYNC");
+    source_data->builtins_str             = handler("SPX_BUILTINS");
+    source_data->depth_str                = handler("SPX_DEPTH");
+    source_data->metrics_str              = handler("SPX_METRICS");
+    source_data->report_str               = handler("SPX_REPORT");
+    source_data->compression_str          = handler("SPX_COMPRESSION");
+    source_data->compression_level_str    = handler("SPX_COMPRESSION_LEVEL");
+    source_data->compression_long_str     = handler("SPX_COMPRESSION_LONG");
+    source_data->buffer_size_str          = handler("SPX_BUFFER_SIZE");
+    source_data->tail_str                 = handler("SPX_TAIL");
+    source_data->tail_min_wall_time_str   = handler("SPX_TAIL_MIN_WALL_TIME");
+    source_data->tail_min_peak_memory_str = handler("SPX_TAIL_MIN_PEAK_MEMORY");
+    source_data->tail_errors_str          = handler("SPX_TAIL_ERRORS");
+    source_data->full_min_duration_str    = handler("SPX_FULL_MIN_DURATION");
+    source_data->rolling_period_str       = handler("SPX_ROLLING_PERIOD");
+    source_data->rolling_calls_str        = handler("SPX_ROLLING_CALLS");
+    source_data->rolling_size_str         = handler("SPX_ROLLING_SIZE");
+    source_data->snapshot_signal_str      = handler("SPX_SNAPSHOT_SIGNAL");
+    source_data->demote_calls_str         = handler("SPX_DEMOTE_CALLS");
+    source_data->demote_max_wall_time_str = handler("SPX_DEMOTE_MAX_WALL_TIME");
+    source_data->demote_measure_str       = handler("SPX_DEMOTE_MEASURE");
+    source_data->filter_include           = handler("SPX_FILTER_INCLUDE");
+    source_data->filter_exclude           = handler("SPX_FILTER_EXCLUDE");
+    source_data->fp_focus_str             = handler("SPX_FP_FOCUS");
+    source_data->fp_inc_str               = handler("SPX_FP_INC");
+    source_data->fp_rel_str               = handler("SPX_FP_REL");
+    source_data->fp_limit_str             = handler("SPX_FP_LIMIT");
+    source_data->fp_live_str              = handler("SPX_FP_LIVE");
+    source_data->fp_color_str             = handler("SPX_FP_COLOR");
+    source_data->trace_file               = handler("SPX_TRACE_FILE");
+    source_data->trace_safe_str           = handler("SPX_TRACE_SAFE");
 }
 
 static void source_data_to_config(const source_data_t * source_data, spx_config_t * config)
@@ -214,6 +321,10 @@ static void source_data_to_config(const source_data_t * source_data, spx_config_
         config->sampling_period = atoi(source_data->sampling_period_str);
     }
 
+    if (source_data->sampling_async_str) {
+        config->sampling_async = *source_data->sampling_async_str == '1' ? 1 : 0;
+    }
+
     if (source_data->builtins_str) {
         config->builtins = *source_data->builtins_str == '1' ? 1 : 0;
     }
@@ -242,9 +353,77 @@ static void source_data_to_config(const source_data_t * source_data, spx_config_
             config->report = SPX_CONFIG_REPORT_FLAT_PROFILE;
         } else if (0 == strcmp(source_data->report_str, "trace")) {
             config->report = SPX_CONFIG_REPORT_TRACE;
+        } else if (0 == strcmp(source_data->report_str, "pool")) {
+            config->report = SPX_CONFIG_REPORT_POOL;
+        }
+    }
+
+    if (source_data->compression_str) {
+        spx_output_stream_codec_t codec = spx_output_stream_codec_get_by_key(source_data->compression_str);
+        if (codec != SPX_OUTPUT_STREAM_CODEC_UNKNOWN) {
+            config->compression.codec = codec;
         }
     }
 
+    if (source_data->compression_level_str) {
+        config->compression.level = atoi(source_data->compression_level_str);
+    }
+
+    if (source_data->compression_long_str) {
+        config->compression.long_mode = *source_data->compression_long_str == '1' ? 1 : 0;
+    }
+
+    if (source_data->buffer_size_str) {
+        config->buffer_size = strtoul(source_data->buffer_size_str, NULL, 10);
+    }
+
+    if (source_data->tail_str) {
+        config->tail.enabled = *source_data->tail_str == '1' ? 1 : 0;
+    }
+
+    if (source_data->tail_min_wall_time_str) {
+        config->tail.min_wall_time_ms = strtoul(source_data->tail_min_wall_time_str, NULL, 10);
+    }
+
+    if (source_data->tail_min_peak_memory_str) {
+        config->tail.min_peak_memory = strtoul(source_data->tail_min_peak_memory_str, NULL, 10);
+    }
+
+    if (source_data->tail_errors_str) {
+        config->tail.errors = *source_data->tail_errors_str == '1' ? 1 : 0;
+    }
+
+    if (source_data->full_min_duration_str) {
+        config->full_min_duration = strtoul(source_data->full_min_duration_str, NULL, 10);
+    }
+
+    if (source_data->rolling_period_str) {
+        config->rolling_period = strtoul(source_data->rolling_period_str, NULL, 10);
+    }
+
+    if (source_data->rolling_calls_str) {
+        config->rolling_calls = strtoul(source_data->rolling_calls_str, NULL, 10);
+    }
+
+    if (source_data->rolling_size_str) {
+        config->rolling_size = strtoul(source_data->rolling_size_str, NULL, 10);
+    }
+
+    if (source_data->snapshot_signal_str) {
+        /*
+         *  Only the user signals are accepted: the other ones are either already handled (e.g.
+         *  SIGINT & SIGTERM to end the report on termination) or cannot be caught.
+         */
+        config->snapshot_signal = 0;
+#ifdef SIGUSR1
+        if (0 == strcmp(source_data->snapshot_signal_str, "usr1")) {
+            config->snapshot_signal = SIGUSR1;
+        } else if (0 == strcmp(source_data->snapshot_signal_str, "usr2")) {
+            config->snapshot_signal = SIGUSR2;
+        }
+#endif
+    }
+
     if (source_data->fp_focus_str) {
         spx_metric_t focus = spx_metric_get_by_key(source_data->fp_focus_str);
         if (focus != SPX_METRIC_NONE) {
@@ -272,6 +451,26 @@ static void source_data_to_config(const source_data_t * source_data, spx_config_
         config->fp_color = *source_data->fp_color_str == '1' ? 1 : 0;
     }
 
+    if (source_data->demote_calls_str) {
+        config->demotion.calls = strtoul(source_data->demote_calls_str, NULL, 10);
+    }
+
+    if (source_data->demote_max_wall_time_str) {
+        config->demotion.max_wall_time = strtoul(source_data->demote_max_wall_time_str, NULL, 10);
+    }
+
+    if (source_data->demote_measure_str) {
+        config->demotion.measure = *source_data->demote_measure_str == '1' ? 1 : 0;
+    }
+
+    if (source_data->filter_include) {
+        config->filter_include = source_data->filter_include;
+    }
+
+    if (source_data->filter_exclude) {
+        config->filter_exclude = source_data->filter_exclude;
+    }
+
     if (source_data->trace_file) {
         config->trace_file = source_data->trace_file;
     }
@@ -21,11 +21,15 @@
 
 #include <stddef.h>
 #include "spx_metric.h"
+#include "spx_output_stream.h"
+#include "spx_reporter_full.h"
+#include "spx_profiler_tracer.h"
 
 typedef enum {
     SPX_CONFIG_REPORT_FULL,
     SPX_CONFIG_REPORT_FLAT_PROFILE,
     SPX_CONFIG_REPORT_TRACE,
+    SPX_CONFIG_REPORT_POOL,
 } spx_config_report_t;
 
 typedef struct {
@@ -37,12 +41,36 @@ typedef struct {
     int auto_start;
 
     size_t sampling_period;
+    int sampling_async;
     int builtins;
     size_t max_depth;
     int enabled_metrics[SPX_METRIC_COUNT];
 
     spx_config_report_t report;
 
+    spx_output_stream_compression_t compression;
+    /* size in bytes of each of the two event buffers of full & trace reporters */
+    size_t buffer_size;
+
+    spx_reporter_full_tail_t tail;
+
+    /* in ns, full report calls shorter than it are elided from the event stream */
+    size_t full_min_duration;
+
+    /* full report rolling thresholds, 0 disables the corresponding one */
+    size_t rolling_period;
+    size_t rolling_calls;
+    size_t rolling_size;
+
+    /* the signal triggering a snapshot of the current full report, 0 means none */
+    int snapshot_signal;
+
+    spx_profiler_tracer_demotion_t demotion;
+
+    /* comma separated function pattern lists, see spx_function_filter.h */
+    const char * filter_include;
+    const char * filter_exclude;
+
     spx_metric_t fp_focus;
     int fp_inc;
     int fp_rel;
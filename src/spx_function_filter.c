@@ -0,0 +1,322 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+
+#include "spx_function_filter.h"
+
+
+typedef enum {
+    PATTERN_NAME,
+    PATTERN_NAMESPACE,
+    PATTERN_FILE,
+} pattern_type_t;
+
+typedef struct {
+    pattern_type_t type;
+    int glob;
+    char * str;
+} pattern_t;
+
+typedef struct {
+    size_t size;
+    pattern_t * patterns;
+} pattern_list_t;
+
+struct spx_function_filter_t {
+    pattern_list_t include;
+    pattern_list_t exclude;
+};
+
+static int pattern_list_init(pattern_list_t * list, const char * str);
+static void pattern_list_release(pattern_list_t * list);
+static int pattern_list_has_type(const pattern_list_t * list, pattern_type_t type);
+static int pattern_list_match(
+    const pattern_list_t * list,
+    const char * class_name,
+    const char * full_name,
+    const char * file_name
+);
+
+static int pattern_match(
+    const pattern_t * pattern,
+    const char * class_name,
+    const char * full_name,
+    const char * file_name
+);
+
+static int glob_match(const char * pattern, const char * str, int prefix);
+
+spx_function_filter_t * spx_function_filter_create(const char * include, const char * exclude)
+{
+    spx_function_filter_t * filter = malloc(sizeof(*filter));
+    if (!filter) {
+        goto error;
+    }
+
+    filter->include.size = 0;
+    filter->include.patterns = NULL;
+    filter->exclude.size = 0;
+    filter->exclude.patterns = NULL;
+
+    if (pattern_list_init(&filter->include, include) != 0) {
+        goto error;
+    }
+
+    if (pattern_list_init(&filter->exclude, exclude) != 0) {
+        goto error;
+    }
+
+    return filter;
+
+error:
+    if (filter) {
+        spx_function_filter_destroy(filter);
+    }
+
+    return NULL;
+}
+
+void spx_function_filter_destroy(spx_function_filter_t * filter)
+{
+    pattern_list_release(&filter->include);
+    pattern_list_release(&filter->exclude);
+
+    free(filter);
+}
+
+int spx_function_filter_match(const spx_function_filter_t * filter, const spx_php_function_t * function)
+{
+    char full_name[8 * 1024];
+    snprintf(
+        full_name,
+        sizeof(full_name),
+        "%s%s%s",
+        function->class_name,
+        function->class_name[0] ? "::" : "",
+        function->func_name
+    );
+
+    const char * file_name = function->file_name ? function->file_name : "";
+
+    if (
+        filter->include.size > 0
+        && !pattern_list_match(&filter->include, function->class_name, full_name, file_name)
+    ) {
+        return 0;
+    }
+
+    return !pattern_list_match(&filter->exclude, function->class_name, full_name, file_name);
+}
+
+int spx_function_filter_has_file_patterns(const spx_function_filter_t * filter)
+{
+    return
+        pattern_list_has_type(&filter->include, PATTERN_FILE)
+        || pattern_list_has_type(&filter->exclude, PATTERN_FILE)
+    ;
+}
+
+static int pattern_list_init(pattern_list_t * list, const char * str)
+{
+    if (!str || !str[0]) {
+        return 0;
+    }
+
+    size_t capacity = 1;
+    const char * p;
+    for (p = str; *p; p++) {
+        if (*p == ',') {
+            capacity++;
+        }
+    }
+
+    list->patterns = malloc(capacity * sizeof(*list->patterns));
+    if (!list->patterns) {
+        return -1;
+    }
+
+    p = str;
+    while (1) {
+        const char * end = strchr(p, ',');
+        if (!end) {
+            end = p + strlen(p);
+        }
+
+        const char * start = p;
+        while (start < end && isspace((unsigned char) *start)) {
+            start++;
+        }
+
+        const char * stop = end;
+        while (stop > start && isspace((unsigned char) stop[-1])) {
+            stop--;
+        }
+
+        if (stop > start) {
+            const size_t len = stop - start;
+            pattern_t * pattern = &list->patterns[list->size];
+
+            pattern->str = malloc(len + 1);
+            if (!pattern->str) {
+                return -1;
+            }
+
+            memcpy(pattern->str, start, len);
+            pattern->str[len] = 0;
+            list->size++;
+
+            pattern->glob = strpbrk(pattern->str, "*?") != NULL;
+
+            if (strchr(pattern->str, '/')) {
+                pattern->type = PATTERN_FILE;
+            } else if (pattern->str[len - 1] == '\\') {
+                pattern->type = PATTERN_NAMESPACE;
+            } else {
+                pattern->type = PATTERN_NAME;
+            }
+        }
+
+        if (!*end) {
+            break;
+        }
+
+        p = end + 1;
+    }
+
+    return 0;
+}
+
+static void pattern_list_release(pattern_list_t * list)
+{
+    size_t i;
+    for (i = 0; i < list->size; i++) {
+        free(list->patterns[i].str);
+    }
+
+    free(list->patterns);
+
+    list->size = 0;
+    list->patterns = NULL;
+}
+
+static int pattern_list_has_type(const pattern_list_t * list, pattern_type_t type)
+{
+    size_t i;
+    for (i = 0; i < list->size; i++) {
+        if (list->patterns[i].type == type) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int pattern_list_match(
+    const pattern_list_t * list,
+    const char * class_name,
+    const char * full_name,
+    const char * file_name
+) {
+    size_t i;
+    for (i = 0; i < list->size; i++) {
+        if (pattern_match(&list->patterns[i], class_name, full_name, file_name)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int pattern_match(
+    const pattern_t * pattern,
+    const char * class_name,
+    const char * full_name,
+    const char * file_name
+) {
+    switch (pattern->type) {
+        case PATTERN_FILE:
+            /*
+             *  Without wildcard, a file pattern (e.g. "vendor/") matches any path containing it.
+             */
+            if (pattern->glob) {
+                return glob_match(pattern->str, file_name, 0);
+            }
+
+            return strstr(file_name, pattern->str) != NULL;
+
+        case PATTERN_NAMESPACE:
+            return glob_match(pattern->str, full_name, 1);
+
+        case PATTERN_NAME:
+            if (pattern->glob) {
+                return
+                    (class_name[0] && glob_match(pattern->str, class_name, 0))
+                    || glob_match(pattern->str, full_name, 0)
+                ;
+            }
+
+            return
+                (class_name[0] && strcmp(pattern->str, class_name) == 0)
+                || strcmp(pattern->str, full_name) == 0
+            ;
+    }
+
+    return 0;
+}
+
+/*
+ *  '*' & '?' wildcards matching with single star backtracking. In prefix mode, the pattern only
+ *  has to match the beginning of str.
+ */
+static int glob_match(const char * pattern, const char * str, int prefix)
+{
+    const char * star = NULL;
+    const char * star_str = NULL;
+
+    while (1) {
+        if (*pattern == '*') {
+            star = ++pattern;
+            star_str = str;
+
+            continue;
+        }
+
+        if (!*pattern) {
+            if (prefix || !*str) {
+                return 1;
+            }
+        } else if (*str && (*pattern == '?' || *pattern == *str)) {
+            pattern++;
+            str++;
+
+            continue;
+        }
+
+        if (!star || !*star_str) {
+            return 0;
+        }
+
+        pattern = star;
+        str = ++star_str;
+    }
+}
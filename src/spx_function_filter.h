@@ -0,0 +1,47 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_FUNCTION_FILTER_H_DEFINED
+#define SPX_FUNCTION_FILTER_H_DEFINED
+
+#include "spx_php.h"
+
+typedef struct spx_function_filter_t spx_function_filter_t;
+
+/*
+ *  include & exclude are comma separated pattern lists, NULL or empty meaning no pattern.
+ *  A pattern containing a '/' applies to the file path, one ending with a '\' is a namespace
+ *  prefix, and any other one applies to the class name or the full function name
+ *  ("Class::method"). '*' & '?' wildcards are supported.
+ */
+spx_function_filter_t * spx_function_filter_create(const char * include, const char * exclude);
+void spx_function_filter_destroy(spx_function_filter_t * filter);
+
+/*
+ *  Returns 1 if the function is matched by the include list (or if it is empty) and is not
+ *  matched by the exclude list, 0 otherwise.
+ */
+int spx_function_filter_match(const spx_function_filter_t * filter, const spx_php_function_t * function);
+
+/*
+ *  Returns 1 if any pattern applies to the file path, meaning that the decision for a given
+ *  function name (e.g. "{closure}") may differ from one file to another.
+ */
+int spx_function_filter_has_file_patterns(const spx_function_filter_t * filter);
+
+#endif /* SPX_FUNCTION_FILTER_H_DEFINED */
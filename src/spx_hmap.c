@@ -16,104 +16,91 @@
  */
 
 
-#include <stdio.h>
+/*
+ *  Open addressing hash map in the spirit of Swiss tables.
+ *
+ *  Slots are grouped by GROUP_SIZE, each slot having a control byte which is either
+ *  CTRL_EMPTY or the 7 lowest bits of the entry hash. A whole group of control bytes is
+ *  matched at once (with SSE2 or NEON when available) and the full hash is stored along
+ *  with each entry, so that the key comparison function is almost only called on actual
+ *  matches. Since entries are never removed there is no need for tombstones, a group
+ *  with an empty slot ends the probing sequence.
+ *
+ *  Growth is incremental: the previous table is kept along with the new one and a few of
+ *  its groups are moved at each spx_hmap_ensure_entry() call, lookups checking both tables
+ *  meanwhile.
+ */
+
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
 
 #include "spx_hmap.h"
 
-#define HSET_BUCKET_SIZE 4
+#define GROUP_SIZE 16
+#define CTRL_EMPTY 0x80
+/*
+ *  Maximum load factor, as MAX_LOAD_NUM / MAX_LOAD_DEN, above which the table is doubled.
+ */
+#define MAX_LOAD_NUM 7
+#define MAX_LOAD_DEN 8
+/*
+ *  Count of previous table groups moved at each insertion while growing, enough for
+ *  the previous table to be drained long before the new one is full in turn.
+ */
+#define MIGRATION_STEP 2
+
+#if defined(__ARM_NEON)
+/* a match is reported as a nibble, only its highest bit is kept */
+#   define GROUP_MASK_STRIDE 4
+#else
+#   define GROUP_MASK_STRIDE 1
+#endif
 
 struct spx_hmap_entry_t {
+    uint64_t hash;
     const void * key;
     void * value;
-    int free;
 };
 
-typedef struct hmap_bucket_t {
-    spx_hmap_entry_t entries[HSET_BUCKET_SIZE];
-    struct hmap_bucket_t * next;
-} hmap_bucket_t;
+typedef struct {
+    /* slot count, a power of 2 multiple of GROUP_SIZE, 0 for an unallocated table */
+    size_t capacity;
+    size_t count;
+    unsigned char * ctrl;
+    spx_hmap_entry_t * entries;
+} hmap_table_t;
 
 struct spx_hmap_t {
     spx_hmap_hash_key_func_t hash;
     spx_hmap_cmp_key_func_t cmp;
-    size_t size;
-    hmap_bucket_t * buckets;
+    hmap_table_t table;
+    /* the previous table while growing, its groups below migrated_groups having been moved */
+    hmap_table_t previous;
+    size_t migrated_groups;
 };
 
-static void bucket_init(hmap_bucket_t * bucket)
-{
-    bucket->next = NULL;
-    size_t i;
-    for (i = 0; i < HSET_BUCKET_SIZE; i++) {
-        bucket->entries[i].free = 1;
-    }
-}
+typedef uint64_t group_mask_t;
 
-static void bucket_release_chain(hmap_bucket_t * bucket)
-{
-    if (!bucket->next) {
-        return;
-    }
-
-    bucket_release_chain(bucket->next);
-    free(bucket->next);
-}
-
-static spx_hmap_entry_t * bucket_get_entry(
-    hmap_bucket_t * bucket,
+static uint64_t mix_hash(uint64_t hash);
+static group_mask_t group_match(const unsigned char * ctrl, unsigned char h2);
+static group_mask_t group_match_empty(const unsigned char * ctrl);
+static int table_init(hmap_table_t * table, size_t capacity);
+static void table_release(hmap_table_t * table);
+static spx_hmap_entry_t * table_find(
+    const hmap_table_t * table,
     spx_hmap_cmp_key_func_t cmp,
     const void * key,
-    int existing,
-    int * new
-) {
-    size_t i;
-    for (i = 0; i < HSET_BUCKET_SIZE; i++) {
-        spx_hmap_entry_t * entry = &bucket->entries[i];
-        if (entry->free) {
-            if (existing) {
-                return NULL;
-            }
-
-            entry->free = 0;
-            entry->key = key;
-            if (new) {
-                *new = 1;
-            }
-
-            return entry;
-        }
-
-        if (0 == cmp(key, entry->key)) {
-            if (new) {
-                *new = 0;
-            }
-
-            return entry;
-        }
-    }
-
-    if (!bucket->next) {
-        if (existing) {
-            return NULL;
-        }
-
-        bucket->next = malloc(sizeof(*bucket->next));
-        if (!bucket->next) {
-            return NULL;
-        }
-
-        bucket_init(bucket->next);
-    }
-
-    return bucket_get_entry(
-        bucket->next,
-        cmp,
-        key,
-        existing,
-        new
-    );
-}
+    uint64_t hash
+);
+static spx_hmap_entry_t * table_insert(hmap_table_t * table, uint64_t hash);
+static int hmap_grow(spx_hmap_t * hmap);
+static void hmap_migrate(spx_hmap_t * hmap, size_t group_count);
 
 spx_hmap_t * spx_hmap_create(
     size_t size,
@@ -127,15 +114,16 @@ spx_hmap_t * spx_hmap_create(
 
     hmap->hash = hash;
     hmap->cmp = cmp;
-    hmap->size = size;
-    hmap->buckets = malloc(hmap->size * sizeof(*hmap->buckets));
-    if (!hmap->buckets) {
-        goto error;
+    hmap->previous.capacity = 0;
+    hmap->migrated_groups = 0;
+
+    size_t capacity = GROUP_SIZE;
+    while (capacity * MAX_LOAD_NUM / MAX_LOAD_DEN < size) {
+        capacity *= 2;
     }
 
-    size_t i;
-    for (i = 0; i < hmap->size; i++) {
-        bucket_init(&hmap->buckets[i]);
+    if (!table_init(&hmap->table, capacity)) {
+        goto error;
     }
 
     return hmap;
@@ -148,43 +136,71 @@ error:
 
 void spx_hmap_reset(spx_hmap_t * hmap)
 {
-    size_t i;
-    for (i = 0; i < hmap->size; i++) {
-        bucket_release_chain(&hmap->buckets[i]);
-        bucket_init(&hmap->buckets[i]);
-    }
+    table_release(&hmap->previous);
+    hmap->migrated_groups = 0;
+
+    memset(hmap->table.ctrl, CTRL_EMPTY, hmap->table.capacity);
+    hmap->table.count = 0;
 }
 
 void spx_hmap_destroy(spx_hmap_t * hmap)
 {
-    size_t i;
-    for (i = 0; i < hmap->size; i++) {
-        bucket_release_chain(&hmap->buckets[i]);
-    }
+    table_release(&hmap->previous);
+    table_release(&hmap->table);
 
-    free(hmap->buckets);
     free(hmap);
 }
 
-spx_hmap_entry_t * spx_hmap_ensure_entry(spx_hmap_t * hmap, const void * key, int * new) {
-    return bucket_get_entry(
-        &hmap->buckets[hmap->hash(key) % hmap->size],
-        hmap->cmp,
-        key,
-        0,
-        new
-    );
+spx_hmap_entry_t * spx_hmap_ensure_entry(spx_hmap_t * hmap, const void * key, int * new)
+{
+    if (hmap->previous.capacity > 0) {
+        hmap_migrate(hmap, MIGRATION_STEP);
+    }
+
+    const uint64_t hash = mix_hash(hmap->hash(key));
+
+    spx_hmap_entry_t * entry = table_find(&hmap->table, hmap->cmp, key, hash);
+    if (!entry && hmap->previous.capacity > 0) {
+        entry = table_find(&hmap->previous, hmap->cmp, key, hash);
+    }
+
+    if (entry) {
+        if (new) {
+            *new = 0;
+        }
+
+        return entry;
+    }
+
+    if ((hmap->table.count + 1) * MAX_LOAD_DEN > hmap->table.capacity * MAX_LOAD_NUM) {
+        /*
+         *  A growth failure is not fatal as long as there is a free slot left, the map
+         *  will just keep working with longer probing sequences.
+         */
+        if (!hmap_grow(hmap) && hmap->table.count == hmap->table.capacity) {
+            return NULL;
+        }
+    }
+
+    entry = table_insert(&hmap->table, hash);
+    entry->key = key;
+    entry->value = NULL;
+
+    if (new) {
+        *new = 1;
+    }
+
+    return entry;
 }
 
 void * spx_hmap_get_value(spx_hmap_t * hmap, const void * key)
 {
-    const spx_hmap_entry_t * entry = bucket_get_entry(
-        &hmap->buckets[hmap->hash(key) % hmap->size],
-        hmap->cmp,
-        key,
-        1,
-        NULL
-    );
+    const uint64_t hash = mix_hash(hmap->hash(key));
+
+    const spx_hmap_entry_t * entry = table_find(&hmap->table, hmap->cmp, key, hash);
+    if (!entry && hmap->previous.capacity > 0) {
+        entry = table_find(&hmap->previous, hmap->cmp, key, hash);
+    }
 
     if (!entry) {
         return NULL;
@@ -213,3 +229,209 @@ void * spx_hmap_entry_get_value(const spx_hmap_entry_t * entry)
 {
     return entry->value;
 }
+
+static uint64_t mix_hash(uint64_t hash)
+{
+    /*
+     *  MurmurHash3 finalizer, the provided hash functions being usually weak (e.g. built
+     *  from pointers) while both the lowest bits (control byte) and the following ones
+     *  (probing start) must be well distributed.
+     */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+static group_mask_t group_match(const unsigned char * ctrl, unsigned char h2)
+{
+#if defined(__SSE2__)
+    const __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+
+    return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) h2)));
+#elif defined(__ARM_NEON)
+    const uint8x16_t eq = vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(h2));
+
+    return vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)),
+        0
+    ) & 0x8888888888888888ULL;
+#else
+    group_mask_t mask = 0;
+    size_t i;
+    for (i = 0; i < GROUP_SIZE; i++) {
+        if (ctrl[i] == h2) {
+            mask |= (group_mask_t) 1 << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+static group_mask_t group_match_empty(const unsigned char * ctrl)
+{
+    /* full slots have their highest bit cleared */
+#if defined(__SSE2__)
+    return (unsigned) _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    return group_match(ctrl, CTRL_EMPTY);
+#endif
+}
+
+static int table_init(hmap_table_t * table, size_t capacity)
+{
+    table->capacity = 0;
+    table->count = 0;
+
+    table->ctrl = malloc(capacity);
+    table->entries = malloc(capacity * sizeof(*table->entries));
+    if (!table->ctrl || !table->entries) {
+        free(table->ctrl);
+        free(table->entries);
+
+        return 0;
+    }
+
+    memset(table->ctrl, CTRL_EMPTY, capacity);
+    table->capacity = capacity;
+
+    return 1;
+}
+
+static void table_release(hmap_table_t * table)
+{
+    if (table->capacity == 0) {
+        return;
+    }
+
+    free(table->ctrl);
+    free(table->entries);
+
+    table->capacity = 0;
+    table->count = 0;
+}
+
+/*
+ *  Groups are probed in triangular order, which visits each of them once since the
+ *  group count is a power of 2.
+ */
+#define TABLE_PROBE(table, hash, group, block) \
+do {                                                                 \
+    const size_t group_mask_ = (table)->capacity / GROUP_SIZE - 1;   \
+    size_t group = ((hash) >> 7) & group_mask_;                      \
+    size_t probe_ = 0;                                               \
+    while (1) {                                                      \
+        block                                                        \
+        probe_++;                                                    \
+        if (probe_ > group_mask_) {                                  \
+            break;                                                   \
+        }                                                            \
+        group = (group + probe_) & group_mask_;                      \
+    }                                                                \
+} while (0)
+
+static spx_hmap_entry_t * table_find(
+    const hmap_table_t * table,
+    spx_hmap_cmp_key_func_t cmp,
+    const void * key,
+    uint64_t hash
+) {
+    const unsigned char h2 = hash & 0x7f;
+
+    TABLE_PROBE(table, hash, group, {
+        const unsigned char * ctrl = table->ctrl + group * GROUP_SIZE;
+
+        group_mask_t mask = group_match(ctrl, h2);
+        while (mask) {
+            spx_hmap_entry_t * entry = &table->entries[
+                group * GROUP_SIZE + __builtin_ctzll(mask) / GROUP_MASK_STRIDE
+            ];
+
+            if (entry->hash == hash && 0 == cmp(key, entry->key)) {
+                return entry;
+            }
+
+            mask &= mask - 1;
+        }
+
+        if (group_match_empty(ctrl)) {
+            return NULL;
+        }
+    });
+
+    return NULL;
+}
+
+static spx_hmap_entry_t * table_insert(hmap_table_t * table, uint64_t hash)
+{
+    TABLE_PROBE(table, hash, group, {
+        const group_mask_t mask = group_match_empty(table->ctrl + group * GROUP_SIZE);
+        if (mask) {
+            const size_t slot = group * GROUP_SIZE + __builtin_ctzll(mask) / GROUP_MASK_STRIDE;
+
+            table->ctrl[slot] = hash & 0x7f;
+            table->count++;
+
+            spx_hmap_entry_t * entry = &table->entries[slot];
+            entry->hash = hash;
+
+            return entry;
+        }
+    });
+
+    /* unreachable as long as the caller checked that the table is not full */
+    return NULL;
+}
+
+static int hmap_grow(spx_hmap_t * hmap)
+{
+    if (hmap->previous.capacity > 0) {
+        /* the previous growth must be completed first */
+        hmap_migrate(hmap, hmap->previous.capacity / GROUP_SIZE);
+    }
+
+    hmap_table_t table;
+    if (!table_init(&table, hmap->table.capacity * 2)) {
+        return 0;
+    }
+
+    hmap->previous = hmap->table;
+    hmap->table = table;
+    hmap->migrated_groups = 0;
+
+    return 1;
+}
+
+static void hmap_migrate(spx_hmap_t * hmap, size_t group_count)
+{
+    const size_t total_group_count = hmap->previous.capacity / GROUP_SIZE;
+
+    while (group_count > 0 && hmap->migrated_groups < total_group_count) {
+        const size_t first = hmap->migrated_groups * GROUP_SIZE;
+
+        size_t i;
+        for (i = first; i < first + GROUP_SIZE; i++) {
+            if (hmap->previous.ctrl[i] & CTRL_EMPTY) {
+                continue;
+            }
+
+            const spx_hmap_entry_t * src = &hmap->previous.entries[i];
+            spx_hmap_entry_t * dst = table_insert(&hmap->table, src->hash);
+
+            dst->key = src->key;
+            dst->value = src->value;
+        }
+
+        hmap->migrated_groups++;
+        group_count--;
+    }
+
+    if (hmap->migrated_groups == total_group_count) {
+        table_release(&hmap->previous);
+        hmap->migrated_groups = 0;
+    }
+}
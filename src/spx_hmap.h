@@ -27,6 +27,10 @@ typedef struct spx_hmap_entry_t spx_hmap_entry_t;
 typedef uint64_t (*spx_hmap_hash_key_func_t) (const void *);
 typedef int (*spx_hmap_cmp_key_func_t) (const void *, const void *);
 
+/*
+ *  size is the entry count the map is initially sized for, it grows on demand.
+ *  Entry pointers are only valid until the next spx_hmap_ensure_entry() call.
+ */
 spx_hmap_t * spx_hmap_create(
     size_t size,
     spx_hmap_hash_key_func_t hash,
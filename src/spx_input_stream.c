@@ -0,0 +1,478 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#ifdef HAVE_SPX_ZSTD
+#   include <zstd.h>
+#endif
+
+#ifdef HAVE_SPX_LZ4
+#   include <lz4frame.h>
+#endif
+
+#include "spx_input_stream.h"
+
+typedef struct {
+    void * (*open)  (const char * file_name, size_t offset);
+    void   (*close) (void * file);
+    size_t (*read)  (void * file, void * buf, size_t size);
+} file_handler_t;
+
+struct spx_input_stream_t {
+    const file_handler_t * file_handler;
+    void * file;
+};
+
+static FILE * open_file_at(const char * file_name, size_t offset);
+
+static void * stdio_file_handler_open(const char * file_name, size_t offset);
+static void stdio_file_handler_close(void * file);
+static size_t stdio_file_handler_read(void * file, void * buf, size_t size);
+
+static void * gz_file_handler_open(const char * file_name, size_t offset);
+static void gz_file_handler_close(void * file);
+static size_t gz_file_handler_read(void * file, void * buf, size_t size);
+
+#define DEFLATE_IN_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    FILE * fp;
+    int eof;
+    int end;
+    z_stream stream;
+    unsigned char in_buf[DEFLATE_IN_BUFFER_SIZE];
+} deflate_file_t;
+
+static void * deflate_file_handler_open(const char * file_name, size_t offset);
+static void deflate_file_handler_close(void * file);
+static size_t deflate_file_handler_read(void * file, void * buf, size_t size);
+
+static file_handler_t stdio_file_handler = {
+    stdio_file_handler_open,
+    stdio_file_handler_close,
+    stdio_file_handler_read
+};
+
+static file_handler_t gz_file_handler = {
+    gz_file_handler_open,
+    gz_file_handler_close,
+    gz_file_handler_read
+};
+
+/*
+ *  Reads the raw deflate stream of a gzip member from a full flush point, i.e. from an offset
+ *  returned by spx_output_stream_sync(), and up to the end of the deflate stream.
+ */
+static file_handler_t deflate_file_handler = {
+    deflate_file_handler_open,
+    deflate_file_handler_close,
+    deflate_file_handler_read
+};
+
+#ifdef HAVE_SPX_ZSTD
+typedef struct {
+    FILE * fp;
+    int eof;
+    ZSTD_DCtx * dctx;
+    ZSTD_inBuffer in;
+    size_t in_capacity;
+    unsigned char * in_buf;
+} zstd_file_t;
+
+static void * zstd_file_handler_open(const char * file_name, size_t offset);
+static void zstd_file_handler_close(void * file);
+static size_t zstd_file_handler_read(void * file, void * buf, size_t size);
+
+static file_handler_t zstd_file_handler = {
+    zstd_file_handler_open,
+    zstd_file_handler_close,
+    zstd_file_handler_read
+};
+#endif
+
+#ifdef HAVE_SPX_LZ4
+#define LZ4_IN_BUFFER_SIZE (64 * 1024)
+
+typedef struct {
+    FILE * fp;
+    int eof;
+    LZ4F_dctx * dctx;
+    size_t in_pos;
+    size_t in_size;
+    unsigned char in_buf[LZ4_IN_BUFFER_SIZE];
+} lz4_file_t;
+
+static void * lz4_file_handler_open(const char * file_name, size_t offset);
+static void lz4_file_handler_close(void * file);
+static size_t lz4_file_handler_read(void * file, void * buf, size_t size);
+
+static file_handler_t lz4_file_handler = {
+    lz4_file_handler_open,
+    lz4_file_handler_close,
+    lz4_file_handler_read
+};
+#endif
+
+spx_input_stream_t * spx_input_stream_open(const char * file_name, spx_output_stream_codec_t codec)
+{
+    return spx_input_stream_open_at(file_name, codec, 0);
+}
+
+spx_input_stream_t * spx_input_stream_open_at(
+    const char * file_name,
+    spx_output_stream_codec_t codec,
+    size_t offset
+) {
+    const file_handler_t * file_handler = NULL;
+    switch (codec) {
+        case SPX_OUTPUT_STREAM_CODEC_RAW:
+            file_handler = &stdio_file_handler;
+            break;
+
+        case SPX_OUTPUT_STREAM_CODEC_GZIP:
+            file_handler = offset > 0 ? &deflate_file_handler : &gz_file_handler;
+            break;
+
+#ifdef HAVE_SPX_ZSTD
+        case SPX_OUTPUT_STREAM_CODEC_ZSTD:
+            file_handler = &zstd_file_handler;
+            break;
+#endif
+
+#ifdef HAVE_SPX_LZ4
+        case SPX_OUTPUT_STREAM_CODEC_LZ4:
+            file_handler = &lz4_file_handler;
+            break;
+#endif
+
+        default:
+            return NULL;
+    }
+
+    void * file = file_handler->open(file_name, offset);
+    if (!file) {
+        return NULL;
+    }
+
+    spx_input_stream_t * input = malloc(sizeof(*input));
+    if (!input) {
+        file_handler->close(file);
+
+        return NULL;
+    }
+
+    input->file_handler = file_handler;
+    input->file = file;
+
+    return input;
+}
+
+void spx_input_stream_close(spx_input_stream_t * input)
+{
+    input->file_handler->close(input->file);
+
+    free(input);
+}
+
+size_t spx_input_stream_read(spx_input_stream_t * input, void * buf, size_t size)
+{
+    return input->file_handler->read(input->file, buf, size);
+}
+
+static FILE * open_file_at(const char * file_name, size_t offset)
+{
+    FILE * fp = fopen(file_name, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    if (offset > 0 && fseek(fp, offset, SEEK_SET) != 0) {
+        fclose(fp);
+
+        return NULL;
+    }
+
+    return fp;
+}
+
+static void * stdio_file_handler_open(const char * file_name, size_t offset)
+{
+    return open_file_at(file_name, offset);
+}
+
+static void stdio_file_handler_close(void * file)
+{
+    fclose(file);
+}
+
+static size_t stdio_file_handler_read(void * file, void * buf, size_t size)
+{
+    return fread(buf, 1, size, file);
+}
+
+static void * gz_file_handler_open(const char * file_name, size_t offset)
+{
+    (void) offset;
+
+    return gzopen(file_name, "rb");
+}
+
+static void gz_file_handler_close(void * file)
+{
+    gzclose(file);
+}
+
+static size_t gz_file_handler_read(void * file, void * buf, size_t size)
+{
+    const int read = gzread(file, buf, size);
+
+    return read < 0 ? 0 : read;
+}
+
+static void * deflate_file_handler_open(const char * file_name, size_t offset)
+{
+    deflate_file_t * file = malloc(sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+
+    file->eof = 0;
+    file->end = 0;
+
+    memset(&file->stream, 0, sizeof(file->stream));
+    if (inflateInit2(&file->stream, -MAX_WBITS) != Z_OK) {
+        free(file);
+
+        return NULL;
+    }
+
+    file->fp = open_file_at(file_name, offset);
+    if (!file->fp) {
+        inflateEnd(&file->stream);
+        free(file);
+
+        return NULL;
+    }
+
+    return file;
+}
+
+static void deflate_file_handler_close(void * file)
+{
+    deflate_file_t * deflate_file = file;
+
+    fclose(deflate_file->fp);
+    inflateEnd(&deflate_file->stream);
+    free(deflate_file);
+}
+
+static size_t deflate_file_handler_read(void * file, void * buf, size_t size)
+{
+    deflate_file_t * deflate_file = file;
+
+    deflate_file->stream.next_out = buf;
+    deflate_file->stream.avail_out = size;
+
+    while (deflate_file->stream.avail_out > 0 && !deflate_file->end) {
+        if (deflate_file->stream.avail_in == 0 && !deflate_file->eof) {
+            deflate_file->stream.next_in = deflate_file->in_buf;
+            deflate_file->stream.avail_in = fread(deflate_file->in_buf, 1, sizeof(deflate_file->in_buf), deflate_file->fp);
+            deflate_file->eof = deflate_file->stream.avail_in == 0;
+        }
+
+        const uInt previous_avail_out = deflate_file->stream.avail_out;
+        const int status = inflate(&deflate_file->stream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+            deflate_file->end = 1;
+            break;
+        }
+
+        if (status != Z_OK && status != Z_BUF_ERROR) {
+            break;
+        }
+
+        if (deflate_file->eof && deflate_file->stream.avail_out == previous_avail_out) {
+            break;
+        }
+    }
+
+    return size - deflate_file->stream.avail_out;
+}
+
+#ifdef HAVE_SPX_ZSTD
+static void * zstd_file_handler_open(const char * file_name, size_t offset)
+{
+    zstd_file_t * file = malloc(sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+
+    file->eof = 0;
+    file->dctx = NULL;
+    file->in_buf = NULL;
+
+    file->fp = open_file_at(file_name, offset);
+    if (!file->fp) {
+        goto error;
+    }
+
+    file->dctx = ZSTD_createDCtx();
+    if (!file->dctx) {
+        goto error;
+    }
+
+    file->in_capacity = ZSTD_DStreamInSize();
+    file->in_buf = malloc(file->in_capacity);
+    if (!file->in_buf) {
+        goto error;
+    }
+
+    file->in.src = file->in_buf;
+    file->in.size = 0;
+    file->in.pos = 0;
+
+    return file;
+
+error:
+    if (file->fp) {
+        fclose(file->fp);
+    }
+
+    ZSTD_freeDCtx(file->dctx);
+    free(file->in_buf);
+    free(file);
+
+    return NULL;
+}
+
+static void zstd_file_handler_close(void * file)
+{
+    zstd_file_t * zstd_file = file;
+
+    fclose(zstd_file->fp);
+    ZSTD_freeDCtx(zstd_file->dctx);
+    free(zstd_file->in_buf);
+    free(zstd_file);
+}
+
+static size_t zstd_file_handler_read(void * file, void * buf, size_t size)
+{
+    zstd_file_t * zstd_file = file;
+    ZSTD_outBuffer out = { buf, size, 0 };
+
+    while (out.pos < out.size) {
+        if (zstd_file->in.pos == zstd_file->in.size && !zstd_file->eof) {
+            zstd_file->in.size = fread(zstd_file->in_buf, 1, zstd_file->in_capacity, zstd_file->fp);
+            zstd_file->in.pos = 0;
+            zstd_file->eof = zstd_file->in.size == 0;
+        }
+
+        const size_t previous_pos = out.pos;
+        if (ZSTD_isError(ZSTD_decompressStream(zstd_file->dctx, &out, &zstd_file->in))) {
+            break;
+        }
+
+        if (zstd_file->eof && out.pos == previous_pos) {
+            break;
+        }
+    }
+
+    return out.pos;
+}
+#endif
+
+#ifdef HAVE_SPX_LZ4
+static void * lz4_file_handler_open(const char * file_name, size_t offset)
+{
+    lz4_file_t * file = malloc(sizeof(*file));
+    if (!file) {
+        return NULL;
+    }
+
+    file->eof = 0;
+    file->in_pos = 0;
+    file->in_size = 0;
+
+    file->fp = open_file_at(file_name, offset);
+    if (!file->fp) {
+        free(file);
+
+        return NULL;
+    }
+
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&file->dctx, LZ4F_VERSION))) {
+        fclose(file->fp);
+        free(file);
+
+        return NULL;
+    }
+
+    return file;
+}
+
+static void lz4_file_handler_close(void * file)
+{
+    lz4_file_t * lz4_file = file;
+
+    fclose(lz4_file->fp);
+    LZ4F_freeDecompressionContext(lz4_file->dctx);
+    free(lz4_file);
+}
+
+static size_t lz4_file_handler_read(void * file, void * buf, size_t size)
+{
+    lz4_file_t * lz4_file = file;
+    size_t read = 0;
+
+    while (read < size) {
+        if (lz4_file->in_pos == lz4_file->in_size && !lz4_file->eof) {
+            lz4_file->in_size = fread(lz4_file->in_buf, 1, sizeof(lz4_file->in_buf), lz4_file->fp);
+            lz4_file->in_pos = 0;
+            lz4_file->eof = lz4_file->in_size == 0;
+        }
+
+        size_t dst_size = size - read;
+        size_t src_size = lz4_file->in_size - lz4_file->in_pos;
+
+        if (LZ4F_isError(LZ4F_decompress(
+            lz4_file->dctx,
+            (char *) buf + read,
+            &dst_size,
+            lz4_file->in_buf + lz4_file->in_pos,
+            &src_size,
+            NULL
+        ))) {
+            break;
+        }
+
+        lz4_file->in_pos += src_size;
+        read += dst_size;
+
+        if (lz4_file->eof && dst_size == 0) {
+            break;
+        }
+    }
+
+    return read;
+}
+#endif
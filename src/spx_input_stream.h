@@ -0,0 +1,41 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_INPUT_STREAM_H_DEFINED
+#define SPX_INPUT_STREAM_H_DEFINED
+
+#include <stddef.h>
+#include "spx_output_stream.h"
+
+/* Reads back, decoded, a file written through spx_output_stream_open() */
+typedef struct spx_input_stream_t spx_input_stream_t;
+
+spx_input_stream_t * spx_input_stream_open(const char * file_name, spx_output_stream_codec_t codec);
+
+/* starts reading at offset, which must have been returned by spx_output_stream_sync() */
+spx_input_stream_t * spx_input_stream_open_at(
+    const char * file_name,
+    spx_output_stream_codec_t codec,
+    size_t offset
+);
+void spx_input_stream_close(spx_input_stream_t * input);
+
+/* returns the number of read bytes, less than size only at end of stream or on error */
+size_t spx_input_stream_read(spx_input_stream_t * input, void * buf, size_t size);
+
+#endif /* SPX_INPUT_STREAM_H_DEFINED */
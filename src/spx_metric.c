@@ -33,6 +33,8 @@
 
 struct spx_metric_collector_t {
     int enabled_metrics[SPX_METRIC_COUNT];
+    size_t enabled_metric_count;
+    spx_metric_t enabled_metric_list[SPX_METRIC_COUNT];
     double ref_values[SPX_METRIC_COUNT];
     double last_values[SPX_METRIC_COUNT];
     double current_fixed_noise[SPX_METRIC_COUNT];
@@ -45,9 +47,10 @@ static size_t metric_handler_io_r_bytes(void);
 static size_t metric_handler_io_w_bytes(void);
 
 static void memoize_io_stats(void);
+static void memoize_metric_value(spx_metric_t metric, size_t value);
 static size_t memoized_metric_value(spx_metric_t metric);
 
-static void collect_raw_values(const int * enabled_metrics, double * current_values);
+static void collect_raw_values(const spx_metric_collector_t * collector, double * current_values);
 
 const spx_metric_info_t spx_metric_info[SPX_METRIC_COUNT] = {
     ARRAY_INIT_INDEX(SPX_METRIC_WALL_TIME) {
@@ -233,6 +236,14 @@ static SPX_THREAD_TLS struct {
     size_t value;
 } memoized_metric_values[SPX_METRIC_COUNT];
 
+/*
+ *  Metrics memoized since the last collection, so that only them have to be reset.
+ */
+static SPX_THREAD_TLS struct {
+    size_t count;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+} memoized_metric_list;
+
 spx_metric_t spx_metric_get_by_key(const char * key)
 {
     SPX_METRIC_FOREACH(i, {
@@ -244,6 +255,12 @@ spx_metric_t spx_metric_get_by_key(const char * key)
     return SPX_METRIC_NONE;
 }
 
+int spx_metric_process_wide_enabled(const int * enabled_metrics)
+{
+    /* these metrics would also account for the activity of our own background threads */
+    return enabled_metrics[SPX_METRIC_CPU_TIME] || enabled_metrics[SPX_METRIC_IDLE_TIME];
+}
+
 spx_metric_collector_t * spx_metric_collector_create(const int * enabled_metrics)
 {
     spx_metric_collector_t * collector = malloc(sizeof(*collector));
@@ -251,14 +268,23 @@ spx_metric_collector_t * spx_metric_collector_create(const int * enabled_metrics
         return NULL;
     }
 
-    collect_raw_values(enabled_metrics, collector->last_values);
-
+    collector->enabled_metric_count = 0;
     SPX_METRIC_FOREACH(i, {
         collector->enabled_metrics[i] = enabled_metrics[i];
-        collector->ref_values[i] = collector->last_values[i];
+        if (enabled_metrics[i]) {
+            collector->enabled_metric_list[collector->enabled_metric_count++] = i;
+        }
+
+        collector->last_values[i] = 0;
         collector->current_fixed_noise[i] = 0;
     });
 
+    collect_raw_values(collector, collector->last_values);
+
+    SPX_METRIC_FOREACH(i, {
+        collector->ref_values[i] = collector->last_values[i];
+    });
+
     return collector;
 }
 
@@ -271,7 +297,7 @@ void spx_metric_collector_collect(spx_metric_collector_t * collector, double * v
 {
     double current_values[SPX_METRIC_COUNT];
 
-    collect_raw_values(collector->enabled_metrics, current_values);
+    collect_raw_values(collector, current_values);
 
     /*
      *  This branch is required to fix cpu / wall time inconsistency (cpu > wall time within a single thread).
@@ -291,10 +317,9 @@ void spx_metric_collector_collect(spx_metric_collector_t * collector, double * v
         }
     }
 
-    SPX_METRIC_FOREACH(i, {
-        if (!collector->enabled_metrics[i]) {
-            continue;
-        }
+    size_t j;
+    for (j = 0; j < collector->enabled_metric_count; j++) {
+        const spx_metric_t i = collector->enabled_metric_list[j];
 
         if (!spx_metric_info[i].releasable) {
             const double diff = current_values[i] - collector->last_values[i];
@@ -308,24 +333,28 @@ void spx_metric_collector_collect(spx_metric_collector_t * collector, double * v
 
         collector->last_values[i] = current_values[i];
         values[i] = collector->last_values[i] - collector->ref_values[i];
-    });
+    }
 }
 
 void spx_metric_collector_noise_barrier(spx_metric_collector_t * collector)
 {
     double current_values[SPX_METRIC_COUNT];
-    collect_raw_values(collector->enabled_metrics, current_values);
+    collect_raw_values(collector, current_values);
 
-    SPX_METRIC_FOREACH(i, {
+    size_t j;
+    for (j = 0; j < collector->enabled_metric_count; j++) {
+        const spx_metric_t i = collector->enabled_metric_list[j];
         collector->current_fixed_noise[i] += current_values[i] - collector->last_values[i];
-    });
+    }
 }
 
 void spx_metric_collector_add_fixed_noise(spx_metric_collector_t * collector, const double * noise)
 {
-    SPX_METRIC_FOREACH(i, {
+    size_t j;
+    for (j = 0; j < collector->enabled_metric_count; j++) {
+        const spx_metric_t i = collector->enabled_metric_list[j];
         collector->current_fixed_noise[i] += noise[i];
-    });
+    }
 }
 
 static size_t metric_handler_idle_time(void)
@@ -364,36 +393,39 @@ static void memoize_io_stats(void)
     size_t in, out;
     spx_resource_stats_io(&in, &out);
 
-    memoized_metric_values[SPX_METRIC_IO_RBYTES].value = in;
-    memoized_metric_values[SPX_METRIC_IO_RBYTES].memoized = 1;
+    memoize_metric_value(SPX_METRIC_IO_RBYTES, in);
+    memoize_metric_value(SPX_METRIC_IO_WBYTES, out);
+}
 
-    memoized_metric_values[SPX_METRIC_IO_WBYTES].value = out;
-    memoized_metric_values[SPX_METRIC_IO_WBYTES].memoized = 1;
+static void memoize_metric_value(spx_metric_t metric, size_t value)
+{
+    memoized_metric_values[metric].value = value;
+    if (!memoized_metric_values[metric].memoized) {
+        memoized_metric_values[metric].memoized = 1;
+        memoized_metric_list.metrics[memoized_metric_list.count++] = metric;
+    }
 }
 
 static size_t memoized_metric_value(spx_metric_t metric)
 {
     if (!memoized_metric_values[metric].memoized) {
-        memoized_metric_values[metric].value = spx_metric_info[metric].handler();
-        memoized_metric_values[metric].memoized = 1;
+        memoize_metric_value(metric, spx_metric_info[metric].handler());
     }
 
     return memoized_metric_values[metric].value;
 }
 
-static void collect_raw_values(const int * enabled_metrics, double * current_values)
+static void collect_raw_values(const spx_metric_collector_t * collector, double * current_values)
 {
-    SPX_METRIC_FOREACH(i, {
-        memoized_metric_values[i].memoized = 0;
-    });
-
-    SPX_METRIC_FOREACH(i, {
-        if (!enabled_metrics[i]) {
-            current_values[i] = 0;
+    size_t j;
+    for (j = 0; j < memoized_metric_list.count; j++) {
+        memoized_metric_values[memoized_metric_list.metrics[j]].memoized = 0;
+    }
 
-            continue;
-        }
+    memoized_metric_list.count = 0;
 
+    for (j = 0; j < collector->enabled_metric_count; j++) {
+        const spx_metric_t i = collector->enabled_metric_list[j];
         current_values[i] = memoized_metric_value(i);
-    });
+    }
 }
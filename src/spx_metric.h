@@ -72,12 +72,14 @@ typedef struct {
 extern const spx_metric_info_t spx_metric_info[SPX_METRIC_COUNT];
 
 spx_metric_t spx_metric_get_by_key(const char * key);
+int spx_metric_process_wide_enabled(const int * enabled_metrics);
 
 typedef struct spx_metric_collector_t spx_metric_collector_t;
 
 spx_metric_collector_t * spx_metric_collector_create(const int * enabled_metrics);
 void spx_metric_collector_destroy(spx_metric_collector_t * collector);
 
+/* only the values of the enabled metrics are written, the other ones are left untouched */
 void spx_metric_collector_collect(spx_metric_collector_t * collector, double * values);
 void spx_metric_collector_noise_barrier(spx_metric_collector_t * collector);
 void spx_metric_collector_add_fixed_noise(spx_metric_collector_t * collector, const double * noise);
@@ -28,35 +28,66 @@
 
 #include <zlib.h>
 
+#ifdef HAVE_SPX_ZSTD
+#   include <zstd.h>
+#endif
+
+#ifdef HAVE_SPX_LZ4
+#   include <lz4frame.h>
+#endif
+
 #include "spx_output_stream.h"
+#include "spx_utils.h"
+
+#define PRINTF_BUFFER_SIZE 1024
 
 typedef struct {
-    void * (*open)     (const char * file_name);
-    void * (*dopen)    (int fileno);
+    void * (*open)     (const char * file_name, const spx_output_stream_compression_t * compression);
+    void * (*dopen)    (int fileno, const spx_output_stream_compression_t * compression);
     void   (*close)    (void * file);
     void   (*flush)    (void * file);
+    int    (*sync)     (void * file, size_t * offset);
     int    (*print)    (void * file, const char * str);
+    int    (*write)    (void * file, const void * ptr, size_t len);
     int    (*vprintf)  (void * file, const char * fmt, va_list ap);
 } file_handler_t;
 
+typedef struct {
+    const char * key;
+    const char * file_suffix;
+    const file_handler_t * file_handler;
+} codec_info_t;
+
 struct spx_output_stream_t {
     const file_handler_t * file_handler;
     void * file;
     int owned;
 };
 
-static void * stdio_file_handler_open(const char * file_name);
-static void * stdio_file_handler_dopen(int fileno);
+static int vprintf_through_write(
+    int (*write) (void * file, const void * ptr, size_t len),
+    void * file,
+    const char * fmt,
+    va_list ap
+);
+
+static void * stdio_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression);
+static void * stdio_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression);
 static void stdio_file_handler_close(void * file);
 static void stdio_file_handler_flush(void * file);
+static int stdio_file_handler_sync(void * file, size_t * offset);
 static int stdio_file_handler_print(void * file, const char * str);
+static int stdio_file_handler_write(void * file, const void * ptr, size_t len);
 static int stdio_file_handler_vprintf(void * file, const char * fmt, va_list ap);
 
-static void * gz_file_handler_open(const char * file_name);
-static void * gz_file_handler_dopen(int fileno);
+static const char * gz_file_handler_mode(const spx_output_stream_compression_t * compression);
+static void * gz_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression);
+static void * gz_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression);
 static void gz_file_handler_close(void * file);
 static void gz_file_handler_flush(void * file);
+static int gz_file_handler_sync(void * file, size_t * offset);
 static int gz_file_handler_print(void * file, const char * str);
+static int gz_file_handler_write(void * file, const void * ptr, size_t len);
 static int gz_file_handler_vprintf(void * file, const char * fmt, va_list ap);
 
 static file_handler_t stdio_file_handler = {
@@ -64,7 +95,9 @@ static file_handler_t stdio_file_handler = {
     stdio_file_handler_dopen,
     stdio_file_handler_close,
     stdio_file_handler_flush,
+    stdio_file_handler_sync,
     stdio_file_handler_print,
+    stdio_file_handler_write,
     stdio_file_handler_vprintf
 };
 
@@ -73,10 +106,135 @@ static file_handler_t gz_file_handler = {
     gz_file_handler_dopen,
     gz_file_handler_close,
     gz_file_handler_flush,
+    gz_file_handler_sync,
     gz_file_handler_print,
+    gz_file_handler_write,
     gz_file_handler_vprintf
 };
 
+#ifdef HAVE_SPX_ZSTD
+typedef struct {
+    FILE * fp;
+    ZSTD_CCtx * cctx;
+    size_t out_capacity;
+    unsigned char * out;
+} zstd_file_t;
+
+static void * zstd_file_handler_create(FILE * fp, const spx_output_stream_compression_t * compression);
+static int zstd_file_handler_compress(zstd_file_t * file, const void * ptr, size_t len, ZSTD_EndDirective directive);
+static void * zstd_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression);
+static void * zstd_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression);
+static void zstd_file_handler_close(void * file);
+static void zstd_file_handler_flush(void * file);
+static int zstd_file_handler_sync(void * file, size_t * offset);
+static int zstd_file_handler_print(void * file, const char * str);
+static int zstd_file_handler_write(void * file, const void * ptr, size_t len);
+static int zstd_file_handler_vprintf(void * file, const char * fmt, va_list ap);
+
+static file_handler_t zstd_file_handler = {
+    zstd_file_handler_open,
+    zstd_file_handler_dopen,
+    zstd_file_handler_close,
+    zstd_file_handler_flush,
+    zstd_file_handler_sync,
+    zstd_file_handler_print,
+    zstd_file_handler_write,
+    zstd_file_handler_vprintf
+};
+#endif
+
+#ifdef HAVE_SPX_LZ4
+/* size of the input chunks given to LZ4F_compressUpdate(), the output buffer is sized accordingly */
+#define LZ4_CHUNK_SIZE (64 * 1024)
+
+typedef struct {
+    FILE * fp;
+    LZ4F_cctx * cctx;
+    LZ4F_preferences_t preferences;
+    size_t out_capacity;
+    unsigned char * out;
+} lz4_file_t;
+
+static void * lz4_file_handler_create(FILE * fp, const spx_output_stream_compression_t * compression);
+static int lz4_file_handler_output(lz4_file_t * file, size_t size);
+static void * lz4_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression);
+static void * lz4_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression);
+static void lz4_file_handler_close(void * file);
+static void lz4_file_handler_flush(void * file);
+static int lz4_file_handler_sync(void * file, size_t * offset);
+static int lz4_file_handler_print(void * file, const char * str);
+static int lz4_file_handler_write(void * file, const void * ptr, size_t len);
+static int lz4_file_handler_vprintf(void * file, const char * fmt, va_list ap);
+
+static file_handler_t lz4_file_handler = {
+    lz4_file_handler_open,
+    lz4_file_handler_dopen,
+    lz4_file_handler_close,
+    lz4_file_handler_flush,
+    lz4_file_handler_sync,
+    lz4_file_handler_print,
+    lz4_file_handler_write,
+    lz4_file_handler_vprintf
+};
+#endif
+
+static const codec_info_t codec_info[SPX_OUTPUT_STREAM_CODEC_COUNT] = {
+    { "none", "",     &stdio_file_handler },
+    { "gzip", ".gz",  &gz_file_handler },
+#ifdef HAVE_SPX_ZSTD
+    { "zstd", ".zst", &zstd_file_handler },
+#else
+    { "zstd", ".zst", NULL },
+#endif
+#ifdef HAVE_SPX_LZ4
+    { "lz4",  ".lz4", &lz4_file_handler },
+#else
+    { "lz4",  ".lz4", NULL },
+#endif
+};
+
+spx_output_stream_codec_t spx_output_stream_codec_get_by_key(const char * key)
+{
+    int i;
+    for (i = 0; i < SPX_OUTPUT_STREAM_CODEC_COUNT; i++) {
+        if (0 == strcmp(codec_info[i].key, key)) {
+            return i;
+        }
+    }
+
+    return SPX_OUTPUT_STREAM_CODEC_UNKNOWN;
+}
+
+spx_output_stream_codec_t spx_output_stream_codec_get_by_file_name(const char * file_name)
+{
+    int i;
+    for (i = 0; i < SPX_OUTPUT_STREAM_CODEC_COUNT; i++) {
+        if (
+            codec_info[i].file_suffix[0]
+            && spx_utils_str_ends_with(file_name, codec_info[i].file_suffix)
+        ) {
+            return i;
+        }
+    }
+
+    return SPX_OUTPUT_STREAM_CODEC_RAW;
+}
+
+const char * spx_output_stream_codec_key(spx_output_stream_codec_t codec)
+{
+    return codec_info[codec].key;
+}
+
+const char * spx_output_stream_codec_file_suffix(spx_output_stream_codec_t codec)
+{
+    return codec_info[codec].file_suffix;
+}
+
+int spx_output_stream_codec_available(spx_output_stream_codec_t codec)
+{
+    return codec_info[codec].file_handler != NULL;
+}
+
 static spx_output_stream_t * create_output_stream(const file_handler_t * file_handler, void * file, int owned)
 {
     if (!file) {
@@ -99,18 +257,40 @@ static spx_output_stream_t * create_output_stream(const file_handler_t * file_ha
     return output;
 }
 
-spx_output_stream_t * spx_output_stream_open(const char * file_name, int compressed)
+static const file_handler_t * get_file_handler(const spx_output_stream_compression_t * compression)
 {
-    const file_handler_t * file_handler = compressed ? &gz_file_handler : &stdio_file_handler;
+    if (!compression || !spx_output_stream_codec_available(compression->codec)) {
+        return &stdio_file_handler;
+    }
 
-    return create_output_stream(file_handler, file_handler->open(file_name), 1);
+    return codec_info[compression->codec].file_handler;
 }
 
-spx_output_stream_t * spx_output_stream_dopen(int fileno, int compressed)
-{
-    const file_handler_t * file_handler = compressed ? &gz_file_handler : &stdio_file_handler;
+spx_output_stream_t * spx_output_stream_open(
+    const char * file_name,
+    const spx_output_stream_compression_t * compression
+) {
+    const file_handler_t * file_handler = get_file_handler(compression);
 
-    return create_output_stream(file_handler, file_handler->dopen(fileno), 0);
+    return create_output_stream(file_handler, file_handler->open(file_name, compression), 1);
+}
+
+spx_output_stream_t * spx_output_stream_dopen(
+    int fileno,
+    const spx_output_stream_compression_t * compression
+) {
+    const file_handler_t * file_handler = get_file_handler(compression);
+
+    return create_output_stream(file_handler, file_handler->dopen(fileno, compression), 0);
+}
+
+spx_output_stream_t * spx_output_stream_fdopen(
+    int fileno,
+    const spx_output_stream_compression_t * compression
+) {
+    const file_handler_t * file_handler = get_file_handler(compression);
+
+    return create_output_stream(file_handler, file_handler->dopen(fileno, compression), 1);
 }
 
 void spx_output_stream_close(spx_output_stream_t * output)
@@ -129,6 +309,11 @@ void spx_output_stream_print(spx_output_stream_t * output, const char * str)
     output->file_handler->print(output->file, str);
 }
 
+void spx_output_stream_write(spx_output_stream_t * output, const void * ptr, size_t len)
+{
+    output->file_handler->write(output->file, ptr, len);
+}
+
 void spx_output_stream_printf(spx_output_stream_t * output, const char * format, ...)
 {
     va_list argp;
@@ -142,12 +327,63 @@ void spx_output_stream_flush(spx_output_stream_t * output)
     output->file_handler->flush(output->file);
 }
 
-static void * stdio_file_handler_open(const char * file_name)
+int spx_output_stream_sync(spx_output_stream_t * output, size_t * offset)
+{
+    return output->file_handler->sync(output->file, offset);
+}
+
+static int file_offset(FILE * fp, size_t * offset)
+{
+    const long position = ftell(fp);
+    if (position < 0) {
+        return -1;
+    }
+
+    *offset = position;
+
+    return 0;
+}
+
+static int vprintf_through_write(
+    int (*write) (void * file, const void * ptr, size_t len),
+    void * file,
+    const char * fmt,
+    va_list ap
+) {
+    /* a stack buffer is enough for almost all calls, sparing an allocation */
+    char buf[PRINTF_BUFFER_SIZE];
+
+    va_list ap_copy;
+    va_copy(ap_copy, ap);
+    int printed = vsnprintf(buf, sizeof(buf), fmt, ap_copy);
+    va_end(ap_copy);
+
+    if (printed < 0) {
+        return printed;
+    }
+
+    if ((size_t) printed < sizeof(buf)) {
+        return write(file, buf, printed);
+    }
+
+    char * heap_buf;
+    printed = vasprintf(&heap_buf, fmt, ap);
+    if (printed < 0) {
+        return printed;
+    }
+
+    printed = write(file, heap_buf, printed);
+    free(heap_buf);
+
+    return printed;
+}
+
+static void * stdio_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression)
 {
     return fopen(file_name, "w");
 }
 
-static void * stdio_file_handler_dopen(int fileno)
+static void * stdio_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression)
 {
     return fdopen(fileno, "w");
 }
@@ -162,24 +398,47 @@ static void stdio_file_handler_flush(void * file)
     fflush(file);
 }
 
+static int stdio_file_handler_sync(void * file, size_t * offset)
+{
+    if (fflush(file) != 0) {
+        return -1;
+    }
+
+    return file_offset(file, offset);
+}
+
 static int stdio_file_handler_print(void * file, const char * str)
 {
     return fputs(str, file);
 }
 
+static int stdio_file_handler_write(void * file, const void * ptr, size_t len)
+{
+    return fwrite(ptr, 1, len, file);
+}
+
 static int stdio_file_handler_vprintf(void * file, const char * fmt, va_list ap)
 {
     return vfprintf(file, fmt, ap);
 }
 
-static void * gz_file_handler_open(const char * file_name)
+static const char * gz_file_handler_mode(const spx_output_stream_compression_t * compression)
 {
-    return gzopen(file_name, "w1");
+    static const char * modes[] = {
+        "wb1", "wb1", "wb2", "wb3", "wb4", "wb5", "wb6", "wb7", "wb8", "wb9",
+    };
+
+    return modes[compression->level < 0 ? 0 : (compression->level > 9 ? 9 : compression->level)];
 }
 
-static void * gz_file_handler_dopen(int fileno)
+static void * gz_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression)
 {
-    return gzdopen(fileno, "w1");
+    return gzopen(file_name, gz_file_handler_mode(compression));
+}
+
+static void * gz_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression)
+{
+    return gzdopen(fileno, gz_file_handler_mode(compression));
 }
 
 static void gz_file_handler_close(void * file)
@@ -192,21 +451,338 @@ static void gz_file_handler_flush(void * file)
     gzflush(file, Z_SYNC_FLUSH);
 }
 
+static int gz_file_handler_sync(void * file, size_t * offset)
+{
+    /*
+     *  A full flush resets the compression dictionary, raw inflating can then start from
+     *  the current offset (see spx_input_stream_open_at()).
+     */
+    if (gzflush(file, Z_FULL_FLUSH) != Z_OK) {
+        return -1;
+    }
+
+    const z_off_t position = gzoffset(file);
+    if (position < 0) {
+        return -1;
+    }
+
+    *offset = position;
+
+    return 0;
+}
+
 static int gz_file_handler_print(void * file, const char * str)
 {
     return gzputs(file, str);
 }
 
+static int gz_file_handler_write(void * file, const void * ptr, size_t len)
+{
+    return gzwrite(file, ptr, len);
+}
+
 static int gz_file_handler_vprintf(void * file, const char * fmt, va_list ap)
 {
-    char * buf;
-    int printed = vasprintf(&buf, fmt, ap);
-    if (printed < 0) {
-        return printed;
+    return vprintf_through_write(gz_file_handler_write, file, fmt, ap);
+}
+
+#ifdef HAVE_SPX_ZSTD
+static void * zstd_file_handler_create(FILE * fp, const spx_output_stream_compression_t * compression)
+{
+    if (!fp) {
+        return NULL;
     }
 
-    printed = gzputs(file, buf);
-    free(buf);
+    zstd_file_t * file = malloc(sizeof(*file));
+    if (!file) {
+        goto error;
+    }
 
-    return printed;
+    file->fp = fp;
+    file->out = NULL;
+
+    file->cctx = ZSTD_createCCtx();
+    if (!file->cctx) {
+        goto error;
+    }
+
+    ZSTD_CCtx_setParameter(
+        file->cctx,
+        ZSTD_c_compressionLevel,
+        compression->level > 0 ? compression->level : 1
+    );
+
+    if (compression->long_mode) {
+        ZSTD_CCtx_setParameter(file->cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    }
+
+    file->out_capacity = ZSTD_CStreamOutSize();
+    file->out = malloc(file->out_capacity);
+    if (!file->out) {
+        goto error;
+    }
+
+    return file;
+
+error:
+    fclose(fp);
+
+    if (file) {
+        ZSTD_freeCCtx(file->cctx);
+        free(file->out);
+        free(file);
+    }
+
+    return NULL;
+}
+
+static int zstd_file_handler_compress(zstd_file_t * file, const void * ptr, size_t len, ZSTD_EndDirective directive)
+{
+    ZSTD_inBuffer input = { ptr, len, 0 };
+
+    while (1) {
+        ZSTD_outBuffer output = { file->out, file->out_capacity, 0 };
+
+        const size_t remaining = ZSTD_compressStream2(file->cctx, &output, &input, directive);
+        if (ZSTD_isError(remaining)) {
+            return -1;
+        }
+
+        if (output.pos > 0 && fwrite(file->out, 1, output.pos, file->fp) != output.pos) {
+            return -1;
+        }
+
+        if (directive == ZSTD_e_continue ? input.pos == input.size : remaining == 0) {
+            break;
+        }
+    }
+
+    return len;
+}
+
+static void * zstd_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression)
+{
+    return zstd_file_handler_create(fopen(file_name, "wb"), compression);
+}
+
+static void * zstd_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression)
+{
+    return zstd_file_handler_create(fdopen(fileno, "wb"), compression);
 }
+
+static void zstd_file_handler_close(void * file)
+{
+    zstd_file_t * zstd_file = file;
+
+    zstd_file_handler_compress(zstd_file, NULL, 0, ZSTD_e_end);
+
+    fclose(zstd_file->fp);
+    ZSTD_freeCCtx(zstd_file->cctx);
+    free(zstd_file->out);
+    free(zstd_file);
+}
+
+static void zstd_file_handler_flush(void * file)
+{
+    zstd_file_t * zstd_file = file;
+
+    zstd_file_handler_compress(zstd_file, NULL, 0, ZSTD_e_flush);
+    fflush(zstd_file->fp);
+}
+
+static int zstd_file_handler_sync(void * file, size_t * offset)
+{
+    zstd_file_t * zstd_file = file;
+
+    /* ending the frame, the next one will be decodable on its own */
+    if (zstd_file_handler_compress(zstd_file, NULL, 0, ZSTD_e_end) < 0) {
+        return -1;
+    }
+
+    if (fflush(zstd_file->fp) != 0) {
+        return -1;
+    }
+
+    return file_offset(zstd_file->fp, offset);
+}
+
+static int zstd_file_handler_print(void * file, const char * str)
+{
+    return zstd_file_handler_compress(file, str, strlen(str), ZSTD_e_continue);
+}
+
+static int zstd_file_handler_write(void * file, const void * ptr, size_t len)
+{
+    return zstd_file_handler_compress(file, ptr, len, ZSTD_e_continue);
+}
+
+static int zstd_file_handler_vprintf(void * file, const char * fmt, va_list ap)
+{
+    return vprintf_through_write(zstd_file_handler_write, file, fmt, ap);
+}
+#endif
+
+#ifdef HAVE_SPX_LZ4
+static void * lz4_file_handler_create(FILE * fp, const spx_output_stream_compression_t * compression)
+{
+    if (!fp) {
+        return NULL;
+    }
+
+    lz4_file_t * file = malloc(sizeof(*file));
+    if (!file) {
+        goto error;
+    }
+
+    file->fp = fp;
+    file->cctx = NULL;
+    file->out = NULL;
+
+    if (LZ4F_isError(LZ4F_createCompressionContext(&file->cctx, LZ4F_VERSION))) {
+        file->cctx = NULL;
+
+        goto error;
+    }
+
+    memset(&file->preferences, 0, sizeof(file->preferences));
+    file->preferences.compressionLevel = compression->level;
+
+    file->out_capacity = LZ4F_compressBound(LZ4_CHUNK_SIZE, &file->preferences);
+    file->out = malloc(file->out_capacity);
+    if (!file->out) {
+        goto error;
+    }
+
+    if (lz4_file_handler_output(
+        file,
+        LZ4F_compressBegin(file->cctx, file->out, file->out_capacity, &file->preferences)
+    ) < 0) {
+        goto error;
+    }
+
+    return file;
+
+error:
+    fclose(fp);
+
+    if (file) {
+        if (file->cctx) {
+            LZ4F_freeCompressionContext(file->cctx);
+        }
+
+        free(file->out);
+        free(file);
+    }
+
+    return NULL;
+}
+
+static int lz4_file_handler_output(lz4_file_t * file, size_t size)
+{
+    if (LZ4F_isError(size)) {
+        return -1;
+    }
+
+    if (size > 0 && fwrite(file->out, 1, size, file->fp) != size) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void * lz4_file_handler_open(const char * file_name, const spx_output_stream_compression_t * compression)
+{
+    return lz4_file_handler_create(fopen(file_name, "wb"), compression);
+}
+
+static void * lz4_file_handler_dopen(int fileno, const spx_output_stream_compression_t * compression)
+{
+    return lz4_file_handler_create(fdopen(fileno, "wb"), compression);
+}
+
+static void lz4_file_handler_close(void * file)
+{
+    lz4_file_t * lz4_file = file;
+
+    lz4_file_handler_output(
+        lz4_file,
+        LZ4F_compressEnd(lz4_file->cctx, lz4_file->out, lz4_file->out_capacity, NULL)
+    );
+
+    fclose(lz4_file->fp);
+    LZ4F_freeCompressionContext(lz4_file->cctx);
+    free(lz4_file->out);
+    free(lz4_file);
+}
+
+static void lz4_file_handler_flush(void * file)
+{
+    lz4_file_t * lz4_file = file;
+
+    lz4_file_handler_output(
+        lz4_file,
+        LZ4F_flush(lz4_file->cctx, lz4_file->out, lz4_file->out_capacity, NULL)
+    );
+
+    fflush(lz4_file->fp);
+}
+
+static int lz4_file_handler_sync(void * file, size_t * offset)
+{
+    lz4_file_t * lz4_file = file;
+
+    /* blocks are linked within a frame, a new one must then be started */
+    if (lz4_file_handler_output(
+        lz4_file,
+        LZ4F_compressEnd(lz4_file->cctx, lz4_file->out, lz4_file->out_capacity, NULL)
+    ) < 0) {
+        return -1;
+    }
+
+    if (fflush(lz4_file->fp) != 0 || file_offset(lz4_file->fp, offset) != 0) {
+        return -1;
+    }
+
+    return lz4_file_handler_output(
+        lz4_file,
+        LZ4F_compressBegin(lz4_file->cctx, lz4_file->out, lz4_file->out_capacity, &lz4_file->preferences)
+    );
+}
+
+static int lz4_file_handler_print(void * file, const char * str)
+{
+    return lz4_file_handler_write(file, str, strlen(str));
+}
+
+static int lz4_file_handler_write(void * file, const void * ptr, size_t len)
+{
+    lz4_file_t * lz4_file = file;
+    const char * src = ptr;
+
+    size_t offset;
+    for (offset = 0; offset < len; offset += LZ4_CHUNK_SIZE) {
+        const size_t chunk_size = len - offset < LZ4_CHUNK_SIZE ? len - offset : LZ4_CHUNK_SIZE;
+
+        if (lz4_file_handler_output(
+            lz4_file,
+            LZ4F_compressUpdate(
+                lz4_file->cctx,
+                lz4_file->out,
+                lz4_file->out_capacity,
+                src + offset,
+                chunk_size,
+                NULL
+            )
+        ) < 0) {
+            return -1;
+        }
+    }
+
+    return len;
+}
+
+static int lz4_file_handler_vprintf(void * file, const char * fmt, va_list ap)
+{
+    return vprintf_through_write(lz4_file_handler_write, file, fmt, ap);
+}
+#endif
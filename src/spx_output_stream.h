@@ -19,16 +19,64 @@
 #ifndef SPX_OUTPUT_STREAM_H_DEFINED
 #define SPX_OUTPUT_STREAM_H_DEFINED
 
+#include <stddef.h>
+
+typedef enum {
+    SPX_OUTPUT_STREAM_CODEC_RAW,
+    SPX_OUTPUT_STREAM_CODEC_GZIP,
+    SPX_OUTPUT_STREAM_CODEC_ZSTD,
+    SPX_OUTPUT_STREAM_CODEC_LZ4,
+
+    SPX_OUTPUT_STREAM_CODEC_COUNT,
+    /* returned for unknown codec keys, the "none" key meaning RAW */
+    SPX_OUTPUT_STREAM_CODEC_UNKNOWN,
+} spx_output_stream_codec_t;
+
+typedef struct {
+    spx_output_stream_codec_t codec;
+    /* 0 means the codec's fastest level */
+    int level;
+    /* zstd long distance matching, ignored by other codecs */
+    int long_mode;
+} spx_output_stream_compression_t;
+
+spx_output_stream_codec_t spx_output_stream_codec_get_by_key(const char * key);
+spx_output_stream_codec_t spx_output_stream_codec_get_by_file_name(const char * file_name);
+const char * spx_output_stream_codec_key(spx_output_stream_codec_t codec);
+const char * spx_output_stream_codec_file_suffix(spx_output_stream_codec_t codec);
+int spx_output_stream_codec_available(spx_output_stream_codec_t codec);
+
 typedef struct spx_output_stream_t spx_output_stream_t;
 
-spx_output_stream_t * spx_output_stream_open(const char * file_name, int compressed);
-spx_output_stream_t * spx_output_stream_dopen(int fileno, int compressed);
+/* a NULL compression means no compression */
+spx_output_stream_t * spx_output_stream_open(
+    const char * file_name,
+    const spx_output_stream_compression_t * compression
+);
+
+spx_output_stream_t * spx_output_stream_dopen(
+    int fileno,
+    const spx_output_stream_compression_t * compression
+);
+
+/* like spx_output_stream_dopen() but fileno is closed along with the stream */
+spx_output_stream_t * spx_output_stream_fdopen(
+    int fileno,
+    const spx_output_stream_compression_t * compression
+);
 
 void spx_output_stream_close(spx_output_stream_t * output);
 
 void spx_output_stream_print(spx_output_stream_t * output, const char * str);
+void spx_output_stream_write(spx_output_stream_t * output, const void * ptr, size_t len);
 void spx_output_stream_printf(spx_output_stream_t * output, const char * format, ...);
 
 void spx_output_stream_flush(spx_output_stream_t * output);
 
+/*
+ *  Ends the current compression unit so that the data written from now on can be decoded
+ *  on its own, starting from the returned file offset (see spx_input_stream_open_at()).
+ */
+int spx_output_stream_sync(spx_output_stream_t * output, size_t * offset);
+
 #endif /* SPX_OUTPUT_STREAM_H_DEFINED */
@@ -28,6 +28,19 @@
 
 #include <stdio.h>
 
+/*
+ *  On PHP 8.0+ user function calls are hooked through the observer API instead of overriding
+ *  zend_execute_ex(), which keeps the VM fast call path & the JIT working. Internal function
+ *  calls are only observed since PHP 8.2, zend_execute_internal() is still overridden before.
+ */
+#if ZEND_MODULE_API_NO >= 20200930
+#   include "zend_observer.h"
+#   define USE_OBSERVER
+#   if ZEND_MODULE_API_NO >= 20220829
+#       define USE_OBSERVER_INTERNAL
+#   endif
+#endif
+
 #include "spx_php.h"
 #include "spx_thread.h"
 #include "spx_str_builder.h"
@@ -118,13 +131,20 @@ static struct {
         va_list args
 #endif
     );
+
+#if ZEND_MODULE_API_NO >= 20160303
+    void (*zend_interrupt_function) (zend_execute_data * execute_data);
+#endif
 } ze_hooked_func = {
     NULL, NULL, NULL,
     NULL, NULL,
 #if ZEND_MODULE_API_NO >= 20151012
     NULL,
 #endif
-    NULL
+    NULL,
+#if ZEND_MODULE_API_NO >= 20160303
+    NULL,
+#endif
 };
 
 #if ZEND_MODULE_API_NO >= 20151012
@@ -146,6 +166,8 @@ static SPX_THREAD_TLS struct {
         } user, internal;
     } ex_hook;
 
+    void (*interrupt_handler)(void);
+
     int global_hooks_enabled;
     int execution_disabled;
 
@@ -170,6 +192,7 @@ static SPX_THREAD_TLS struct {
 } context;
 
 static void execute_data_function(const zend_execute_data * execute_data, spx_php_function_t * function TSRMLS_DC);
+static void function_hash_code(spx_php_function_t * function);
 static void reset_context(void);
 
 #if ZEND_MODULE_API_NO >= 20151012
@@ -186,9 +209,10 @@ static void * tls_hook_realloc(void * ptr, size_t size);
 
 #if ZEND_MODULE_API_NO < 20121212
 static void global_hook_execute(zend_op_array * op_array TSRMLS_DC);
-#else
+#elif !defined(USE_OBSERVER)
 static void global_hook_execute_ex(zend_execute_data * execute_data TSRMLS_DC);
 #endif
+#ifndef USE_OBSERVER_INTERNAL
 static void global_hook_execute_internal(
     zend_execute_data * execute_data,
 #if ZEND_MODULE_API_NO >= 20151012
@@ -201,6 +225,16 @@ static void global_hook_execute_internal(
 #endif
     TSRMLS_DC
 );
+#endif
+
+#ifdef USE_OBSERVER
+static zend_observer_fcall_handlers observer_fcall_init(zend_execute_data * execute_data);
+static void observer_fcall_begin(zend_execute_data * execute_data);
+static void observer_fcall_end(zend_execute_data * execute_data, zval * return_value);
+#endif
+
+static void user_call_begin(void);
+static void user_call_end(void);
 
 static zend_op_array * global_hook_zend_compile_file(zend_file_handle * file_handle, int type TSRMLS_DC);
 static zend_op_array * global_hook_zend_compile_string(
@@ -221,6 +255,10 @@ static zend_op_array * global_hook_zend_compile_string(
 static int global_hook_gc_collect_cycles(void);
 #endif
 
+#if ZEND_MODULE_API_NO >= 20160303
+static void global_hook_zend_interrupt_function(zend_execute_data * execute_data);
+#endif
+
 static void global_hook_zend_error_cb(
     int type,
 #if ZEND_MODULE_API_NO >= 20210902
@@ -264,6 +302,7 @@ void spx_php_current_function(spx_php_function_t * function)
     function->hash_code = 0;
     function->class_name = "";
     function->func_name = "";
+    function->file_name = "";
 
     if (context.active_function_name) {
         function->class_name = "";
@@ -272,10 +311,82 @@ void spx_php_current_function(spx_php_function_t * function)
         execute_data_function(EG(current_execute_data), function TSRMLS_CC);
     }
 
-    function->hash_code =
-        zend_inline_hash_func(function->func_name, strlen(function->func_name)) ^
-        zend_inline_hash_func(function->class_name, strlen(function->class_name))
-    ;
+    function_hash_code(function);
+}
+
+size_t spx_php_execution_stack(spx_php_function_t * stack, size_t capacity, int internal)
+{
+#if ZEND_MODULE_API_NO >= 20151012
+    size_t depth = 0;
+    const zend_execute_data * execute_data = EG(current_execute_data);
+    while (execute_data) {
+        if (
+            execute_data->func
+            && (internal || ZEND_USER_CODE(execute_data->func->type))
+        ) {
+            depth++;
+        }
+
+        execute_data = execute_data->prev_execute_data;
+    }
+
+    /*
+     *  Frames are stored from the outermost one, the innermost ones are dropped
+     *  when capacity is exceeded.
+     */
+    size_t i = depth;
+    execute_data = EG(current_execute_data);
+    while (execute_data) {
+        if (
+            execute_data->func
+            && (internal || ZEND_USER_CODE(execute_data->func->type))
+        ) {
+            i--;
+            if (i < capacity) {
+                spx_php_function_t * function = &stack[i];
+
+                function->hash_code = 0;
+                function->class_name = "";
+                function->func_name = "";
+                function->file_name = "";
+
+                execute_data_function(execute_data, function);
+                function_hash_code(function);
+            }
+        }
+
+        execute_data = execute_data->prev_execute_data;
+    }
+
+    return depth < capacity ? depth : capacity;
+#else
+    return 0;
+#endif
+}
+
+void * spx_php_execution_interrupt_handle(void)
+{
+#if ZEND_MODULE_API_NO >= 20160303
+    return (void *) &EG(vm_interrupt);
+#else
+    return NULL;
+#endif
+}
+
+void spx_php_execution_interrupt(void * handle)
+{
+#if ZEND_MODULE_API_NO >= 20220829
+    zend_atomic_bool_store((zend_atomic_bool *) handle, true);
+#else
+#   if ZEND_MODULE_API_NO >= 20160303
+    *((volatile zend_uchar *) handle) = 1;
+#   endif
+#endif
+}
+
+void spx_php_execution_interrupt_hook(void (*handler)(void))
+{
+    context.interrupt_handler = handler;
 }
 
 const char * spx_php_ini_get_string(const char * name)
@@ -437,6 +548,13 @@ size_t spx_php_zend_memory_usage(void)
     return zend_memory_usage(0 TSRMLS_CC);
 }
 
+size_t spx_php_zend_memory_peak_usage(void)
+{
+    TSRMLS_FETCH();
+
+    return zend_memory_peak_usage(0 TSRMLS_CC);
+}
+
 
 size_t spx_php_zend_memory_alloc_count(void)
 {
@@ -577,21 +695,45 @@ size_t spx_php_zend_error_count(void)
     return context.error_count;
 }
 
+int spx_php_error_occurred(void)
+{
+    TSRMLS_FETCH();
+
+    if (SG(sapi_headers).http_response_code >= 500) {
+        return 1;
+    }
+
+    return PG(last_error_message) && (
+        PG(last_error_type) & (
+            E_ERROR | E_PARSE | E_CORE_ERROR | E_COMPILE_ERROR | E_USER_ERROR | E_RECOVERABLE_ERROR
+        )
+    );
+}
+
+void spx_php_global_hooks_register(void)
+{
+#ifdef USE_OBSERVER
+    zend_observer_fcall_register(observer_fcall_init);
+#endif
+}
+
 void spx_php_global_hooks_set(void)
 {
 #if ZEND_MODULE_API_NO < 20121212
     ze_hooked_func.execute = zend_execute;
     zend_execute = global_hook_execute;
-#else
+#elif !defined(USE_OBSERVER)
     ze_hooked_func.execute_ex = zend_execute_ex;
     zend_execute_ex = global_hook_execute_ex;
 #endif
 
+#ifndef USE_OBSERVER_INTERNAL
     ze_hooked_func.previous_zend_execute_internal = zend_execute_internal;
     ze_hooked_func.execute_internal = zend_execute_internal ?
         zend_execute_internal : execute_internal
     ;
     zend_execute_internal = global_hook_execute_internal;
+#endif
 
     ze_hooked_func.zend_compile_file = zend_compile_file;
     zend_compile_file = global_hook_zend_compile_file;
@@ -606,6 +748,11 @@ void spx_php_global_hooks_set(void)
 
     ze_hooked_func.zend_error_cb = zend_error_cb;
     zend_error_cb = global_hook_zend_error_cb;
+
+#if ZEND_MODULE_API_NO >= 20160303
+    ze_hooked_func.zend_interrupt_function = zend_interrupt_function;
+    zend_interrupt_function = global_hook_zend_interrupt_function;
+#endif
 }
 
 void spx_php_global_hooks_unset(void)
@@ -649,6 +796,16 @@ void spx_php_global_hooks_unset(void)
         zend_error_cb = ze_hooked_func.zend_error_cb;
         ze_hooked_func.zend_error_cb = NULL;
     }
+
+#if ZEND_MODULE_API_NO >= 20160303
+    /*
+     *  The previous interrupt function is usually NULL, hence this specific check.
+     */
+    if (zend_interrupt_function == global_hook_zend_interrupt_function) {
+        zend_interrupt_function = ze_hooked_func.zend_interrupt_function;
+        ze_hooked_func.zend_interrupt_function = NULL;
+    }
+#endif
 }
 
 void spx_php_global_hooks_disable(void)
@@ -872,6 +1029,16 @@ void spx_php_log_notice(const char * fmt, ...)
 
 static void execute_data_function(const zend_execute_data * execute_data, spx_php_function_t * function TSRMLS_DC)
 {
+#if ZEND_MODULE_API_NO >= 20151012
+    /*
+     *  Names are resolved from zend_string instances, whose hash is computed at most once
+     *  (and usually already computed for interned strings), so that we do not have to
+     *  hash the names on each call.
+     */
+    zend_string * func_name_zs = NULL;
+    zend_string * class_name_zs = NULL;
+#endif
+
     if (zend_is_executing(TSRMLS_C)) {
 #if ZEND_MODULE_API_NO >= 20151012
         const zend_function * func = execute_data->func;
@@ -881,7 +1048,8 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
             {
                 const zend_class_entry * ce = func->common.scope;
                 if (ce) {
-                    function->class_name = ZSTR_VAL(ce->name);
+                    class_name_zs = ce->name;
+                    function->class_name = ZSTR_VAL(class_name_zs);
                 }
             }
         }
@@ -891,13 +1059,19 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
             {
                 zend_string * function_name = func->common.function_name;
                 if (function_name) {
+                    func_name_zs = function_name;
                     function->func_name = ZSTR_VAL(function_name);
                 }
 
+                if (func->op_array.filename) {
+                    function->file_name = ZSTR_VAL(func->op_array.filename);
+                }
+
                 break;
             }
 
             case ZEND_INTERNAL_FUNCTION:
+                func_name_zs = func->common.function_name;
                 function->func_name = ZSTR_VAL(func->common.function_name);
         }
 #else
@@ -925,6 +1099,14 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
                     function->func_name = function_name;
                 }
 
+                if (((zend_op_array *) execute_data->function_state.function)->filename) {
+                    function->file_name = (
+                            (zend_op_array *) execute_data->function_state.function
+                        )
+                        ->filename
+                    ;
+                }
+
                 break;
             }
             case ZEND_INTERNAL_FUNCTION:
@@ -943,6 +1125,7 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
          *  See get_active_function_name() implementation in php-src.
          */
         if (func->type == ZEND_USER_FUNCTION && !func->common.function_name) {
+            func_name_zs = NULL;
             function->func_name = "";
         }
         /*
@@ -950,6 +1133,7 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
          *  TODO: open an issue if not yet tracked
          */
         if (func->type == ZEND_INTERNAL_FUNCTION && !func->common.function_name) {
+            func_name_zs = NULL;
             function->func_name = "";
         }
 #endif
@@ -959,23 +1143,53 @@ static void execute_data_function(const zend_execute_data * execute_data, spx_ph
         function->class_name = "";
 
 #if ZEND_MODULE_API_NO >= 20151012
+        class_name_zs = NULL;
+        func_name_zs = NULL;
+
         while (execute_data && (!execute_data->func || !ZEND_USER_CODE(execute_data->func->type))) {
             execute_data = execute_data->prev_execute_data;
         }
 
         if (execute_data) {
-            function->func_name = ZSTR_VAL(execute_data->func->op_array.filename);
+            func_name_zs = execute_data->func->op_array.filename;
+            function->func_name = ZSTR_VAL(func_name_zs);
+            function->file_name = function->func_name;
         } else {
             function->func_name = "[no active file]";
         }
 #else
         if (EG(active_op_array)) {
             function->func_name = EG(active_op_array)->filename;
+            function->file_name = function->func_name;
         } else {
             function->func_name = "[no active file]";
         }
 #endif
     }
+
+#if ZEND_MODULE_API_NO >= 20151012
+    if (func_name_zs) {
+        function->hash_code =
+            ZSTR_HASH(func_name_zs) ^
+            (class_name_zs ? ZSTR_HASH(class_name_zs) : zend_inline_hash_func("", 0))
+        ;
+    }
+#endif
+}
+
+static void function_hash_code(spx_php_function_t * function)
+{
+    if (function->hash_code) {
+        /*
+         *  Already resolved from the names' zend_string cached hashes.
+         */
+        return;
+    }
+
+    function->hash_code =
+        zend_inline_hash_func(function->func_name, strlen(function->func_name)) ^
+        zend_inline_hash_func(function->class_name, strlen(function->class_name))
+    ;
 }
 
 static void reset_context(void)
@@ -985,6 +1199,8 @@ static void reset_context(void)
     context.ex_hook.internal.before = NULL;
     context.ex_hook.internal.after = NULL;
 
+    context.interrupt_handler = NULL;
+
     context.global_hooks_enabled = 1;
     context.execution_disabled = 0;
     context.user_depth = 0;
@@ -1077,6 +1293,7 @@ static void * tls_hook_realloc(void * ptr, size_t size)
 }
 #endif
 
+#if ZEND_MODULE_API_NO < 20121212 || !defined(USE_OBSERVER)
 #if ZEND_MODULE_API_NO < 20121212
 static void global_hook_execute(zend_op_array * op_array TSRMLS_DC)
 #else
@@ -1097,11 +1314,7 @@ static void global_hook_execute_ex(zend_execute_data * execute_data TSRMLS_DC)
         return;
     }
 
-    context.user_depth++;
-
-    if (context.ex_hook.user.before) {
-        context.ex_hook.user.before();
-    }
+    user_call_begin();
 
 #if ZEND_MODULE_API_NO < 20121212
     ze_hooked_func.execute(op_array TSRMLS_CC);
@@ -1109,26 +1322,11 @@ static void global_hook_execute_ex(zend_execute_data * execute_data TSRMLS_DC)
     ze_hooked_func.execute_ex(execute_data TSRMLS_CC);
 #endif
 
-    if (context.ex_hook.user.after) {
-        context.ex_hook.user.after();
-    }
-
-    context.user_depth--;
-
-    /*
-     *  FIXME: it might not works with prepend files
-     */
-    if (context.user_depth == 0 && !context.request_shutdown) {
-        context.request_shutdown = 1;
-
-        if (context.ex_hook.internal.before) {
-            context.active_function_name = "::php_request_shutdown";
-            context.ex_hook.internal.before();
-            context.active_function_name = NULL;
-        }
-    }
+    user_call_end();
 }
+#endif
 
+#ifndef USE_OBSERVER_INTERNAL
 static void global_hook_execute_internal(
     zend_execute_data * execute_data,
 #if ZEND_MODULE_API_NO >= 20151012
@@ -1183,6 +1381,100 @@ static void global_hook_execute_internal(
         context.ex_hook.internal.after();
     }
 }
+#endif
+
+#ifdef USE_OBSERVER
+static zend_observer_fcall_handlers observer_fcall_init(zend_execute_data * execute_data)
+{
+    /*
+     *  This is called once per function & request, at its first call. Functions which are not
+     *  hooked, i.e. all of them when the current request is not profiled, are then called
+     *  without any overhead.
+     */
+    zend_observer_fcall_handlers handlers = {NULL, NULL};
+
+    if (!context.global_hooks_enabled || context.execution_disabled) {
+        return handlers;
+    }
+
+    if (ZEND_USER_CODE(execute_data->func->type)) {
+        if (!context.ex_hook.user.before && !context.ex_hook.user.after) {
+            return handlers;
+        }
+    } else {
+#ifdef USE_OBSERVER_INTERNAL
+        if (!context.ex_hook.internal.before && !context.ex_hook.internal.after) {
+            return handlers;
+        }
+#else
+        /* still hooked via zend_execute_internal() */
+        return handlers;
+#endif
+    }
+
+    handlers.begin = observer_fcall_begin;
+    handlers.end = observer_fcall_end;
+
+    return handlers;
+}
+
+static void observer_fcall_begin(zend_execute_data * execute_data)
+{
+    if (!context.global_hooks_enabled || context.execution_disabled) {
+        return;
+    }
+
+    if (ZEND_USER_CODE(execute_data->func->type)) {
+        user_call_begin();
+    } else if (context.ex_hook.internal.before) {
+        context.ex_hook.internal.before();
+    }
+}
+
+static void observer_fcall_end(zend_execute_data * execute_data, zval * return_value)
+{
+    if (!context.global_hooks_enabled || context.execution_disabled) {
+        return;
+    }
+
+    if (ZEND_USER_CODE(execute_data->func->type)) {
+        user_call_end();
+    } else if (context.ex_hook.internal.after) {
+        context.ex_hook.internal.after();
+    }
+}
+#endif
+
+static void user_call_begin(void)
+{
+    context.user_depth++;
+
+    if (context.ex_hook.user.before) {
+        context.ex_hook.user.before();
+    }
+}
+
+static void user_call_end(void)
+{
+    if (context.ex_hook.user.after) {
+        context.ex_hook.user.after();
+    }
+
+    context.user_depth--;
+
+    /*
+     *  FIXME: it might not works with prepend files
+     */
+    if (context.user_depth == 0 && !context.request_shutdown) {
+        context.request_shutdown = 1;
+
+        if (context.ex_hook.internal.before) {
+            context.active_function_name = "::php_request_shutdown";
+            context.ex_hook.internal.before();
+            context.active_function_name = NULL;
+        }
+    }
+}
 
 static zend_op_array * global_hook_zend_compile_file(zend_file_handle * file_handle, int type TSRMLS_DC)
 {
@@ -1322,6 +1614,23 @@ static int global_hook_gc_collect_cycles(void)
 }
 #endif
 
+#if ZEND_MODULE_API_NO >= 20160303
+static void global_hook_zend_interrupt_function(zend_execute_data * execute_data)
+{
+    if (
+        context.global_hooks_enabled
+        && !context.execution_disabled
+        && context.interrupt_handler
+    ) {
+        context.interrupt_handler();
+    }
+
+    if (ze_hooked_func.zend_interrupt_function) {
+        ze_hooked_func.zend_interrupt_function(execute_data);
+    }
+}
+#endif
+
 static void global_hook_zend_error_cb(
     int type,
 #if ZEND_MODULE_API_NO >= 20210902
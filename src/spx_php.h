@@ -42,6 +42,11 @@ typedef struct {
 
     const char * func_name;
     const char * class_name;
+    /*
+     *  Path of the file defining the function, empty for internal functions. Unlike names,
+     *  it is only meant to be read while the function is running.
+     */
+    const char * file_name;
 } spx_php_function_t;
 
 int spx_php_is_cli_sapi(void);
@@ -55,6 +60,7 @@ const char * spx_php_global_array_get(const char * name, const char * key);
 char * spx_php_build_command_line(void);
 
 size_t spx_php_zend_memory_usage(void);
+size_t spx_php_zend_memory_peak_usage(void);
 size_t spx_php_zend_memory_alloc_count(void);
 size_t spx_php_zend_memory_alloc_bytes(void);
 size_t spx_php_zend_memory_free_count(void);
@@ -70,6 +76,14 @@ size_t spx_php_zend_opcode_count(void);
 size_t spx_php_zend_object_count(void);
 size_t spx_php_zend_error_count(void);
 
+/* whether a fatal error occurred or, for HTTP requests, a 5xx status code has been set */
+int spx_php_error_occurred(void);
+
+/*
+ *  Registers the hooks which can only be registered at module startup, i.e. the function
+ *  call observer on PHP 8.0+. They stay inactive until spx_php_global_hooks_set().
+ */
+void spx_php_global_hooks_register(void);
 void spx_php_global_hooks_set(void);
 void spx_php_global_hooks_unset(void);
 void spx_php_global_hooks_disable(void);
@@ -81,6 +95,20 @@ void spx_php_execution_disable(void);
 void spx_php_execution_hook(void (*before)(void), void (*after)(void), int internal);
 void spx_php_execution_finalize(void);
 
+/*
+ *  Fills stack with the current call stack (outermost frame first) and returns its depth.
+ */
+size_t spx_php_execution_stack(spx_php_function_t * stack, size_t capacity, int internal);
+
+/*
+ *  VM interrupt support (PHP 7.1+), the handle is NULL when not supported.
+ *  spx_php_execution_interrupt() can be called from any thread, the VM will then call the
+ *  hooked interrupt handler at its next safe point in the handle's owner thread.
+ */
+void * spx_php_execution_interrupt_handle(void);
+void spx_php_execution_interrupt(void * handle);
+void spx_php_execution_interrupt_hook(void (*handler)(void));
+
 void spx_php_output_add_header_line(const char * header_line);
 void spx_php_output_add_header_linef(const char * fmt, ...);
 void spx_php_output_send_headers(void);
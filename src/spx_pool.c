@@ -0,0 +1,758 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* _GNU_SOURCE is implicitly defined since PHP 8.2 https://github.com/php/php-src/pull/8807 */
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE /* MAP_ANONYMOUS */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "spx_pool.h"
+#include "spx_metric.h"
+#include "spx_utils.h"
+
+#define FUNCTION_CAPACITY (8 * 1024)
+#define FUNCTION_NAME_SIZE 256
+#define NODE_CAPACITY (32 * 1024)
+#define TRUNCATED_NAME_SUFFIX "..."
+/* maximum number of concurrent merges, the extra ones being dropped */
+#define MERGE_SLOT_COUNT 256
+/* age beyond which a merge is considered as abandoned, e.g. by a stopped process */
+#define MERGE_MAX_AGE_S 60
+/* how long a reset waits for the merges in progress before failing */
+#define RESET_MAX_WAIT_MS 1000
+#define READY_MAX_SPIN 100000
+#define WRITE_BUFFER_SIZE (16 * 1024)
+
+typedef struct {
+    /* 0 for a free slot */
+    uint64_t hash;
+    /* set once the name has been written by the process which claimed the slot */
+    int ready;
+    char name[FUNCTION_NAME_SIZE];
+
+    uint64_t called;
+    uint64_t max_cycle_depth;
+    int64_t inc[SPX_METRIC_COUNT];
+    int64_t exc[SPX_METRIC_COUNT];
+} function_slot_t;
+
+typedef struct {
+    /* (parent index + 1) << 32 | (function index + 1), 0 for a free slot */
+    uint64_t key;
+
+    uint64_t called;
+    int64_t inc[SPX_METRIC_COUNT];
+} node_slot_t;
+
+struct spx_pool_t {
+    int resetting;
+    /*
+     *  Merges in progress, each slot holding the merging process pid << 32 | the merge start
+     *  time in seconds, 0 for a free slot. It allows a reset to reclaim the slots of crashed
+     *  processes instead of waiting for them forever.
+     */
+    uint64_t merges[MERGE_SLOT_COUNT];
+
+    uint64_t requests;
+    int enabled_metrics[SPX_METRIC_COUNT];
+    int64_t inc[SPX_METRIC_COUNT];
+
+    function_slot_t functions[FUNCTION_CAPACITY];
+    node_slot_t nodes[NODE_CAPACITY];
+};
+
+typedef struct {
+    const spx_pool_t * pool;
+    size_t metric_count;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+
+    /* call tree adjacency, -1 terminated */
+    ssize_t root_first_child;
+    ssize_t * first_child;
+    ssize_t * next_sibling;
+
+    size_t (*write) (void * arg, const void * ptr, size_t len);
+    void * arg;
+    size_t size;
+    char buffer[WRITE_BUFFER_SIZE];
+    char escape_buffer[2 * FUNCTION_NAME_SIZE];
+} writer_t;
+
+typedef struct {
+    ssize_t idx;
+    int64_t wall_time;
+} node_ref_t;
+
+static void add_values(int64_t * dst, const int * enabled_metrics, const double * values);
+static int wait_ready(const function_slot_t * slot);
+static uint64_t hash_name(const char * class_name, const char * func_name);
+static uint64_t hash_str(uint64_t hash, const char * str);
+static uint64_t merge_slot_value(void);
+static int merge_slot_is_abandoned(uint64_t value);
+static uint64_t hash_u64(uint64_t value);
+
+static void output_flush(writer_t * writer);
+static void output_print(writer_t * writer, const char * str);
+static void output_printf(writer_t * writer, const char * fmt, ...);
+static void output_print_values(writer_t * writer, const int64_t * values);
+static void output_print_node(writer_t * writer, ssize_t node_idx);
+static int node_cmp(const void * va, const void * vb);
+
+spx_pool_t * spx_pool_create(void)
+{
+    /* shared anonymous memory is zero initialized and inherited across fork() */
+    spx_pool_t * pool = mmap(
+        NULL,
+        sizeof(*pool),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS,
+        -1,
+        0
+    );
+
+    if (pool == MAP_FAILED) {
+        return NULL;
+    }
+
+    return pool;
+}
+
+void spx_pool_destroy(spx_pool_t * pool)
+{
+    munmap(pool, sizeof(*pool));
+}
+
+int spx_pool_reset(spx_pool_t * pool)
+{
+    int expected = 0;
+    if (
+        !__atomic_compare_exchange_n(
+            &pool->resetting,
+            &expected,
+            1,
+            0,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST
+        )
+    ) {
+        return -1;
+    }
+
+    const struct timespec period = {0, 1000 * 1000};
+
+    size_t i, j;
+    for (i = 0; i < RESET_MAX_WAIT_MS; i++) {
+        size_t merge_count = 0;
+        for (j = 0; j < MERGE_SLOT_COUNT; j++) {
+            uint64_t value = __atomic_load_n(&pool->merges[j], __ATOMIC_SEQ_CST);
+            if (value == 0) {
+                continue;
+            }
+
+            if (
+                !merge_slot_is_abandoned(value)
+                || !__atomic_compare_exchange_n(
+                    &pool->merges[j],
+                    &value,
+                    0,
+                    0,
+                    __ATOMIC_SEQ_CST,
+                    __ATOMIC_SEQ_CST
+                )
+            ) {
+                merge_count++;
+            }
+        }
+
+        if (merge_count == 0) {
+            break;
+        }
+
+        nanosleep(&period, NULL);
+    }
+
+    if (i == RESET_MAX_WAIT_MS) {
+        /* clearing the tables while they are written would corrupt them */
+        __atomic_store_n(&pool->resetting, 0, __ATOMIC_SEQ_CST);
+
+        return -1;
+    }
+
+    pool->requests = 0;
+    memset(pool->enabled_metrics, 0, sizeof(pool->enabled_metrics));
+    memset(pool->inc, 0, sizeof(pool->inc));
+    memset(pool->functions, 0, sizeof(pool->functions));
+    memset(pool->nodes, 0, sizeof(pool->nodes));
+
+    __atomic_store_n(&pool->resetting, 0, __ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+ssize_t spx_pool_merge_begin(spx_pool_t * pool, const int * enabled_metrics, const double * values)
+{
+    const uint64_t slot_value = merge_slot_value();
+
+    ssize_t merge = -1;
+    size_t i;
+    for (i = 0; i < MERGE_SLOT_COUNT; i++) {
+        uint64_t expected = 0;
+        if (
+            __atomic_compare_exchange_n(
+                &pool->merges[i],
+                &expected,
+                slot_value,
+                0,
+                __ATOMIC_SEQ_CST,
+                __ATOMIC_SEQ_CST
+            )
+        ) {
+            merge = i;
+
+            break;
+        }
+    }
+
+    if (merge < 0) {
+        return -1;
+    }
+
+    /* the slot is claimed before checking the flag, see spx_pool_reset() */
+    if (__atomic_load_n(&pool->resetting, __ATOMIC_SEQ_CST)) {
+        __atomic_store_n(&pool->merges[merge], 0, __ATOMIC_SEQ_CST);
+
+        return -1;
+    }
+
+    __atomic_add_fetch(&pool->requests, 1, __ATOMIC_RELAXED);
+
+    SPX_METRIC_FOREACH(i, {
+        if (enabled_metrics[i] && !__atomic_load_n(&pool->enabled_metrics[i], __ATOMIC_RELAXED)) {
+            __atomic_store_n(&pool->enabled_metrics[i], 1, __ATOMIC_RELAXED);
+        }
+    });
+
+    add_values(pool->inc, enabled_metrics, values);
+
+    return merge;
+}
+
+void spx_pool_merge_end(spx_pool_t * pool, ssize_t merge)
+{
+    __atomic_store_n(&pool->merges[merge], 0, __ATOMIC_SEQ_CST);
+}
+
+ssize_t spx_pool_intern_function(spx_pool_t * pool, const char * class_name, const char * func_name)
+{
+    char name[FUNCTION_NAME_SIZE];
+    const int len = snprintf(
+        name,
+        sizeof(name),
+        "%s%s%s",
+        class_name,
+        class_name[0] ? "::" : "",
+        func_name
+    );
+
+    /*
+     *  A truncated name is marked as such, and since the hash is computed from the full
+     *  name distinct names sharing the same prefix still get their own slot.
+     */
+    if (len >= (int) sizeof(name)) {
+        memcpy(
+            name + sizeof(name) - sizeof(TRUNCATED_NAME_SUFFIX),
+            TRUNCATED_NAME_SUFFIX,
+            sizeof(TRUNCATED_NAME_SUFFIX)
+        );
+    }
+
+    const uint64_t hash = hash_name(class_name, func_name) | 1;
+
+    size_t i;
+    size_t idx = hash % FUNCTION_CAPACITY;
+    for (i = 0; i < FUNCTION_CAPACITY; i++, idx = (idx + 1) % FUNCTION_CAPACITY) {
+        function_slot_t * slot = &pool->functions[idx];
+
+        uint64_t current = __atomic_load_n(&slot->hash, __ATOMIC_ACQUIRE);
+        if (current == 0) {
+            if (
+                __atomic_compare_exchange_n(
+                    &slot->hash,
+                    &current,
+                    hash,
+                    0,
+                    __ATOMIC_SEQ_CST,
+                    __ATOMIC_SEQ_CST
+                )
+            ) {
+                memcpy(slot->name, name, sizeof(name));
+                __atomic_store_n(&slot->ready, 1, __ATOMIC_RELEASE);
+
+                return idx;
+            }
+
+            /* claimed concurrently, current now holds the winner's hash */
+        }
+
+        if (current != hash) {
+            continue;
+        }
+
+        if (!wait_ready(slot)) {
+            return -1;
+        }
+
+        if (strcmp(slot->name, name) == 0) {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+void spx_pool_add_function_stats(
+    spx_pool_t * pool,
+    size_t function_idx,
+    size_t called,
+    size_t max_cycle_depth,
+    const int * enabled_metrics,
+    const double * inc,
+    const double * exc
+) {
+    function_slot_t * slot = &pool->functions[function_idx];
+
+    __atomic_add_fetch(&slot->called, called, __ATOMIC_RELAXED);
+
+    uint64_t current = __atomic_load_n(&slot->max_cycle_depth, __ATOMIC_RELAXED);
+    while (
+        current < max_cycle_depth
+        && !__atomic_compare_exchange_n(
+            &slot->max_cycle_depth,
+            &current,
+            max_cycle_depth,
+            1,
+            __ATOMIC_RELAXED,
+            __ATOMIC_RELAXED
+        )
+    ) {
+    }
+
+    add_values(slot->inc, enabled_metrics, inc);
+    add_values(slot->exc, enabled_metrics, exc);
+}
+
+ssize_t spx_pool_intern_call_tree_node(spx_pool_t * pool, ssize_t parent_idx, size_t function_idx)
+{
+    const uint64_t key = ((uint64_t) (parent_idx + 1) << 32) | (uint64_t) (function_idx + 1);
+
+    size_t i;
+    size_t idx = hash_u64(key) % NODE_CAPACITY;
+    for (i = 0; i < NODE_CAPACITY; i++, idx = (idx + 1) % NODE_CAPACITY) {
+        node_slot_t * slot = &pool->nodes[idx];
+
+        uint64_t current = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (current == 0) {
+            if (
+                __atomic_compare_exchange_n(
+                    &slot->key,
+                    &current,
+                    key,
+                    0,
+                    __ATOMIC_SEQ_CST,
+                    __ATOMIC_SEQ_CST
+                )
+            ) {
+                return idx;
+            }
+        }
+
+        if (current == key) {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+void spx_pool_add_call_tree_node_stats(
+    spx_pool_t * pool,
+    size_t node_idx,
+    size_t called,
+    const int * enabled_metrics,
+    const double * inc
+) {
+    node_slot_t * slot = &pool->nodes[node_idx];
+
+    __atomic_add_fetch(&slot->called, called, __ATOMIC_RELAXED);
+    add_values(slot->inc, enabled_metrics, inc);
+}
+
+void spx_pool_output(
+    const spx_pool_t * pool,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+) {
+    /*
+     *  The pool is read while merges may be in progress, the output is then only a
+     *  consistent snapshot per counter.
+     */
+    writer_t * writer = malloc(sizeof(*writer));
+    if (!writer) {
+        return;
+    }
+
+    writer->pool = pool;
+    writer->write = write;
+    writer->arg = arg;
+    writer->size = 0;
+
+    writer->first_child = malloc(NODE_CAPACITY * sizeof(*writer->first_child));
+    writer->next_sibling = malloc(NODE_CAPACITY * sizeof(*writer->next_sibling));
+    if (!writer->first_child || !writer->next_sibling) {
+        goto end;
+    }
+
+    writer->metric_count = 0;
+    SPX_METRIC_FOREACH(i, {
+        if (__atomic_load_n(&pool->enabled_metrics[i], __ATOMIC_RELAXED)) {
+            writer->metrics[writer->metric_count++] = i;
+        }
+    });
+
+    size_t i;
+
+    writer->root_first_child = -1;
+    for (i = 0; i < NODE_CAPACITY; i++) {
+        writer->first_child[i] = -1;
+        writer->next_sibling[i] = -1;
+    }
+
+    for (i = 0; i < NODE_CAPACITY; i++) {
+        const uint64_t key = __atomic_load_n(&pool->nodes[i].key, __ATOMIC_ACQUIRE);
+        if (key == 0) {
+            continue;
+        }
+
+        const ssize_t parent_idx = (ssize_t) (key >> 32) - 1;
+        ssize_t * first_child = parent_idx < 0 ?
+            &writer->root_first_child : &writer->first_child[parent_idx];
+
+        writer->next_sibling[i] = *first_child;
+        *first_child = i;
+    }
+
+    output_printf(
+        writer,
+        "{\"requests\":%" PRIu64 ",\"metrics\":[",
+        __atomic_load_n(&pool->requests, __ATOMIC_RELAXED)
+    );
+
+    for (i = 0; i < writer->metric_count; i++) {
+        output_printf(writer, i > 0 ? ",\"%s\"" : "\"%s\"", spx_metric_info[writer->metrics[i]].key);
+    }
+
+    output_print(writer, "],\"functions\":[");
+
+    int first = 1;
+    for (i = 0; i < FUNCTION_CAPACITY; i++) {
+        const function_slot_t * slot = &pool->functions[i];
+        if (
+            !__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE)
+            || __atomic_load_n(&slot->called, __ATOMIC_RELAXED) == 0
+        ) {
+            continue;
+        }
+
+        if (!first) {
+            output_print(writer, ",");
+        }
+
+        first = 0;
+
+        output_print(writer, "{\"name\":\"");
+        output_print(
+            writer,
+            spx_utils_json_escape(writer->escape_buffer, slot->name, sizeof(writer->escape_buffer))
+        );
+
+        output_printf(
+            writer,
+            "\",\"called\":%" PRIu64 ",\"max_cycle_depth\":%" PRIu64 ",\"inc\":",
+            __atomic_load_n(&slot->called, __ATOMIC_RELAXED),
+            __atomic_load_n(&slot->max_cycle_depth, __ATOMIC_RELAXED)
+        );
+
+        output_print_values(writer, slot->inc);
+        output_print(writer, ",\"exc\":");
+        output_print_values(writer, slot->exc);
+        output_print(writer, "}");
+    }
+
+    output_print(writer, "],\"root\":");
+    output_print_node(writer, -1);
+    output_print(writer, "}\n");
+    output_flush(writer);
+
+end:
+    free(writer->first_child);
+    free(writer->next_sibling);
+    free(writer);
+}
+
+static void add_values(int64_t * dst, const int * enabled_metrics, const double * values)
+{
+    SPX_METRIC_FOREACH(i, {
+        /* the slots of the metrics disabled for this request are left untouched */
+        if (!enabled_metrics[i]) {
+            continue;
+        }
+
+        const int64_t value = llround(values[i]);
+        if (value != 0) {
+            __atomic_add_fetch(&dst[i], value, __ATOMIC_RELAXED);
+        }
+    });
+}
+
+static int wait_ready(const function_slot_t * slot)
+{
+    size_t i;
+    for (i = 0; i < READY_MAX_SPIN; i++) {
+        if (__atomic_load_n(&slot->ready, __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static uint64_t hash_name(const char * class_name, const char * func_name)
+{
+    /* FNV-1a */
+    uint64_t hash = 14695981039346656037ULL;
+    if (class_name[0]) {
+        hash = hash_str(hash, class_name);
+        hash = hash_str(hash, "::");
+    }
+
+    return hash_str(hash, func_name);
+}
+
+static uint64_t hash_str(uint64_t hash, const char * str)
+{
+    while (*str) {
+        hash ^= (unsigned char) *str++;
+        hash *= 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+static uint64_t merge_slot_value(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* never 0 since the pid is not */
+    return ((uint64_t) getpid() << 32) | (uint32_t) now.tv_sec;
+}
+
+static int merge_slot_is_abandoned(uint64_t value)
+{
+    const pid_t pid = (pid_t) (value >> 32);
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+        return 1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) now.tv_sec - (uint32_t) value > MERGE_MAX_AGE_S;
+}
+
+static uint64_t hash_u64(uint64_t value)
+{
+    /* splitmix64 finalizer */
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+
+    return value;
+}
+
+static void output_flush(writer_t * writer)
+{
+    if (writer->size > 0) {
+        writer->write(writer->arg, writer->buffer, writer->size);
+        writer->size = 0;
+    }
+}
+
+static void output_print(writer_t * writer, const char * str)
+{
+    size_t len = strlen(str);
+    while (len > 0) {
+        if (writer->size == sizeof(writer->buffer)) {
+            output_flush(writer);
+        }
+
+        size_t n = sizeof(writer->buffer) - writer->size;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(writer->buffer + writer->size, str, n);
+        writer->size += n;
+        str += n;
+        len -= n;
+    }
+}
+
+static void output_printf(writer_t * writer, const char * fmt, ...)
+{
+    char buf[512];
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    output_print(writer, buf);
+}
+
+static void output_print_values(writer_t * writer, const int64_t * values)
+{
+    output_print(writer, "[");
+
+    size_t i;
+    for (i = 0; i < writer->metric_count; i++) {
+        output_printf(
+            writer,
+            i > 0 ? ",%" PRId64 : "%" PRId64,
+            __atomic_load_n(&values[writer->metrics[i]], __ATOMIC_RELAXED)
+        );
+    }
+
+    output_print(writer, "]");
+}
+
+static void output_print_node(writer_t * writer, ssize_t node_idx)
+{
+    const spx_pool_t * pool = writer->pool;
+
+    output_print(writer, "{");
+
+    ssize_t first_child;
+    if (node_idx < 0) {
+        output_printf(
+            writer,
+            "\"called\":%" PRIu64 ",\"inc\":",
+            __atomic_load_n(&pool->requests, __ATOMIC_RELAXED)
+        );
+
+        output_print_values(writer, pool->inc);
+        first_child = writer->root_first_child;
+    } else {
+        const node_slot_t * node = &pool->nodes[node_idx];
+        const function_slot_t * function = &pool->functions[(node->key & 0xffffffff) - 1];
+
+        output_print(writer, "\"name\":\"");
+        output_print(
+            writer,
+            spx_utils_json_escape(
+                writer->escape_buffer,
+                __atomic_load_n(&function->ready, __ATOMIC_ACQUIRE) ? function->name : "n/a",
+                sizeof(writer->escape_buffer)
+            )
+        );
+
+        output_printf(
+            writer,
+            "\",\"called\":%" PRIu64 ",\"inc\":",
+            __atomic_load_n(&node->called, __ATOMIC_RELAXED)
+        );
+
+        output_print_values(writer, node->inc);
+        first_child = writer->first_child[node_idx];
+    }
+
+    output_print(writer, ",\"children\":[");
+
+    size_t count = 0;
+    ssize_t child;
+    for (child = first_child; child >= 0; child = writer->next_sibling[child]) {
+        count++;
+    }
+
+    node_ref_t * children = count > 0 ? malloc(count * sizeof(*children)) : NULL;
+    if (children) {
+        size_t i = 0;
+        for (child = first_child; child >= 0; child = writer->next_sibling[child]) {
+            children[i].idx = child;
+            children[i].wall_time = __atomic_load_n(
+                &pool->nodes[child].inc[SPX_METRIC_WALL_TIME],
+                __ATOMIC_RELAXED
+            );
+
+            i++;
+        }
+
+        /* the costliest first, since there is no chronological order to follow here */
+        qsort(children, count, sizeof(*children), node_cmp);
+
+        for (i = 0; i < count; i++) {
+            if (i > 0) {
+                output_print(writer, ",");
+            }
+
+            output_print_node(writer, children[i].idx);
+        }
+
+        free(children);
+    }
+
+    output_print(writer, "]}");
+}
+
+static int node_cmp(const void * va, const void * vb)
+{
+    const node_ref_t * a = va;
+    const node_ref_t * b = vb;
+
+    if (a->wall_time != b->wall_time) {
+        return a->wall_time > b->wall_time ? -1 : 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_POOL_H_DEFINED
+#define SPX_POOL_H_DEFINED
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ *  Profile aggregated across all the processes sharing the pool, typically the workers of
+ *  a php-fpm pool, since the pool is a shared memory segment created before they are forked.
+ *
+ *  It holds a flat profile and a call tree whose entries are interned by function name
+ *  (resp. parent node & function) in fixed capacity lock-free hash tables, and whose stats
+ *  are atomic counters. Each request is merged at its end, concurrently with other ones.
+ */
+
+typedef struct spx_pool_t spx_pool_t;
+
+spx_pool_t * spx_pool_create(void);
+void spx_pool_destroy(spx_pool_t * pool);
+
+/*
+ *  Waits for the merges in progress and clears the pool. A merge starting during the reset
+ *  is dropped. Returns -1, leaving the pool untouched, when the merges in progress do not
+ *  end in time or when another reset is in progress.
+ */
+int spx_pool_reset(spx_pool_t * pool);
+
+/*
+ *  A request merge must be enclosed by these calls, merge_begin() returns the merge handle
+ *  to pass to merge_end(), or -1 when the merge must be dropped. values hold all metric
+ *  values (see spx_metric_t), only the enabled ones being added, and the output reporting
+ *  the metrics enabled by any request.
+ *  Interning functions return -1 when the pool is full. Function names longer than the
+ *  pool's limit are truncated with a "..." suffix.
+ */
+ssize_t spx_pool_merge_begin(spx_pool_t * pool, const int * enabled_metrics, const double * values);
+void spx_pool_merge_end(spx_pool_t * pool, ssize_t merge);
+
+ssize_t spx_pool_intern_function(spx_pool_t * pool, const char * class_name, const char * func_name);
+void spx_pool_add_function_stats(
+    spx_pool_t * pool,
+    size_t function_idx,
+    size_t called,
+    size_t max_cycle_depth,
+    const int * enabled_metrics,
+    const double * inc,
+    const double * exc
+);
+
+/* parent_idx is -1 for a root node */
+ssize_t spx_pool_intern_call_tree_node(spx_pool_t * pool, ssize_t parent_idx, size_t function_idx);
+void spx_pool_add_call_tree_node_stats(
+    spx_pool_t * pool,
+    size_t node_idx,
+    size_t called,
+    const int * enabled_metrics,
+    const double * inc
+);
+
+/*
+ *  Writes the pool profile as JSON, with the same flat profile & call tree layouts than the
+ *  report analyzer ones (see spx_report_analyzer_output()).
+ */
+void spx_pool_output(
+    const spx_pool_t * pool,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+);
+
+#endif /* SPX_POOL_H_DEFINED */
@@ -40,6 +40,8 @@ typedef struct {
     size_t idx;
     spx_php_function_t function;
     spx_profiler_func_stats_t stats;
+    /* whether the calls of this function are only aggregated in stats, not reported */
+    int demoted;
 } spx_profiler_func_table_entry_t;
 
 typedef enum {
@@ -59,8 +61,7 @@ typedef struct {
 
     struct {
         size_t size;
-        size_t capacity;
-        const spx_profiler_func_table_entry_t * entries;
+        const spx_profiler_func_table_entry_t * const * entries;
     } func_table;
 
     size_t depth;
@@ -37,6 +37,8 @@ typedef struct {
         pthread_t thread;
         int ready;
         int stop;
+        void (*callback) (void * arg);
+        void * callback_arg;
     } heartbeat;
 
     struct {
@@ -61,6 +63,20 @@ static void sampling_profiler_destroy(spx_profiler_t * base_profiler);
 spx_profiler_t * spx_profiler_sampler_create(
     spx_profiler_t * sampled_profiler,
     size_t sampling_period_us
+) {
+    return spx_profiler_sampler_create_async(
+        sampled_profiler,
+        sampling_period_us,
+        NULL,
+        NULL
+    );
+}
+
+spx_profiler_t * spx_profiler_sampler_create_async(
+    spx_profiler_t * sampled_profiler,
+    size_t sampling_period_us,
+    void (*heartbeat_callback) (void * arg),
+    void * heartbeat_callback_arg
 ) {
     if (sampling_period_us < 1) {
         spx_utils_die("sampling_period_us must be greater than zero");
@@ -73,6 +89,8 @@ spx_profiler_t * spx_profiler_sampler_create(
 
     profiler->heartbeat.ready = 1;
     profiler->heartbeat.stop = 0;
+    profiler->heartbeat.callback = heartbeat_callback;
+    profiler->heartbeat.callback_arg = heartbeat_callback_arg;
     if (
         pthread_create(
             &profiler->heartbeat.thread,
@@ -119,6 +137,10 @@ static void * sampling_profiler_heartbeat_handler(void * arg)
 
         nanosleep(&period, NULL);
         __atomic_store_n(&profiler->heartbeat.ready, 1, __ATOMIC_SEQ_CST);
+
+        if (profiler->heartbeat.callback) {
+            profiler->heartbeat.callback(profiler->heartbeat.callback_arg);
+        }
     }
 
     return NULL;
@@ -147,6 +169,27 @@ static void sampling_profiler_call_end(spx_profiler_t * base_profiler)
     profiler->stack.current.size--;
 }
 
+void spx_profiler_sampler_sample_stack(
+    spx_profiler_t * base_profiler,
+    const spx_php_function_t * stack,
+    size_t depth
+) {
+    sampling_profiler_t * profiler = (sampling_profiler_t *) base_profiler;
+
+    if (depth > STACK_CAPACITY) {
+        depth = STACK_CAPACITY;
+    }
+
+    size_t i;
+    for (i = 0; i < depth; i++) {
+        profiler->stack.current.frames[i] = stack[i];
+    }
+
+    profiler->stack.current.size = depth;
+
+    sampling_profiler_handle_sample(profiler, 0);
+}
+
 static void sampling_profiler_handle_sample(sampling_profiler_t * profiler, int call_end)
 {
     if (!__atomic_load_n(&profiler->heartbeat.ready, __ATOMIC_SEQ_CST)) {
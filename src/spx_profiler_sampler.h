@@ -28,4 +28,22 @@ spx_profiler_t * spx_profiler_sampler_create(
     size_t sampling_period_us
 );
 
+/*
+ *  Asynchronous mode: the sampler is not fed by call start / end events but by
+ *  spx_profiler_sampler_sample_stack() calls, heartbeat_callback being called from the
+ *  heartbeat thread at each sampling period to request the next sample.
+ */
+spx_profiler_t * spx_profiler_sampler_create_async(
+    spx_profiler_t * sampled_profiler,
+    size_t sampling_period_us,
+    void (*heartbeat_callback) (void * arg),
+    void * heartbeat_callback_arg
+);
+
+void spx_profiler_sampler_sample_stack(
+    spx_profiler_t * profiler,
+    const spx_php_function_t * stack,
+    size_t depth
+);
+
 #endif /* SPX_PROFILER_SAMPLER_H_DEFINED */
@@ -24,36 +24,64 @@
 #include "spx_fmt.h"
 #include "spx_profiler_tracer.h"
 #include "spx_resource_stats.h"
+#include "spx_thread.h"
 #include "spx_utils.h"
 
 
 #define STACK_CAPACITY 2048
-#define FUNC_TABLE_CAPACITY 65536
+/*
+ *  Function table entries are allocated by chunks so that their address remains stable
+ *  while the table grows (they are referenced by stack frames, the hmap & the cache).
+ */
+#define FUNC_TABLE_CHUNK_SIZE 256
+#define FUNC_TABLE_INITIAL_HMAP_SIZE 256
+#define FUNC_TABLE_CACHE_SIZE 2048
+
+/*
+ *  Calibration results are kept per process (per thread in ZTS) for each enabled metrics set,
+ *  and refreshed once expired to follow CPU frequency / load changes.
+ */
+#define CALIBRATION_CACHE_SIZE SPX_PROFILER_TRACER_CALIBRATION_CACHE_SIZE
+#define CALIBRATION_TTL_S 300
+
+/*
+ *  Metric values are stored by metric index but only the enabled metrics are processed.
+ *  The other values are zeroed once in the profiler's persistent value sets, which all
+ *  the others (stack frames, stats & events) are copied from.
+ */
+#define ENABLED_METRIC_FOREACH(p, it, block)                  \
+do {                                                          \
+    size_t j_;                                                \
+    for (j_ = 0; j_ < (p)->enabled_metric_count; j_++) {      \
+        const spx_metric_t it = (p)->enabled_metric_list[j_]; \
+        block                                                 \
+    }                                                         \
+} while (0)
 
-#define METRIC_VALUES_ZERO(m)                \
+#define METRIC_VALUES_ZERO(p, m)             \
 do {                                         \
-    SPX_METRIC_FOREACH(i_, {                 \
+    ENABLED_METRIC_FOREACH(p, i_, {          \
         (m).values[i_] = 0;                  \
     });                                      \
 } while (0)
 
-#define METRIC_VALUES_ADD(a, b)              \
+#define METRIC_VALUES_ADD(p, a, b)           \
 do {                                         \
-    SPX_METRIC_FOREACH(i_, {                 \
+    ENABLED_METRIC_FOREACH(p, i_, {          \
         (a).values[i_] += (b).values[i_];    \
     });                                      \
 } while (0)
 
-#define METRIC_VALUES_SUB(a, b)               \
+#define METRIC_VALUES_SUB(p, a, b)            \
 do {                                          \
-    SPX_METRIC_FOREACH(i_, {                  \
+    ENABLED_METRIC_FOREACH(p, i_, {           \
         (a).values[i_] -= (b).values[i_];     \
     });                                       \
 } while (0)
 
-#define METRIC_VALUES_MAX(a, b)               \
+#define METRIC_VALUES_MAX(p, a, b)            \
 do {                                          \
-    SPX_METRIC_FOREACH(i_, {                  \
+    ENABLED_METRIC_FOREACH(p, i_, {           \
         (a).values[i_] =                      \
             (a).values[i_] > (b).values[i_] ? \
                 (a).values[i_] :              \
@@ -62,17 +90,94 @@ do {                                          \
     });                                       \
 } while (0)
 
+typedef struct {
+    uint32_t metric_mask;
+    size_t calibrated_at;
+    double call_start_noise;
+    double call_end_noise;
+} calibration_cache_slot_t;
+
+static SPX_THREAD_TLS struct {
+    size_t size;
+    calibration_cache_slot_t slots[CALIBRATION_CACHE_SIZE];
+} calibration_cache;
+
+typedef struct stack_frame_t stack_frame_t;
+
+typedef struct {
+    spx_profiler_func_table_entry_t base;
+
+    /*
+     *  Number of stack frames currently running this function & the innermost one, each
+     *  frame pointing to the previous one of the same function. It allows cycle detection
+     *  & exclusive metrics fixup at call end without walking the stack.
+     */
+    size_t active_frame_count;
+    stack_frame_t * innermost_active_frame;
+
+    /*
+     *  Number of calls at cycle depth 0, i.e. the ones accounted in the inclusive stats.
+     */
+    size_t outer_called;
+
+    /*
+     *  Filter decision, evaluated once when the function is first seen. Excluded functions
+     *  are not indexed and therefore never reach the reporter.
+     */
+    int excluded;
+} func_table_entry_t;
+
+/*
+ *  Direct-mapped cache slot resolving a function to its entry from the identity of its
+ *  name & file pointers. The pointers are never dereferenced, they are only compared, and the
+ *  hash code (computed from the names' content) guards against address reuse.
+ */
+typedef struct {
+    uint64_t hash_code;
+    const char * func_name;
+    const char * class_name;
+    const char * file_name;
+    func_table_entry_t * entry;
+} func_table_cache_slot_t;
+
 typedef struct {
     spx_hmap_t * hmap;
     size_t size;
-    spx_profiler_func_table_entry_t entries[FUNC_TABLE_CAPACITY];
+    size_t capacity;
+    /*
+     *  Index of entry pointers, the first entry of each chunk being the chunk itself.
+     */
+    spx_profiler_func_table_entry_t ** entries;
+    func_table_cache_slot_t cache[FUNC_TABLE_CACHE_SIZE];
+
+    const spx_function_filter_t * filter;
+    /*
+     *  Set when the filter has file patterns, entries are then keyed by file too so that
+     *  same-named functions of distinct files (e.g. closures) get their own filter decision.
+     */
+    int file_keyed;
+    struct {
+        size_t size;
+        size_t capacity;
+        func_table_entry_t ** entries;
+    } excluded;
 } func_table_t;
 
-typedef struct {
-    spx_profiler_func_table_entry_t * func_table_entry;
+struct stack_frame_t {
+    func_table_entry_t * func_table_entry;
+    /* closest ancestor frame of a measured or extrapolated call */
+    stack_frame_t * parent_frame;
+    /* a call is measured unless filtered out or demoted without measure */
+    int measured;
+    /* a demoted call without measure, its cost is extrapolated at call end */
+    int extrapolated;
+    /* a call is reported unless it is or is made from a demoted call */
+    int reported;
+    int in_demoted_call;
+    stack_frame_t * prev_same_function_frame;
     spx_profiler_metric_values_t start_metric_values;
     spx_profiler_metric_values_t children_metric_values;
-} stack_frame_t;
+};
 
 typedef struct {
     spx_profiler_t base;
@@ -81,6 +186,8 @@ typedef struct {
     int active;
 
     int enabled_metrics[SPX_METRIC_COUNT];
+    size_t enabled_metric_count;
+    spx_metric_t enabled_metric_list[SPX_METRIC_COUNT];
     spx_metric_collector_t * metric_collector;
 
     int calibrated;
@@ -92,6 +199,8 @@ typedef struct {
     size_t max_depth;
     size_t called;
 
+    spx_profiler_tracer_demotion_t demotion;
+
     spx_profiler_metric_values_t first_metric_values;
     spx_profiler_metric_values_t last_metric_values;
     spx_profiler_metric_values_t cum_metric_values;
@@ -99,6 +208,8 @@ typedef struct {
 
     struct {
         size_t depth;
+        /* depth counting only the reported calls */
+        size_t reported_depth;
         stack_frame_t frames[STACK_CAPACITY];
     } stack;
 
@@ -117,17 +228,30 @@ static spx_profiler_reporter_cost_t null_reporter_notify(
     const spx_profiler_event_t * event
 );
 
+static void demoted_call_extrapolate(tracing_profiler_t * profiler, stack_frame_t * frame);
+
 static void calibrate(tracing_profiler_t * profiler, const spx_php_function_t * function);
+static uint32_t calibration_metric_mask(const tracing_profiler_t * profiler);
+static calibration_cache_slot_t * calibration_cache_find(uint32_t metric_mask, int valid_only);
 
 static uint64_t func_table_hmap_hash_key(const void * v);
 static int func_table_hmap_cmp_key(const void * va, const void * vb);
+static int func_table_hmap_cmp_file_key(const void * va, const void * vb);
+
+static func_table_entry_t * func_table_get_entry(
+    func_table_t * func_table,
+    const spx_php_function_t * function
+);
 
-static spx_profiler_func_table_entry_t * func_table_get_entry(
+static func_table_entry_t * func_table_get_uncached_entry(
     func_table_t * func_table,
     const spx_php_function_t * function
 );
 
+static func_table_entry_t * func_table_new_entry(func_table_t * func_table);
+static func_table_entry_t * func_table_new_excluded_entry(func_table_t * func_table);
 static void func_table_reset(func_table_t * func_table);
+static void func_table_cache_reset(func_table_t * func_table);
 
 static void fill_event(
     spx_profiler_event_t * event,
@@ -142,6 +266,8 @@ static void fill_event(
 spx_profiler_t * spx_profiler_tracer_create(
     size_t max_depth,
     const int * enabled_metrics,
+    const spx_function_filter_t * filter,
+    const spx_profiler_tracer_demotion_t * demotion,
     spx_profiler_reporter_t * reporter
 ) {
     tracing_profiler_t * profiler = malloc(sizeof(*profiler));
@@ -159,22 +285,47 @@ spx_profiler_t * spx_profiler_tracer_create(
 
     profiler->reporter = reporter;
 
+    profiler->enabled_metric_count = 0;
     SPX_METRIC_FOREACH(i, {
         profiler->enabled_metrics[i] = enabled_metrics[i];
+        if (enabled_metrics[i]) {
+            profiler->enabled_metric_list[profiler->enabled_metric_count++] = i;
+        }
     });
 
     profiler->metric_collector = NULL;
 
     profiler->calibrated = 0;
-    METRIC_VALUES_ZERO(profiler->call_start_noise);
-    METRIC_VALUES_ZERO(profiler->call_end_noise);
+    memset(&profiler->call_start_noise, 0, sizeof(profiler->call_start_noise));
+    memset(&profiler->call_end_noise, 0, sizeof(profiler->call_end_noise));
+
+    memset(&profiler->first_metric_values, 0, sizeof(profiler->first_metric_values));
+    memset(&profiler->last_metric_values, 0, sizeof(profiler->last_metric_values));
+    memset(&profiler->cum_metric_values, 0, sizeof(profiler->cum_metric_values));
+    memset(&profiler->max_metric_values, 0, sizeof(profiler->max_metric_values));
 
     profiler->max_depth = max_depth > 0 && max_depth < STACK_CAPACITY ? max_depth : STACK_CAPACITY;
     profiler->called = 0;
 
+    profiler->demotion.calls = 0;
+    profiler->demotion.max_wall_time = 0;
+    profiler->demotion.measure = 1;
+    if (demotion && profiler->enabled_metrics[SPX_METRIC_WALL_TIME]) {
+        profiler->demotion = *demotion;
+    }
+
     profiler->stack.depth = 0;
+    profiler->stack.reported_depth = 0;
     profiler->func_table.size = 0;
+    profiler->func_table.capacity = 0;
+    profiler->func_table.entries = NULL;
     profiler->func_table.hmap = NULL;
+    profiler->func_table.filter = filter;
+    profiler->func_table.file_keyed = filter && spx_function_filter_has_file_patterns(filter);
+    profiler->func_table.excluded.size = 0;
+    profiler->func_table.excluded.capacity = 0;
+    profiler->func_table.excluded.entries = NULL;
+    func_table_cache_reset(&profiler->func_table);
 
     profiler->metric_collector = spx_metric_collector_create(profiler->enabled_metrics);
     if (!profiler->metric_collector) {
@@ -182,9 +333,9 @@ spx_profiler_t * spx_profiler_tracer_create(
     }
 
     profiler->func_table.hmap = spx_hmap_create(
-        FUNC_TABLE_CAPACITY,
+        FUNC_TABLE_INITIAL_HMAP_SIZE,
         func_table_hmap_hash_key,
-        func_table_hmap_cmp_key
+        profiler->func_table.file_keyed ? func_table_hmap_cmp_file_key : func_table_hmap_cmp_key
     );
 
     if (!profiler->func_table.hmap) {
@@ -221,47 +372,95 @@ static void tracing_profiler_call_start(spx_profiler_t * base_profiler, const sp
         calibrate(profiler, function);
     }
 
-    spx_profiler_metric_values_t cur_metric_values;
+    stack_frame_t * frame = &profiler->stack.frames[profiler->stack.depth];
+    frame->func_table_entry = func_table_get_entry(
+        &profiler->func_table,
+        function
+    );
 
+    frame->parent_frame = NULL;
+    if (profiler->stack.depth > 0) {
+        stack_frame_t * prev_frame = &profiler->stack.frames[profiler->stack.depth - 1];
+        frame->parent_frame = prev_frame->measured || prev_frame->extrapolated ?
+            prev_frame : prev_frame->parent_frame
+        ;
+    }
+
+    /*
+     *  The demoted state is inherited from the previous frame and not from the parent one,
+     *  since the latter skips the unmeasured frames.
+     */
+    frame->in_demoted_call = frame->func_table_entry && frame->func_table_entry->base.demoted;
+    if (!frame->in_demoted_call && profiler->stack.depth > 0) {
+        frame->in_demoted_call = profiler->stack.frames[profiler->stack.depth - 1].in_demoted_call;
+    }
+
+    frame->measured = frame->func_table_entry && !frame->func_table_entry->excluded;
+    frame->extrapolated = 0;
+    frame->reported = frame->measured && !frame->in_demoted_call;
+
+    if (frame->measured && frame->func_table_entry->base.demoted && !profiler->demotion.measure) {
+        /*
+         *  The active frame count is still maintained so that the extrapolation at call end
+         *  can tell the outer calls, and the measured callees are accounted as children.
+         */
+        frame->measured = 0;
+        frame->extrapolated = 1;
+        frame->func_table_entry->active_frame_count++;
+        METRIC_VALUES_ZERO(profiler, frame->children_metric_values);
+        profiler->called++;
+    }
+
+    if (!frame->measured) {
+        /*
+         *  Nothing is collected, the cost of a filtered out call is then simply accounted to
+         *  its closest measured caller, the one of a demoted call being extrapolated at call
+         *  end.
+         */
+        goto end;
+    }
+
+    /*
+     *  Values are collected in place so that the disabled ones keep their zero value.
+     */
     spx_metric_collector_collect(
         profiler->metric_collector,
-        cur_metric_values.values
+        profiler->last_metric_values.values
     );
 
+    const spx_profiler_metric_values_t cur_metric_values = profiler->last_metric_values;
+
     if (profiler->called == 0) {
         profiler->first_metric_values = cur_metric_values;
         profiler->max_metric_values = cur_metric_values;
     }
 
-    profiler->last_metric_values = cur_metric_values;
     profiler->cum_metric_values = cur_metric_values;
-    METRIC_VALUES_SUB(profiler->cum_metric_values, profiler->first_metric_values);
-    METRIC_VALUES_MAX(profiler->max_metric_values, cur_metric_values);
+    METRIC_VALUES_SUB(profiler, profiler->cum_metric_values, profiler->first_metric_values);
+    METRIC_VALUES_MAX(profiler, profiler->max_metric_values, cur_metric_values);
 
     profiler->called++;
 
-    stack_frame_t * frame = &profiler->stack.frames[profiler->stack.depth];
-    frame->func_table_entry = func_table_get_entry(
-        &profiler->func_table,
-        function
-    );
+    frame->prev_same_function_frame = frame->func_table_entry->innermost_active_frame;
+    frame->func_table_entry->innermost_active_frame = frame;
+    frame->func_table_entry->active_frame_count++;
+
+    frame->start_metric_values = cur_metric_values;
+    METRIC_VALUES_ZERO(profiler, frame->children_metric_values);
+
+    if (!frame->reported) {
+        spx_metric_collector_add_fixed_noise(profiler->metric_collector, profiler->call_start_noise.values);
 
-    if (!frame->func_table_entry) {
         goto end;
     }
 
-    frame->start_metric_values = cur_metric_values;
-    METRIC_VALUES_ZERO(frame->children_metric_values);
-
     spx_profiler_event_t event;
     fill_event(
         &event,
         profiler,
         SPX_PROFILER_EVENT_CALL_START,
-        profiler->stack.depth > 0 ?
-            profiler->stack.frames[profiler->stack.depth - 1].func_table_entry : NULL
-        ,
-        profiler->stack.frames[profiler->stack.depth].func_table_entry,
+        frame->parent_frame ? (spx_profiler_func_table_entry_t *) frame->parent_frame->func_table_entry : NULL,
+        (spx_profiler_func_table_entry_t *) frame->func_table_entry,
         NULL,
         NULL
     );
@@ -272,6 +471,8 @@ static void tracing_profiler_call_start(spx_profiler_t * base_profiler, const sp
 
     spx_metric_collector_add_fixed_noise(profiler->metric_collector, profiler->call_start_noise.values);
 
+    profiler->stack.reported_depth++;
+
 end:
     profiler->stack.depth++;
 
@@ -298,60 +499,85 @@ static void tracing_profiler_call_end(spx_profiler_t * base_profiler)
         return;
     }
 
-    spx_profiler_metric_values_t cur_metric_values;
+    stack_frame_t * frame = &profiler->stack.frames[profiler->stack.depth];
+    if (!frame->measured) {
+        if (frame->extrapolated) {
+            demoted_call_extrapolate(profiler, frame);
+        }
+
+        return;
+    }
+
+    if (frame->reported) {
+        profiler->stack.reported_depth--;
+    }
 
     spx_metric_collector_collect(
         profiler->metric_collector,
-        cur_metric_values.values
+        profiler->last_metric_values.values
     );
 
-    profiler->last_metric_values = cur_metric_values;
-    profiler->cum_metric_values = cur_metric_values;
-    METRIC_VALUES_SUB(profiler->cum_metric_values, profiler->first_metric_values);
-    METRIC_VALUES_MAX(profiler->max_metric_values, cur_metric_values);
+    const spx_profiler_metric_values_t cur_metric_values = profiler->last_metric_values;
 
-    stack_frame_t * frame = &profiler->stack.frames[profiler->stack.depth];
-    if (!frame->func_table_entry) {
-        return;
-    }
+    profiler->cum_metric_values = cur_metric_values;
+    METRIC_VALUES_SUB(profiler, profiler->cum_metric_values, profiler->first_metric_values);
+    METRIC_VALUES_MAX(profiler, profiler->max_metric_values, cur_metric_values);
 
-    spx_profiler_func_table_entry_t * entry = frame->func_table_entry;
+    func_table_entry_t * entry = frame->func_table_entry;
 
     spx_profiler_metric_values_t inc_metric_values = cur_metric_values;
-    METRIC_VALUES_SUB(inc_metric_values, frame->start_metric_values);
+    METRIC_VALUES_SUB(profiler, inc_metric_values, frame->start_metric_values);
 
     spx_profiler_metric_values_t exc_metric_values = inc_metric_values;
-    METRIC_VALUES_SUB(exc_metric_values, frame->children_metric_values);
+    METRIC_VALUES_SUB(profiler, exc_metric_values, frame->children_metric_values);
 
-    size_t cycle_depth = 0;
-    int i;
-    for (i = profiler->stack.depth - 1; i >= 0; i--) {
-        stack_frame_t * parent_frame = &profiler->stack.frames[i];
-        if (!parent_frame->func_table_entry) {
-            continue;
-        }
-
-        if (i == profiler->stack.depth - 1) {
-            METRIC_VALUES_ADD(parent_frame->children_metric_values, inc_metric_values);
-        }
+    if (frame->parent_frame) {
+        METRIC_VALUES_ADD(profiler, frame->parent_frame->children_metric_values, inc_metric_values);
+    }
 
-        if (parent_frame->func_table_entry == entry) {
-            cycle_depth++;
+    entry->active_frame_count--;
+    entry->innermost_active_frame = frame->prev_same_function_frame;
 
-            if (cycle_depth == 1) {
-                METRIC_VALUES_SUB(parent_frame->children_metric_values, exc_metric_values);
-            }
-        }
+    /*
+     *  The cycle depth is the number of still active frames of the same function, and the
+     *  exclusive metrics of this call must not be accounted as children metrics of the
+     *  innermost of them.
+     */
+    const size_t cycle_depth = entry->active_frame_count;
+    if (frame->prev_same_function_frame) {
+        METRIC_VALUES_SUB(profiler, frame->prev_same_function_frame->children_metric_values, exc_metric_values);
     }
 
-    entry->stats.called++;
-    if (entry->stats.max_cycle_depth < cycle_depth) {
-        entry->stats.max_cycle_depth = cycle_depth;
+    entry->base.stats.called++;
+    if (entry->base.stats.max_cycle_depth < cycle_depth) {
+        entry->base.stats.max_cycle_depth = cycle_depth;
     }
 
     if (cycle_depth == 0) {
-        METRIC_VALUES_ADD(entry->stats.inc, inc_metric_values);
-        METRIC_VALUES_ADD(entry->stats.exc, exc_metric_values);
+        entry->outer_called++;
+        METRIC_VALUES_ADD(profiler, entry->base.stats.inc, inc_metric_values);
+        METRIC_VALUES_ADD(profiler, entry->base.stats.exc, exc_metric_values);
+    }
+
+    /*
+     *  The average inclusive time is computed from the outer calls only, as the inclusive
+     *  stats do not account the recursive ones.
+     */
+    if (
+        profiler->demotion.calls > 0
+        && !entry->base.demoted
+        && cycle_depth == 0
+        && entry->outer_called % profiler->demotion.calls == 0
+        && entry->base.stats.inc.values[SPX_METRIC_WALL_TIME]
+            < (double) entry->outer_called * profiler->demotion.max_wall_time
+    ) {
+        entry->base.demoted = 1;
+    }
+
+    if (!frame->reported) {
+        spx_metric_collector_add_fixed_noise(profiler->metric_collector, profiler->call_end_noise.values);
+
+        return;
     }
 
     spx_profiler_event_t event;
@@ -359,10 +585,8 @@ static void tracing_profiler_call_end(spx_profiler_t * base_profiler)
         &event,
         profiler,
         SPX_PROFILER_EVENT_CALL_END,
-        profiler->stack.depth > 0 ?
-            profiler->stack.frames[profiler->stack.depth - 1].func_table_entry : NULL
-        ,
-        profiler->stack.frames[profiler->stack.depth].func_table_entry,
+        frame->parent_frame ? (spx_profiler_func_table_entry_t *) frame->parent_frame->func_table_entry : NULL,
+        (spx_profiler_func_table_entry_t *) frame->func_table_entry,
         &inc_metric_values,
         &exc_metric_values
     );
@@ -407,6 +631,9 @@ static void tracing_profiler_destroy(spx_profiler_t * base_profiler)
         spx_hmap_destroy(profiler->func_table.hmap);
     }
 
+    free(profiler->func_table.entries);
+    free(profiler->func_table.excluded.entries);
+
     free(profiler);
 }
 
@@ -417,10 +644,95 @@ static spx_profiler_reporter_cost_t null_reporter_notify(
     return SPX_PROFILER_REPORTER_COST_LIGHT;
 }
 
+size_t spx_profiler_tracer_get_calibrations(
+    spx_profiler_tracer_calibration_t * calibrations,
+    size_t max
+) {
+    const size_t now = spx_resource_stats_wall_time();
+
+    size_t i;
+    for (i = 0; i < calibration_cache.size && i < max; i++) {
+        const calibration_cache_slot_t * slot = &calibration_cache.slots[i];
+
+        SPX_METRIC_FOREACH(j, {
+            calibrations[i].enabled_metrics[j] = (slot->metric_mask >> j) & 1;
+        });
+
+        calibrations[i].age_s = (now - slot->calibrated_at) / (1000 * 1000 * 1000);
+        calibrations[i].call_start_noise = slot->call_start_noise;
+        calibrations[i].call_end_noise = slot->call_end_noise;
+    }
+
+    return i;
+}
+
+static void demoted_call_extrapolate(tracing_profiler_t * profiler, stack_frame_t * frame)
+{
+    func_table_entry_t * entry = frame->func_table_entry;
+
+    entry->active_frame_count--;
+
+    const size_t cycle_depth = entry->active_frame_count;
+
+    entry->base.stats.called++;
+    if (entry->base.stats.max_cycle_depth < cycle_depth) {
+        entry->base.stats.max_cycle_depth = cycle_depth;
+    }
+
+    /*
+     *  The inclusive cost is the current average, the measured callees' cost being a lower
+     *  bound, and the exclusive cost is the part not accounted by the measured callees. The
+     *  inclusive cost is accounted as children cost of the closest measured caller so that
+     *  its exclusive cost only covers its own code.
+     */
+    const double outer_called = entry->outer_called;
+
+    spx_profiler_metric_values_t inc_metric_values;
+    ENABLED_METRIC_FOREACH(profiler, i, {
+        inc_metric_values.values[i] = entry->base.stats.inc.values[i] / outer_called;
+        if (inc_metric_values.values[i] < frame->children_metric_values.values[i]) {
+            inc_metric_values.values[i] = frame->children_metric_values.values[i];
+        }
+    });
+
+    spx_profiler_metric_values_t exc_metric_values = inc_metric_values;
+    METRIC_VALUES_SUB(profiler, exc_metric_values, frame->children_metric_values);
+
+    if (frame->parent_frame) {
+        METRIC_VALUES_ADD(profiler, frame->parent_frame->children_metric_values, inc_metric_values);
+    }
+
+    /*
+     *  Unlike measured calls, a recursive call's exclusive cost is not part of the outer
+     *  call's one since it is accounted as a child cost.
+     */
+    METRIC_VALUES_ADD(profiler, entry->base.stats.exc, exc_metric_values);
+
+    if (cycle_depth == 0) {
+        METRIC_VALUES_ADD(profiler, entry->base.stats.inc, inc_metric_values);
+        entry->outer_called++;
+    }
+}
+
 static void calibrate(tracing_profiler_t * profiler, const spx_php_function_t * function)
 {
     profiler->calibrated = 1;
 
+    /*
+     *  Calibration is done with a null reporter, the noise therefore only depends on the
+     *  enabled metrics.
+     */
+    const uint32_t metric_mask = calibration_metric_mask(profiler);
+    calibration_cache_slot_t * slot = calibration_cache_find(metric_mask, 1);
+    if (slot) {
+        profiler->call_start_noise.values[SPX_METRIC_WALL_TIME] = slot->call_start_noise;
+        profiler->call_start_noise.values[SPX_METRIC_CPU_TIME] = slot->call_start_noise;
+        profiler->call_end_noise.values[SPX_METRIC_WALL_TIME] = slot->call_end_noise;
+        profiler->call_end_noise.values[SPX_METRIC_CPU_TIME] = slot->call_end_noise;
+
+        return;
+    }
+
     spx_profiler_reporter_t null_reporter = {
         null_reporter_notify,
         NULL
@@ -429,6 +741,15 @@ static void calibrate(tracing_profiler_t * profiler, const spx_php_function_t *
     spx_profiler_reporter_t * const orig_reporter = profiler->reporter;
     profiler->reporter = &null_reporter;
 
+    /*
+     *  The calibration function must be reported whatever the filter.
+     */
+    const spx_function_filter_t * const orig_filter = profiler->func_table.filter;
+    profiler->func_table.filter = NULL;
+
+    const size_t orig_demotion_calls = profiler->demotion.calls;
+    profiler->demotion.calls = 0;
+
     const size_t iter_count = 50000;
     int i;
     size_t start, avg_noise;
@@ -460,9 +781,66 @@ static void calibrate(tracing_profiler_t * profiler, const spx_php_function_t *
     profiler->call_end_noise.values[SPX_METRIC_CPU_TIME] = (double) avg_noise;
 
     profiler->reporter = orig_reporter;
+    profiler->func_table.filter = orig_filter;
+    profiler->demotion.calls = orig_demotion_calls;
     profiler->called = 0;
     profiler->stack.depth = 0;
+    profiler->stack.reported_depth = 0;
     func_table_reset(&profiler->func_table);
+
+    slot = calibration_cache_find(metric_mask, 0);
+    if (!slot) {
+        if (calibration_cache.size < CALIBRATION_CACHE_SIZE) {
+            slot = &calibration_cache.slots[calibration_cache.size++];
+        } else {
+            /*
+             *  Evict the oldest one
+             */
+            slot = &calibration_cache.slots[0];
+            size_t i;
+            for (i = 1; i < CALIBRATION_CACHE_SIZE; i++) {
+                if (calibration_cache.slots[i].calibrated_at < slot->calibrated_at) {
+                    slot = &calibration_cache.slots[i];
+                }
+            }
+        }
+    }
+
+    slot->metric_mask = metric_mask;
+    slot->calibrated_at = spx_resource_stats_wall_time();
+    slot->call_start_noise = profiler->call_start_noise.values[SPX_METRIC_WALL_TIME];
+    slot->call_end_noise = profiler->call_end_noise.values[SPX_METRIC_WALL_TIME];
+}
+
+static uint32_t calibration_metric_mask(const tracing_profiler_t * profiler)
+{
+    uint32_t metric_mask = 0;
+    ENABLED_METRIC_FOREACH(profiler, i, {
+        metric_mask |= (uint32_t) 1 << i;
+    });
+
+    return metric_mask;
+}
+
+static calibration_cache_slot_t * calibration_cache_find(uint32_t metric_mask, int valid_only)
+{
+    const size_t now = spx_resource_stats_wall_time();
+
+    size_t i;
+    for (i = 0; i < calibration_cache.size; i++) {
+        calibration_cache_slot_t * slot = &calibration_cache.slots[i];
+        if (slot->metric_mask != metric_mask) {
+            continue;
+        }
+
+        if (valid_only && (now - slot->calibrated_at) / (1000 * 1000 * 1000) >= CALIBRATION_TTL_S) {
+            return NULL;
+        }
+
+        return slot;
+    }
+
+    return NULL;
 }
 
 static uint64_t func_table_hmap_hash_key(const void * v)
@@ -475,6 +853,10 @@ static int func_table_hmap_cmp_key(const void * va, const void * vb)
     const spx_php_function_t * a = va;
     const spx_php_function_t * b = vb;
 
+    if (a->hash_code != b->hash_code) {
+        return a->hash_code < b->hash_code ? -1 : 1;
+    }
+
     int n;
 
     n = strcmp(a->func_name, b->func_name);
@@ -490,14 +872,56 @@ static int func_table_hmap_cmp_key(const void * va, const void * vb)
     return 0;
 }
 
-static spx_profiler_func_table_entry_t * func_table_get_entry(
+static int func_table_hmap_cmp_file_key(const void * va, const void * vb)
+{
+    const spx_php_function_t * a = va;
+    const spx_php_function_t * b = vb;
+
+    const int n = func_table_hmap_cmp_key(a, b);
+    if (n != 0) {
+        return n;
+    }
+
+    return strcmp(
+        a->file_name ? a->file_name : "",
+        b->file_name ? b->file_name : ""
+    );
+}
+
+static func_table_entry_t * func_table_get_entry(
     func_table_t * func_table,
     const spx_php_function_t * function
 ) {
-    if (func_table->size == FUNC_TABLE_CAPACITY) {
-        return spx_hmap_get_value(func_table->hmap, function);
+    func_table_cache_slot_t * cache_slot = &func_table->cache[
+        function->hash_code & (FUNC_TABLE_CACHE_SIZE - 1)
+    ];
+
+    if (
+        cache_slot->entry
+        && cache_slot->func_name == function->func_name
+        && cache_slot->class_name == function->class_name
+        && cache_slot->file_name == function->file_name
+        && cache_slot->hash_code == function->hash_code
+    ) {
+        return cache_slot->entry;
+    }
+
+    func_table_entry_t * entry = func_table_get_uncached_entry(func_table, function);
+    if (entry) {
+        cache_slot->hash_code = function->hash_code;
+        cache_slot->func_name = function->func_name;
+        cache_slot->class_name = function->class_name;
+        cache_slot->file_name = function->file_name;
+        cache_slot->entry = entry;
     }
 
+    return entry;
+}
+
+static func_table_entry_t * func_table_get_uncached_entry(
+    func_table_t * func_table,
+    const spx_php_function_t * function
+) {
     int new = 0;
     spx_hmap_entry_t * hmap_entry = spx_hmap_ensure_entry(
         func_table->hmap,
@@ -513,37 +937,128 @@ static spx_profiler_func_table_entry_t * func_table_get_entry(
         return spx_hmap_entry_get_value(hmap_entry);
     }
 
-    func_table->size++;
-    if (func_table->size == FUNC_TABLE_CAPACITY) {
-        fprintf(stderr, "SPX: FUNC_TABLE_CAPACITY (%d) reached\n", FUNC_TABLE_CAPACITY);
-    }
+    const int excluded = func_table->filter
+        && !spx_function_filter_match(func_table->filter, function)
+    ;
 
-    const size_t idx = func_table->size - 1;
-    spx_profiler_func_table_entry_t * entry = &func_table->entries[idx];
+    func_table_entry_t * entry = excluded ?
+        func_table_new_excluded_entry(func_table) : func_table_new_entry(func_table)
+    ;
 
-    entry->idx = idx;
-    entry->function = *function;
+    entry->base.function = *function;
 
     /*
      *  Review needed: workaround for a lifespan issue
      *  These allocations should be useless in many cases...
      */
-    entry->function.func_name = strdup(entry->function.func_name);
-    entry->function.class_name = strdup(entry->function.class_name);
+    entry->base.function.func_name = strdup(entry->base.function.func_name);
+    entry->base.function.class_name = strdup(entry->base.function.class_name);
     if (
-        !entry->function.func_name
-        || !entry->function.class_name
+        !entry->base.function.func_name
+        || !entry->base.function.class_name
     ) {
         spx_utils_die("Cannot dup function / class name\n");
     }
 
-    entry->stats.called = 0;
-    entry->stats.max_cycle_depth = 0;
-    METRIC_VALUES_ZERO(entry->stats.inc);
-    METRIC_VALUES_ZERO(entry->stats.exc);
+    entry->base.stats.called = 0;
+    entry->base.stats.max_cycle_depth = 0;
+    SPX_METRIC_FOREACH(i, {
+        entry->base.stats.inc.values[i] = 0;
+        entry->base.stats.exc.values[i] = 0;
+    });
+
+    entry->active_frame_count = 0;
+    entry->innermost_active_frame = NULL;
+    entry->outer_called = 0;
+    entry->excluded = excluded;
+    entry->base.demoted = 0;
+
+    /*
+     *  The file name is only valid during the call, see spx_php_function_t. It is dup'ed
+     *  only when it is part of the key.
+     */
+    if (func_table->file_keyed) {
+        entry->base.function.file_name = strdup(
+            entry->base.function.file_name ? entry->base.function.file_name : ""
+        );
+
+        if (!entry->base.function.file_name) {
+            spx_utils_die("Cannot dup file name\n");
+        }
+    } else {
+        entry->base.function.file_name = "";
+    }
 
     spx_hmap_entry_set_value(hmap_entry, entry);
-    spx_hmap_set_entry_key(func_table->hmap, hmap_entry, &entry->function);
+    spx_hmap_set_entry_key(func_table->hmap, hmap_entry, &entry->base.function);
+
+    return entry;
+}
+
+static func_table_entry_t * func_table_new_entry(func_table_t * func_table)
+{
+    const size_t idx = func_table->size;
+
+    if (idx == func_table->capacity) {
+        const size_t new_capacity = func_table->capacity > 0 ?
+            func_table->capacity * 2 : FUNC_TABLE_CHUNK_SIZE;
+
+        spx_profiler_func_table_entry_t ** entries = realloc(
+            func_table->entries,
+            new_capacity * sizeof(*entries)
+        );
+
+        if (!entries) {
+            spx_utils_die("Cannot grow function table\n");
+        }
+
+        func_table->entries = entries;
+        func_table->capacity = new_capacity;
+    }
+
+    func_table_entry_t * entry;
+    if (idx % FUNC_TABLE_CHUNK_SIZE == 0) {
+        entry = malloc(FUNC_TABLE_CHUNK_SIZE * sizeof(*entry));
+        if (!entry) {
+            spx_utils_die("Cannot allocate function table chunk\n");
+        }
+    } else {
+        entry = (func_table_entry_t *) func_table->entries[idx - 1] + 1;
+    }
+
+    entry->base.idx = idx;
+    func_table->entries[idx] = &entry->base;
+    func_table->size++;
+
+    return entry;
+}
+
+static func_table_entry_t * func_table_new_excluded_entry(func_table_t * func_table)
+{
+    if (func_table->excluded.size == func_table->excluded.capacity) {
+        const size_t new_capacity = func_table->excluded.capacity > 0 ?
+            func_table->excluded.capacity * 2 : FUNC_TABLE_CHUNK_SIZE;
+
+        func_table_entry_t ** entries = realloc(
+            func_table->excluded.entries,
+            new_capacity * sizeof(*entries)
+        );
+
+        if (!entries) {
+            spx_utils_die("Cannot grow function table\n");
+        }
+
+        func_table->excluded.entries = entries;
+        func_table->excluded.capacity = new_capacity;
+    }
+
+    func_table_entry_t * entry = malloc(sizeof(*entry));
+    if (!entry) {
+        spx_utils_die("Cannot allocate function table entry\n");
+    }
+
+    entry->base.idx = func_table->excluded.size;
+    func_table->excluded.entries[func_table->excluded.size++] = entry;
 
     return entry;
 }
@@ -555,14 +1070,42 @@ static void func_table_reset(func_table_t * func_table)
      */
     size_t i;
     for (i = 0; i < func_table->size; i++) {
-        spx_profiler_func_table_entry_t * entry = &func_table->entries[i];
+        spx_profiler_func_table_entry_t * entry = func_table->entries[i];
 
         free((char *)entry->function.func_name);
         free((char *)entry->function.class_name);
+        if (func_table->file_keyed) {
+            free((char *)entry->function.file_name);
+        }
+    }
+
+    for (i = 0; i < func_table->size; i += FUNC_TABLE_CHUNK_SIZE) {
+        free(func_table->entries[i]);
+    }
+
+    for (i = 0; i < func_table->excluded.size; i++) {
+        func_table_entry_t * entry = func_table->excluded.entries[i];
+
+        free((char *)entry->base.function.func_name);
+        free((char *)entry->base.function.class_name);
+        if (func_table->file_keyed) {
+            free((char *)entry->base.function.file_name);
+        }
+        free(entry);
     }
 
     func_table->size = 0;
+    func_table->excluded.size = 0;
     spx_hmap_reset(func_table->hmap);
+    func_table_cache_reset(func_table);
+}
+
+static void func_table_cache_reset(func_table_t * func_table)
+{
+    size_t i;
+    for (i = 0; i < FUNC_TABLE_CACHE_SIZE; i++) {
+        func_table->cache[i].entry = NULL;
+    }
 }
 
 static void fill_event(
@@ -583,10 +1126,9 @@ static void fill_event(
     event->cum = &profiler->cum_metric_values;
 
     event->func_table.size = profiler->func_table.size;
-    event->func_table.capacity = FUNC_TABLE_CAPACITY;
-    event->func_table.entries = profiler->func_table.entries;
+    event->func_table.entries = (const spx_profiler_func_table_entry_t * const *) profiler->func_table.entries;
 
-    event->depth = profiler->stack.depth;
+    event->depth = profiler->stack.reported_depth;
 
     event->caller = caller;
     event->callee = callee;
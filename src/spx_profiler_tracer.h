@@ -22,11 +22,56 @@
 #include <stddef.h>
 
 #include "spx_profiler.h"
+#include "spx_function_filter.h"
 
+/* the maximum number of cached calibration results, see spx_profiler_tracer_get_calibrations() */
+#define SPX_PROFILER_TRACER_CALIBRATION_CACHE_SIZE 8
+
+typedef struct {
+    int enabled_metrics[SPX_METRIC_COUNT];
+    size_t age_s;
+    /* average call start / end noise in ns */
+    double call_start_noise;
+    double call_end_noise;
+} spx_profiler_tracer_calibration_t;
+
+/*
+ *  Adaptive demotion of hot tiny functions: once its average inclusive wall time turns out to
+ *  be below max_wall_time, a function is only aggregated in its stats, its calls (and the ones
+ *  they make) being no longer reported.
+ */
+typedef struct {
+    /* the call count interval at which functions are evaluated, 0 disables demotion */
+    size_t calls;
+    /* in ns */
+    size_t max_wall_time;
+    /*
+     *  Whether demoted calls are still measured. Otherwise their cost is accounted to their
+     *  caller and their stats are extrapolated from their average at demotion time.
+     */
+    int measure;
+} spx_profiler_tracer_demotion_t;
+
+/*
+ *  filter is optional and must outlive the profiler. Calls to functions it rejects are not
+ *  reported, their cost is accounted to the closest reported caller.
+ *  demotion is optional too, it requires the wall time metric.
+ */
 spx_profiler_t * spx_profiler_tracer_create(
     size_t max_depth,
     const int * enabled_metrics,
+    const spx_function_filter_t * filter,
+    const spx_profiler_tracer_demotion_t * demotion,
     spx_profiler_reporter_t * reporter
 );
 
+/*
+ *  Fills calibrations with the current thread's cached calibration results and returns
+ *  their count.
+ */
+size_t spx_profiler_tracer_get_calibrations(
+    spx_profiler_tracer_calibration_t * calibrations,
+    size_t max
+);
+
 #endif /* SPX_PROFILER_TRACER_H_DEFINED */
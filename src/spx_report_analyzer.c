@@ -0,0 +1,2359 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* _GNU_SOURCE is implicitly defined since PHP 8.2 https://github.com/php/php-src/pull/8807 */
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE /* strdup */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include <sys/types.h>
+
+#include "spx_report_analyzer.h"
+#include "spx_input_stream.h"
+#include "spx_output_stream.h"
+#include "spx_hmap.h"
+#include "spx_metric.h"
+#include "spx_utils.h"
+
+#define READ_BUFFER_SIZE (64 * 1024)
+#define WRITE_BUFFER_SIZE (16 * 1024)
+
+typedef struct {
+    spx_input_stream_t * input;
+    size_t size;
+    size_t offset;
+    unsigned char buffer[READ_BUFFER_SIZE];
+} reader_t;
+
+typedef struct {
+    size_t called;
+    size_t max_cycle_depth;
+    double * inc;
+    double * exc;
+} function_stats_t;
+
+typedef struct call_tree_node_t call_tree_node_t;
+
+typedef struct {
+    const call_tree_node_t * parent;
+    size_t function_idx;
+} call_tree_node_key_t;
+
+struct call_tree_node_t {
+    call_tree_node_key_t key;
+
+    size_t called;
+    double min_time;
+    double * inc;
+
+    call_tree_node_t * first_child;
+    call_tree_node_t * next_sibling;
+    /* allocation list, for release */
+    call_tree_node_t * next;
+};
+
+typedef struct {
+    size_t size;
+    size_t capacity;
+    double * values;
+} value_list_t;
+
+/* state of the "[aggregates]" section being read, see read_aggregate() */
+typedef struct {
+    /* cleared when the query does not cover the whole report, the section is then skipped */
+    int enabled;
+    /* call tree nodes in section order from the root, NULL beyond the query depth limit */
+    size_t node_count;
+    size_t node_capacity;
+    call_tree_node_t ** nodes;
+    size_t * node_depths;
+} aggregates_reader_t;
+
+typedef struct {
+    size_t function_idx;
+    size_t cycle_depth;
+    /* index of the innermost enclosing frame of the same function, -1 if none */
+    ssize_t prev_same_function_frame;
+    call_tree_node_t * node;
+} frame_t;
+
+struct spx_report_analyzer_t {
+    spx_report_analyzer_query_t query;
+
+    size_t metric_count;
+    size_t wt_idx;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+
+    struct {
+        size_t size;
+        size_t capacity;
+        frame_t * frames;
+        /* metric values are stored in flat arrays indexed by frame * metric_count */
+        double * start;
+        double * children;
+    } stack;
+
+    /* top frame index per function, -1 if the function is not on the stack */
+    ssize_t * function_top_frames;
+
+    size_t function_capacity;
+    function_stats_t * functions;
+
+    struct {
+        size_t count;
+        size_t size;
+        size_t capacity;
+        char * buffer;
+        size_t * offsets;
+    } function_names;
+
+    struct {
+        spx_hmap_t * hmap;
+        call_tree_node_t root;
+        call_tree_node_t * nodes;
+    } call_tree;
+
+    struct {
+        int first;
+        int lower_set;
+        int upper_set;
+        int done;
+        double last_time;
+        double previous[SPX_METRIC_COUNT];
+        double lower[SPX_METRIC_COUNT];
+        double upper[SPX_METRIC_COUNT];
+        double cum_cost_min[SPX_METRIC_COUNT];
+        double cum_cost_max[SPX_METRIC_COUNT];
+        double cum_cost_last[SPX_METRIC_COUNT];
+        double value_min[SPX_METRIC_COUNT];
+        double value_max[SPX_METRIC_COUNT];
+        double call_inc_min[SPX_METRIC_COUNT];
+        double call_inc_max[SPX_METRIC_COUNT];
+        double last_sample_time;
+    } window;
+
+    /*
+     *  Calls query only: the records of the window calls, i.e. the function index, the depth
+     *  and the truncated flag followed by the start, end and exclusive metric values, and the
+     *  sampled metric values.
+     */
+    value_list_t calls;
+    value_list_t samples;
+};
+
+typedef struct {
+    size_t (*write) (void * arg, const void * ptr, size_t len);
+    void * arg;
+    size_t size;
+    char buffer[WRITE_BUFFER_SIZE];
+    char escape_buffer[8 * 1024];
+} json_writer_t;
+
+static int read_metadata(const char * file_name, int * enabled_metrics, size_t * chunk_index_offset);
+static const char * metadata_find_entry(const char * buf, const char * key);
+static int parse_metadata(const char * buf, int * enabled_metrics, size_t * chunk_index_offset);
+static int read_report(spx_report_analyzer_t * analyzer, const char * file_name);
+static int read_report_from_chunk(
+    spx_report_analyzer_t * analyzer,
+    const char * file_name,
+    size_t chunk_index_offset
+);
+static int read_chunk_index(
+    const spx_report_analyzer_t * analyzer,
+    const char * file_name,
+    size_t chunk_index_offset,
+    size_t * functions_offset,
+    size_t * aggregates_offset,
+    char ** chunk
+);
+static int read_aggregates(spx_report_analyzer_t * analyzer, const char * file_name, size_t offset);
+static int read_function_names(spx_report_analyzer_t * analyzer, const char * file_name, size_t offset);
+static int read_binary_events(
+    spx_report_analyzer_t * analyzer,
+    reader_t * reader,
+    int64_t * last_values,
+    int stop_when_done
+);
+static int read_text_event(spx_report_analyzer_t * analyzer, const char * line);
+static int begin_aggregates(spx_report_analyzer_t * analyzer, aggregates_reader_t * aggregates);
+static int read_aggregate(
+    spx_report_analyzer_t * analyzer,
+    aggregates_reader_t * aggregates,
+    const char * line
+);
+static int add_function_name(spx_report_analyzer_t * analyzer, const char * name, size_t len);
+
+static reader_t * reader_open(const char * file_name, size_t offset);
+static void reader_close(reader_t * reader);
+static int reader_getc(reader_t * reader);
+static int reader_read_varint(reader_t * reader, uint64_t * value);
+static ssize_t reader_read_line(reader_t * reader, char ** line, size_t * capacity);
+
+static void lerp_by_time(
+    const spx_report_analyzer_t * analyzer,
+    double * dst,
+    const double * a,
+    const double * b,
+    double time
+);
+
+static int update_window(spx_report_analyzer_t * analyzer, const double * values);
+static void merge_cum_cost(spx_report_analyzer_t * analyzer, const double * values);
+static int add_window_values(spx_report_analyzer_t * analyzer, const double * values, int bound);
+static int push_frame(spx_report_analyzer_t * analyzer, size_t function_idx, const double * values);
+static int pop_frame(spx_report_analyzer_t * analyzer, const double * values);
+static int pop_all_frames(spx_report_analyzer_t * analyzer, const double * values);
+static int ensure_function(spx_report_analyzer_t * analyzer, size_t function_idx);
+
+static call_tree_node_t * call_tree_get_child(
+    spx_report_analyzer_t * analyzer,
+    call_tree_node_t * parent,
+    size_t function_idx
+);
+
+static uint64_t call_tree_hmap_hash_key(const void * v);
+static int call_tree_hmap_cmp_key(const void * va, const void * vb);
+static int call_tree_node_cmp(const void * va, const void * vb);
+
+static int value_list_append(value_list_t * list, const double * values, size_t count);
+
+static void json_flush(json_writer_t * writer);
+static void json_print(json_writer_t * writer, const char * str);
+static void json_printf(json_writer_t * writer, const char * fmt, ...);
+static void json_print_string(json_writer_t * writer, const char * str);
+static void json_print_values(json_writer_t * writer, const double * values, size_t count);
+static void json_print_metrics(json_writer_t * writer, const spx_report_analyzer_t * analyzer);
+static void json_print_functions(json_writer_t * writer, const spx_report_analyzer_t * analyzer);
+static void json_print_call_tree_node(
+    json_writer_t * writer,
+    const spx_report_analyzer_t * analyzer,
+    const call_tree_node_t * node
+);
+static void json_print_bounds(
+    json_writer_t * writer,
+    const char * name,
+    const double * min,
+    const double * max,
+    size_t count
+);
+static void json_print_calls(json_writer_t * writer, const spx_report_analyzer_t * analyzer);
+static void json_print_value_lists(json_writer_t * writer, const value_list_t * list, size_t stride);
+
+static void text_print_values(json_writer_t * writer, const double * values, size_t count);
+static void text_print_call_tree_node(
+    json_writer_t * writer,
+    const spx_report_analyzer_t * analyzer,
+    const call_tree_node_t * node,
+    size_t number,
+    size_t * node_count
+);
+
+static const char * function_name(const spx_report_analyzer_t * analyzer, size_t function_idx);
+
+spx_report_analyzer_t * spx_report_analyzer_create(
+    const spx_report_analyzer_query_t * query,
+    const int * enabled_metrics
+) {
+    spx_report_analyzer_t * analyzer = malloc(sizeof(*analyzer));
+    if (!analyzer) {
+        return NULL;
+    }
+
+    analyzer->query = *query;
+    if (analyzer->query.begin < 0) {
+        analyzer->query.begin = 0;
+    }
+
+    if (analyzer->query.end < 0) {
+        analyzer->query.end = INFINITY;
+    }
+
+    analyzer->metric_count = 0;
+    analyzer->wt_idx = 0;
+
+    SPX_METRIC_FOREACH(i, {
+        if (!enabled_metrics[i]) {
+            continue;
+        }
+
+        if (i == SPX_METRIC_WALL_TIME) {
+            analyzer->wt_idx = analyzer->metric_count;
+        }
+
+        analyzer->metrics[analyzer->metric_count++] = i;
+    });
+
+    analyzer->stack.size = 0;
+    analyzer->stack.capacity = 0;
+    analyzer->stack.frames = NULL;
+    analyzer->stack.start = NULL;
+    analyzer->stack.children = NULL;
+
+    analyzer->function_top_frames = NULL;
+    analyzer->function_capacity = 0;
+    analyzer->functions = NULL;
+
+    analyzer->function_names.count = 0;
+    analyzer->function_names.size = 0;
+    analyzer->function_names.capacity = 0;
+    analyzer->function_names.buffer = NULL;
+    analyzer->function_names.offsets = NULL;
+
+    analyzer->call_tree.hmap = NULL;
+    analyzer->call_tree.nodes = NULL;
+    analyzer->call_tree.root.key.parent = NULL;
+    analyzer->call_tree.root.key.function_idx = 0;
+    analyzer->call_tree.root.called = 1;
+    analyzer->call_tree.root.min_time = 0;
+    analyzer->call_tree.root.inc = NULL;
+    analyzer->call_tree.root.first_child = NULL;
+    analyzer->call_tree.root.next_sibling = NULL;
+    analyzer->call_tree.root.next = NULL;
+
+    analyzer->call_tree.hmap = spx_hmap_create(
+        1024,
+        call_tree_hmap_hash_key,
+        call_tree_hmap_cmp_key
+    );
+
+    if (!analyzer->call_tree.hmap) {
+        goto error;
+    }
+
+    analyzer->window.first = 1;
+    analyzer->window.lower_set = 0;
+    analyzer->window.upper_set = 0;
+    analyzer->window.done = 0;
+    analyzer->window.last_time = 0;
+    analyzer->window.last_sample_time = -INFINITY;
+
+    size_t i;
+    for (i = 0; i < SPX_METRIC_COUNT; i++) {
+        analyzer->window.cum_cost_min[i] = 0;
+        analyzer->window.cum_cost_max[i] = 0;
+        analyzer->window.value_min[i] = INFINITY;
+        analyzer->window.value_max[i] = -INFINITY;
+        analyzer->window.call_inc_min[i] = INFINITY;
+        analyzer->window.call_inc_max[i] = -INFINITY;
+    }
+
+    analyzer->calls.size = 0;
+    analyzer->calls.capacity = 0;
+    analyzer->calls.values = NULL;
+
+    analyzer->samples.size = 0;
+    analyzer->samples.capacity = 0;
+    analyzer->samples.values = NULL;
+
+    analyzer->call_tree.root.inc = calloc(analyzer->metric_count, sizeof(double));
+    if (!analyzer->call_tree.root.inc) {
+        goto error;
+    }
+
+    return analyzer;
+
+error:
+    spx_report_analyzer_destroy(analyzer);
+
+    return NULL;
+}
+
+spx_report_analyzer_t * spx_report_analyzer_create_from_report(
+    const char * report_file_name,
+    const char * metadata_file_name,
+    const spx_report_analyzer_query_t * query
+) {
+    int enabled_metrics[SPX_METRIC_COUNT];
+    size_t chunk_index_offset;
+    if (read_metadata(metadata_file_name, enabled_metrics, &chunk_index_offset) != 0) {
+        return NULL;
+    }
+
+    spx_report_analyzer_t * analyzer = spx_report_analyzer_create(query, enabled_metrics);
+    if (!analyzer) {
+        return NULL;
+    }
+
+    int ret = 1;
+    if (chunk_index_offset > 0) {
+        ret = read_report_from_chunk(analyzer, report_file_name, chunk_index_offset);
+    }
+
+    if (ret > 0) {
+        ret = read_report(analyzer, report_file_name);
+    }
+
+    if (ret != 0) {
+        spx_report_analyzer_destroy(analyzer);
+
+        return NULL;
+    }
+
+    return analyzer;
+}
+
+void spx_report_analyzer_destroy(spx_report_analyzer_t * analyzer)
+{
+    free(analyzer->stack.frames);
+    free(analyzer->stack.start);
+    free(analyzer->stack.children);
+
+    free(analyzer->function_top_frames);
+
+    size_t i;
+    for (i = 0; i < analyzer->function_capacity; i++) {
+        free(analyzer->functions[i].inc);
+        free(analyzer->functions[i].exc);
+    }
+
+    free(analyzer->functions);
+
+    free(analyzer->function_names.buffer);
+    free(analyzer->function_names.offsets);
+
+    call_tree_node_t * node = analyzer->call_tree.nodes;
+    while (node) {
+        call_tree_node_t * next = node->next;
+        free(node->inc);
+        free(node);
+        node = next;
+    }
+
+    free(analyzer->call_tree.root.inc);
+
+    if (analyzer->call_tree.hmap) {
+        spx_hmap_destroy(analyzer->call_tree.hmap);
+    }
+
+    free(analyzer->calls.values);
+    free(analyzer->samples.values);
+
+    free(analyzer);
+}
+
+int spx_report_analyzer_add_event(
+    spx_report_analyzer_t * analyzer,
+    size_t function_idx,
+    int start,
+    const double * values
+) {
+    if (analyzer->window.done) {
+        return 0;
+    }
+
+    if (
+        analyzer->window.upper_set
+        && values[analyzer->wt_idx] > analyzer->query.end
+    ) {
+        /*
+         *  Past the window end, every still running call is truncated and nothing else
+         *  is relevant: the remaining events are skipped.
+         */
+        analyzer->window.done = 1;
+
+        return pop_all_frames(analyzer, values);
+    }
+
+    if (update_window(analyzer, values) != 0) {
+        return -1;
+    }
+
+    if (start) {
+        return push_frame(analyzer, function_idx, values);
+    }
+
+    if (analyzer->stack.size == 0) {
+        return -1;
+    }
+
+    return pop_frame(analyzer, values);
+}
+
+void spx_report_analyzer_output(
+    const spx_report_analyzer_t * analyzer,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+) {
+    json_writer_t * writer = malloc(sizeof(*writer));
+    if (!writer) {
+        return;
+    }
+
+    writer->write = write;
+    writer->arg = arg;
+    writer->size = 0;
+
+    json_print(writer, "{");
+    json_print_metrics(writer, analyzer);
+
+    switch (analyzer->query.type) {
+        case SPX_REPORT_ANALYZER_QUERY_FLAT_PROFILE:
+            json_print(writer, ",");
+            json_print_functions(writer, analyzer);
+
+            break;
+
+        case SPX_REPORT_ANALYZER_QUERY_CALL_TREE:
+            json_print(writer, ",\"root\":");
+            json_print_call_tree_node(writer, analyzer, &analyzer->call_tree.root);
+
+            break;
+
+        case SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS:
+            json_printf(
+                writer,
+                ",\"range\":{\"begin\":%.15g,\"end\":%.15g},",
+                analyzer->query.begin,
+                fmin(analyzer->query.end, analyzer->window.last_time)
+            );
+
+            json_print_functions(writer, analyzer);
+
+            json_print(writer, ",\"call_tree\":");
+            json_print_call_tree_node(writer, analyzer, &analyzer->call_tree.root);
+
+            json_print(writer, ",");
+            json_print_bounds(
+                writer,
+                "cum_cost",
+                analyzer->window.cum_cost_min,
+                analyzer->window.cum_cost_max,
+                analyzer->metric_count
+            );
+
+            json_print(writer, ",");
+            json_print_bounds(
+                writer,
+                "value_range",
+                analyzer->window.value_min,
+                analyzer->window.value_max,
+                analyzer->metric_count
+            );
+
+            json_print(writer, ",");
+            json_print_bounds(
+                writer,
+                "call_range",
+                analyzer->window.call_inc_min,
+                analyzer->window.call_inc_max,
+                analyzer->metric_count
+            );
+
+            break;
+
+        case SPX_REPORT_ANALYZER_QUERY_CALLS:
+            json_printf(
+                writer,
+                ",\"range\":{\"begin\":%.15g,\"end\":%.15g},",
+                analyzer->query.begin,
+                fmin(analyzer->query.end, analyzer->window.last_time)
+            );
+
+            json_print_calls(writer, analyzer);
+
+            json_print(writer, ",\"samples\":[");
+            json_print_value_lists(writer, &analyzer->samples, analyzer->metric_count);
+
+            /* the window end is sampled even when no event follows it */
+            if (
+                analyzer->window.lower_set
+                && !analyzer->window.upper_set
+                && analyzer->window.last_sample_time < analyzer->window.last_time
+            ) {
+                json_print(writer, ",");
+                json_print_values(writer, analyzer->window.previous, analyzer->metric_count);
+            }
+
+            json_print(writer, "]");
+
+            break;
+    }
+
+    json_print(writer, "}\n");
+    json_flush(writer);
+
+    free(writer);
+}
+
+void spx_report_analyzer_output_aggregates(
+    const spx_report_analyzer_t * analyzer,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+) {
+    /*
+     *  The section is made of:
+     *    - a "w <last time> <cum cost min> <cum cost max> <value min> <value max>
+     *      <call inc min> <call inc max>" line, each bound being made of the metric values
+     *    - a "f <function index> <called> <max cycle depth> <inc values> <exc values>" line
+     *      per called function
+     *    - a "r <inc values>" line for the call tree root
+     *    - a "n <parent number> <function index> <called> <first call time> <inc values>" line
+     *      per call tree node, parents first, the root being numbered 0 and the nodes from 1
+     *      in line order
+     */
+    json_writer_t * writer = malloc(sizeof(*writer));
+    if (!writer) {
+        return;
+    }
+
+    writer->write = write;
+    writer->arg = arg;
+    writer->size = 0;
+
+    json_print(writer, "[aggregates]\n");
+
+    json_printf(writer, "w %.15g", analyzer->window.last_time);
+    text_print_values(writer, analyzer->window.cum_cost_min, analyzer->metric_count);
+    text_print_values(writer, analyzer->window.cum_cost_max, analyzer->metric_count);
+    text_print_values(writer, analyzer->window.value_min, analyzer->metric_count);
+    text_print_values(writer, analyzer->window.value_max, analyzer->metric_count);
+    text_print_values(writer, analyzer->window.call_inc_min, analyzer->metric_count);
+    text_print_values(writer, analyzer->window.call_inc_max, analyzer->metric_count);
+    json_print(writer, "\n");
+
+    size_t i;
+    for (i = 0; i < analyzer->function_capacity; i++) {
+        const function_stats_t * stats = &analyzer->functions[i];
+        if (stats->called == 0) {
+            continue;
+        }
+
+        json_printf(writer, "f %zu %zu %zu", i, stats->called, stats->max_cycle_depth);
+        text_print_values(writer, stats->inc, analyzer->metric_count);
+        text_print_values(writer, stats->exc, analyzer->metric_count);
+        json_print(writer, "\n");
+    }
+
+    json_print(writer, "r");
+    text_print_values(writer, analyzer->call_tree.root.inc, analyzer->metric_count);
+    json_print(writer, "\n");
+
+    size_t node_count = 0;
+    text_print_call_tree_node(writer, analyzer, &analyzer->call_tree.root, 0, &node_count);
+
+    json_flush(writer);
+
+    free(writer);
+}
+
+static int read_metadata(const char * file_name, int * enabled_metrics, size_t * chunk_index_offset)
+{
+    FILE * fp = fopen(file_name, "r");
+    if (!fp) {
+        return -1;
+    }
+
+    /*
+     *  The whole file is read since its size is unbounded (custom metadata, demoted
+     *  function list...).
+     */
+    char * buf = NULL;
+    long size = -1;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        size = ftell(fp);
+    }
+
+    if (size >= 0 && fseek(fp, 0, SEEK_SET) == 0) {
+        buf = malloc(size + 1);
+    }
+
+    if (!buf || fread(buf, 1, size, fp) != (size_t) size) {
+        free(buf);
+        fclose(fp);
+
+        return -1;
+    }
+
+    fclose(fp);
+
+    buf[size] = 0;
+
+    const int ret = parse_metadata(buf, enabled_metrics, chunk_index_offset);
+
+    free(buf);
+
+    return ret;
+}
+
+static const char * metadata_find_entry(const char * buf, const char * key)
+{
+    /*
+     *  Top level entries are written one per line with a 2 spaces indentation, string
+     *  values being escaped they cannot contain a line break, and therefore a fake entry.
+     */
+    char entry[64];
+    snprintf(entry, sizeof(entry), "\n  \"%s\":", key);
+
+    const char * p = strstr(buf, entry);
+
+    return p ? p + strlen(entry) : NULL;
+}
+
+static int parse_metadata(const char * buf, int * enabled_metrics, size_t * chunk_index_offset)
+{
+    /*
+     *  Only the enabled metric list and the chunk index offset are needed here, since the
+     *  metadata file is written by spx_reporter_full.c in a fixed layout a minimal scan is
+     *  enough.
+     */
+    const char * p = metadata_find_entry(buf, "chunk_index_offset");
+    *chunk_index_offset = p ? strtoul(p, NULL, 10) : 0;
+
+    p = metadata_find_entry(buf, "enabled_metrics");
+    if (!p) {
+        return -1;
+    }
+
+    p = strchr(p, '[');
+    if (!p) {
+        return -1;
+    }
+
+    SPX_METRIC_FOREACH(i, {
+        enabled_metrics[i] = 0;
+    });
+
+    while (*p && *p != ']') {
+        if (*p != '"') {
+            p++;
+
+            continue;
+        }
+
+        const char * key_end = strchr(p + 1, '"');
+        if (!key_end) {
+            return -1;
+        }
+
+        char key[32];
+        snprintf(key, sizeof(key), "%.*s", (int) (key_end - p - 1), p + 1);
+
+        const spx_metric_t metric = spx_metric_get_by_key(key);
+        if (metric == SPX_METRIC_NONE) {
+            return -1;
+        }
+
+        enabled_metrics[metric] = 1;
+        p = key_end + 1;
+    }
+
+    return enabled_metrics[SPX_METRIC_WALL_TIME] ? 0 : -1;
+}
+
+static int read_report(spx_report_analyzer_t * analyzer, const char * file_name)
+{
+    int ret = -1;
+    char * line = NULL;
+    size_t line_capacity = 0;
+
+    aggregates_reader_t aggregates;
+    aggregates.enabled = 0;
+    aggregates.node_count = 0;
+    aggregates.node_capacity = 0;
+    aggregates.nodes = NULL;
+    aggregates.node_depths = NULL;
+
+    reader_t * reader = reader_open(file_name, 0);
+    if (!reader) {
+        goto end;
+    }
+
+    enum {
+        SECTION_NONE,
+        SECTION_EVENTS,
+        SECTION_AGGREGATES,
+        SECTION_FUNCTIONS,
+    } section = SECTION_NONE;
+
+    while (1) {
+        const ssize_t len = reader_read_line(reader, &line, &line_capacity);
+        if (len < 0) {
+            break;
+        }
+
+        if (0 == strcmp(line, "[events]")) {
+            section = SECTION_EVENTS;
+
+            continue;
+        }
+
+        if (0 == strcmp(line, "[events:binary:1]")) {
+            int64_t last_values[SPX_METRIC_COUNT] = {0};
+
+            /* the whole event list is consumed to reach the function names */
+            if (read_binary_events(analyzer, reader, last_values, 0) != 0) {
+                goto end;
+            }
+
+            section = SECTION_NONE;
+
+            continue;
+        }
+
+        if (0 == strcmp(line, "[aggregates]")) {
+            if (begin_aggregates(analyzer, &aggregates) != 0) {
+                goto end;
+            }
+
+            section = SECTION_AGGREGATES;
+
+            continue;
+        }
+
+        if (0 == strcmp(line, "[functions]")) {
+            section = SECTION_FUNCTIONS;
+
+            continue;
+        }
+
+        if (0 == strcmp(line, "[chunks]")) {
+            break;
+        }
+
+        switch (section) {
+            case SECTION_EVENTS:
+                if (read_text_event(analyzer, line) != 0) {
+                    goto end;
+                }
+
+                break;
+
+            case SECTION_AGGREGATES:
+                if (read_aggregate(analyzer, &aggregates, line) != 0) {
+                    goto end;
+                }
+
+                break;
+
+            case SECTION_FUNCTIONS:
+                if (add_function_name(analyzer, line, len) != 0) {
+                    goto end;
+                }
+
+                break;
+
+            default:
+                ;
+        }
+    }
+
+    /* calls left open by a truncated report end with the last event */
+    if (pop_all_frames(analyzer, analyzer->window.previous) != 0) {
+        goto end;
+    }
+
+    ret = 0;
+
+end:
+    if (reader) {
+        reader_close(reader);
+    }
+
+    free(line);
+    free(aggregates.nodes);
+    free(aggregates.node_depths);
+
+    return ret;
+}
+
+/*
+ *  Decodes the event list from the last chunk starting before the window, see the chunk
+ *  index description in spx_reporter_full.c.
+ *  Returns 1 when it is not worth it (e.g. the window starts within the first chunk), the
+ *  whole report has then to be read.
+ */
+static int read_report_from_chunk(
+    spx_report_analyzer_t * analyzer,
+    const char * file_name,
+    size_t chunk_index_offset
+) {
+    int ret = -1;
+    char * chunk = NULL;
+    reader_t * reader = NULL;
+
+    size_t functions_offset, aggregates_offset;
+    if (
+        read_chunk_index(
+            analyzer,
+            file_name,
+            chunk_index_offset,
+            &functions_offset,
+            &aggregates_offset,
+            &chunk
+        ) != 0
+    ) {
+        ret = 1;
+        goto end;
+    }
+
+    if (aggregates_offset > 0) {
+        /* the event list is not needed at all when the aggregates cover the query */
+        ret = read_aggregates(analyzer, file_name, aggregates_offset);
+        if (ret == 0) {
+            ret = read_function_names(analyzer, file_name, functions_offset);
+        }
+
+        if (ret <= 0) {
+            goto end;
+        }
+    }
+
+    if (!chunk) {
+        ret = 1;
+        goto end;
+    }
+
+    const size_t count = analyzer->metric_count;
+    int64_t last_values[SPX_METRIC_COUNT];
+    double values[SPX_METRIC_COUNT];
+
+    char * p;
+    const size_t offset = strtoul(chunk, &p, 10);
+    const size_t depth = strtoul(p, &p, 10);
+
+    size_t i, j;
+    for (i = 0; i < count; i++) {
+        last_values[i] = strtoll(p, &p, 10);
+        analyzer->window.previous[i] = last_values[i];
+    }
+
+    /* as if the events before the chunk had been read */
+    analyzer->window.first = 0;
+    analyzer->window.last_time = analyzer->window.previous[analyzer->wt_idx];
+
+    for (i = 0; i < depth; i++) {
+        const size_t function_idx = strtoul(p, &p, 10);
+        for (j = 0; j < count; j++) {
+            values[j] = strtoll(p, &p, 10);
+        }
+
+        if (push_frame(analyzer, function_idx, values) != 0) {
+            goto end;
+        }
+    }
+
+    reader = reader_open(file_name, offset);
+    if (!reader) {
+        goto end;
+    }
+
+    if (read_binary_events(analyzer, reader, last_values, 1) != 0) {
+        goto end;
+    }
+
+    if (pop_all_frames(analyzer, analyzer->window.previous) != 0) {
+        goto end;
+    }
+
+    ret = read_function_names(analyzer, file_name, functions_offset);
+
+end:
+    if (reader) {
+        reader_close(reader);
+    }
+
+    free(chunk);
+
+    return ret;
+}
+
+static int read_chunk_index(
+    const spx_report_analyzer_t * analyzer,
+    const char * file_name,
+    size_t chunk_index_offset,
+    size_t * functions_offset,
+    size_t * aggregates_offset,
+    char ** chunk
+) {
+    int ret = -1;
+    char * line = NULL;
+    size_t line_capacity = 0;
+    size_t chunk_count = 0;
+
+    *aggregates_offset = 0;
+    *chunk = NULL;
+
+    reader_t * reader = reader_open(file_name, chunk_index_offset);
+    if (!reader) {
+        goto end;
+    }
+
+    if (
+        reader_read_line(reader, &line, &line_capacity) < 0
+        || 0 != strcmp(line, "[chunks]")
+        || reader_read_line(reader, &line, &line_capacity) < 0
+        || 0 != strncmp(line, "functions ", strlen("functions "))
+    ) {
+        goto end;
+    }
+
+    *functions_offset = strtoul(line + strlen("functions "), NULL, 10);
+
+    while (1) {
+        const ssize_t len = reader_read_line(reader, &line, &line_capacity);
+        if (len <= 0) {
+            break;
+        }
+
+        if (0 == strncmp(line, "aggregates ", strlen("aggregates "))) {
+            *aggregates_offset = strtoul(line + strlen("aggregates "), NULL, 10);
+
+            continue;
+        }
+
+        char * p;
+        strtoul(line, &p, 10);
+        strtoul(p, &p, 10);
+
+        size_t i;
+        for (i = 0; i < analyzer->wt_idx; i++) {
+            strtoll(p, &p, 10);
+        }
+
+        if (strtoll(p, &p, 10) >= analyzer->query.begin) {
+            break;
+        }
+
+        chunk_count++;
+
+        free(*chunk);
+        *chunk = strdup(line);
+        if (!*chunk) {
+            goto end;
+        }
+    }
+
+    if (chunk_count < 2) {
+        /* the first chunk is the start of the event list */
+        free(*chunk);
+        *chunk = NULL;
+    }
+
+    ret = 0;
+
+end:
+    if (ret != 0) {
+        free(*chunk);
+        *chunk = NULL;
+    }
+
+    if (reader) {
+        reader_close(reader);
+    }
+
+    free(line);
+
+    return ret;
+}
+
+/*
+ *  Reads the "[aggregates]" section alone, see spx_report_analyzer_output_aggregates().
+ *  Returns 1 when it does not cover the query, the event list has then to be read.
+ */
+static int read_aggregates(spx_report_analyzer_t * analyzer, const char * file_name, size_t offset)
+{
+    int ret = -1;
+    char * line = NULL;
+    size_t line_capacity = 0;
+
+    aggregates_reader_t aggregates;
+    aggregates.enabled = 0;
+    aggregates.node_count = 0;
+    aggregates.node_capacity = 0;
+    aggregates.nodes = NULL;
+    aggregates.node_depths = NULL;
+
+    reader_t * reader = reader_open(file_name, offset);
+    if (!reader) {
+        goto end;
+    }
+
+    if (
+        reader_read_line(reader, &line, &line_capacity) < 0
+        || 0 != strcmp(line, "[aggregates]")
+        || reader_read_line(reader, &line, &line_capacity) < 0
+        || line[0] != 'w'
+    ) {
+        goto end;
+    }
+
+    /* the window is set first since it decides whether the aggregates cover the query */
+    analyzer->window.last_time = strtod(line + 1, NULL);
+
+    if (begin_aggregates(analyzer, &aggregates) != 0) {
+        goto end;
+    }
+
+    if (!aggregates.enabled) {
+        analyzer->window.last_time = 0;
+        ret = 1;
+
+        goto end;
+    }
+
+    while (1) {
+        if (read_aggregate(analyzer, &aggregates, line) != 0) {
+            goto end;
+        }
+
+        const ssize_t len = reader_read_line(reader, &line, &line_capacity);
+        if (len < 0 || 0 == strcmp(line, "[functions]")) {
+            break;
+        }
+    }
+
+    ret = 0;
+
+end:
+    if (reader) {
+        reader_close(reader);
+    }
+
+    free(line);
+    free(aggregates.nodes);
+    free(aggregates.node_depths);
+
+    return ret;
+}
+
+static int read_function_names(spx_report_analyzer_t * analyzer, const char * file_name, size_t offset)
+{
+    int ret = -1;
+    char * line = NULL;
+    size_t line_capacity = 0;
+
+    reader_t * reader = reader_open(file_name, offset);
+    if (!reader) {
+        goto end;
+    }
+
+    if (reader_read_line(reader, &line, &line_capacity) < 0 || 0 != strcmp(line, "[functions]")) {
+        goto end;
+    }
+
+    while (1) {
+        const ssize_t len = reader_read_line(reader, &line, &line_capacity);
+        if (len < 0 || 0 == strcmp(line, "[chunks]")) {
+            break;
+        }
+
+        if (add_function_name(analyzer, line, len) != 0) {
+            goto end;
+        }
+    }
+
+    ret = 0;
+
+end:
+    if (reader) {
+        reader_close(reader);
+    }
+
+    free(line);
+
+    return ret;
+}
+
+static int read_binary_events(
+    spx_report_analyzer_t * analyzer,
+    reader_t * reader,
+    int64_t * last_values,
+    int stop_when_done
+) {
+    /* see spx_reporter_full.c for the format description */
+    double values[SPX_METRIC_COUNT];
+
+    while (1) {
+        if (stop_when_done && analyzer->window.done) {
+            return 0;
+        }
+
+        uint64_t value;
+        if (reader_read_varint(reader, &value) != 0) {
+            return -1;
+        }
+
+        if (value == 0) {
+            return 0;
+        }
+
+        const size_t function_idx = (value >> 1) - 1;
+        const int start = value & 1;
+
+        size_t i;
+        for (i = 0; i < analyzer->metric_count; i++) {
+            uint64_t delta;
+            if (reader_read_varint(reader, &delta) != 0) {
+                return -1;
+            }
+
+            last_values[i] += delta & 1 ? (int64_t) ~(delta >> 1) : (int64_t) (delta >> 1);
+            values[i] = last_values[i];
+        }
+
+        if (spx_report_analyzer_add_event(analyzer, function_idx, start, values) != 0) {
+            return -1;
+        }
+    }
+}
+
+static int read_text_event(spx_report_analyzer_t * analyzer, const char * line)
+{
+    double values[SPX_METRIC_COUNT];
+
+    char * end;
+    const size_t function_idx = strtoul(line, &end, 10);
+    const int start = strtol(end, &end, 10);
+
+    size_t i;
+    for (i = 0; i < analyzer->metric_count; i++) {
+        values[i] = strtod(end, &end);
+    }
+
+    return spx_report_analyzer_add_event(analyzer, function_idx, start, values);
+}
+
+/*
+ *  The "[aggregates]" section follows the event list, the window is then known and the
+ *  replayed aggregates can be replaced when it covers the whole report.
+ */
+static int begin_aggregates(spx_report_analyzer_t * analyzer, aggregates_reader_t * aggregates)
+{
+    aggregates->enabled =
+        analyzer->query.type != SPX_REPORT_ANALYZER_QUERY_CALLS
+        && analyzer->query.begin == 0
+        && analyzer->query.end >= analyzer->window.last_time
+    ;
+
+    if (!aggregates->enabled) {
+        return 0;
+    }
+
+    if (pop_all_frames(analyzer, analyzer->window.previous) != 0) {
+        return -1;
+    }
+
+    const size_t count = analyzer->metric_count;
+
+    size_t i;
+    for (i = 0; i < analyzer->function_capacity; i++) {
+        analyzer->functions[i].called = 0;
+        analyzer->functions[i].max_cycle_depth = 0;
+        memset(analyzer->functions[i].inc, 0, count * sizeof(double));
+        memset(analyzer->functions[i].exc, 0, count * sizeof(double));
+    }
+
+    /* nodes are kept for the hmap, those left uncalled are not output */
+    call_tree_node_t * node;
+    for (node = analyzer->call_tree.nodes; node; node = node->next) {
+        node->called = 0;
+        node->min_time = INFINITY;
+        memset(node->inc, 0, count * sizeof(double));
+    }
+
+    memset(analyzer->call_tree.root.inc, 0, count * sizeof(double));
+
+    return 0;
+}
+
+/* see spx_report_analyzer_output_aggregates() for the line format */
+static int read_aggregate(
+    spx_report_analyzer_t * analyzer,
+    aggregates_reader_t * aggregates,
+    const char * line
+) {
+    if (!aggregates->enabled) {
+        return 0;
+    }
+
+    const size_t count = analyzer->metric_count;
+    char * p;
+    size_t i;
+
+    if (line[0] == 'w') {
+        analyzer->window.last_time = strtod(line + 1, &p);
+
+        double * bounds[] = {
+            analyzer->window.cum_cost_min,
+            analyzer->window.cum_cost_max,
+            analyzer->window.value_min,
+            analyzer->window.value_max,
+            analyzer->window.call_inc_min,
+            analyzer->window.call_inc_max,
+        };
+
+        size_t j;
+        for (j = 0; j < sizeof(bounds) / sizeof(bounds[0]); j++) {
+            for (i = 0; i < count; i++) {
+                bounds[j][i] = strtod(p, &p);
+            }
+        }
+
+        return 0;
+    }
+
+    if (line[0] == 'f') {
+        const size_t function_idx = strtoul(line + 1, &p, 10);
+        if (ensure_function(analyzer, function_idx) != 0) {
+            return -1;
+        }
+
+        function_stats_t * stats = &analyzer->functions[function_idx];
+
+        stats->called = strtoul(p, &p, 10);
+        stats->max_cycle_depth = strtoul(p, &p, 10);
+
+        for (i = 0; i < count; i++) {
+            stats->inc[i] = strtod(p, &p);
+        }
+
+        for (i = 0; i < count; i++) {
+            stats->exc[i] = strtod(p, &p);
+        }
+
+        return 0;
+    }
+
+    if (line[0] == 'r') {
+        p = (char *) line + 1;
+        for (i = 0; i < count; i++) {
+            analyzer->call_tree.root.inc[i] = strtod(p, &p);
+        }
+
+        return 0;
+    }
+
+    if (
+        line[0] != 'n'
+        || (
+            analyzer->query.type != SPX_REPORT_ANALYZER_QUERY_CALL_TREE
+            && analyzer->query.type != SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS
+        )
+    ) {
+        return 0;
+    }
+
+    if (aggregates->node_count == aggregates->node_capacity) {
+        const size_t capacity = aggregates->node_capacity > 0 ? aggregates->node_capacity * 2 : 1024;
+
+        call_tree_node_t ** nodes = realloc(aggregates->nodes, capacity * sizeof(*nodes));
+        if (!nodes) {
+            return -1;
+        }
+
+        aggregates->nodes = nodes;
+
+        size_t * node_depths = realloc(aggregates->node_depths, capacity * sizeof(*node_depths));
+        if (!node_depths) {
+            return -1;
+        }
+
+        aggregates->node_depths = node_depths;
+        aggregates->node_capacity = capacity;
+    }
+
+    if (aggregates->node_count == 0) {
+        aggregates->nodes[0] = &analyzer->call_tree.root;
+        aggregates->node_depths[0] = 0;
+        aggregates->node_count = 1;
+    }
+
+    const size_t parent_number = strtoul(line + 1, &p, 10);
+    const size_t function_idx = strtoul(p, &p, 10);
+    if (parent_number >= aggregates->node_count) {
+        return -1;
+    }
+
+    call_tree_node_t * parent = aggregates->nodes[parent_number];
+    const size_t depth = aggregates->node_depths[parent_number] + 1;
+
+    /* like push_frame(), for a frame at depth - 1 */
+    call_tree_node_t * node = NULL;
+    if (parent && (analyzer->query.max_depth == 0 || depth <= analyzer->query.max_depth)) {
+        if (ensure_function(analyzer, function_idx) != 0) {
+            return -1;
+        }
+
+        node = call_tree_get_child(analyzer, parent, function_idx);
+        if (!node) {
+            return -1;
+        }
+
+        node->called = strtoul(p, &p, 10);
+        node->min_time = strtod(p, &p);
+
+        for (i = 0; i < count; i++) {
+            node->inc[i] = strtod(p, &p);
+        }
+    }
+
+    aggregates->nodes[aggregates->node_count] = node;
+    aggregates->node_depths[aggregates->node_count] = depth;
+    aggregates->node_count++;
+
+    return 0;
+}
+
+static int add_function_name(spx_report_analyzer_t * analyzer, const char * name, size_t len)
+{
+    if (analyzer->function_names.count == analyzer->function_capacity) {
+        /* names beyond the last called function are not needed */
+        return 0;
+    }
+
+    const size_t size = analyzer->function_names.size;
+    if (size + len + 1 > analyzer->function_names.capacity) {
+        size_t capacity = analyzer->function_names.capacity * 2;
+        if (capacity < size + len + 1) {
+            capacity = size + len + 1 + 4096;
+        }
+
+        char * buffer = realloc(analyzer->function_names.buffer, capacity);
+        if (!buffer) {
+            return -1;
+        }
+
+        analyzer->function_names.buffer = buffer;
+        analyzer->function_names.capacity = capacity;
+    }
+
+    if (!analyzer->function_names.offsets) {
+        analyzer->function_names.offsets = malloc(
+            analyzer->function_capacity * sizeof(*analyzer->function_names.offsets)
+        );
+
+        if (!analyzer->function_names.offsets) {
+            return -1;
+        }
+    }
+
+    memcpy(analyzer->function_names.buffer + size, name, len + 1);
+    analyzer->function_names.offsets[analyzer->function_names.count++] = size;
+    analyzer->function_names.size += len + 1;
+
+    return 0;
+}
+
+static reader_t * reader_open(const char * file_name, size_t offset)
+{
+    reader_t * reader = malloc(sizeof(*reader));
+    if (!reader) {
+        return NULL;
+    }
+
+    reader->size = 0;
+    reader->offset = 0;
+    reader->input = spx_input_stream_open_at(
+        file_name,
+        spx_output_stream_codec_get_by_file_name(file_name),
+        offset
+    );
+
+    if (!reader->input) {
+        free(reader);
+
+        return NULL;
+    }
+
+    return reader;
+}
+
+static void reader_close(reader_t * reader)
+{
+    spx_input_stream_close(reader->input);
+    free(reader);
+}
+
+static int reader_getc(reader_t * reader)
+{
+    if (reader->offset == reader->size) {
+        reader->size = spx_input_stream_read(reader->input, reader->buffer, sizeof(reader->buffer));
+        reader->offset = 0;
+
+        if (reader->size == 0) {
+            return -1;
+        }
+    }
+
+    return reader->buffer[reader->offset++];
+}
+
+static int reader_read_varint(reader_t * reader, uint64_t * value)
+{
+    *value = 0;
+
+    int shift = 0;
+    while (shift < 64) {
+        const int c = reader_getc(reader);
+        if (c < 0) {
+            return -1;
+        }
+
+        *value |= (uint64_t) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return 0;
+        }
+
+        shift += 7;
+    }
+
+    return -1;
+}
+
+static ssize_t reader_read_line(reader_t * reader, char ** line, size_t * capacity)
+{
+    size_t len = 0;
+    while (1) {
+        const int c = reader_getc(reader);
+        if (c < 0 && len == 0) {
+            return -1;
+        }
+
+        if (len + 1 >= *capacity) {
+            const size_t new_capacity = *capacity > 0 ? *capacity * 2 : 256;
+            char * new_line = realloc(*line, new_capacity);
+            if (!new_line) {
+                return -1;
+            }
+
+            *line = new_line;
+            *capacity = new_capacity;
+        }
+
+        if (c < 0 || c == '\n') {
+            (*line)[len] = 0;
+
+            return len;
+        }
+
+        (*line)[len++] = c;
+    }
+}
+
+static void lerp_by_time(
+    const spx_report_analyzer_t * analyzer,
+    double * dst,
+    const double * a,
+    const double * b,
+    double time
+) {
+    const size_t m = analyzer->wt_idx;
+    const double dist = a[m] == b[m] ? 0 : (time - a[m]) / (b[m] - a[m]);
+
+    size_t i;
+    for (i = 0; i < analyzer->metric_count; i++) {
+        dst[i] = a[i] + (b[i] - a[i]) * dist;
+    }
+}
+
+static int update_window(spx_report_analyzer_t * analyzer, const double * values)
+{
+    const size_t count = analyzer->metric_count;
+    const double time = values[analyzer->wt_idx];
+
+    if (!analyzer->window.lower_set && time >= analyzer->query.begin) {
+        analyzer->window.lower_set = 1;
+
+        if (analyzer->window.first) {
+            memcpy(analyzer->window.lower, values, count * sizeof(*values));
+        } else {
+            lerp_by_time(
+                analyzer,
+                analyzer->window.lower,
+                analyzer->window.previous,
+                values,
+                analyzer->query.begin
+            );
+        }
+
+        memcpy(analyzer->window.previous, analyzer->window.lower, count * sizeof(*values));
+
+        if (add_window_values(analyzer, analyzer->window.lower, 1) != 0) {
+            return -1;
+        }
+    }
+
+    if (
+        analyzer->window.lower_set
+        && !analyzer->window.upper_set
+        && time >= analyzer->query.end
+    ) {
+        analyzer->window.upper_set = 1;
+
+        lerp_by_time(
+            analyzer,
+            analyzer->window.upper,
+            analyzer->window.previous,
+            values,
+            analyzer->query.end
+        );
+
+        merge_cum_cost(analyzer, analyzer->window.upper);
+
+        if (add_window_values(analyzer, analyzer->window.upper, 1) != 0) {
+            return -1;
+        }
+    }
+
+    if (analyzer->window.lower_set && !analyzer->window.upper_set) {
+        merge_cum_cost(analyzer, values);
+
+        if (add_window_values(analyzer, values, 0) != 0) {
+            return -1;
+        }
+    }
+
+    memcpy(analyzer->window.previous, values, count * sizeof(*values));
+
+    analyzer->window.first = 0;
+    analyzer->window.last_time = time;
+
+    return 0;
+}
+
+static void merge_cum_cost(spx_report_analyzer_t * analyzer, const double * values)
+{
+    size_t i;
+    for (i = 0; i < analyzer->metric_count; i++) {
+        const double delta = values[i] - analyzer->window.previous[i];
+        if (delta < 0) {
+            analyzer->window.cum_cost_min[i] += delta;
+        } else {
+            analyzer->window.cum_cost_max[i] += delta;
+        }
+    }
+}
+
+/*
+ *  Merges values of the window, a window bound being always sampled by the calls query, see
+ *  the min_duration query field.
+ */
+static int add_window_values(spx_report_analyzer_t * analyzer, const double * values, int bound)
+{
+    size_t i;
+    for (i = 0; i < analyzer->metric_count; i++) {
+        analyzer->window.value_min[i] = fmin(analyzer->window.value_min[i], values[i]);
+        analyzer->window.value_max[i] = fmax(analyzer->window.value_max[i], values[i]);
+    }
+
+    if (analyzer->query.type != SPX_REPORT_ANALYZER_QUERY_CALLS) {
+        return 0;
+    }
+
+    const double time = values[analyzer->wt_idx];
+    if (
+        !bound
+        && (
+            time < analyzer->window.last_sample_time + analyzer->query.min_duration
+            || time == analyzer->window.last_sample_time
+        )
+    ) {
+        return 0;
+    }
+
+    analyzer->window.last_sample_time = time;
+
+    return value_list_append(&analyzer->samples, values, analyzer->metric_count);
+}
+
+static int push_frame(spx_report_analyzer_t * analyzer, size_t function_idx, const double * values)
+{
+    const size_t count = analyzer->metric_count;
+
+    if (analyzer->stack.size == analyzer->stack.capacity) {
+        const size_t capacity = analyzer->stack.capacity > 0 ? analyzer->stack.capacity * 2 : 256;
+
+        frame_t * frames = realloc(analyzer->stack.frames, capacity * sizeof(*frames));
+        if (!frames) {
+            return -1;
+        }
+
+        analyzer->stack.frames = frames;
+
+        double * start = realloc(analyzer->stack.start, capacity * count * sizeof(*start));
+        if (!start) {
+            return -1;
+        }
+
+        analyzer->stack.start = start;
+
+        double * children = realloc(analyzer->stack.children, capacity * count * sizeof(*children));
+        if (!children) {
+            return -1;
+        }
+
+        analyzer->stack.children = children;
+        analyzer->stack.capacity = capacity;
+    }
+
+    if (ensure_function(analyzer, function_idx) != 0) {
+        return -1;
+    }
+
+    const size_t idx = analyzer->stack.size;
+    frame_t * frame = &analyzer->stack.frames[idx];
+
+    frame->function_idx = function_idx;
+    frame->prev_same_function_frame = analyzer->function_top_frames[function_idx];
+    frame->cycle_depth = frame->prev_same_function_frame < 0 ?
+        0 : analyzer->stack.frames[frame->prev_same_function_frame].cycle_depth + 1;
+
+    analyzer->function_top_frames[function_idx] = idx;
+
+    frame->node = NULL;
+    if (
+        (
+            analyzer->query.type == SPX_REPORT_ANALYZER_QUERY_CALL_TREE
+            || analyzer->query.type == SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS
+        )
+        && (analyzer->query.max_depth == 0 || idx < analyzer->query.max_depth)
+    ) {
+        call_tree_node_t * parent = idx == 0 ?
+            &analyzer->call_tree.root : analyzer->stack.frames[idx - 1].node;
+
+        if (parent) {
+            frame->node = call_tree_get_child(analyzer, parent, function_idx);
+            if (!frame->node) {
+                return -1;
+            }
+        }
+    }
+
+    memcpy(analyzer->stack.start + idx * count, values, count * sizeof(*values));
+    memset(analyzer->stack.children + idx * count, 0, count * sizeof(*values));
+
+    analyzer->stack.size++;
+
+    return 0;
+}
+
+static int pop_frame(spx_report_analyzer_t * analyzer, const double * values)
+{
+    const size_t count = analyzer->metric_count;
+    const size_t idx = --analyzer->stack.size;
+    const frame_t * frame = &analyzer->stack.frames[idx];
+
+    const double * start = analyzer->stack.start + idx * count;
+    const double * children = analyzer->stack.children + idx * count;
+
+    double exc[SPX_METRIC_COUNT];
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        exc[i] = values[i] - start[i] - children[i];
+    }
+
+    if (idx > 0) {
+        double * parent_children = analyzer->stack.children + (idx - 1) * count;
+        for (i = 0; i < count; i++) {
+            parent_children[i] += values[i] - start[i];
+        }
+    }
+
+    /* the exclusive cost is not counted twice for direct or indirect recursive calls */
+    if (frame->prev_same_function_frame >= 0) {
+        double * same_children = analyzer->stack.children + frame->prev_same_function_frame * count;
+        for (i = 0; i < count; i++) {
+            same_children[i] -= exc[i];
+        }
+    }
+
+    analyzer->function_top_frames[frame->function_idx] = frame->prev_same_function_frame;
+
+    const size_t wt = analyzer->wt_idx;
+    if (
+        values[wt] < analyzer->query.begin
+        || analyzer->query.end < start[wt]
+    ) {
+        return 0;
+    }
+
+    /*
+     *  Calls overlapping a window bound are truncated to it, their exclusive cost is then
+     *  left out since it cannot be split.
+     */
+    int truncated = 0;
+    if (analyzer->window.lower_set && analyzer->window.lower[wt] > start[wt]) {
+        truncated = 1;
+        start = analyzer->window.lower;
+    }
+
+    if (analyzer->window.upper_set && analyzer->window.upper[wt] < values[wt]) {
+        truncated = 1;
+        values = analyzer->window.upper;
+    }
+
+    double inc[SPX_METRIC_COUNT];
+    for (i = 0; i < count; i++) {
+        inc[i] = values[i] - start[i];
+        if (truncated) {
+            exc[i] = 0;
+        }
+
+        analyzer->window.call_inc_min[i] = fmin(analyzer->window.call_inc_min[i], inc[i]);
+        analyzer->window.call_inc_max[i] = fmax(analyzer->window.call_inc_max[i], inc[i]);
+    }
+
+    if (
+        analyzer->query.type == SPX_REPORT_ANALYZER_QUERY_CALLS
+        && inc[wt] >= analyzer->query.min_duration
+    ) {
+        double record[3 + 3 * SPX_METRIC_COUNT];
+
+        record[0] = frame->function_idx;
+        record[1] = idx;
+        record[2] = truncated;
+
+        memcpy(record + 3, start, count * sizeof(*record));
+        memcpy(record + 3 + count, values, count * sizeof(*record));
+        memcpy(record + 3 + 2 * count, exc, count * sizeof(*record));
+
+        if (value_list_append(&analyzer->calls, record, 3 + 3 * count) != 0) {
+            return -1;
+        }
+    }
+
+    function_stats_t * stats = &analyzer->functions[frame->function_idx];
+
+    stats->called++;
+    if (stats->max_cycle_depth < frame->cycle_depth) {
+        stats->max_cycle_depth = frame->cycle_depth;
+    }
+
+    if (frame->cycle_depth == 0) {
+        for (i = 0; i < count; i++) {
+            stats->inc[i] += inc[i];
+            stats->exc[i] += exc[i];
+        }
+    }
+
+    call_tree_node_t * node = frame->node;
+    if (!node) {
+        return 0;
+    }
+
+    node->called++;
+    if (node->min_time > start[wt]) {
+        node->min_time = start[wt];
+    }
+
+    for (i = 0; i < count; i++) {
+        node->inc[i] += inc[i];
+    }
+
+    if (idx == 0) {
+        for (i = 0; i < count; i++) {
+            analyzer->call_tree.root.inc[i] += inc[i];
+        }
+    }
+
+    return 0;
+}
+
+static int pop_all_frames(spx_report_analyzer_t * analyzer, const double * values)
+{
+    while (analyzer->stack.size > 0) {
+        if (pop_frame(analyzer, values) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int ensure_function(spx_report_analyzer_t * analyzer, size_t function_idx)
+{
+    if (function_idx < analyzer->function_capacity) {
+        return 0;
+    }
+
+    size_t capacity = analyzer->function_capacity > 0 ? analyzer->function_capacity : 1024;
+    while (capacity <= function_idx) {
+        capacity *= 2;
+    }
+
+    function_stats_t * functions = realloc(analyzer->functions, capacity * sizeof(*functions));
+    if (!functions) {
+        return -1;
+    }
+
+    analyzer->functions = functions;
+
+    ssize_t * top_frames = realloc(analyzer->function_top_frames, capacity * sizeof(*top_frames));
+    if (!top_frames) {
+        return -1;
+    }
+
+    analyzer->function_top_frames = top_frames;
+
+    size_t i;
+    for (i = analyzer->function_capacity; i < capacity; i++) {
+        functions[i].called = 0;
+        functions[i].max_cycle_depth = 0;
+        functions[i].inc = NULL;
+        functions[i].exc = NULL;
+        top_frames[i] = -1;
+    }
+
+    const size_t previous_capacity = analyzer->function_capacity;
+    analyzer->function_capacity = capacity;
+
+    for (i = previous_capacity; i < capacity; i++) {
+        functions[i].inc = calloc(analyzer->metric_count, sizeof(double));
+        functions[i].exc = calloc(analyzer->metric_count, sizeof(double));
+
+        if (!functions[i].inc || !functions[i].exc) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static call_tree_node_t * call_tree_get_child(
+    spx_report_analyzer_t * analyzer,
+    call_tree_node_t * parent,
+    size_t function_idx
+) {
+    const call_tree_node_key_t key = {parent, function_idx};
+
+    int new = 0;
+    spx_hmap_entry_t * entry = spx_hmap_ensure_entry(analyzer->call_tree.hmap, &key, &new);
+    if (!entry) {
+        return NULL;
+    }
+
+    if (!new) {
+        return spx_hmap_entry_get_value(entry);
+    }
+
+    /*
+     *  On allocation failure the entry is left with a key living on the stack, this is
+     *  fine since the whole analysis is then aborted.
+     */
+    call_tree_node_t * node = malloc(sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+
+    node->inc = calloc(analyzer->metric_count, sizeof(double));
+    if (!node->inc) {
+        free(node);
+
+        return NULL;
+    }
+
+    node->key = key;
+    node->called = 0;
+    node->min_time = INFINITY;
+
+    /* the hmap only references the key, it must then live in the node */
+    spx_hmap_set_entry_key(analyzer->call_tree.hmap, entry, &node->key);
+    spx_hmap_entry_set_value(entry, node);
+
+    node->first_child = NULL;
+    node->next_sibling = parent->first_child;
+    parent->first_child = node;
+
+    node->next = analyzer->call_tree.nodes;
+    analyzer->call_tree.nodes = node;
+
+    return node;
+}
+
+static uint64_t call_tree_hmap_hash_key(const void * v)
+{
+    const call_tree_node_key_t * key = v;
+
+    return (uint64_t) (uintptr_t) key->parent * 31 + key->function_idx;
+}
+
+static int call_tree_hmap_cmp_key(const void * va, const void * vb)
+{
+    const call_tree_node_key_t * a = va;
+    const call_tree_node_key_t * b = vb;
+
+    if (a->parent != b->parent) {
+        return a->parent < b->parent ? -1 : 1;
+    }
+
+    if (a->function_idx != b->function_idx) {
+        return a->function_idx < b->function_idx ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int call_tree_node_cmp(const void * va, const void * vb)
+{
+    const call_tree_node_t * a = *(const call_tree_node_t * const *) va;
+    const call_tree_node_t * b = *(const call_tree_node_t * const *) vb;
+
+    if (a->min_time != b->min_time) {
+        return a->min_time < b->min_time ? -1 : 1;
+    }
+
+    return 0;
+}
+
+static int value_list_append(value_list_t * list, const double * values, size_t count)
+{
+    if (list->size + count > list->capacity) {
+        size_t capacity = list->capacity > 0 ? list->capacity * 2 : 4096;
+        while (capacity < list->size + count) {
+            capacity *= 2;
+        }
+
+        double * new_values = realloc(list->values, capacity * sizeof(*new_values));
+        if (!new_values) {
+            return -1;
+        }
+
+        list->values = new_values;
+        list->capacity = capacity;
+    }
+
+    memcpy(list->values + list->size, values, count * sizeof(*values));
+    list->size += count;
+
+    return 0;
+}
+
+static void json_flush(json_writer_t * writer)
+{
+    if (writer->size > 0) {
+        writer->write(writer->arg, writer->buffer, writer->size);
+        writer->size = 0;
+    }
+}
+
+static void json_print(json_writer_t * writer, const char * str)
+{
+    size_t len = strlen(str);
+    while (len > 0) {
+        if (writer->size == sizeof(writer->buffer)) {
+            json_flush(writer);
+        }
+
+        size_t n = sizeof(writer->buffer) - writer->size;
+        if (n > len) {
+            n = len;
+        }
+
+        memcpy(writer->buffer + writer->size, str, n);
+        writer->size += n;
+        str += n;
+        len -= n;
+    }
+}
+
+static void json_printf(json_writer_t * writer, const char * fmt, ...)
+{
+    char buf[512];
+
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    json_print(writer, buf);
+}
+
+static void json_print_string(json_writer_t * writer, const char * str)
+{
+    json_print(writer, "\"");
+    json_print(
+        writer,
+        spx_utils_json_escape(writer->escape_buffer, str, sizeof(writer->escape_buffer))
+    );
+
+    json_print(writer, "\"");
+}
+
+static void json_print_values(json_writer_t * writer, const double * values, size_t count)
+{
+    json_print(writer, "[");
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        json_printf(writer, i > 0 ? ",%.15g" : "%.15g", values[i]);
+    }
+
+    json_print(writer, "]");
+}
+
+static void json_print_metrics(json_writer_t * writer, const spx_report_analyzer_t * analyzer)
+{
+    json_print(writer, "\"metrics\":[");
+
+    size_t i;
+    for (i = 0; i < analyzer->metric_count; i++) {
+        if (i > 0) {
+            json_print(writer, ",");
+        }
+
+        json_print_string(writer, spx_metric_info[analyzer->metrics[i]].key);
+    }
+
+    json_print(writer, "]");
+}
+
+static void json_print_functions(json_writer_t * writer, const spx_report_analyzer_t * analyzer)
+{
+    json_print(writer, "\"functions\":[");
+
+    int first = 1;
+    size_t i;
+    for (i = 0; i < analyzer->function_capacity; i++) {
+        const function_stats_t * stats = &analyzer->functions[i];
+        if (stats->called == 0) {
+            continue;
+        }
+
+        if (!first) {
+            json_print(writer, ",");
+        }
+
+        first = 0;
+
+        json_print(writer, "{\"name\":");
+        json_print_string(writer, function_name(analyzer, i));
+        json_printf(
+            writer,
+            ",\"called\":%zu,\"max_cycle_depth\":%zu,\"inc\":",
+            stats->called,
+            stats->max_cycle_depth
+        );
+
+        json_print_values(writer, stats->inc, analyzer->metric_count);
+        json_print(writer, ",\"exc\":");
+        json_print_values(writer, stats->exc, analyzer->metric_count);
+        json_print(writer, "}");
+    }
+
+    json_print(writer, "]");
+}
+
+static void json_print_call_tree_node(
+    json_writer_t * writer,
+    const spx_report_analyzer_t * analyzer,
+    const call_tree_node_t * node
+) {
+    json_print(writer, "{");
+
+    if (node != &analyzer->call_tree.root) {
+        json_print(writer, "\"name\":");
+        json_print_string(writer, function_name(analyzer, node->key.function_idx));
+        json_print(writer, ",");
+    }
+
+    json_printf(writer, "\"called\":%zu,\"inc\":", node->called);
+    json_print_values(writer, node->inc, analyzer->metric_count);
+    json_print(writer, ",\"children\":[");
+
+    const size_t wt = analyzer->wt_idx;
+
+    size_t count = 0;
+    const call_tree_node_t * child;
+    for (child = node->first_child; child; child = child->next_sibling) {
+        if (child->called > 0 && child->inc[wt] >= analyzer->query.min_duration) {
+            count++;
+        }
+    }
+
+    const call_tree_node_t ** children = count > 0 ? malloc(count * sizeof(*children)) : NULL;
+    if (children) {
+        size_t i = 0;
+        for (child = node->first_child; child; child = child->next_sibling) {
+            if (child->called > 0 && child->inc[wt] >= analyzer->query.min_duration) {
+                children[i++] = child;
+            }
+        }
+
+        /* like CallTreeStatsNode.getChildren() */
+        qsort(children, count, sizeof(*children), call_tree_node_cmp);
+
+        for (i = 0; i < count; i++) {
+            if (i > 0) {
+                json_print(writer, ",");
+            }
+
+            json_print_call_tree_node(writer, analyzer, children[i]);
+        }
+
+        free(children);
+    }
+
+    json_print(writer, "]}");
+}
+
+static void json_print_bounds(
+    json_writer_t * writer,
+    const char * name,
+    const double * min,
+    const double * max,
+    size_t count
+) {
+    double finite_min[SPX_METRIC_COUNT];
+    double finite_max[SPX_METRIC_COUNT];
+
+    /* the bounds of an empty window are left infinite, they are then output as 0 */
+    size_t i;
+    for (i = 0; i < count; i++) {
+        finite_min[i] = isfinite(min[i]) ? min[i] : 0;
+        finite_max[i] = isfinite(max[i]) ? max[i] : 0;
+    }
+
+    json_print_string(writer, name);
+    json_print(writer, ":{\"min\":");
+    json_print_values(writer, finite_min, count);
+    json_print(writer, ",\"max\":");
+    json_print_values(writer, finite_max, count);
+    json_print(writer, "}");
+}
+
+static void json_print_calls(json_writer_t * writer, const spx_report_analyzer_t * analyzer)
+{
+    const size_t stride = 3 + 3 * analyzer->metric_count;
+    const size_t call_count = analyzer->calls.size / stride;
+
+    /* the calls only reference the names of their functions, renumbered in order of appearance */
+    size_t * local_idx = NULL;
+    if (analyzer->function_capacity > 0) {
+        local_idx = malloc(analyzer->function_capacity * sizeof(*local_idx));
+        if (!local_idx) {
+            json_print(writer, "\"functions\":[],\"calls\":[]");
+
+            return;
+        }
+    }
+
+    size_t i;
+    for (i = 0; i < analyzer->function_capacity; i++) {
+        local_idx[i] = SIZE_MAX;
+    }
+
+    json_print(writer, "\"functions\":[");
+
+    size_t function_count = 0;
+    for (i = 0; i < call_count; i++) {
+        const size_t function_idx = analyzer->calls.values[i * stride];
+        if (local_idx[function_idx] != SIZE_MAX) {
+            continue;
+        }
+
+        if (function_count > 0) {
+            json_print(writer, ",");
+        }
+
+        local_idx[function_idx] = function_count++;
+        json_print_string(writer, function_name(analyzer, function_idx));
+    }
+
+    json_print(writer, "],\"calls\":[");
+
+    for (i = 0; i < call_count; i++) {
+        const double * record = analyzer->calls.values + i * stride;
+
+        json_printf(
+            writer,
+            i > 0 ? ",[%zu,%zu,%d" : "[%zu,%zu,%d",
+            local_idx[(size_t) record[0]],
+            (size_t) record[1],
+            (int) record[2]
+        );
+
+        size_t j;
+        for (j = 3; j < stride; j++) {
+            json_printf(writer, ",%.15g", record[j]);
+        }
+
+        json_print(writer, "]");
+    }
+
+    json_print(writer, "]");
+
+    free(local_idx);
+}
+
+static void json_print_value_lists(json_writer_t * writer, const value_list_t * list, size_t stride)
+{
+    size_t i;
+    for (i = 0; i < list->size; i += stride) {
+        if (i > 0) {
+            json_print(writer, ",");
+        }
+
+        json_print_values(writer, list->values + i, stride);
+    }
+}
+
+static void text_print_values(json_writer_t * writer, const double * values, size_t count)
+{
+    size_t i;
+    for (i = 0; i < count; i++) {
+        json_printf(writer, " %.15g", values[i]);
+    }
+}
+
+static void text_print_call_tree_node(
+    json_writer_t * writer,
+    const spx_report_analyzer_t * analyzer,
+    const call_tree_node_t * node,
+    size_t number,
+    size_t * node_count
+) {
+    const call_tree_node_t * child;
+    for (child = node->first_child; child; child = child->next_sibling) {
+        if (child->called == 0) {
+            continue;
+        }
+
+        const size_t child_number = ++*node_count;
+
+        json_printf(
+            writer,
+            "n %zu %zu %zu %.15g",
+            number,
+            child->key.function_idx,
+            child->called,
+            child->min_time
+        );
+
+        text_print_values(writer, child->inc, analyzer->metric_count);
+        json_print(writer, "\n");
+
+        text_print_call_tree_node(writer, analyzer, child, child_number, node_count);
+    }
+}
+
+static const char * function_name(const spx_report_analyzer_t * analyzer, size_t function_idx)
+{
+    if (function_idx >= analyzer->function_names.count) {
+        return "n/a";
+    }
+
+    return analyzer->function_names.buffer + analyzer->function_names.offsets[function_idx];
+}
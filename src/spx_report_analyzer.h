@@ -0,0 +1,97 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_REPORT_ANALYZER_H_DEFINED
+#define SPX_REPORT_ANALYZER_H_DEFINED
+
+#include <stddef.h>
+
+/*
+ *  Analysis of a full report event stream, computing in a single streaming pass the
+ *  aggregates displayed by the web UI: flat profile, call tree and cumulative cost stats,
+ *  optionally restricted to a wall time window.
+ *  The calls query instead lists the calls of the window, along with the metric values
+ *  sampled over it, for the timeline views.
+ *  Events are either read back from a report file or fed while recording.
+ */
+
+typedef enum {
+    SPX_REPORT_ANALYZER_QUERY_FLAT_PROFILE,
+    SPX_REPORT_ANALYZER_QUERY_CALL_TREE,
+    SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS,
+    SPX_REPORT_ANALYZER_QUERY_CALLS,
+} spx_report_analyzer_query_type_t;
+
+typedef struct {
+    spx_report_analyzer_query_type_t type;
+    /* wall time window in ns, a negative end means up to the end of the report */
+    double begin;
+    double end;
+    /* call tree depth limit, 0 means unlimited */
+    size_t max_depth;
+    /*
+     *  Call tree nodes and calls below this wall time in ns are left out of the output, 0
+     *  keeps them all. It is also the metric values sampling period of the calls query.
+     */
+    double min_duration;
+} spx_report_analyzer_query_t;
+
+typedef struct spx_report_analyzer_t spx_report_analyzer_t;
+
+spx_report_analyzer_t * spx_report_analyzer_create(
+    const spx_report_analyzer_query_t * query,
+    const int * enabled_metrics
+);
+
+spx_report_analyzer_t * spx_report_analyzer_create_from_report(
+    const char * report_file_name,
+    const char * metadata_file_name,
+    const spx_report_analyzer_query_t * query
+);
+
+void spx_report_analyzer_destroy(spx_report_analyzer_t * analyzer);
+
+/* values holds the enabled metric values only, in metric order */
+int spx_report_analyzer_add_event(
+    spx_report_analyzer_t * analyzer,
+    size_t function_idx,
+    int start,
+    const double * values
+);
+
+/* writes the query result as JSON */
+void spx_report_analyzer_output(
+    const spx_report_analyzer_t * analyzer,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+);
+
+/*
+ *  Writes the flat profile, the call tree and the time range stats as an "[aggregates]"
+ *  report section. A query covering the whole report is then answered from this section
+ *  alone when the report has a chunk index, or else they replace the ones replayed from the
+ *  event list. It also allows a report to keep exact aggregates while its event list lacks
+ *  some calls (see SPX_FULL_MIN_DURATION).
+ */
+void spx_report_analyzer_output_aggregates(
+    const spx_report_analyzer_t * analyzer,
+    size_t (*write) (void * arg, const void * ptr, size_t len),
+    void * arg
+);
+
+#endif /* SPX_REPORT_ANALYZER_H_DEFINED */
@@ -0,0 +1,522 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "spx_report_timeline.h"
+#include "spx_metric.h"
+#include "spx_utils.h"
+
+/*
+ *  A slot is stored as the function index + 1 of its call (0 if there is no call), followed
+ *  by the call start and end metric values.
+ */
+#define SLOT_STRIDE(metric_count) (1 + 2 * (metric_count))
+#define SLOT_FILE_SIZE(metric_count) (2 * (metric_count) * sizeof(double) + sizeof(uint32_t))
+
+typedef struct {
+    size_t function_idx;
+    double start[SPX_METRIC_COUNT];
+} frame_t;
+
+typedef struct {
+    size_t metric_count;
+    size_t wt_idx;
+    size_t bucket_count;
+    double * values;
+    int * has_values;
+    double * slots[SPX_REPORT_TIMELINE_MAX_DEPTH];
+} level_t;
+
+struct spx_report_timeline_t {
+    size_t metric_count;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+    size_t wt_idx;
+
+    double bucket_width;
+    size_t max_depth;
+
+    /* finest level, slot rows are allocated on first use of their depth */
+    level_t level;
+
+    struct {
+        size_t size;
+        size_t capacity;
+        frame_t * frames;
+    } stack;
+};
+
+static size_t bucket_idx(spx_report_timeline_t * timeline, double time);
+static void coarsen(spx_report_timeline_t * timeline);
+static void merge_buckets(level_t * level, size_t depth, size_t dst, size_t a, size_t b);
+static double * level_slot(const level_t * level, size_t depth, size_t bucket);
+static double slot_duration(const level_t * level, const double * slot);
+static int level_init(
+    level_t * level,
+    size_t bucket_count,
+    size_t depth,
+    size_t metric_count,
+    size_t wt_idx
+);
+static void level_release(level_t * level);
+static int write_level(FILE * fp, const level_t * level, size_t depth, double * last_values);
+
+spx_report_timeline_t * spx_report_timeline_create(const int * enabled_metrics)
+{
+    spx_report_timeline_t * timeline = malloc(sizeof(*timeline));
+    if (!timeline) {
+        return NULL;
+    }
+
+    timeline->metric_count = 0;
+    timeline->wt_idx = 0;
+
+    SPX_METRIC_FOREACH(i, {
+        if (!enabled_metrics[i]) {
+            continue;
+        }
+
+        if (i == SPX_METRIC_WALL_TIME) {
+            timeline->wt_idx = timeline->metric_count;
+        }
+
+        timeline->metrics[timeline->metric_count++] = i;
+    });
+
+    /* the finest bucket width starts at ~1us and is doubled each time the time span exceeds the buckets */
+    timeline->bucket_width = 1024;
+    timeline->max_depth = 0;
+
+    timeline->stack.size = 0;
+    timeline->stack.capacity = 0;
+    timeline->stack.frames = NULL;
+
+    if (
+        level_init(
+            &timeline->level,
+            SPX_REPORT_TIMELINE_MAX_BUCKETS,
+            0,
+            timeline->metric_count,
+            timeline->wt_idx
+        ) != 0
+    ) {
+        goto error;
+    }
+
+    timeline->level.bucket_count = 0;
+
+    return timeline;
+
+error:
+    spx_report_timeline_destroy(timeline);
+
+    return NULL;
+}
+
+void spx_report_timeline_destroy(spx_report_timeline_t * timeline)
+{
+    level_release(&timeline->level);
+    free(timeline->stack.frames);
+    free(timeline);
+}
+
+int spx_report_timeline_add_event(
+    spx_report_timeline_t * timeline,
+    size_t function_idx,
+    int start,
+    const double * values
+) {
+    const double time = values[timeline->wt_idx];
+    const size_t idx = bucket_idx(timeline, time);
+    level_t * level = &timeline->level;
+
+    memcpy(
+        level->values + idx * timeline->metric_count,
+        values,
+        timeline->metric_count * sizeof(*values)
+    );
+
+    level->has_values[idx] = 1;
+    if (level->bucket_count <= idx) {
+        level->bucket_count = idx + 1;
+    }
+
+    if (start) {
+        if (timeline->stack.size == timeline->stack.capacity) {
+            const size_t capacity = timeline->stack.capacity > 0 ? timeline->stack.capacity * 2 : 256;
+            frame_t * frames = realloc(timeline->stack.frames, capacity * sizeof(*frames));
+            if (!frames) {
+                return -1;
+            }
+
+            timeline->stack.frames = frames;
+            timeline->stack.capacity = capacity;
+        }
+
+        frame_t * frame = &timeline->stack.frames[timeline->stack.size++];
+        frame->function_idx = function_idx;
+        memcpy(frame->start, values, timeline->metric_count * sizeof(*values));
+
+        return 0;
+    }
+
+    if (timeline->stack.size == 0) {
+        return -1;
+    }
+
+    const size_t depth = --timeline->stack.size;
+    if (depth >= SPX_REPORT_TIMELINE_MAX_DEPTH) {
+        return 0;
+    }
+
+    const size_t metric_count = timeline->metric_count;
+    const size_t stride = SLOT_STRIDE(metric_count);
+
+    if (!level->slots[depth]) {
+        level->slots[depth] = calloc(SPX_REPORT_TIMELINE_MAX_BUCKETS * stride, sizeof(double));
+        if (!level->slots[depth]) {
+            return -1;
+        }
+    }
+
+    if (timeline->max_depth <= depth) {
+        timeline->max_depth = depth + 1;
+    }
+
+    const frame_t * frame = &timeline->stack.frames[depth];
+
+    double call[SLOT_STRIDE(SPX_METRIC_COUNT)];
+    call[0] = frame->function_idx + 1;
+    memcpy(call + 1, frame->start, metric_count * sizeof(*values));
+    memcpy(call + 1 + metric_count, values, metric_count * sizeof(*values));
+
+    const double duration = slot_duration(level, call);
+
+    size_t i;
+    for (i = bucket_idx(timeline, frame->start[timeline->wt_idx]); i <= idx; i++) {
+        double * slot = level_slot(level, depth, i);
+        if (slot_duration(level, slot) < duration) {
+            memcpy(slot, call, stride * sizeof(*call));
+        }
+    }
+
+    return 0;
+}
+
+int spx_report_timeline_save(
+    const spx_report_timeline_t * timeline,
+    const char * file_name,
+    size_t function_count,
+    void (*function_name) (void * arg, size_t function_idx, char * buf, size_t size),
+    void * arg
+) {
+    const size_t metric_count = timeline->metric_count;
+    const size_t depth = timeline->max_depth;
+    const size_t record_size = metric_count * sizeof(double) + depth * SLOT_FILE_SIZE(metric_count);
+
+    level_t level;
+    if (level_init(&level, timeline->level.bucket_count, depth, metric_count, timeline->wt_idx) != 0) {
+        return -1;
+    }
+
+    FILE * fp = fopen(file_name, "w");
+    if (!fp) {
+        level_release(&level);
+
+        return -1;
+    }
+
+    const uint16_t endianness = 1;
+
+    fprintf(
+        fp,
+        "{\"version\":2,\"little_endian\":%d,\"metrics\":[",
+        *(const uint8_t *) &endianness
+    );
+
+    size_t i;
+    for (i = 0; i < metric_count; i++) {
+        fprintf(fp, i > 0 ? ",\"%s\"" : "\"%s\"", spx_metric_info[timeline->metrics[i]].key);
+    }
+
+    fprintf(fp, "],\"max_depth\":%zu,\"record_size\":%zu,\"levels\":[", depth, record_size);
+
+    size_t bucket_count = timeline->level.bucket_count;
+    double bucket_width = timeline->bucket_width;
+    size_t offset = 0;
+    while (bucket_count > 0) {
+        fprintf(
+            fp,
+            "%s{\"bucket_width\":%.15g,\"bucket_count\":%zu,\"offset\":%zu}",
+            offset > 0 ? "," : "",
+            bucket_width,
+            bucket_count,
+            offset
+        );
+
+        offset += bucket_count * record_size;
+        if (bucket_count == 1) {
+            break;
+        }
+
+        bucket_count = (bucket_count + 1) / 2;
+        bucket_width *= 2;
+    }
+
+    fprintf(fp, "],\"functions\":[");
+
+    char name[8 * 1024];
+    char escaped_name[8 * 1024];
+    for (i = 0; i < function_count; i++) {
+        function_name(arg, i, name, sizeof(name));
+        fprintf(
+            fp,
+            i > 0 ? ",\"%s\"" : "\"%s\"",
+            spx_utils_json_escape(escaped_name, name, sizeof(escaped_name))
+        );
+    }
+
+    fprintf(fp, "]}\n");
+
+    /* the working level is a copy of the finest one, then merged in place level after level */
+    memcpy(level.values, timeline->level.values, level.bucket_count * metric_count * sizeof(double));
+    memcpy(level.has_values, timeline->level.has_values, level.bucket_count * sizeof(int));
+
+    size_t d;
+    for (d = 0; d < depth; d++) {
+        if (timeline->level.slots[d]) {
+            memcpy(
+                level.slots[d],
+                timeline->level.slots[d],
+                level.bucket_count * SLOT_STRIDE(metric_count) * sizeof(double)
+            );
+        }
+    }
+
+    int ret = 0;
+    double last_values[SPX_METRIC_COUNT];
+
+    while (level.bucket_count > 0) {
+        for (i = 0; i < metric_count; i++) {
+            last_values[i] = 0;
+        }
+
+        if (write_level(fp, &level, depth, last_values) != 0) {
+            ret = -1;
+
+            break;
+        }
+
+        if (level.bucket_count == 1) {
+            break;
+        }
+
+        const size_t next_bucket_count = (level.bucket_count + 1) / 2;
+        for (i = 0; i < next_bucket_count; i++) {
+            const size_t b = 2 * i + 1 < level.bucket_count ? 2 * i + 1 : 2 * i;
+            merge_buckets(&level, depth, i, 2 * i, b);
+        }
+
+        level.bucket_count = next_bucket_count;
+    }
+
+    fclose(fp);
+    level_release(&level);
+
+    return ret;
+}
+
+static size_t bucket_idx(spx_report_timeline_t * timeline, double time)
+{
+    if (time < 0) {
+        time = 0;
+    }
+
+    while (time / timeline->bucket_width >= SPX_REPORT_TIMELINE_MAX_BUCKETS) {
+        coarsen(timeline);
+    }
+
+    return (size_t) (time / timeline->bucket_width);
+}
+
+static void coarsen(spx_report_timeline_t * timeline)
+{
+    level_t * level = &timeline->level;
+
+    size_t i;
+    for (i = 0; i < SPX_REPORT_TIMELINE_MAX_BUCKETS / 2; i++) {
+        merge_buckets(level, SPX_REPORT_TIMELINE_MAX_DEPTH, i, 2 * i, 2 * i + 1);
+    }
+
+    for (i = SPX_REPORT_TIMELINE_MAX_BUCKETS / 2; i < SPX_REPORT_TIMELINE_MAX_BUCKETS; i++) {
+        level->has_values[i] = 0;
+
+        size_t d;
+        for (d = 0; d < SPX_REPORT_TIMELINE_MAX_DEPTH; d++) {
+            if (level->slots[d]) {
+                level_slot(level, d, i)[0] = 0;
+            }
+        }
+    }
+
+    level->bucket_count = (level->bucket_count + 1) / 2;
+    timeline->bucket_width *= 2;
+}
+
+static void merge_buckets(level_t * level, size_t depth, size_t dst, size_t a, size_t b)
+{
+    const size_t metric_count = level->metric_count;
+
+    /* the metric values at the end of the merged bucket are the latest known ones */
+    const size_t src = level->has_values[b] ? b : a;
+
+    memmove(
+        level->values + dst * metric_count,
+        level->values + src * metric_count,
+        metric_count * sizeof(double)
+    );
+
+    level->has_values[dst] = level->has_values[src];
+
+    size_t d;
+    for (d = 0; d < depth; d++) {
+        if (!level->slots[d]) {
+            continue;
+        }
+
+        /* the longest call overlapping a bucket is the longest of both halves */
+        const double * slot_a = level_slot(level, d, a);
+        const double * slot_b = level_slot(level, d, b);
+
+        memmove(
+            level_slot(level, d, dst),
+            slot_duration(level, slot_b) > slot_duration(level, slot_a) ? slot_b : slot_a,
+            SLOT_STRIDE(metric_count) * sizeof(double)
+        );
+    }
+}
+
+static double * level_slot(const level_t * level, size_t depth, size_t bucket)
+{
+    return level->slots[depth] + bucket * SLOT_STRIDE(level->metric_count);
+}
+
+static double slot_duration(const level_t * level, const double * slot)
+{
+    if (slot[0] == 0) {
+        return -1;
+    }
+
+    return slot[1 + level->metric_count + level->wt_idx] - slot[1 + level->wt_idx];
+}
+
+static int level_init(
+    level_t * level,
+    size_t bucket_count,
+    size_t depth,
+    size_t metric_count,
+    size_t wt_idx
+) {
+    level->metric_count = metric_count;
+    level->wt_idx = wt_idx;
+    level->bucket_count = bucket_count;
+    level->values = NULL;
+    level->has_values = NULL;
+
+    size_t d;
+    for (d = 0; d < SPX_REPORT_TIMELINE_MAX_DEPTH; d++) {
+        level->slots[d] = NULL;
+    }
+
+    if (bucket_count == 0) {
+        return 0;
+    }
+
+    level->values = calloc(bucket_count * metric_count, sizeof(double));
+    level->has_values = calloc(bucket_count, sizeof(int));
+    if (!level->values || !level->has_values) {
+        goto error;
+    }
+
+    for (d = 0; d < depth; d++) {
+        level->slots[d] = calloc(bucket_count * SLOT_STRIDE(metric_count), sizeof(double));
+        if (!level->slots[d]) {
+            goto error;
+        }
+    }
+
+    return 0;
+
+error:
+    level_release(level);
+
+    return -1;
+}
+
+static void level_release(level_t * level)
+{
+    free(level->values);
+    free(level->has_values);
+
+    size_t d;
+    for (d = 0; d < SPX_REPORT_TIMELINE_MAX_DEPTH; d++) {
+        free(level->slots[d]);
+    }
+}
+
+static int write_level(FILE * fp, const level_t * level, size_t depth, double * last_values)
+{
+    const size_t metric_count = level->metric_count;
+
+    unsigned char record[
+        SPX_METRIC_COUNT * sizeof(double)
+            + SPX_REPORT_TIMELINE_MAX_DEPTH * SLOT_FILE_SIZE(SPX_METRIC_COUNT)
+    ];
+
+    size_t i;
+    for (i = 0; i < level->bucket_count; i++) {
+        /* buckets without event carry the values of the previous one */
+        if (level->has_values[i]) {
+            memcpy(last_values, level->values + i * metric_count, metric_count * sizeof(double));
+        }
+
+        unsigned char * p = record;
+        memcpy(p, last_values, metric_count * sizeof(double));
+        p += metric_count * sizeof(double);
+
+        size_t d;
+        for (d = 0; d < depth; d++) {
+            const double * slot = level_slot(level, d, i);
+            const uint32_t function_idx = slot[0];
+
+            memcpy(p, slot + 1, 2 * metric_count * sizeof(double));
+            p += 2 * metric_count * sizeof(double);
+            memcpy(p, &function_idx, sizeof(function_idx));
+            p += sizeof(function_idx);
+        }
+
+        if (fwrite(record, p - record, 1, fp) != 1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef SPX_REPORT_TIMELINE_H_DEFINED
+#define SPX_REPORT_TIMELINE_H_DEFINED
+
+#include <stddef.h>
+
+/*
+ *  Level of detail pyramid of a full report timeline.
+ *
+ *  The report time span is split in at most SPX_REPORT_TIMELINE_MAX_BUCKETS power of two
+ *  sized buckets, each one holding, per call depth, the longest call overlapping it and
+ *  the cumulative metric values at its end. Each coarser level merges pairs of buckets of
+ *  the previous one, down to a single bucket.
+ *
+ *  The file starts with a single JSON header line describing the levels, followed by the
+ *  levels, finest first, as arrays of fixed size records (in the byte order given by the
+ *  header "little_endian" flag):
+ *    - for each enabled metric, a float64 value
+ *    - for each depth up to "max_depth", the float64 start then end values of each enabled
+ *      metric and the uint32 function index + 1 (0 if no call) of the longest call
+ *  so that any bucket range of any level can be fetched with a single range request.
+ */
+
+#define SPX_REPORT_TIMELINE_MAX_BUCKETS 512
+#define SPX_REPORT_TIMELINE_MAX_DEPTH 64
+
+typedef struct spx_report_timeline_t spx_report_timeline_t;
+
+spx_report_timeline_t * spx_report_timeline_create(const int * enabled_metrics);
+void spx_report_timeline_destroy(spx_report_timeline_t * timeline);
+
+/* values holds the enabled metric values only, in metric order */
+int spx_report_timeline_add_event(
+    spx_report_timeline_t * timeline,
+    size_t function_idx,
+    int start,
+    const double * values
+);
+
+int spx_report_timeline_save(
+    const spx_report_timeline_t * timeline,
+    const char * file_name,
+    size_t function_count,
+    void (*function_name) (void * arg, size_t function_idx, char * buf, size_t size),
+    void * arg
+);
+
+#endif /* SPX_REPORT_TIMELINE_H_DEFINED */
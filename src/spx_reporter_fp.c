@@ -106,9 +106,9 @@ spx_profiler_reporter_t * spx_reporter_fp_create(
             goto error;
         }
 
-        reporter->output = spx_output_stream_dopen(reporter->fd_backup.stdout_fd, 0);
+        reporter->output = spx_output_stream_dopen(reporter->fd_backup.stdout_fd, NULL);
     } else {
-        reporter->output = spx_output_stream_dopen(STDERR_FILENO, 0);
+        reporter->output = spx_output_stream_dopen(STDERR_FILENO, NULL);
     }
 
     if (!reporter->output) {
@@ -246,11 +246,11 @@ static size_t print_report(fp_reporter_t * reporter, const spx_profiler_event_t
 
     size_t i;
     for (i = 0; i < limit; i++) {
-        reporter->top_entries[i] = &event->func_table.entries[i];
+        reporter->top_entries[i] = event->func_table.entries[i];
     }
 
     for (i = limit; i < event->func_table.size; i++) {
-        const spx_profiler_func_table_entry_t * current = &event->func_table.entries[i];
+        const spx_profiler_func_table_entry_t * current = event->func_table.entries[i];
         size_t j;
         for (j = 0; j < limit; j++) {
             if (entry_cmp_r(&reporter->top_entries[j], &current, reporter) > 0) {
@@ -295,10 +295,6 @@ static size_t print_report(fp_reporter_t * reporter, const spx_profiler_event_t
         event->func_table.size
     );
 
-    if (event->func_table.size == event->func_table.capacity) {
-        spx_output_stream_print(reporter->output, "+");
-    }
-
     spx_output_stream_print(reporter->output, "\n\n");
     line_count += 2;
 
@@ -18,10 +18,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -32,15 +37,64 @@
 #include "spx_reporter_full.h"
 #include "spx_php.h"
 #include "spx_output_stream.h"
-#include "spx_str_builder.h"
+#include "spx_async_flusher.h"
+#include "spx_report_analyzer.h"
+#include "spx_report_timeline.h"
 #include "spx_utils.h"
 
-#define BUFFER_CAPACITY 16384
+/*
+ *  Events are written in a binary form, after a "[events:binary:1]" header line, each
+ *  event being encoded as a sequence of unsigned LEB128 varints:
+ *    - ((function index + 1) << 1) | start
+ *    - for each enabled metric, the zig-zag encoded delta between the rounded metric value
+ *      and the one of the previous event
+ *  A 0 varint ends the event list, the text "[aggregates]" section holding the flat profile,
+ *  the call tree & the time range stats of the whole report then follows (see
+ *  spx_report_analyzer_output_aggregates()), and finally the text "[functions]" section.
+ *  The aggregates are computed while flushing events (i.e. in the background flusher when
+ *  available) so that whole report analyses do not have to replay all events.
+ *
+ *  The event list is split in chunks of CHUNK_EVENT_COUNT events, each one starting at a
+ *  sync point of the output stream (see spx_output_stream_sync()) and thus decodable on its
+ *  own. A trailing "[chunks]" section, located by the "chunk_index_offset" metadata entry,
+ *  indexes them:
+ *    - a "functions <offset>" line giving the offset of the "[functions]" section
+ *    - an "aggregates <offset>" line giving the offset of the "[aggregates]" section, if any
+ *    - a line per chunk: "<offset> <depth> <values> (<function index> <start values>)*"
+ *      where values are the enabled metric values of the last event before the chunk
+ *      (i.e. the base of the deltas) and the tuples describe, from the outermost one, the
+ *      calls still running at the chunk start.
+ *  This allows to start the decoding at any chunk, e.g. to analyze a time range.
+ */
+#define EVENTS_HEADER "[events:binary:1]\n"
+#define VARINT_MAX_SIZE 10
+#define EVENT_MAX_SIZE ((1 + SPX_METRIC_COUNT) * VARINT_MAX_SIZE)
+#define WRITE_BUFFER_SIZE (64 * 1024)
+#define CHUNK_EVENT_COUNT (64 * 1024)
+
+/* the timeline level of detail pyramid, see spx_report_timeline.h */
+#define TIMELINE_FILE_SUFFIX ".timeline.bin"
+
+/*
+ *  In tail mode the report is written to an in-memory file (when memfd is available),
+ *  which is copied to the actual report file only if the report is kept. Beyond this size
+ *  the report is spilled to its actual file, which is then removed if the report is not kept.
+ */
+#define TAIL_MEMORY_LIMIT (64 * 1024 * 1024)
 
+/*
+ *  Calls shorter than the minimum duration are elided from the event stream when their
+ *  start event can still be withdrawn, i.e. when it is found in the current buffer within
+ *  this many trailing entries. Elided events are kept in the buffer, flagged, so that the
+ *  aggregates & the timeline still account them.
+ */
+#define ELISION_MAX_LOOKBACK 64
+
+/* buffered events are packed, each entry being followed by its enabled metric values */
 typedef struct {
     size_t function_idx;
     int start;
-    spx_profiler_metric_values_t metric_values;
+    int elided;
 } buffer_entry_t;
 
 typedef struct {
@@ -56,25 +110,76 @@ typedef struct {
     char * http_method;
     char * http_host;
     char * custom_metadata_str;
+    char * previous_key;
     size_t wall_time_ms;
     size_t peak_memory_usage;
     size_t called_function_count;
     size_t call_count;
     size_t recorded_call_count;
+    size_t chunk_index_offset;
+    size_t demoted_function_count;
+    char ** demoted_functions;
     int enabled_metrics[SPX_METRIC_COUNT];
 } metadata_t;
 
 typedef struct {
     spx_profiler_reporter_t base;
 
+    char file_name[PATH_MAX];
     char metadata_file_name[PATH_MAX];
+    char timeline_file_name[PATH_MAX];
     metadata_t * metadata;
     spx_output_stream_t * output;
-
+    spx_report_analyzer_t * aggregates;
+    spx_report_timeline_t * timeline;
+
+    int first;
+    /* in ns, 0 disables call elision */
+    size_t min_duration;
+    size_t metric_count;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+    spx_async_flusher_t * flusher;
+
+    /*
+     *  Events are double buffered, the full buffer being flushed by the background
+     *  flusher (when available) while the other one is filled.
+     *  Sizes are in bytes.
+     */
+    size_t entry_size;
+    size_t buffer_capacity;
+    unsigned char * buffer;
     size_t buffer_size;
-    buffer_entry_t buffer[BUFFER_CAPACITY];
-
-    spx_str_builder_t * str_builder;
+    unsigned char * buffers[2];
+
+    /* in enabled metric order, as all other metric values below */
+    int64_t last_metric_values[SPX_METRIC_COUNT];
+
+    struct {
+        /* cleared on failure, the report then simply comes without chunk index */
+        int enabled;
+        size_t event_count;
+
+        /* running calls, as (function index, enabled metric start values) tuples */
+        size_t depth;
+        size_t frame_capacity;
+        int64_t * frames;
+
+        size_t index_size;
+        size_t index_capacity;
+        char * index;
+    } chunks;
+
+    struct {
+        spx_reporter_full_tail_t config;
+        int kept;
+        int memory_fd;
+        /* the descriptor the output stream writes to, redirected to the actual file on spill */
+        int output_fd;
+        int spilled;
+    } tail;
+
+    size_t write_buffer_size;
+    unsigned char write_buffer[WRITE_BUFFER_SIZE];
 } full_reporter_t;
 
 static spx_profiler_reporter_cost_t full_notify(
@@ -83,12 +188,28 @@ static spx_profiler_reporter_cost_t full_notify(
 );
 
 static void full_destroy(spx_profiler_reporter_t * reporter);
-static void flush_buffer(full_reporter_t * reporter, const int * enabled_metrics);
+static void setup(full_reporter_t * reporter, const int * enabled_metrics);
+static int submit_buffer(full_reporter_t * reporter);
+static int elide_call(full_reporter_t * reporter, const spx_profiler_event_t * event);
+static void flush_buffer_handler(void * arg, const void * buffer, size_t size);
+static void flush_buffer(full_reporter_t * reporter, const unsigned char * buffer, size_t size);
+static size_t encode_varint(unsigned char * dst, uint64_t value);
+static void chunks_begin(full_reporter_t * reporter);
+static void chunks_track_event(full_reporter_t * reporter, const buffer_entry_t * entry);
+static void chunks_index_printf(full_reporter_t * reporter, const char * format, ...);
+static void write_pending(full_reporter_t * reporter);
+static int tail_open(full_reporter_t * reporter, const spx_output_stream_compression_t * compression);
+static int tail_spill(full_reporter_t * reporter);
+static int tail_keep(full_reporter_t * reporter, const spx_profiler_event_t * event);
+static int copy_fd(int src, int dst);
 static void finalize(full_reporter_t * reporter, const spx_profiler_event_t * event);
+static size_t aggregates_write(void * arg, const void * ptr, size_t len);
+static void function_name(void * arg, size_t function_idx, char * buf, size_t size);
 
 static metadata_t * metadata_create(void);
 static void metadata_destroy(metadata_t * metadata);
 static int metadata_save(const metadata_t * metadata, const char * file_name);
+static void metadata_set_demoted_functions(metadata_t * metadata, const spx_profiler_event_t * event);
 
 size_t spx_reporter_full_metadata_list_files(
     const char * data_dir,
@@ -144,18 +265,60 @@ char * spx_reporter_full_build_file_name(
     const char * key,
     char * file_name,
     size_t size
+) {
+    /* the report may have been written with any of the available codecs */
+    int codec;
+    for (codec = 0; codec < SPX_OUTPUT_STREAM_CODEC_COUNT; codec++) {
+        if (!spx_output_stream_codec_available(codec)) {
+            continue;
+        }
+
+        char suffix[32];
+        snprintf(
+            suffix,
+            sizeof(suffix),
+            ".txt%s",
+            spx_output_stream_codec_file_suffix(codec)
+        );
+
+        if (
+            spx_utils_resolve_confined_file_absolute_path(
+                data_dir,
+                key,
+                suffix,
+                file_name,
+                size
+            ) != NULL
+        ) {
+            return file_name;
+        }
+    }
+
+    return NULL;
+}
+
+char * spx_reporter_full_build_timeline_file_name(
+    const char * data_dir,
+    const char * key,
+    char * file_name,
+    size_t size
 ) {
     return spx_utils_resolve_confined_file_absolute_path(
         data_dir,
         key,
-        ".txt.gz",
+        TIMELINE_FILE_SUFFIX,
         file_name,
         size
     );
 }
 
-spx_profiler_reporter_t * spx_reporter_full_create(const char * data_dir)
-{
+spx_profiler_reporter_t * spx_reporter_full_create(
+    const char * data_dir,
+    const spx_output_stream_compression_t * compression,
+    size_t buffer_size,
+    const spx_reporter_full_tail_t * tail,
+    size_t min_duration
+) {
     full_reporter_t * reporter = malloc(sizeof(*reporter));
     if (!reporter) {
         return NULL;
@@ -166,20 +329,45 @@ spx_profiler_reporter_t * spx_reporter_full_create(const char * data_dir)
 
     reporter->metadata = NULL;
     reporter->output = NULL;
-    reporter->str_builder = NULL;
+    reporter->aggregates = NULL;
+    reporter->timeline = NULL;
+    reporter->flusher = NULL;
+    reporter->chunks.frames = NULL;
+    reporter->chunks.index = NULL;
+    reporter->buffers[0] = NULL;
+    reporter->buffers[1] = NULL;
+
+    reporter->tail.config.enabled = 0;
+    if (tail) {
+        reporter->tail.config = *tail;
+    }
+
+    reporter->min_duration = min_duration;
+
+    reporter->tail.kept = 0;
+    reporter->tail.memory_fd = -1;
+    reporter->tail.output_fd = -1;
+    reporter->tail.spilled = 0;
+
+    reporter->buffer_capacity = buffer_size;
+    reporter->buffers[0] = malloc(buffer_size);
+    reporter->buffers[1] = malloc(buffer_size);
+    if (!reporter->buffers[0] || !reporter->buffers[1]) {
+        goto error;
+    }
 
     reporter->metadata = metadata_create();
     if (!reporter->metadata) {
         goto error;
     }
 
-    char file_name[PATH_MAX];
     snprintf(
-        file_name,
-        sizeof(file_name),
-        "%s/%s.txt.gz",
+        reporter->file_name,
+        sizeof(reporter->file_name),
+        "%s/%s.txt%s",
         data_dir,
-        reporter->metadata->key
+        reporter->metadata->key,
+        spx_output_stream_codec_file_suffix(compression->codec)
     );
 
     snprintf(
@@ -190,20 +378,48 @@ spx_profiler_reporter_t * spx_reporter_full_create(const char * data_dir)
         reporter->metadata->key
     );
 
-    (void) mkdir(data_dir, 0777);
-    reporter->output = spx_output_stream_open(file_name, 1);
-    if (!reporter->output) {
-        goto error;
-    }
+    snprintf(
+        reporter->timeline_file_name,
+        sizeof(reporter->timeline_file_name),
+        "%s/%s%s",
+        data_dir,
+        reporter->metadata->key,
+        TIMELINE_FILE_SUFFIX
+    );
 
-    reporter->str_builder = spx_str_builder_create(8 * 1024);
-    if (!reporter->str_builder) {
-        goto error;
+    (void) mkdir(data_dir, 0777);
+    if (reporter->tail.config.enabled) {
+        if (tail_open(reporter, compression) != 0) {
+            goto error;
+        }
+    } else {
+        reporter->output = spx_output_stream_open(reporter->file_name, compression);
+        if (!reporter->output) {
+            goto error;
+        }
     }
 
+    reporter->first = 1;
+    reporter->metric_count = 0;
+    reporter->entry_size = 0;
+    reporter->buffer = reporter->buffers[0];
     reporter->buffer_size = 0;
+    reporter->write_buffer_size = 0;
 
-    spx_output_stream_print(reporter->output, "[events]\n");
+    reporter->chunks.enabled = 1;
+    reporter->chunks.event_count = 0;
+    reporter->chunks.depth = 0;
+    reporter->chunks.frame_capacity = 0;
+    reporter->chunks.frames = NULL;
+    reporter->chunks.index_size = 0;
+    reporter->chunks.index_capacity = 0;
+    reporter->chunks.index = NULL;
+
+    SPX_METRIC_FOREACH(i, {
+        reporter->last_metric_values[i] = 0;
+    });
+
+    spx_output_stream_print(reporter->output, EVENTS_HEADER);
 
     return (spx_profiler_reporter_t *) reporter;
 
@@ -222,6 +438,23 @@ void spx_reporter_full_set_custom_metadata_str(
     reporter->metadata->custom_metadata_str = strdup(custom_metadata_str);
 }
 
+const char * spx_reporter_full_get_custom_metadata_str(const spx_profiler_reporter_t * base_reporter)
+{
+    const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
+
+    return reporter->metadata->custom_metadata_str;
+}
+
+void spx_reporter_full_set_previous_key(
+    const spx_profiler_reporter_t * base_reporter,
+    const char * previous_key
+) {
+    const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
+
+    free(reporter->metadata->previous_key);
+    reporter->metadata->previous_key = strdup(previous_key);
+}
+
 const char * spx_reporter_full_get_key(const spx_profiler_reporter_t * base_reporter)
 {
     const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
@@ -229,47 +462,109 @@ const char * spx_reporter_full_get_key(const spx_profiler_reporter_t * base_repo
     return reporter->metadata->key;
 }
 
+size_t spx_reporter_full_get_call_count(const spx_profiler_reporter_t * base_reporter)
+{
+    const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
+
+    return reporter->metadata->call_count;
+}
+
+size_t spx_reporter_full_get_recorded_size(const spx_profiler_reporter_t * base_reporter)
+{
+    const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
+
+    /* each recorded call is made of a start & an end event */
+    return 2 * reporter->metadata->recorded_call_count * reporter->entry_size;
+}
+
+void spx_reporter_full_keep(spx_profiler_reporter_t * base_reporter)
+{
+    full_reporter_t * reporter = (full_reporter_t *) base_reporter;
+
+    reporter->tail.kept = 1;
+}
+
+int spx_reporter_full_is_kept(const spx_profiler_reporter_t * base_reporter)
+{
+    const full_reporter_t * reporter = (const full_reporter_t *) base_reporter;
+
+    return !reporter->tail.config.enabled || reporter->tail.kept;
+}
+
 static spx_profiler_reporter_cost_t full_notify(
     spx_profiler_reporter_t * base_reporter,
     const spx_profiler_event_t * event
 ) {
     full_reporter_t * reporter = (full_reporter_t *) base_reporter;
 
+    if (reporter->first) {
+        reporter->first = 0;
+        setup(reporter, event->enabled_metrics);
+    }
+
     if (event->type == SPX_PROFILER_EVENT_CALL_END) {
         reporter->metadata->call_count++;
     }
 
     if (event->type != SPX_PROFILER_EVENT_FINALIZE) {
-        if (event->type == SPX_PROFILER_EVENT_CALL_END) {
+        const int elided = event->type == SPX_PROFILER_EVENT_CALL_END && elide_call(reporter, event);
+
+        if (event->type == SPX_PROFILER_EVENT_CALL_END && !elided) {
             reporter->metadata->recorded_call_count++;
         }
 
-        buffer_entry_t * current = &reporter->buffer[reporter->buffer_size];
+        buffer_entry_t * current = (buffer_entry_t *) (reporter->buffer + reporter->buffer_size);
+
+        current->function_idx = event->callee->idx;
+        current->start        = event->type == SPX_PROFILER_EVENT_CALL_START;
+        current->elided       = elided;
+
+        double * values = (double *) (current + 1);
 
-        current->function_idx  = event->callee->idx;
-        current->start         = event->type == SPX_PROFILER_EVENT_CALL_START;
-        current->metric_values = *event->cum;
+        size_t i;
+        for (i = 0; i < reporter->metric_count; i++) {
+            values[i] = event->cum->values[reporter->metrics[i]];
+        }
 
-        reporter->buffer_size++;
+        reporter->buffer_size += reporter->entry_size;
 
-        if (reporter->buffer_size < BUFFER_CAPACITY) {
+        if (reporter->buffer_size + reporter->entry_size <= reporter->buffer_capacity) {
             return SPX_PROFILER_REPORTER_COST_LIGHT;
         }
     }
 
-    flush_buffer(reporter, event->enabled_metrics);
+    const int waited = submit_buffer(reporter);
 
     if (event->type == SPX_PROFILER_EVENT_FINALIZE) {
+        if (reporter->flusher) {
+            spx_async_flusher_wait(reporter->flusher);
+        }
+
         finalize(reporter, event);
+
+        return SPX_PROFILER_REPORTER_COST_HEAVY;
     }
 
-    return SPX_PROFILER_REPORTER_COST_HEAVY;
+    /* swapping buffers is cheap unless the previous one is still being flushed */
+    return waited ? SPX_PROFILER_REPORTER_COST_HEAVY : SPX_PROFILER_REPORTER_COST_LIGHT;
 }
 
 static void full_destroy(spx_profiler_reporter_t * base_reporter)
 {
     full_reporter_t * reporter = (full_reporter_t *) base_reporter;
 
+    if (reporter->flusher) {
+        spx_async_flusher_destroy(reporter->flusher);
+    }
+
+    if (reporter->aggregates) {
+        spx_report_analyzer_destroy(reporter->aggregates);
+    }
+
+    if (reporter->timeline) {
+        spx_report_timeline_destroy(reporter->timeline);
+    }
+
     if (reporter->metadata) {
         metadata_destroy(reporter->metadata);
     }
@@ -278,54 +573,477 @@ static void full_destroy(spx_profiler_reporter_t * base_reporter)
         spx_output_stream_close(reporter->output);
     }
 
-    if (reporter->str_builder) {
-        spx_str_builder_destroy(reporter->str_builder);
+    if (reporter->tail.memory_fd != -1) {
+        close(reporter->tail.memory_fd);
+    }
+
+    if (reporter->tail.config.enabled && reporter->tail.spilled && !reporter->tail.kept) {
+        unlink(reporter->file_name);
     }
+
+    free(reporter->chunks.frames);
+    free(reporter->chunks.index);
+
+    free(reporter->buffers[0]);
+    free(reporter->buffers[1]);
 }
 
-static void flush_buffer(full_reporter_t * reporter, const int * enabled_metrics)
+static void setup(full_reporter_t * reporter, const int * enabled_metrics)
 {
-    spx_str_builder_reset(reporter->str_builder);
+    SPX_METRIC_FOREACH(i, {
+        if (enabled_metrics[i]) {
+            reporter->metrics[reporter->metric_count++] = i;
+        }
+    });
 
-    size_t i;
-    for (i = 0; i < reporter->buffer_size; i++) {
-        const buffer_entry_t * current = &reporter->buffer[i];
+    reporter->entry_size = sizeof(buffer_entry_t) + reporter->metric_count * sizeof(double);
 
-        spx_str_builder_append_long(reporter->str_builder, current->function_idx);
-        spx_str_builder_append_char(reporter->str_builder, ' ');
-        spx_str_builder_append_char(reporter->str_builder, current->start ? '1' : '0');
+    if (reporter->metric_count == 0 || reporter->metrics[0] != SPX_METRIC_WALL_TIME) {
+        /* call durations are read from the first metric value */
+        reporter->min_duration = 0;
+    }
+
+    spx_report_analyzer_query_t query;
+    query.type = SPX_REPORT_ANALYZER_QUERY_TIME_RANGE_STATS;
+    query.begin = 0;
+    query.end = -1;
+    query.max_depth = 0;
+    query.min_duration = 0;
+
+    /* on failure the report will simply come without aggregates or timeline */
+    reporter->aggregates = spx_report_analyzer_create(&query, enabled_metrics);
+    reporter->timeline = spx_report_timeline_create(enabled_metrics);
 
-        SPX_METRIC_FOREACH(i, {
-            if (!enabled_metrics[i]) {
-                continue;
+    if (!spx_metric_process_wide_enabled(enabled_metrics)) {
+        /* on failure we simply fall back to synchronous flushing */
+        reporter->flusher = spx_async_flusher_create(flush_buffer_handler, reporter);
+    }
+}
+
+static int submit_buffer(full_reporter_t * reporter)
+{
+    if (!reporter->flusher) {
+        flush_buffer(reporter, reporter->buffer, reporter->buffer_size);
+        reporter->buffer_size = 0;
+
+        return 1;
+    }
+
+    const int waited = spx_async_flusher_submit(
+        reporter->flusher,
+        reporter->buffer,
+        reporter->buffer_size
+    );
+
+    reporter->buffer = reporter->buffer == reporter->buffers[0] ?
+        reporter->buffers[1] : reporter->buffers[0];
+
+    reporter->buffer_size = 0;
+
+    return waited;
+}
+
+static int elide_call(full_reporter_t * reporter, const spx_profiler_event_t * event)
+{
+    if (reporter->min_duration == 0 || event->depth == 0) {
+        /* root calls are always kept so that the report cannot end up empty */
+        return 0;
+    }
+
+    /*
+     *  The start event of the ending call is the last non-elided entry, unless it has
+     *  already been submitted.
+     */
+    size_t offset = reporter->buffer_size;
+    size_t lookback = 0;
+    while (offset > 0 && lookback < ELISION_MAX_LOOKBACK) {
+        offset -= reporter->entry_size;
+        lookback++;
+
+        buffer_entry_t * entry = (buffer_entry_t *) (reporter->buffer + offset);
+        if (entry->elided) {
+            continue;
+        }
+
+        if (!entry->start || entry->function_idx != event->callee->idx) {
+            return 0;
+        }
+
+        const double * values = (const double *) (entry + 1);
+        if (event->cum->values[SPX_METRIC_WALL_TIME] - values[0] >= reporter->min_duration) {
+            return 0;
+        }
+
+        entry->elided = 1;
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static void flush_buffer_handler(void * arg, const void * buffer, size_t size)
+{
+    flush_buffer(arg, buffer, size);
+}
+
+static void flush_buffer(full_reporter_t * reporter, const unsigned char * buffer, size_t size)
+{
+    size_t offset;
+    for (offset = 0; offset < size; offset += reporter->entry_size) {
+        const buffer_entry_t * current = (const buffer_entry_t *) (buffer + offset);
+        const double * metric_values = (const double *) (current + 1);
+
+        double values[SPX_METRIC_COUNT];
+
+        size_t i;
+        for (i = 0; i < reporter->metric_count; i++) {
+            values[i] = llround(metric_values[i]);
+        }
+
+        if (!current->elided) {
+            if (reporter->chunks.enabled) {
+                if (reporter->chunks.event_count % CHUNK_EVENT_COUNT == 0) {
+                    write_pending(reporter);
+                    chunks_begin(reporter);
+                }
+
+                reporter->chunks.event_count++;
+            }
+
+            unsigned char * dst = reporter->write_buffer + reporter->write_buffer_size;
+
+            dst += encode_varint(dst, (((uint64_t) current->function_idx + 1) << 1) | (current->start ? 1 : 0));
+
+            for (i = 0; i < reporter->metric_count; i++) {
+                const int64_t value = values[i];
+                const int64_t delta = value - reporter->last_metric_values[i];
+                reporter->last_metric_values[i] = value;
+
+                dst += encode_varint(
+                    dst,
+                    delta < 0 ? ~((uint64_t) delta << 1) : (uint64_t) delta << 1
+                );
+            }
+
+            reporter->write_buffer_size = dst - reporter->write_buffer;
+
+            if (reporter->chunks.enabled) {
+                chunks_track_event(reporter, current);
             }
+        }
 
-            spx_str_builder_append_char(reporter->str_builder, ' ');
-            spx_str_builder_append_double(reporter->str_builder, current->metric_values.values[i], 4);
-        });
+        if (
+            reporter->aggregates
+            && spx_report_analyzer_add_event(
+                reporter->aggregates,
+                current->function_idx,
+                current->start,
+                values
+            ) != 0
+        ) {
+            spx_report_analyzer_destroy(reporter->aggregates);
+            reporter->aggregates = NULL;
+        }
 
-        spx_str_builder_append_str(reporter->str_builder, "\n");
+        if (
+            reporter->timeline
+            && spx_report_timeline_add_event(
+                reporter->timeline,
+                current->function_idx,
+                current->start,
+                values
+            ) != 0
+        ) {
+            spx_report_timeline_destroy(reporter->timeline);
+            reporter->timeline = NULL;
+        }
 
-        if (spx_str_builder_remaining(reporter->str_builder) < 128) {
-            spx_output_stream_print(reporter->output, spx_str_builder_str(reporter->str_builder));
-            spx_str_builder_reset(reporter->str_builder);
+        if (WRITE_BUFFER_SIZE - reporter->write_buffer_size < EVENT_MAX_SIZE) {
+            write_pending(reporter);
         }
     }
 
-    if (spx_str_builder_size(reporter->str_builder) > 0) {
-        spx_output_stream_print(reporter->output, spx_str_builder_str(reporter->str_builder));
+    write_pending(reporter);
+
+    if (reporter->tail.memory_fd != -1) {
+        struct stat st;
+        if (fstat(reporter->tail.memory_fd, &st) == 0 && st.st_size > TAIL_MEMORY_LIMIT) {
+            /* on failure we simply keep going in memory */
+            tail_spill(reporter);
+        }
     }
+}
 
-    reporter->buffer_size = 0;
+static void write_pending(full_reporter_t * reporter)
+{
+    if (reporter->write_buffer_size > 0) {
+        spx_output_stream_write(reporter->output, reporter->write_buffer, reporter->write_buffer_size);
+        reporter->write_buffer_size = 0;
+    }
+}
+
+static size_t encode_varint(unsigned char * dst, uint64_t value)
+{
+    size_t size = 0;
+    while (value >= 0x80) {
+        dst[size++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+
+    dst[size++] = (unsigned char) value;
+
+    return size;
+}
+
+static void chunks_begin(full_reporter_t * reporter)
+{
+    size_t offset;
+    if (spx_output_stream_sync(reporter->output, &offset) != 0) {
+        reporter->chunks.enabled = 0;
+
+        return;
+    }
+
+    chunks_index_printf(reporter, "%zu %zu", offset, reporter->chunks.depth);
+
+    size_t i;
+    for (i = 0; i < reporter->metric_count; i++) {
+        chunks_index_printf(reporter, " %" PRId64, reporter->last_metric_values[i]);
+    }
+
+    for (i = 0; i < reporter->chunks.depth * (1 + reporter->metric_count); i++) {
+        chunks_index_printf(reporter, " %" PRId64, reporter->chunks.frames[i]);
+    }
+
+    chunks_index_printf(reporter, "\n");
+}
+
+static void chunks_track_event(full_reporter_t * reporter, const buffer_entry_t * entry)
+{
+    const size_t frame_size = 1 + reporter->metric_count;
+
+    if (!entry->start) {
+        if (reporter->chunks.depth > 0) {
+            reporter->chunks.depth--;
+        }
+
+        return;
+    }
+
+    if (reporter->chunks.depth == reporter->chunks.frame_capacity) {
+        const size_t capacity = reporter->chunks.frame_capacity > 0 ?
+            reporter->chunks.frame_capacity * 2 : 256;
+
+        int64_t * frames = realloc(reporter->chunks.frames, capacity * frame_size * sizeof(*frames));
+        if (!frames) {
+            reporter->chunks.enabled = 0;
+
+            return;
+        }
+
+        reporter->chunks.frames = frames;
+        reporter->chunks.frame_capacity = capacity;
+    }
+
+    /* last_metric_values already holds the values of this event */
+    int64_t * frame = reporter->chunks.frames + reporter->chunks.depth * frame_size;
+    frame[0] = entry->function_idx;
+    memcpy(frame + 1, reporter->last_metric_values, reporter->metric_count * sizeof(*frame));
+
+    reporter->chunks.depth++;
+}
+
+static void chunks_index_printf(full_reporter_t * reporter, const char * format, ...)
+{
+    if (!reporter->chunks.enabled) {
+        return;
+    }
+
+    char buf[64];
+
+    va_list ap;
+    va_start(ap, format);
+    const int len = vsnprintf(buf, sizeof(buf), format, ap);
+    va_end(ap);
+
+    if (len < 0 || (size_t) len >= sizeof(buf)) {
+        reporter->chunks.enabled = 0;
+
+        return;
+    }
+
+    if (reporter->chunks.index_size + len > reporter->chunks.index_capacity) {
+        const size_t capacity = reporter->chunks.index_capacity > 0 ?
+            reporter->chunks.index_capacity * 2 : 16 * 1024;
+
+        char * index = realloc(reporter->chunks.index, capacity);
+        if (!index) {
+            reporter->chunks.enabled = 0;
+
+            return;
+        }
+
+        reporter->chunks.index = index;
+        reporter->chunks.index_capacity = capacity;
+    }
+
+    memcpy(reporter->chunks.index + reporter->chunks.index_size, buf, len);
+    reporter->chunks.index_size += len;
+}
+
+static int tail_open(full_reporter_t * reporter, const spx_output_stream_compression_t * compression)
+{
+#if defined(linux) && defined(SYS_memfd_create)
+    reporter->tail.memory_fd = syscall(SYS_memfd_create, "spx-tail", 0);
+#endif
+
+    if (reporter->tail.memory_fd == -1) {
+        /* without memfd the report is directly spilled */
+        reporter->tail.spilled = 1;
+        reporter->output = spx_output_stream_open(reporter->file_name, compression);
+
+        return reporter->output ? 0 : -1;
+    }
+
+    reporter->tail.output_fd = dup(reporter->tail.memory_fd);
+    if (reporter->tail.output_fd == -1) {
+        return -1;
+    }
+
+    reporter->output = spx_output_stream_fdopen(reporter->tail.output_fd, compression);
+    if (!reporter->output) {
+        close(reporter->tail.output_fd);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+static int tail_spill(full_reporter_t * reporter)
+{
+    const int fd = open(reporter->file_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+
+    reporter->tail.spilled = 1;
+
+    if (copy_fd(reporter->tail.memory_fd, fd) != 0) {
+        close(fd);
+
+        return -1;
+    }
+
+    /*
+     *  The actual file offset now matches the in-memory one, the output stream can then
+     *  transparently go on writing to it.
+     */
+    if (reporter->output && dup2(fd, reporter->tail.output_fd) == -1) {
+        close(fd);
+
+        return -1;
+    }
+
+    close(fd);
+    close(reporter->tail.memory_fd);
+    reporter->tail.memory_fd = -1;
+
+    return 0;
+}
+
+static int tail_keep(full_reporter_t * reporter, const spx_profiler_event_t * event)
+{
+    if (reporter->tail.kept) {
+        return 1;
+    }
+
+    const spx_reporter_full_tail_t * config = &reporter->tail.config;
+
+    if (
+        config->min_wall_time_ms > 0
+        && event->cum->values[SPX_METRIC_WALL_TIME] / (1000 * 1000) >= config->min_wall_time_ms
+    ) {
+        return 1;
+    }
+
+    if (
+        config->min_peak_memory > 0
+        && spx_php_zend_memory_peak_usage() >= config->min_peak_memory
+    ) {
+        return 1;
+    }
+
+    return config->errors && spx_php_error_occurred();
+}
+
+static int copy_fd(int src, int dst)
+{
+    char buf[64 * 1024];
+    off_t offset = 0;
+
+    while (1) {
+        const ssize_t size = pread(src, buf, sizeof(buf), offset);
+        if (size == 0) {
+            return 0;
+        }
+
+        if (size < 0) {
+            return -1;
+        }
+
+        ssize_t written = 0;
+        while (written < size) {
+            const ssize_t ret = write(dst, buf + written, size - written);
+            if (ret < 0) {
+                return -1;
+            }
+
+            written += ret;
+        }
+
+        offset += size;
+    }
 }
 
 static void finalize(full_reporter_t * reporter, const spx_profiler_event_t * event)
 {
+    if (reporter->tail.config.enabled) {
+        reporter->tail.kept = tail_keep(reporter, event);
+        if (!reporter->tail.kept) {
+            return;
+        }
+    }
+
+    const unsigned char end_of_events = 0;
+    spx_output_stream_write(reporter->output, &end_of_events, 1);
+
+    size_t aggregates_offset = 0;
+    if (reporter->aggregates) {
+        if (
+            reporter->chunks.enabled
+            && spx_output_stream_sync(reporter->output, &aggregates_offset) != 0
+        ) {
+            reporter->chunks.enabled = 0;
+        }
+
+        spx_report_analyzer_output_aggregates(reporter->aggregates, aggregates_write, reporter->output);
+    }
+
+    size_t functions_offset = 0;
+    if (
+        reporter->chunks.enabled
+        && spx_output_stream_sync(reporter->output, &functions_offset) != 0
+    ) {
+        reporter->chunks.enabled = 0;
+    }
+
     spx_output_stream_print(reporter->output, "[functions]\n");
 
     size_t i;
     for (i = 0; i < event->func_table.size; i++) {
-        const spx_profiler_func_table_entry_t * entry = &event->func_table.entries[i];
+        const spx_profiler_func_table_entry_t * entry = event->func_table.entries[i];
 
         spx_output_stream_printf(
             reporter->output,
@@ -336,15 +1054,110 @@ static void finalize(full_reporter_t * reporter, const spx_profiler_event_t * ev
         );
     }
 
+    reporter->metadata->chunk_index_offset = 0;
+    if (
+        reporter->chunks.enabled
+        && reporter->chunks.event_count > 0
+        && spx_output_stream_sync(reporter->output, &reporter->metadata->chunk_index_offset) == 0
+    ) {
+        spx_output_stream_printf(reporter->output, "[chunks]\nfunctions %zu\n", functions_offset);
+        if (aggregates_offset > 0) {
+            spx_output_stream_printf(reporter->output, "aggregates %zu\n", aggregates_offset);
+        }
+
+        spx_output_stream_write(reporter->output, reporter->chunks.index, reporter->chunks.index_size);
+    }
+
+    if (reporter->tail.memory_fd != -1) {
+        spx_output_stream_close(reporter->output);
+        reporter->output = NULL;
+
+        if (tail_spill(reporter) != 0) {
+            /* the partially written file is then removed by full_destroy() */
+            reporter->tail.kept = 0;
+
+            return;
+        }
+    }
+
     reporter->metadata->peak_memory_usage = spx_php_zend_memory_usage();
     reporter->metadata->wall_time_ms = event->cum->values[SPX_METRIC_WALL_TIME] / 1000;
 
     reporter->metadata->called_function_count = event->func_table.size;
+    metadata_set_demoted_functions(reporter->metadata, event);
     SPX_METRIC_FOREACH(i, {
         reporter->metadata->enabled_metrics[i] = event->enabled_metrics[i];
     });
 
     metadata_save(reporter->metadata, reporter->metadata_file_name);
+
+    if (reporter->timeline) {
+        spx_report_timeline_save(
+            reporter->timeline,
+            reporter->timeline_file_name,
+            event->func_table.size,
+            function_name,
+            (void *) event
+        );
+    }
+}
+
+static size_t aggregates_write(void * arg, const void * ptr, size_t len)
+{
+    spx_output_stream_write(arg, ptr, len);
+
+    return len;
+}
+
+static void metadata_set_demoted_functions(metadata_t * metadata, const spx_profiler_event_t * event)
+{
+    size_t count = 0;
+    size_t i;
+    for (i = 0; i < event->func_table.size; i++) {
+        if (event->func_table.entries[i]->demoted) {
+            count++;
+        }
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    metadata->demoted_functions = malloc(count * sizeof(*metadata->demoted_functions));
+    if (!metadata->demoted_functions) {
+        return;
+    }
+
+    char name[8 * 1024];
+    for (i = 0; i < event->func_table.size; i++) {
+        if (!event->func_table.entries[i]->demoted) {
+            continue;
+        }
+
+        function_name((void *) event, i, name, sizeof(name));
+
+        char * dup = strdup(name);
+        if (!dup) {
+            return;
+        }
+
+        metadata->demoted_functions[metadata->demoted_function_count++] = dup;
+    }
+}
+
+static void function_name(void * arg, size_t function_idx, char * buf, size_t size)
+{
+    const spx_profiler_event_t * event = arg;
+    const spx_profiler_func_table_entry_t * entry = event->func_table.entries[function_idx];
+
+    snprintf(
+        buf,
+        size,
+        "%s%s%s",
+        entry->function.class_name,
+        entry->function.class_name[0] ? "::" : "",
+        entry->function.func_name
+    );
 }
 
 static metadata_t * metadata_create(void)
@@ -363,6 +1176,9 @@ static metadata_t * metadata_create(void)
     metadata->http_method = NULL;
     metadata->http_host = NULL;
     metadata->custom_metadata_str = NULL;
+    metadata->previous_key = NULL;
+    metadata->demoted_function_count = 0;
+    metadata->demoted_functions = NULL;
 
     metadata->exec_ts = time(NULL);
 
@@ -448,6 +1264,7 @@ static metadata_t * metadata_create(void)
 
     metadata->call_count = 0;
     metadata->recorded_call_count = 0;
+    metadata->chunk_index_offset = 0;
 
     return metadata;
 
@@ -468,6 +1285,14 @@ static void metadata_destroy(metadata_t * metadata)
     free(metadata->http_method);
     free(metadata->http_host);
     free(metadata->custom_metadata_str);
+    free(metadata->previous_key);
+
+    size_t i;
+    for (i = 0; i < metadata->demoted_function_count; i++) {
+        free(metadata->demoted_functions[i]);
+    }
+
+    free(metadata->demoted_functions);
 
     free(metadata);
 }
@@ -575,6 +1400,21 @@ static int metadata_save(const metadata_t * metadata, const char * file_name)
         );
     }
 
+    if (metadata->previous_key) {
+        fprintf(
+            fp,
+            "  \"%s\": \"%s\",\n",
+            "previous_key",
+            spx_utils_json_escape(buf, metadata->previous_key, sizeof(buf))
+        );
+    } else {
+        fprintf(
+            fp,
+            "  \"%s\": null,\n",
+            "previous_key"
+        );
+    }
+
     fprintf(
         fp,
         "  \"%s\": %zu,\n",
@@ -610,6 +1450,27 @@ static int metadata_save(const metadata_t * metadata, const char * file_name)
         metadata->recorded_call_count
     );
 
+    fprintf(
+        fp,
+        "  \"%s\": %zu,\n",
+        "chunk_index_offset",
+        metadata->chunk_index_offset
+    );
+
+    fprintf(fp, "  \"demoted_functions\": [\n");
+
+    size_t i;
+    for (i = 0; i < metadata->demoted_function_count; i++) {
+        fprintf(
+            fp,
+            "    %s\"%s\"\n",
+            i > 0 ? "," : "",
+            spx_utils_json_escape(buf, metadata->demoted_functions[i], sizeof(buf))
+        );
+    }
+
+    fprintf(fp, "  ],\n");
+
     fprintf(fp, "  \"enabled_metrics\": [\n");
 
     int first = 1;
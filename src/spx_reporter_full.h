@@ -20,6 +20,19 @@
 #define SPX_REPORTER_FULL_H_DEFINED
 
 #include "spx_profiler.h"
+#include "spx_output_stream.h"
+
+/*
+ *  Tail mode: the report is recorded in memory and only persisted at the end when one of
+ *  the enabled conditions holds, or when spx_reporter_full_keep() has been called.
+ */
+typedef struct {
+    int enabled;
+    /* 0 disables the corresponding condition, the wall time one requires the wt metric */
+    size_t min_wall_time_ms;
+    size_t min_peak_memory;
+    int errors;
+} spx_reporter_full_tail_t;
 
 size_t spx_reporter_full_metadata_list_files(
     const char * data_dir,
@@ -40,13 +53,49 @@ char * spx_reporter_full_build_file_name(
     size_t size
 );
 
-spx_profiler_reporter_t * spx_reporter_full_create(const char * data_dir);
+char * spx_reporter_full_build_timeline_file_name(
+    const char * data_dir,
+    const char * key,
+    char * file_name,
+    size_t size
+);
+
+/*
+ *  buffer_size is the size in bytes of each of the two event buffers.
+ *  Calls shorter than min_duration (in ns, 0 meaning none) are elided from the event stream,
+ *  the report aggregates still accounting them.
+ */
+spx_profiler_reporter_t * spx_reporter_full_create(
+    const char * data_dir,
+    const spx_output_stream_compression_t * compression,
+    size_t buffer_size,
+    const spx_reporter_full_tail_t * tail,
+    size_t min_duration
+);
 
 void spx_reporter_full_set_custom_metadata_str(
     const spx_profiler_reporter_t * base_reporter,
     const char * custom_metadata_str
 );
 
+const char * spx_reporter_full_get_custom_metadata_str(const spx_profiler_reporter_t * base_reporter);
+
+/* links this report to the previous segment of a rolling profile */
+void spx_reporter_full_set_previous_key(
+    const spx_profiler_reporter_t * base_reporter,
+    const char * previous_key
+);
+
 const char * spx_reporter_full_get_key(const spx_profiler_reporter_t * base_reporter);
 
+size_t spx_reporter_full_get_call_count(const spx_profiler_reporter_t * base_reporter);
+
+/* size in bytes of the events recorded so far, before encoding & compression */
+size_t spx_reporter_full_get_recorded_size(const spx_profiler_reporter_t * base_reporter);
+
+void spx_reporter_full_keep(spx_profiler_reporter_t * base_reporter);
+
+/* whether the report is persisted, i.e. always outside of tail mode */
+int spx_reporter_full_is_kept(const spx_profiler_reporter_t * base_reporter);
+
 #endif /* SPX_REPORTER_FULL_H_DEFINED */
@@ -0,0 +1,383 @@
+/* SPX - A simple profiler for PHP
+ * Copyright (C) 2017-2025 Sylvain Lassaut <NoiseByNorthwest@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "spx_reporter_pool.h"
+#include "spx_hmap.h"
+
+typedef struct call_tree_node_t call_tree_node_t;
+
+typedef struct {
+    const call_tree_node_t * parent;
+    size_t function_idx;
+} call_tree_node_key_t;
+
+struct call_tree_node_t {
+    call_tree_node_key_t key;
+
+    size_t called;
+    spx_profiler_metric_values_t inc;
+
+    call_tree_node_t * first_child;
+    call_tree_node_t * next_sibling;
+    /* allocation list, for release */
+    call_tree_node_t * next;
+};
+
+typedef struct {
+    spx_profiler_reporter_t base;
+
+    spx_pool_t * pool;
+
+    /* the call tree of the current request, merged into the pool at the end */
+    struct {
+        spx_hmap_t * hmap;
+        call_tree_node_t root;
+        call_tree_node_t * nodes;
+    } call_tree;
+
+    struct {
+        size_t size;
+        size_t capacity;
+        call_tree_node_t ** nodes;
+    } stack;
+
+    /* set on allocation failure, the request is then not merged */
+    int failed;
+} pool_reporter_t;
+
+static spx_profiler_reporter_cost_t pool_notify(
+    spx_profiler_reporter_t * reporter,
+    const spx_profiler_event_t * event
+);
+
+static void pool_destroy(spx_profiler_reporter_t * reporter);
+
+static int call_start(pool_reporter_t * reporter, size_t function_idx);
+static void call_end(
+    pool_reporter_t * reporter,
+    const int * enabled_metrics,
+    const spx_profiler_metric_values_t * inc
+);
+static void merge(pool_reporter_t * reporter, const spx_profiler_event_t * event);
+static void merge_call_tree_node(
+    pool_reporter_t * reporter,
+    const call_tree_node_t * node,
+    ssize_t parent_idx,
+    const int * enabled_metrics,
+    const ssize_t * function_indexes
+);
+
+static call_tree_node_t * call_tree_get_child(
+    pool_reporter_t * reporter,
+    call_tree_node_t * parent,
+    size_t function_idx
+);
+
+static uint64_t call_tree_hmap_hash_key(const void * v);
+static int call_tree_hmap_cmp_key(const void * va, const void * vb);
+
+spx_profiler_reporter_t * spx_reporter_pool_create(spx_pool_t * pool)
+{
+    pool_reporter_t * reporter = malloc(sizeof(*reporter));
+    if (!reporter) {
+        return NULL;
+    }
+
+    reporter->base.notify = pool_notify;
+    reporter->base.destroy = pool_destroy;
+
+    reporter->pool = pool;
+    reporter->failed = 0;
+
+    reporter->call_tree.nodes = NULL;
+    reporter->call_tree.root.first_child = NULL;
+
+    reporter->stack.size = 0;
+    reporter->stack.capacity = 0;
+    reporter->stack.nodes = NULL;
+
+    reporter->call_tree.hmap = spx_hmap_create(
+        1024,
+        call_tree_hmap_hash_key,
+        call_tree_hmap_cmp_key
+    );
+
+    if (!reporter->call_tree.hmap) {
+        goto error;
+    }
+
+    return (spx_profiler_reporter_t *) reporter;
+
+error:
+    spx_profiler_reporter_destroy((spx_profiler_reporter_t *) reporter);
+
+    return NULL;
+}
+
+static spx_profiler_reporter_cost_t pool_notify(
+    spx_profiler_reporter_t * base_reporter,
+    const spx_profiler_event_t * event
+) {
+    pool_reporter_t * reporter = (pool_reporter_t *) base_reporter;
+
+    if (reporter->failed) {
+        return SPX_PROFILER_REPORTER_COST_LIGHT;
+    }
+
+    switch (event->type) {
+        case SPX_PROFILER_EVENT_CALL_START:
+            if (call_start(reporter, event->callee->idx) != 0) {
+                reporter->failed = 1;
+            }
+
+            return SPX_PROFILER_REPORTER_COST_LIGHT;
+
+        case SPX_PROFILER_EVENT_CALL_END:
+            call_end(reporter, event->enabled_metrics, event->inc);
+
+            return SPX_PROFILER_REPORTER_COST_LIGHT;
+
+        case SPX_PROFILER_EVENT_FINALIZE:
+            merge(reporter, event);
+
+            return SPX_PROFILER_REPORTER_COST_HEAVY;
+    }
+
+    return SPX_PROFILER_REPORTER_COST_LIGHT;
+}
+
+static void pool_destroy(spx_profiler_reporter_t * base_reporter)
+{
+    pool_reporter_t * reporter = (pool_reporter_t *) base_reporter;
+
+    call_tree_node_t * node = reporter->call_tree.nodes;
+    while (node) {
+        call_tree_node_t * next = node->next;
+        free(node);
+        node = next;
+    }
+
+    free(reporter->stack.nodes);
+
+    if (reporter->call_tree.hmap) {
+        spx_hmap_destroy(reporter->call_tree.hmap);
+    }
+}
+
+static int call_start(pool_reporter_t * reporter, size_t function_idx)
+{
+    if (reporter->stack.size == reporter->stack.capacity) {
+        const size_t capacity = reporter->stack.capacity ? reporter->stack.capacity * 2 : 64;
+        call_tree_node_t ** nodes = realloc(reporter->stack.nodes, capacity * sizeof(*nodes));
+        if (!nodes) {
+            return -1;
+        }
+
+        reporter->stack.nodes = nodes;
+        reporter->stack.capacity = capacity;
+    }
+
+    call_tree_node_t * parent = reporter->stack.size > 0 ?
+        reporter->stack.nodes[reporter->stack.size - 1] : &reporter->call_tree.root;
+
+    call_tree_node_t * node = call_tree_get_child(reporter, parent, function_idx);
+    if (!node) {
+        return -1;
+    }
+
+    reporter->stack.nodes[reporter->stack.size++] = node;
+
+    return 0;
+}
+
+static void call_end(
+    pool_reporter_t * reporter,
+    const int * enabled_metrics,
+    const spx_profiler_metric_values_t * inc
+) {
+    if (reporter->stack.size == 0) {
+        return;
+    }
+
+    call_tree_node_t * node = reporter->stack.nodes[--reporter->stack.size];
+
+    node->called++;
+
+    SPX_METRIC_FOREACH(i, {
+        if (enabled_metrics[i]) {
+            node->inc.values[i] += inc->values[i];
+        }
+    });
+}
+
+static void merge(pool_reporter_t * reporter, const spx_profiler_event_t * event)
+{
+    ssize_t * function_indexes = malloc(event->func_table.size * sizeof(*function_indexes));
+    if (!function_indexes) {
+        return;
+    }
+
+    const ssize_t merge = spx_pool_merge_begin(
+        reporter->pool,
+        event->enabled_metrics,
+        event->cum->values
+    );
+    if (merge < 0) {
+        goto end;
+    }
+
+    size_t i;
+    for (i = 0; i < event->func_table.size; i++) {
+        const spx_profiler_func_table_entry_t * entry = event->func_table.entries[i];
+
+        function_indexes[i] = spx_pool_intern_function(
+            reporter->pool,
+            entry->function.class_name,
+            entry->function.func_name
+        );
+
+        if (function_indexes[i] < 0) {
+            continue;
+        }
+
+        spx_pool_add_function_stats(
+            reporter->pool,
+            function_indexes[i],
+            entry->stats.called,
+            entry->stats.max_cycle_depth,
+            event->enabled_metrics,
+            entry->stats.inc.values,
+            entry->stats.exc.values
+        );
+    }
+
+    const call_tree_node_t * node;
+    for (node = reporter->call_tree.root.first_child; node; node = node->next_sibling) {
+        merge_call_tree_node(reporter, node, -1, event->enabled_metrics, function_indexes);
+    }
+
+    spx_pool_merge_end(reporter->pool, merge);
+
+end:
+    free(function_indexes);
+}
+
+static void merge_call_tree_node(
+    pool_reporter_t * reporter,
+    const call_tree_node_t * node,
+    ssize_t parent_idx,
+    const int * enabled_metrics,
+    const ssize_t * function_indexes
+) {
+    const ssize_t function_idx = function_indexes[node->key.function_idx];
+    if (function_idx < 0) {
+        return;
+    }
+
+    /* the subtree is dropped when the pool is full */
+    const ssize_t idx = spx_pool_intern_call_tree_node(reporter->pool, parent_idx, function_idx);
+    if (idx < 0) {
+        return;
+    }
+
+    spx_pool_add_call_tree_node_stats(
+        reporter->pool,
+        idx,
+        node->called,
+        enabled_metrics,
+        node->inc.values
+    );
+
+    const call_tree_node_t * child;
+    for (child = node->first_child; child; child = child->next_sibling) {
+        merge_call_tree_node(reporter, child, idx, enabled_metrics, function_indexes);
+    }
+}
+
+static call_tree_node_t * call_tree_get_child(
+    pool_reporter_t * reporter,
+    call_tree_node_t * parent,
+    size_t function_idx
+) {
+    const call_tree_node_key_t key = {parent, function_idx};
+
+    int new = 0;
+    spx_hmap_entry_t * entry = spx_hmap_ensure_entry(reporter->call_tree.hmap, &key, &new);
+    if (!entry) {
+        return NULL;
+    }
+
+    if (!new) {
+        return spx_hmap_entry_get_value(entry);
+    }
+
+    /*
+     *  On allocation failure the entry is left with a key living on the stack, this is
+     *  fine since the request is then not merged.
+     */
+    call_tree_node_t * node = malloc(sizeof(*node));
+    if (!node) {
+        return NULL;
+    }
+
+    node->key = key;
+    node->called = 0;
+
+    SPX_METRIC_FOREACH(i, {
+        node->inc.values[i] = 0;
+    });
+
+    /* the hmap only references the key, it must then live in the node */
+    spx_hmap_set_entry_key(reporter->call_tree.hmap, entry, &node->key);
+    spx_hmap_entry_set_value(entry, node);
+
+    node->first_child = NULL;
+    node->next_sibling = parent->first_child;
+    parent->first_child = node;
+
+    node->next = reporter->call_tree.nodes;
+    reporter->call_tree.nodes = node;
+
+    return node;
+}
+
+static uint64_t call_tree_hmap_hash_key(const void * v)
+{
+    const call_tree_node_key_t * key = v;
+
+    return (uint64_t) (uintptr_t) key->parent * 31 + key->function_idx;
+}
+
+static int call_tree_hmap_cmp_key(const void * va, const void * vb)
+{
+    const call_tree_node_key_t * a = va;
+    const call_tree_node_key_t * b = vb;
+
+    if (a->parent != b->parent) {
+        return a->parent < b->parent ? -1 : 1;
+    }
+
+    if (a->function_idx != b->function_idx) {
+        return a->function_idx < b->function_idx ? -1 : 1;
+    }
+
+    return 0;
+}
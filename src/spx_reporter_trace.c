@@ -22,52 +22,72 @@
 
 #include "spx_reporter_trace.h"
 #include "spx_output_stream.h"
+#include "spx_async_flusher.h"
 #include "spx_utils.h"
 
-#define BUFFER_CAPACITY 16384
-
+/*
+ *  Buffered events are packed, each entry being followed by its cumulative enabled metric
+ *  values and, for a call end, by the inclusive & exclusive ones.
+ */
 typedef struct {
     spx_profiler_event_type_t event_type;
     const spx_php_function_t * function;
     size_t depth;
-    spx_profiler_metric_values_t cum_metric_values;
-    spx_profiler_metric_values_t inc_metric_values;
-    spx_profiler_metric_values_t exc_metric_values;
 } buffer_entry_t;
 
 typedef struct {
     spx_profiler_reporter_t base;
 
-    const char * file_name;
+    char file_name[PATH_MAX];
     spx_output_stream_t * output;
 
     int safe;
 
     int first;
+    int header_printed;
+    int enabled_metrics[SPX_METRIC_COUNT];
+    size_t metric_count;
+    spx_metric_t metrics[SPX_METRIC_COUNT];
+    spx_async_flusher_t * flusher;
+
+    /*
+     *  Events are double buffered, the full buffer being flushed by the background
+     *  flusher (when available) while the other one is filled.
+     *  Sizes are in bytes.
+     */
+    size_t buffer_capacity;
+    unsigned char * buffer;
     size_t buffer_size;
-    buffer_entry_t buffer[BUFFER_CAPACITY];
+    unsigned char * buffers[2];
 } trace_reporter_t;
 
 static spx_profiler_reporter_cost_t trace_notify(spx_profiler_reporter_t * base_reporter, const spx_profiler_event_t * event);
 static void trace_destroy(spx_profiler_reporter_t * base_reporter);
 
-static void flush_buffer(trace_reporter_t * reporter, const int * enabled_metrics);
+static void setup(trace_reporter_t * reporter, const int * enabled_metrics);
+static size_t entry_size(const trace_reporter_t * reporter, spx_profiler_event_type_t event_type);
+static int submit_buffer(trace_reporter_t * reporter);
+static void flush_buffer_handler(void * arg, const void * buffer, size_t size);
+static void flush_buffer(trace_reporter_t * reporter, const unsigned char * buffer, size_t size);
 
 static void print_header(spx_output_stream_t * output, const int * enabled_metrics);
 
 static void print_row(
-    spx_output_stream_t * output,
+    const trace_reporter_t * reporter,
     const char * prefix,
     const spx_php_function_t * function,
     size_t depth,
-    const int * enabled_metrics,
-    const spx_profiler_metric_values_t * cum_metric_values,
-    const spx_profiler_metric_values_t * inc_metric_values,
-    const spx_profiler_metric_values_t * exc_metric_values
+    const double * cum_metric_values,
+    const double * inc_metric_values,
+    const double * exc_metric_values
 );
 
-spx_profiler_reporter_t * spx_reporter_trace_create(const char * file_name, int safe)
-{
+spx_profiler_reporter_t * spx_reporter_trace_create(
+    const char * file_name,
+    int safe,
+    const spx_output_stream_compression_t * compression,
+    size_t buffer_size
+) {
     trace_reporter_t * reporter = malloc(sizeof(*reporter));
     if (!reporter) {
         return NULL;
@@ -76,99 +96,240 @@ spx_profiler_reporter_t * spx_reporter_trace_create(const char * file_name, int
     reporter->base.notify = trace_notify;
     reporter->base.destroy = trace_destroy;
 
-    reporter->file_name = file_name ? file_name : "spx_trace.txt.gz";
+    spx_output_stream_compression_t file_compression = *compression;
+    if (file_name) {
+        snprintf(reporter->file_name, sizeof(reporter->file_name), "%s", file_name);
+
+        /* a custom file name dictates the codec, the configured level only applies to the same codec */
+        file_compression.codec = spx_output_stream_codec_get_by_file_name(file_name);
+        if (!spx_output_stream_codec_available(file_compression.codec)) {
+            /*
+             *  Same fallback as for the configured codec, the suffix is then replaced so that
+             *  the file name keeps reflecting the actual codec.
+             */
+            const size_t base_len = strlen(file_name)
+                - strlen(spx_output_stream_codec_file_suffix(file_compression.codec));
+
+            file_compression.codec = SPX_OUTPUT_STREAM_CODEC_GZIP;
+            snprintf(
+                reporter->file_name,
+                sizeof(reporter->file_name),
+                "%.*s%s",
+                (int) base_len,
+                file_name,
+                spx_output_stream_codec_file_suffix(file_compression.codec)
+            );
+        }
+
+        if (file_compression.codec != compression->codec) {
+            file_compression.level = 0;
+            file_compression.long_mode = 0;
+        }
+    } else {
+        snprintf(
+            reporter->file_name,
+            sizeof(reporter->file_name),
+            "spx_trace.txt%s",
+            spx_output_stream_codec_file_suffix(compression->codec)
+        );
+    }
 
     reporter->safe = safe;
 
     reporter->first = 1;
+    reporter->header_printed = 0;
+    reporter->metric_count = 0;
+    reporter->flusher = NULL;
+    reporter->output = NULL;
+
+    reporter->buffer_capacity = buffer_size;
+    reporter->buffers[0] = malloc(buffer_size);
+    reporter->buffers[1] = malloc(buffer_size);
+    reporter->buffer = reporter->buffers[0];
     reporter->buffer_size = 0;
 
-    const int compressed = spx_utils_str_ends_with(reporter->file_name, ".gz");
-    reporter->output = spx_output_stream_open(reporter->file_name, compressed);
-    if (!reporter->output) {
-        spx_profiler_reporter_destroy((spx_profiler_reporter_t *)reporter);
+    if (!reporter->buffers[0] || !reporter->buffers[1]) {
+        goto error;
+    }
 
-        return NULL;
+    reporter->output = spx_output_stream_open(reporter->file_name, &file_compression);
+    if (!reporter->output) {
+        goto error;
     }
 
     return (spx_profiler_reporter_t *) reporter;
+
+error:
+    spx_profiler_reporter_destroy((spx_profiler_reporter_t *)reporter);
+
+    return NULL;
 }
 
 static spx_profiler_reporter_cost_t trace_notify(spx_profiler_reporter_t * base_reporter, const spx_profiler_event_t * event)
 {
     trace_reporter_t * reporter = (trace_reporter_t *) base_reporter;
 
+    if (reporter->first) {
+        reporter->first = 0;
+        setup(reporter, event->enabled_metrics);
+    }
+
     if (event->type != SPX_PROFILER_EVENT_FINALIZE) {
-        buffer_entry_t * current = &reporter->buffer[reporter->buffer_size];
+        buffer_entry_t * current = (buffer_entry_t *) (reporter->buffer + reporter->buffer_size);
+
+        current->event_type = event->type;
+        current->function   = &event->callee->function;
+        current->depth      = event->depth;
 
-        current->event_type        = event->type;
-        current->function          = &event->callee->function;
-        current->depth             = event->depth;
-        current->cum_metric_values = *event->cum;
+        double * values = (double *) (current + 1);
+        const size_t count = reporter->metric_count;
+
+        size_t i;
+        for (i = 0; i < count; i++) {
+            values[i] = event->cum->values[reporter->metrics[i]];
+        }
 
         if (event->type == SPX_PROFILER_EVENT_CALL_END) {
-            current->inc_metric_values = *event->inc;
-            current->exc_metric_values = *event->exc;
+            for (i = 0; i < count; i++) {
+                values[count + i]     = event->inc->values[reporter->metrics[i]];
+                values[2 * count + i] = event->exc->values[reporter->metrics[i]];
+            }
         }
 
-        reporter->buffer_size++;
+        reporter->buffer_size += entry_size(reporter, event->type);
 
-        if (reporter->buffer_size < BUFFER_CAPACITY && !reporter->safe) {
+        if (
+            reporter->buffer_size + entry_size(reporter, SPX_PROFILER_EVENT_CALL_END)
+                <= reporter->buffer_capacity
+            && !reporter->safe
+        ) {
             return SPX_PROFILER_REPORTER_COST_LIGHT;
         }
     }
 
-    flush_buffer(reporter, event->enabled_metrics);
+    const int waited = submit_buffer(reporter);
 
     if (event->type == SPX_PROFILER_EVENT_FINALIZE) {
+        if (reporter->flusher) {
+            spx_async_flusher_wait(reporter->flusher);
+        }
+
         fprintf(
             stderr,
             "\nSPX trace file: %s\n",
             reporter->file_name
         );
+
+        return SPX_PROFILER_REPORTER_COST_HEAVY;
     }
 
-    return SPX_PROFILER_REPORTER_COST_HEAVY;
+    /* swapping buffers is cheap unless the previous one is still being flushed */
+    return waited ? SPX_PROFILER_REPORTER_COST_HEAVY : SPX_PROFILER_REPORTER_COST_LIGHT;
 }
 
 static void trace_destroy(spx_profiler_reporter_t * base_reporter)
 {
     trace_reporter_t * reporter = (trace_reporter_t *) base_reporter;
 
+    if (reporter->flusher) {
+        spx_async_flusher_destroy(reporter->flusher);
+    }
+
     if (reporter->output) {
         spx_output_stream_close(reporter->output);
     }
+
+    free(reporter->buffers[0]);
+    free(reporter->buffers[1]);
 }
 
-static void flush_buffer(trace_reporter_t * reporter, const int * enabled_metrics)
+static void setup(trace_reporter_t * reporter, const int * enabled_metrics)
 {
-    if (reporter->first) {
-        reporter->first = 0;
+    SPX_METRIC_FOREACH(i, {
+        reporter->enabled_metrics[i] = enabled_metrics[i];
+        if (enabled_metrics[i]) {
+            reporter->metrics[reporter->metric_count++] = i;
+        }
+    });
 
-        print_header(reporter->output, enabled_metrics);
+    /*
+     *  Safe mode requires each event to be written before the next one, it is
+     *  therefore kept synchronous.
+     */
+    if (!reporter->safe && !spx_metric_process_wide_enabled(enabled_metrics)) {
+        /* on failure we simply fall back to synchronous flushing */
+        reporter->flusher = spx_async_flusher_create(flush_buffer_handler, reporter);
     }
+}
 
-    size_t i;
-    for (i = 0; i < reporter->buffer_size; i++) {
-        const buffer_entry_t * entry = &reporter->buffer[i];
+static size_t entry_size(const trace_reporter_t * reporter, spx_profiler_event_type_t event_type)
+{
+    const size_t value_count = event_type == SPX_PROFILER_EVENT_CALL_END ?
+        3 * reporter->metric_count : reporter->metric_count;
+
+    return sizeof(buffer_entry_t) + value_count * sizeof(double);
+}
+
+static int submit_buffer(trace_reporter_t * reporter)
+{
+    if (!reporter->flusher) {
+        flush_buffer(reporter, reporter->buffer, reporter->buffer_size);
+        reporter->buffer_size = 0;
+
+        return 1;
+    }
+
+    const int waited = spx_async_flusher_submit(
+        reporter->flusher,
+        reporter->buffer,
+        reporter->buffer_size
+    );
+
+    reporter->buffer = reporter->buffer == reporter->buffers[0] ?
+        reporter->buffers[1] : reporter->buffers[0];
+
+    reporter->buffer_size = 0;
+
+    return waited;
+}
+
+static void flush_buffer_handler(void * arg, const void * buffer, size_t size)
+{
+    flush_buffer(arg, buffer, size);
+}
+
+static void flush_buffer(trace_reporter_t * reporter, const unsigned char * buffer, size_t size)
+{
+    if (!reporter->header_printed) {
+        reporter->header_printed = 1;
+
+        print_header(reporter->output, reporter->enabled_metrics);
+    }
+
+    const size_t count = reporter->metric_count;
+
+    size_t offset = 0;
+    while (offset < size) {
+        const buffer_entry_t * entry = (const buffer_entry_t *) (buffer + offset);
+        const double * values = (const double *) (entry + 1);
+        const int end = entry->event_type == SPX_PROFILER_EVENT_CALL_END;
+
+        offset += entry_size(reporter, entry->event_type);
 
         print_row(
-            reporter->output,
-            entry->event_type == SPX_PROFILER_EVENT_CALL_START ? "+" : "-",
+            reporter,
+            end ? "-" : "+",
             entry->function,
             entry->depth,
-            enabled_metrics,
-            &entry->cum_metric_values,
-            entry->event_type == SPX_PROFILER_EVENT_CALL_END ? &entry->inc_metric_values : NULL,
-            entry->event_type == SPX_PROFILER_EVENT_CALL_END ? &entry->exc_metric_values : NULL
+            values,
+            end ? values + count : NULL,
+            end ? values + 2 * count : NULL
         );
 
         if (reporter->safe) {
             spx_output_stream_flush(reporter->output);
         }
     }
-
-    reporter->buffer_size = 0;
 }
 
 static void print_header(spx_output_stream_t * output, const int * enabled_metrics)
@@ -205,45 +366,43 @@ static void print_header(spx_output_stream_t * output, const int * enabled_metri
 }
 
 static void print_row(
-    spx_output_stream_t * output,
+    const trace_reporter_t * reporter,
     const char * prefix,
     const spx_php_function_t * function,
     size_t depth,
-    const int * enabled_metrics,
-    const spx_profiler_metric_values_t * cum_metric_values,
-    const spx_profiler_metric_values_t * inc_metric_values,
-    const spx_profiler_metric_values_t * exc_metric_values
+    const double * cum_metric_values,
+    const double * inc_metric_values,
+    const double * exc_metric_values
 ) {
     spx_fmt_row_t * fmt_row = spx_fmt_row_create();
 
-    SPX_METRIC_FOREACH(i, {
-        if (!enabled_metrics[i]) {
-            continue;
-        }
+    size_t i;
+    for (i = 0; i < reporter->metric_count; i++) {
+        const spx_metric_t metric = reporter->metrics[i];
 
         spx_fmt_row_add_ncell(
             fmt_row,
             1,
-            spx_metric_info[i].type,
-            cum_metric_values->values[i]
+            spx_metric_info[metric].type,
+            cum_metric_values[i]
         );
 
-        const double inc = inc_metric_values ? inc_metric_values->values[i] : 0;
+        const double inc = inc_metric_values ? inc_metric_values[i] : 0;
         spx_fmt_row_add_ncell(
             fmt_row,
             1,
-            spx_metric_info[i].type,
+            spx_metric_info[metric].type,
             inc
         );
 
-        const double exc = exc_metric_values ? exc_metric_values->values[i] : 0;
+        const double exc = exc_metric_values ? exc_metric_values[i] : 0;
         spx_fmt_row_add_ncell(
             fmt_row,
             1,
-            spx_metric_info[i].type,
+            spx_metric_info[metric].type,
             exc
         );
-    });
+    }
 
     spx_fmt_row_add_ncell(
         fmt_row,
@@ -273,6 +432,6 @@ static void print_row(
 
     spx_fmt_row_add_tcell(fmt_row, 0, func_name);
 
-    spx_fmt_row_print(fmt_row, output);
+    spx_fmt_row_print(fmt_row, reporter->output);
     spx_fmt_row_destroy(fmt_row);
 }
@@ -20,7 +20,13 @@
 #define SPX_REPORTER_TRACE_H_DEFINED
 
 #include "spx_profiler.h"
+#include "spx_output_stream.h"
 
-spx_profiler_reporter_t * spx_reporter_trace_create(const char * file_name, int safe);
+spx_profiler_reporter_t * spx_reporter_trace_create(
+    const char * file_name,
+    int safe,
+    const spx_output_stream_compression_t * compression,
+    size_t buffer_size
+);
 
 #endif /* SPX_REPORTER_TRACE_H_DEFINED */
@@ -0,0 +1,28 @@
+--TEST--
+Full report written without compression
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_COMPRESSION=none
+END;
+--FILE--
+<?php
+function foo() {
+}
+
+spx_profiler_start();
+foo();
+$key = spx_profiler_stop();
+
+var_dump(file_exists('/tmp/spx/' . $key . '.txt.gz'));
+
+$fp = fopen('/tmp/spx/' . $key . '.txt', 'rb');
+echo fgets($fp);
+fclose($fp);
+
+?>
+--EXPECT--
+bool(false)
+[events:binary:1]
@@ -50,11 +50,15 @@ foreach ($metadataStrings as $metadataString) {
   "http_method": "GET",
   "http_host": "n\/a",
   "custom_metadata_str": "a:1:{s:2:\"id\";i:1;}",
+  "previous_key": null,
   "wall_time_ms": %d,
   "peak_memory_usage": %d,
   "called_function_count": 2,
   "call_count": 2,
   "recorded_call_count": 2,
+  "chunk_index_offset": %d,
+  "demoted_functions": [
+  ],
   "enabled_metrics": [
     "wt"
     ,"zm"
@@ -73,11 +77,15 @@ foreach ($metadataStrings as $metadataString) {
   "http_method": "GET",
   "http_host": "n\/a",
   "custom_metadata_str": null,
+  "previous_key": null,
   "wall_time_ms": %d,
   "peak_memory_usage": %d,
   "called_function_count": 2,
   "call_count": 2,
   "recorded_call_count": 2,
+  "chunk_index_offset": %d,
+  "demoted_functions": [
+  ],
   "enabled_metrics": [
     "wt"
     ,"zm"
@@ -96,11 +104,15 @@ foreach ($metadataStrings as $metadataString) {
   "http_method": "GET",
   "http_host": "n\/a",
   "custom_metadata_str": "%saabb",
+  "previous_key": null,
   "wall_time_ms": %d,
   "peak_memory_usage": %d,
   "called_function_count": 2,
   "call_count": 2,
   "recorded_call_count": 2,
+  "chunk_index_offset": %d,
+  "demoted_functions": [
+  ],
   "enabled_metrics": [
     "wt"
     ,"zm"
@@ -122,11 +134,15 @@ Notice: SPX: spx_profiler_full_report_set_custom_metadata_str(): too large $cust
   "http_method": "GET",
   "http_host": "n\/a",
   "custom_metadata_str": null,
+  "previous_key": null,
   "wall_time_ms": %d,
   "peak_memory_usage": %d,
   "called_function_count": 2,
   "call_count": 2,
   "recorded_call_count": 2,
+  "chunk_index_offset": %d,
+  "demoted_functions": [
+  ],
   "enabled_metrics": [
     "wt"
     ,"zm"
@@ -145,11 +161,15 @@ Notice: SPX: spx_profiler_full_report_set_custom_metadata_str(): too large $cust
   "http_method": "GET",
   "http_host": "n\/a",
   "custom_metadata_str": "foo",
+  "previous_key": null,
   "wall_time_ms": %d,
   "peak_memory_usage": %d,
   "called_function_count": 2,
   "call_count": 2,
   "recorded_call_count": 2,
+  "chunk_index_offset": %d,
+  "demoted_functions": [
+  ],
   "enabled_metrics": [
     "wt"
     ,"zm"
@@ -0,0 +1,45 @@
+--TEST--
+Hot function demotion without measure
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_DEMOTE_CALLS=100
+SPX_DEMOTE_MAX_WALL_TIME=1000000000
+SPX_DEMOTE_MEASURE=0
+END;
+--FILE--
+<?php
+class Foo {
+    private $value = 1;
+
+    public function get($i) {
+        if ($i % 300 == 0) {
+            $this->load();
+        }
+
+        return $this->value;
+    }
+
+    private function load() {
+        $this->value = 1;
+    }
+}
+
+spx_profiler_start();
+$foo = new Foo();
+for ($i = 0; $i < 1000; $i++) {
+    $foo->get($i);
+}
+$key = spx_profiler_stop();
+
+$metadata = json_decode(file_get_contents('/tmp/spx/' . $key . '.json'), true);
+
+echo 'Demoted: ', implode(', ', $metadata['demoted_functions']), "\n";
+echo 'Recorded calls: ', $metadata['recorded_call_count'], "\n";
+
+?>
+--EXPECT--
+Demoted: Foo::get
+Recorded calls: 102
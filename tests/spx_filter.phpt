@@ -0,0 +1,44 @@
+--TEST--
+Function filters
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_FILTER_EXCLUDE=foo*, Baz::qux
+END;
+--FILE--
+<?php
+class Baz {
+    public static function qux() {
+        bar();
+    }
+}
+
+function foo1() {
+    bar();
+}
+
+function foo2() {
+}
+
+function bar() {
+    foo2();
+}
+
+spx_profiler_start();
+for ($i = 0; $i < 3; $i++) {
+    foo1();
+    Baz::qux();
+}
+$key = spx_profiler_stop();
+
+$metadata = json_decode(file_get_contents('/tmp/spx/' . $key . '.json'), true);
+
+echo 'Functions: ', $metadata['called_function_count'], "\n";
+echo 'Calls: ', $metadata['call_count'], "\n";
+
+?>
+--EXPECT--
+Functions: 2
+Calls: 7
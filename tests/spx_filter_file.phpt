@@ -0,0 +1,33 @@
+--TEST--
+Function filters: file patterns & same-named functions
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_FILTER_EXCLUDE=spx_filter_file_vendor/
+END;
+--FILE--
+<?php
+@mkdir('/tmp/spx_filter_file_vendor');
+file_put_contents('/tmp/spx_filter_file_vendor/lib.php', '<?php return function () {};');
+
+$vendor = require '/tmp/spx_filter_file_vendor/lib.php';
+$local = function () {};
+
+spx_profiler_start();
+for ($i = 0; $i < 3; $i++) {
+    $vendor();
+    $local();
+}
+$key = spx_profiler_stop();
+
+$metadata = json_decode(file_get_contents('/tmp/spx/' . $key . '.json'), true);
+
+echo 'Functions: ', $metadata['called_function_count'], "\n";
+echo 'Calls: ', $metadata['call_count'], "\n";
+
+?>
+--EXPECT--
+Functions: 2
+Calls: 4
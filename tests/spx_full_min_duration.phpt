@@ -0,0 +1,46 @@
+--TEST--
+Full report short call elision
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_FULL_MIN_DURATION=1000000000
+SPX_COMPRESSION=none
+END;
+--FILE--
+<?php
+function foo() {
+}
+
+spx_profiler_start();
+for ($i = 0; $i < 10; $i++) {
+    foo();
+}
+$key = spx_profiler_stop();
+
+$metadata = json_decode(file_get_contents('/tmp/spx/' . $key . '.json'), true);
+
+echo 'Calls: ', $metadata['call_count'], "\n";
+echo 'Recorded calls: ', $metadata['recorded_call_count'], "\n";
+
+// the report itself comes with the exact aggregates, see spx_report_analyzer.h
+$report = file_get_contents('/tmp/spx/' . $key . '.txt');
+$aggregatesOffset = strpos($report, "[aggregates]\n");
+$functionsOffset = strpos($report, "[functions]\n", $aggregatesOffset);
+
+$aggregates = explode("\n", substr($report, $aggregatesOffset, $functionsOffset - $aggregatesOffset));
+$functionNames = explode("\n", substr($report, $functionsOffset + strlen("[functions]\n")));
+
+foreach ($aggregates as $line) {
+    $fields = explode(' ', $line);
+    if ($fields[0] === 'f' && $functionNames[$fields[1]] === 'foo') {
+        echo 'foo aggregated calls: ', $fields[2], "\n";
+    }
+}
+
+?>
+--EXPECT--
+Calls: 11
+Recorded calls: 1
+foo aggregated calls: 10
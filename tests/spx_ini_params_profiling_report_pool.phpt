@@ -0,0 +1,18 @@
+--TEST--
+INI profiling parameters: pool report
+--CGI--
+--INI--
+spx.debug=1
+spx.pool_enabled=1
+spx.http_profiling_enabled=1
+spx.http_profiling_report=pool
+--FILE--
+<?php
+function foo() {}
+foo();
+echo 'Normal output';
+?>
+--EXPECTHEADERS--
+SPX-Debug-Profiling-Triggered: 1
+--EXPECT--
+Normal output
@@ -0,0 +1,20 @@
+--TEST--
+INI profiling parameters: request sampling
+--CGI--
+--INI--
+spx.debug=1
+spx.http_profiling_sample_rate=1
+--FILE--
+<?php
+echo 'Normal output';
+?>
+--EXPECTHEADERS--
+SPX-Debug-Profiling-Triggered: 1
+--EXPECT--
+Normal output
+--CLEAN--
+<?php
+
+exec("rm -rf /tmp/spx");
+
+?>
\ No newline at end of file
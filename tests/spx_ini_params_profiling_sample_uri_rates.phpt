@@ -0,0 +1,19 @@
+--TEST--
+INI profiling parameters: request sampling URI prefix override
+--CGI--
+--INI--
+spx.debug=1
+spx.http_profiling_sample_rate=1
+spx.http_profiling_sample_uri_rates="/=1,/health=0"
+--ENV--
+return <<<END
+REQUEST_URI=/health/check
+END;
+--FILE--
+<?php
+echo 'Normal output';
+?>
+--EXPECTHEADERS--
+SPX-Debug-Profiling-Triggered: 0
+--EXPECT--
+Normal output
@@ -0,0 +1,36 @@
+--TEST--
+Rolling full report segments
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_AUTO_START=0
+SPX_REPORT=full
+SPX_ROLLING_CALLS=10
+END;
+--FILE--
+<?php
+function foo() {
+}
+
+function bar() {
+    for ($i = 0; $i < 25; $i++) {
+        foo();
+    }
+}
+
+spx_profiler_start();
+bar();
+$key = spx_profiler_stop();
+
+$segments = 0;
+while ($key !== null) {
+    $metadata = json_decode(file_get_contents('/tmp/spx/' . $key . '.json'), true);
+    $segments++;
+    $key = $metadata['previous_key'];
+}
+
+echo 'Segments: ', $segments, "\n";
+
+?>
+--EXPECT--
+Segments: 3
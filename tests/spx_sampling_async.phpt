@@ -0,0 +1,32 @@
+--TEST--
+Asynchronous sampling
+--SKIPIF--
+<?php
+if (version_compare(PHP_VERSION, '7.1') < 0) {
+    die('skip this test is for PHP 7.1+ only');
+}
+?>
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_SAMPLING_PERIOD=1000
+SPX_SAMPLING_ASYNC=1
+END;
+--FILE--
+<?php
+
+function spin() {
+    $end = microtime(true) + 0.1;
+    while (microtime(true) < $end) {
+    }
+}
+
+spin();
+echo 'Normal output';
+?>
+--EXPECTF--
+Normal output
+*** SPX Report ***
+%A
+ %s | %s | %s | %s | %s | spin
+%A
@@ -0,0 +1,39 @@
+--TEST--
+Snapshot on signal
+--SKIPIF--
+<?php
+if (
+    !function_exists('posix_kill')
+    || !defined('SIGUSR1')
+    || PHP_ZTS
+) {
+    echo 'skip';
+}
+?>
+--INI--
+log_errors=on
+--ENV--
+return <<<END
+SPX_ENABLED=1
+SPX_REPORT=full
+SPX_SNAPSHOT_SIGNAL=usr1
+END;
+--FILE--
+<?php
+function foo() {
+}
+
+function bar() {
+    foo();
+    posix_kill(getmypid(), SIGUSR1);
+    foo();
+}
+
+bar();
+
+echo "Done\n";
+
+?>
+--EXPECTF--
+%ANotice: SPX: snapshot saved as spx-full-%s
+Done
@@ -0,0 +1,24 @@
+--TEST--
+UI: report calls
+--CGI--
+--INI--
+spx.http_enabled=1
+spx.http_key="dev"
+spx.http_ip_whitelist="127.0.0.1"
+spx.data_dir="{PWD}/data_dir"
+log_errors=on
+--ENV--
+return <<<END
+REMOTE_ADDR=127.0.0.1
+REQUEST_URI=/
+END;
+--GET--
+SPX_KEY=dev&SPX_UI_URI=/data/reports/calls/analysiskey&begin=5&end=45&min_duration=15
+--FILE--
+<?php
+// noop
+?>
+--EXPECTHEADERS--
+Content-Type: application/json
+--EXPECT--
+{"metrics":["wt","zm"],"range":{"begin":5,"end":45},"functions":["foo","main"],"calls":[[0,1,0,10,5,30,3,20,-2],[1,0,1,5,2.5,45,4.25,0,0]],"samples":[[5,2.5],[30,3],[45,4.25]]}
@@ -0,0 +1,24 @@
+--TEST--
+UI: report call tree with elided calls
+--CGI--
+--INI--
+spx.http_enabled=1
+spx.http_key="dev"
+spx.http_ip_whitelist="127.0.0.1"
+spx.data_dir="{PWD}/data_dir"
+log_errors=on
+--ENV--
+return <<<END
+REMOTE_ADDR=127.0.0.1
+REQUEST_URI=/
+END;
+--GET--
+SPX_KEY=dev&SPX_UI_URI=/data/reports/call-tree/elisionkey
+--FILE--
+<?php
+// noop
+?>
+--EXPECTHEADERS--
+Content-Type: application/json
+--EXPECT--
+{"metrics":["wt","zm"],"root":{"called":1,"inc":[100,0],"children":[{"name":"main","called":1,"inc":[100,0],"children":[{"name":"foo","called":2,"inc":[25,-1],"children":[]},{"name":"bar","called":1,"inc":[2,-2],"children":[]}]}]}}
@@ -0,0 +1,24 @@
+--TEST--
+UI: report flat profile with elided calls
+--CGI--
+--INI--
+spx.http_enabled=1
+spx.http_key="dev"
+spx.http_ip_whitelist="127.0.0.1"
+spx.data_dir="{PWD}/data_dir"
+log_errors=on
+--ENV--
+return <<<END
+REMOTE_ADDR=127.0.0.1
+REQUEST_URI=/
+END;
+--GET--
+SPX_KEY=dev&SPX_UI_URI=/data/reports/flat-profile/elisionkey
+--FILE--
+<?php
+// noop
+?>
+--EXPECTHEADERS--
+Content-Type: application/json
+--EXPECT--
+{"metrics":["wt","zm"],"functions":[{"name":"main","called":1,"max_cycle_depth":0,"inc":[100,0],"exc":[73,3]},{"name":"foo","called":2,"max_cycle_depth":0,"inc":[25,-1],"exc":[25,-1]},{"name":"bar","called":1,"max_cycle_depth":0,"inc":[2,-2],"exc":[2,-2]}]}
@@ -0,0 +1,24 @@
+--TEST--
+UI: report time range stats
+--CGI--
+--INI--
+spx.http_enabled=1
+spx.http_key="dev"
+spx.http_ip_whitelist="127.0.0.1"
+spx.data_dir="{PWD}/data_dir"
+log_errors=on
+--ENV--
+return <<<END
+REMOTE_ADDR=127.0.0.1
+REQUEST_URI=/
+END;
+--GET--
+SPX_KEY=dev&SPX_UI_URI=/data/reports/time-range-stats/analysiskey&begin=0&end=50&min_duration=40
+--FILE--
+<?php
+// noop
+?>
+--EXPECTHEADERS--
+Content-Type: application/json
+--EXPECT--
+{"metrics":["wt","zm"],"range":{"begin":0,"end":50},"functions":[{"name":"main","called":1,"max_cycle_depth":0,"inc":[50,5.5],"exc":[0,0]},{"name":"foo","called":2,"max_cycle_depth":0,"inc":[30,0.5],"exc":[20,-2]}],"call_tree":{"called":1,"inc":[50,5.5],"children":[{"name":"main","called":1,"inc":[50,5.5],"children":[]}]},"cum_cost":{"min":[0,-2],"max":[50,7.5]},"value_range":{"min":[0,0],"max":[50,5.5]},"call_range":{"min":[10,-2],"max":[50,5.5]}}